@@ -0,0 +1,23 @@
+# The Robertson chemical kinetics problem of cvode(), as a model, solved for
+# a hundred rate constants k1 on two threads
+model <- ode_model(
+  list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+       y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+       y3 = quote( k3 * y2^2)),
+  parameters = c("k1", "k2", "k3"))
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+IC <- c(1, 0, 0)
+params <- cbind(k1 = seq(0.01, 0.1, length.out = 100), k2 = 10000, k3 = 30000000)
+
+out <- cvode_batch(time_vec, IC, model, params, 1e-04, c(1e-8, 1e-14, 1e-6),
+                   threads = 2)
+dim(out)
+
+# the solution for the tenth set, as cvode() would give it
+out[, , 10]
+
+# the same sets in lockstep groups of eight, each group sharing its steps
+grouped <- cvode_batch(time_vec, IC, model, params, 1e-04, c(1e-8, 1e-14, 1e-6),
+                       threads = 2, ensemble = 8)
+table(attr(grouped, "steps"))
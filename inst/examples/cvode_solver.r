@@ -0,0 +1,23 @@
+# The Robertson chemical kinetics problem of cvode(), solved again and again
+# with new rate constants, as an optimiser would, on one solver
+ODE_R <- function(t, y, p){
+  r = rep(NA, length(y))
+  r[1] <- -p[1]*y[1] + p[2]*y[2]*y[3]
+  r[3] <- p[3]*y[2]*y[2]
+  r[2] <- -r[1] - r[3]
+  return(r)
+}
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+IC <- c(1, 0, 0)
+params <- c(0.04, 10000, 30000000)
+
+solver <- cvode_solver(0, IC, ODE_R, params, 1e-04, c(1e-8, 1e-14, 1e-6))
+df1 <- solver_solve(solver, time_vec)
+
+for (k1 in c(0.02, 0.04, 0.08)) {
+  solver_reinit(solver, 0, IC, c(k1, 10000, 30000000))
+  df2 <- solver_solve(solver, time_vec)
+}
+
+# a further call continues from where the last one stopped
+df3 <- solver_solve(solver, c(4E4, 4E5))
@@ -0,0 +1,18 @@
+# The Robertson chemical kinetics problem of cvode(), as a model, solved once
+# on a coarse grid and kept as a continuous solution
+model <- ode_model(
+  list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+       y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+       y3 = quote( k3 * y2^2)),
+  parameters = c("k1", "k2", "k3"))
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+soln <- cvode(time_vec, c(1, 0, 0), model, c(0.04, 10000, 30000000),
+              1e-04, c(1e-8, 1e-14, 1e-6), dense_output = TRUE)
+
+# y2 on a fine logarithmic grid, without solving again
+fine <- dense_eval(soln, 10^seq(-3, 3, length.out = 200))
+plot(fine[, 1], fine[, 3], log = "x", type = "l", xlab = "t", ylab = "y2")
+
+# and its derivative, which is the right-hand side along the solution
+dense_eval(soln, c(1, 10, 100), deriv = 1)
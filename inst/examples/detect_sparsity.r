@@ -0,0 +1,17 @@
+# A chain of reactions, each species feeding the next, whose Jacobian is
+# bidiagonal: detect_sparsity() finds the pattern and recommends a band matrix
+n <- 50
+chain <- function(t, y, p) {
+  ydot <- -p[1] * y
+  ydot[-1] <- ydot[-1] + p[1] * y[-n]
+  ydot
+}
+IC <- c(1, rep(0, n - 1))
+pattern <- detect_sparsity(IC, chain, c(0.5))
+pattern$storage
+df1 <- cvode(seq(0, 10, by = 1), IC, chain, c(0.5), sparsity = pattern)
+
+# the same pattern used with a sparse matrix and the finite-difference
+# Jacobian by groups of columns
+pattern$storage <- "sparse"
+df2 <- cvode(seq(0, 10, by = 1), IC, chain, c(0.5), sparsity = pattern)
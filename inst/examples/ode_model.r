@@ -0,0 +1,26 @@
+# The Robertson chemical kinetics problem of cvode(), with the right-hand side
+# given as expressions instead of an R function
+model <- ode_model(
+  list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+       y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+       y3 = quote( k3 * y2^2)),
+  parameters = c("k1", "k2", "k3"))
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3, 4E4, 4E5, 4E6, 4E7, 4E8, 4E9, 4E10)
+IC <- c(1, 0, 0)
+params <- c(0.04, 10000, 30000000)
+reltol <- 1e-04
+abstol <- c(1e-8, 1e-14, 1e-6)
+
+df1 <- cvode(time_vec, IC, model, params, reltol, abstol)
+
+# the same model written with y[i] and p[i], as in an R right-hand side
+model2 <- ode_model(
+  list(quote(-p[1] * y[1] + p[2] * y[2] * y[3]),
+       quote( p[1] * y[1] - p[2] * y[2] * y[3] - p[3] * y[2]^2),
+       quote( p[3] * y[2]^2)),
+  parameters = c("k1", "k2", "k3"))
+df2 <- cvode(time_vec, IC, model2, params, reltol, abstol)
+
+# sensitivities of the states with respect to k1, k2 and k3
+df3 <- cvodes(time_vec[1:7], IC, model, params, reltol, abstol)
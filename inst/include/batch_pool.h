@@ -0,0 +1,176 @@
+// File: batch_pool.h
+
+#ifndef BATCH_POOL_H
+#define BATCH_POOL_H
+
+// Independent tasks run over a pool of threads, for the batch solvers.
+//
+// batch_run() starts n_workers threads and schedules the tasks on them by work
+// stealing. Each worker has its own queue, which it works through from the
+// front; a worker whose queue runs dry takes the back half of the fullest
+// other queue, and stops when every queue is empty. So a worker that draws
+// short tasks simply runs more of them, and no worker waits while there is
+// work queued anywhere.
+//
+// The cost of each task may be given, typically as the steps it took the last
+// time it was solved. The tasks are then dealt out most costly first, round
+// the workers, so that every queue starts with its longest tasks and ends with
+// its shortest: the long solves are started early, the short ones fill the gaps
+// at the end, and what a thief takes from the back of a queue is the cheap
+// work. Without costs the tasks are dealt out in their order, in contiguous
+// blocks.
+//
+// A task is identified by its index; what the index means, and where its
+// result goes, is up to the caller, which gives each worker its own state (its
+// SUNDIALS context and integrator, say) indexed by the worker's number.
+// Nothing here touches R, so the tasks must not either: they run on threads R
+// knows nothing about.
+//
+// While the workers run, the calling thread waits, calling poll() about ten
+// times a second; when poll() returns false no further task is started and
+// batch_run() returns once the running ones finish. The R solvers poll for a
+// user interrupt this way. An exception thrown by a task likewise stops the
+// batch, and is rethrown from batch_run() in the calling thread.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+// The number of workers to use for n_tasks tasks when `requested` were asked
+// for, 0 meaning one per core
+static inline int batch_workers(int requested, int n_tasks) {
+  int n = requested;
+  if (n <= 0) n = (int) std::thread::hardware_concurrency();
+  if (n <= 0) n = 1;
+  if (n > n_tasks) n = n_tasks;
+  return n < 1 ? 1 : n;
+}
+
+// One worker's tasks: taken from the front by the worker and from the back by
+// the others
+struct batch_queue {
+  std::mutex mutex;
+  std::deque<int> tasks;
+};
+
+// The next task of queue q, if any
+static inline bool batch_pop(batch_queue &q, int &task) {
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (q.tasks.empty()) return false;
+  task = q.tasks.front();
+  q.tasks.pop_front();
+  return true;
+}
+
+// Move the back half of the fullest queue but the thief's own to the thief's.
+// False when every other queue is empty. Tasks only ever move from one queue
+// to another, so once all are seen empty there is nothing left to run but what
+// the workers hold.
+static inline bool batch_steal(std::vector<batch_queue> &queues, int thief) {
+  for (;;) {
+    int victim = -1;
+    size_t most = 0;
+    for (int w = 0; w < (int) queues.size(); w++) {
+      if (w == thief) continue;
+      std::lock_guard<std::mutex> lock(queues[w].mutex);
+      if (queues[w].tasks.size() > most) { most = queues[w].tasks.size(); victim = w; }
+    }
+    if (victim < 0) return false;
+
+    std::deque<int> loot;
+    {
+      std::lock_guard<std::mutex> lock(queues[victim].mutex);
+      std::deque<int> &from = queues[victim].tasks;
+      size_t take = (from.size() + 1) / 2;
+      loot.assign(from.end() - take, from.end());
+      from.erase(from.end() - take, from.end());
+    }
+    // emptied by its owner or another thief in the meantime: look again
+    if (loot.empty()) continue;
+    std::lock_guard<std::mutex> lock(queues[thief].mutex);
+    queues[thief].tasks.insert(queues[thief].tasks.end(), loot.begin(), loot.end());
+    return true;
+  }
+}
+
+// Runs task(worker, i) for every i in 0 .. n_tasks-1 on n_workers threads,
+// worker being the number (0 .. n_workers-1) of the thread running it. cost,
+// if not NULL, has the expected cost of each task. Returns true if every task
+// ran, false if poll() stopped the batch first.
+template <typename Task, typename Poll>
+bool batch_run(int n_workers, int n_tasks, Task task, Poll poll,
+               const double *cost = NULL) {
+
+  // deal out the tasks: most costly first, round the workers, or in blocks
+  std::vector<batch_queue> queues(n_workers);
+  if (cost) {
+    std::vector<int> order(n_tasks);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [cost](int a, int b) { return cost[a] > cost[b]; });
+    for (int k = 0; k < n_tasks; k++) queues[k % n_workers].tasks.push_back(order[k]);
+  } else {
+    for (int k = 0; k < n_tasks; k++) {
+      queues[(int) ((long long) k * n_workers / n_tasks)].tasks.push_back(k);
+    }
+  }
+
+  std::atomic<bool> cancel(false);
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  int done = 0;                     // workers finished, under mutex
+  std::exception_ptr failure;       // the first task exception, under mutex
+
+  auto work = [&](int worker) {
+    try {
+      int i;
+      while (!cancel) {
+        if (batch_pop(queues[worker], i)) task(worker, i);
+        else if (!batch_steal(queues, worker)) break;
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!failure) failure = std::current_exception();
+      cancel = true;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    done++;
+    done_cv.notify_one();
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(n_workers);
+  try {
+    for (int w = 0; w < n_workers; w++) threads.emplace_back(work, w);
+  } catch (...) {
+    // a thread could not be started: stop the ones that were
+    cancel = true;
+    for (std::thread &th : threads) th.join();
+    throw;
+  }
+
+  bool polled_out = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (done < n_workers) {
+      if (done_cv.wait_for(lock, std::chrono::milliseconds(100),
+                           [&] { return done == n_workers; })) break;
+      lock.unlock();
+      if (!polled_out && !poll()) { polled_out = true; cancel = true; }
+      lock.lock();
+    }
+  }
+  for (std::thread &th : threads) th.join();
+
+  if (failure) std::rethrow_exception(failure);
+  return !polled_out;
+}
+
+#endif /* BATCH_POOL_H */
@@ -0,0 +1,149 @@
+// File: callback_timer.h
+
+#ifndef CALLBACK_TIMER_H
+#define CALLBACK_TIMER_H
+
+// Timing of the callbacks SUNDIALS makes into the user's functions, for the
+// stats attribute of a solution (see solver_stats.h) and the profile attribute
+// that a solver called with profile = TRUE returns.
+//
+// Each callback declares a callback_timer against the solve's solver_clock,
+// which the user-data struct points to only when timing was asked for; when
+// it was not, the timer does nothing but test the pointer. For stats the
+// clock keeps the total time inside callbacks, a callback that calls another,
+// as the finite-difference Jacobian calls the right-hand side, being timed
+// once, as a whole.
+//
+// When profiling, the clock also keeps for each kind of callback its number of
+// calls and total time, and of that the time in the user's own function: the
+// evaluation of an R call, or the call of a compiled function or of a model's
+// bytecode, each marked by a user_section. The rest is marshalling - copying
+// the state into R's argument vectors and the result back, checking it, and
+// storing a Jacobian into SUNDIALS' matrix. A nested callback is the outer
+// one's user time, and for the error weights, which run no user code, all of
+// the time is the package's own.
+//
+// Prerequisites: Rcpp.h
+
+#include <chrono>
+
+enum callback_kind {
+  CB_RHS,           // right-hand side, or for ida the residual
+  CB_JAC,
+  CB_SENS,          // cvodes' sensitivity right-hand side
+  CB_JTIMES,        // Jacobian-times-vector and its setup
+  CB_PSETUP,
+  CB_PSOLVE,
+  CB_EWT,           // cvodes' error weights, not counted as a user callback
+  CB_KINDS
+};
+
+struct callback_timer;
+
+struct solver_clock {
+  double callback_sec;         // total time inside callbacks
+  callback_timer *current;     // the innermost callback running, if any
+
+  // Per kind of callback, only when profiling
+  bool profiling;
+  double calls[CB_KINDS], total_sec[CB_KINDS], user_sec[CB_KINDS];
+
+  explicit solver_clock(bool profiling_ = false)
+    : callback_sec(0), current(NULL), profiling(profiling_) {
+    for (int k = 0; k < CB_KINDS; k++) calls[k] = total_sec[k] = user_sec[k] = 0;
+  }
+
+  static std::chrono::steady_clock::time_point now() {
+    return std::chrono::steady_clock::now();
+  }
+
+  static double since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(now() - start).count();
+  }
+};
+
+// Times the enclosing callback from construction to destruction, including
+// when it is left by an exception, if clock is not NULL
+struct callback_timer {
+  solver_clock *clock;
+  callback_kind kind;
+  callback_timer *outer;
+  double user_sec;             // in user_sections and nested callbacks
+  std::chrono::steady_clock::time_point start;
+
+  explicit callback_timer(solver_clock *clock_, callback_kind kind_ = CB_RHS)
+    : clock(clock_ && (kind_ != CB_EWT || clock_->profiling) ? clock_ : NULL),
+      kind(kind_), outer(NULL), user_sec(0) {
+    if (!clock) return;
+    outer = clock->current;
+    clock->current = this;
+    if (!outer || clock->profiling) start = solver_clock::now();
+  }
+
+  ~callback_timer() {
+    if (!clock) return;
+    clock->current = outer;
+    if (outer && !clock->profiling) return;
+    double sec = solver_clock::since(start);
+    if (!outer && kind != CB_EWT) clock->callback_sec += sec;
+    if (clock->profiling) {
+      clock->calls[kind] += 1;
+      clock->total_sec[kind] += sec;
+      clock->user_sec[kind] += user_sec;
+      if (outer) outer->user_sec += sec;
+    }
+  }
+
+  callback_timer(const callback_timer &) = delete;
+  callback_timer &operator=(const callback_timer &) = delete;
+};
+
+// Marks the user's own part of the running callback, when profiling
+struct user_section {
+  callback_timer *timer;
+  std::chrono::steady_clock::time_point start;
+
+  explicit user_section(solver_clock *clock)
+    : timer(clock && clock->profiling ? clock->current : NULL) {
+    if (timer) start = solver_clock::now();
+  }
+
+  ~user_section() {
+    if (timer) timer->user_sec += solver_clock::since(start);
+  }
+
+  user_section(const user_section &) = delete;
+  user_section &operator=(const user_section &) = delete;
+};
+
+// The profile attribute: one row per kind of callback that was called, with
+// the number of calls and the total, mean, marshalling and user nanoseconds.
+// rhs_name is "rhs", or "residual" for ida.
+static inline Rcpp::DataFrame callback_profile_frame(const solver_clock &clock,
+                                                     const char *rhs_name) {
+  const char *names[CB_KINDS] = {rhs_name, "jacobian", "sensitivity", "jtimes",
+                                 "psetup", "psolve", "ewt"};
+  int rows = 0;
+  for (int k = 0; k < CB_KINDS; k++) if (clock.calls[k] > 0) rows++;
+
+  Rcpp::CharacterVector callback(rows);
+  Rcpp::NumericVector calls(rows), total_ns(rows), mean_ns(rows), marshal_ns(rows),
+    user_ns(rows);
+  for (int k = 0, r = 0; k < CB_KINDS; k++) {
+    if (clock.calls[k] == 0) continue;
+    callback[r]   = names[k];
+    calls[r]      = clock.calls[k];
+    total_ns[r]   = clock.total_sec[k] * 1e9;
+    mean_ns[r]    = total_ns[r] / calls[r];
+    user_ns[r]    = clock.user_sec[k] * 1e9;
+    marshal_ns[r] = total_ns[r] - user_ns[r];
+    r++;
+  }
+  return Rcpp::DataFrame::create(
+    Rcpp::_["callback"] = callback, Rcpp::_["calls"] = calls,
+    Rcpp::_["total_ns"] = total_ns, Rcpp::_["mean_ns"] = mean_ns,
+    Rcpp::_["marshal_ns"] = marshal_ns, Rcpp::_["user_ns"] = user_ns,
+    Rcpp::_["stringsAsFactors"] = false);
+}
+
+#endif /* CALLBACK_TIMER_H */
@@ -0,0 +1,71 @@
+// File: cvode_solver.h
+
+#ifndef CVODE_SOLVER_H
+#define CVODE_SOLVER_H
+
+// A CVODE solve kept alive between R calls, behind the external pointer that
+// cvode_solver() returns.
+//
+// cvode() builds the context, the integrator memory, the vectors, the matrix
+// and the linear solver on every call and frees them all on the way out. For a
+// short solve repeated many times with new initial conditions or parameters,
+// as in an optimiser or a fit, that setup costs as much as the integration. A
+// solver handle owns the same objects once; solver_reinit() restarts CVODE on
+// them with CVodeReInit and solver_solve() integrates, so each further solve
+// allocates nothing but its result.
+//
+// The parameters are a private copy, overwritten in place by solver_reinit():
+// the right-hand side's prebuilt R call and a compiled function's udata both
+// refer to that one vector (see rhs_func.h).
+//
+// Prerequisites: Rcpp.h, nvector_serial.h
+
+#include <memory>
+
+#include <sundials_err_record.h>
+#include <linear_solver.h>
+#include <rhs_func.h>
+
+struct cvode_solver_handle {
+  // Receives SUNDIALS errors; the context holds a pointer to it, so it stays
+  // where it is for the handle's lifetime
+  sundials_err_record err;
+
+  SUNContext sunctx;
+  void *cvode_mem;
+  N_Vector y;            // the state, advanced by every solve
+  N_Vector abstol;
+  SUNMatrix SM;
+  SUNLinearSolver LS;
+
+  linsol_spec ls_spec;   // owns the sparsity pattern rhs refers to
+  std::unique_ptr<rhs_func> rhs;
+
+  int n;
+  sunrealtype t;         // the time the state is at
+
+  cvode_solver_handle()
+    : sunctx(NULL), cvode_mem(NULL), y(NULL), abstol(NULL), SM(NULL), LS(NULL),
+      n(0), t(0) {}
+
+  // The user data goes first: its finite-difference vectors belong to the
+  // context
+  ~cvode_solver_handle() {
+    rhs.reset();
+    if (y)         N_VDestroy(y);
+    if (abstol)    N_VDestroy(abstol);
+    if (cvode_mem) CVodeFree(&cvode_mem);
+    if (LS)        SUNLinSolFree(LS);
+    if (SM)        SUNMatDestroy(SM);
+    if (sunctx)    SUNContext_Free(&sunctx);
+  }
+
+  cvode_solver_handle(const cvode_solver_handle &) = delete;
+  cvode_solver_handle &operator=(const cvode_solver_handle &) = delete;
+};
+
+// The handle behind an object made by cvode_solver(); an error for anything
+// else, and for a handle that did not survive saving and reloading the session
+cvode_solver_handle *cvode_solver_get(SEXP solver);
+
+#endif /* CVODE_SOLVER_H */
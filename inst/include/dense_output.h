@@ -0,0 +1,111 @@
+// File: dense_output.h
+
+#ifndef DENSE_OUTPUT_H
+#define DENSE_OUTPUT_H
+
+// The continuous solution of a cvode() solve, kept with dense_output = TRUE
+// and evaluated afterwards by dense_eval() (see dense_output.cpp) at any time
+// the solve covered, without integrating again.
+//
+// Over each of its internal steps CVODE represents the solution by the
+// polynomial in its Nordsieck history array, of the order q of the step, which
+// is what CVodeGetDky interpolates and what the output times of CV_NORMAL are
+// read from. The history is kept here as the derivatives y, y', ..., y^(q) of
+// that polynomial at the end of the step, got from CVodeGetDky there, so that
+// within the step
+//
+//   y^(k)(t) = sum over j = k..q of y^(j)(tn) (t - tn)^(j-k) / (j-k)!
+//
+// which is CVodeGetDky's own polynomial, in a form that needs neither the step
+// size nor the scaling of the history array.
+//
+// dense_output_solve() takes the place of CVode(..., CV_NORMAL) for one output
+// time: it takes CVODE's steps one at a time in CV_ONE_STEP mode, recording
+// each, until one passes tout, and then interpolates at tout, just as
+// CV_NORMAL does. The steps and the solution are exactly those of CV_NORMAL,
+// and so is the limit mxstep on the steps to one output time.
+//
+// Prerequisites: Rcpp.h, cvode.h, nvector_serial.h, sundials_err_record.h
+
+#include <string>
+#include <vector>
+
+struct dense_output {
+  int n;                       // states
+  std::vector<double> time;    // the initial time and the end of every step
+  std::vector<int> order;      // of every step
+  std::vector<double> start;   // where the derivatives of every step start
+  std::vector<double> deriv;   // derivative j of state i of a step at
+                               // start + j*n + i
+
+  dense_output(int n_, double t0) : n(n_), time(1, t0) {}
+
+  // The step CVODE has just taken, to tn; work is a vector of n, used as
+  // scratch and left holding the state at tn, so it may be the solver's y
+  int record(void *cvode_mem, double tn, N_Vector work) {
+    int q;
+    int flag = CVodeGetLastOrder(cvode_mem, &q);
+    if (flag < 0) return flag;
+    start.push_back((double) deriv.size());
+    const sunrealtype *w = N_VGetArrayPointer(work);
+    for (int j = 0; j <= q; j++) {
+      flag = CVodeGetDky(cvode_mem, tn, j, work);
+      if (flag < 0) return flag;
+      deriv.insert(deriv.end(), w, w + n);
+    }
+    flag = CVodeGetDky(cvode_mem, tn, 0, work);
+    if (flag < 0) return flag;
+    time.push_back(tn);
+    order.push_back(q);
+    return CV_SUCCESS;
+  }
+
+  // The "dense_output" attribute of the solution
+  Rcpp::List as_list() const {
+    Rcpp::List out = Rcpp::List::create(
+      Rcpp::_["states"] = n,
+      Rcpp::_["time"]   = Rcpp::NumericVector(time.begin(), time.end()),
+      Rcpp::_["order"]  = Rcpp::IntegerVector(order.begin(), order.end()),
+      Rcpp::_["start"]  = Rcpp::NumericVector(start.begin(), start.end()),
+      Rcpp::_["deriv"]  = Rcpp::NumericVector(deriv.begin(), deriv.end()));
+    out.attr("class") = "sundialr_dense_output";
+    return out;
+  }
+};
+
+// CVode(cvode_mem, tout, y, tret, CV_NORMAL), recording every step into rec.
+// CVODE counts the steps of a call against mxstep, the most CV_NORMAL takes to
+// one output time, and here each call takes one step, so they are counted here
+// instead and CV_TOO_MUCH_WORK returned once mxstep are taken, as CV_NORMAL
+// does, with SUNDIALS' message for it recorded in err.
+static inline int dense_output_solve(void *cvode_mem, sunrealtype tout, N_Vector y,
+                                     sunrealtype *tret, dense_output &rec,
+                                     long mxstep, sundials_err_record &err) {
+  long int nst;
+  sunrealtype tn;
+  int flag = CVodeGetNumSteps(cvode_mem, &nst);
+  if (flag >= 0) flag = CVodeGetCurrentTime(cvode_mem, &tn);
+  if (flag < 0) return flag;
+
+  // the first call always steps, as CV_NORMAL's does
+  double dir = tout >= rec.time[0] ? 1.0 : -1.0;
+  long nstloc = 0;
+  while (nst == 0 || (tn - tout) * dir < 0) {
+    if (nstloc++ >= mxstep) {
+      err.record("SUNDIALS error in CVode: At t = " + std::to_string(tn) +
+                 ", mxstep steps taken before reaching tout.");
+      return CV_TOO_MUCH_WORK;
+    }
+    flag = CVode(cvode_mem, tout, y, &tn, CV_ONE_STEP);
+    if (flag < 0) return flag;
+    flag = rec.record(cvode_mem, tn, y);
+    if (flag < 0) return flag;
+    nst++;
+  }
+  flag = CVodeGetDky(cvode_mem, tout, 0, y);
+  if (flag < 0) return flag;
+  *tret = tout;
+  return CV_SUCCESS;
+}
+
+#endif /* DENSE_OUTPUT_H */
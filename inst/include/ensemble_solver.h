@@ -0,0 +1,51 @@
+// File: ensemble_solver.h
+
+#ifndef ENSEMBLE_SOLVER_H
+#define ENSEMBLE_SOLVER_H
+
+// The vector, matrix and linear solver with which one CVODE integrates an
+// ensemble: K systems of the same n equations, for K subjects, stepped
+// together (see sundialr_cvode_create_ensemble() in sundialr_capi.h).
+//
+// The states are stored structure-of-arrays, species-major and subject-minor:
+// state i of subject k is element i*K + k. Every loop over the subjects is
+// then the innermost one, over contiguous memory, which the compiler turns
+// into SIMD instructions - in a compiled or ode_model() right-hand side
+// written for the layout, and in the factorisations below.
+//
+// N_VNew_Ensemble() is a serial N_Vector whose weighted RMS norm is the
+// largest of the subjects' own norms. CVODE takes every norm it tests -
+// of the local error, of the Newton corrections, for the first step - through
+// N_VWrmsNorm, so a step is accepted only when every subject passes its own
+// error test, and sized for the subject that needs the smallest. The subjects
+// share the step, but each is solved to its own tolerance, as if alone.
+//
+// SUNEnsembleMatrix() is the block-diagonal Newton matrix, one n x n block
+// per subject, stored element-major and subject-minor: element (i, j) of the
+// block of subject k is data[(i + j*n)*K + k]. SUNLinSol_Ensemble() factors
+// the K blocks at once by LU with partial pivoting - each subject choosing its
+// own pivots - and solves with the factors, again with the subject loop
+// innermost. CVODE's own strategy for reusing the Jacobian applies unchanged,
+// but the matrix is not one CVODE can approximate by differences, so a
+// Jacobian function is always needed; the C API supplies one by differences
+// of the whole ensemble, one right-hand side per state.
+//
+// setup() returns SUNLS_LUFACT_FAIL, which SUNDIALS treats as recoverable, when
+// the block of any subject is singular.
+//
+// Prerequisites: nvector_serial.h
+
+#include <sundials/sundials_linearsolver.h>
+#include <sundials/sundials_matrix.h>
+
+// A vector of the n states of K subjects
+N_Vector N_VNew_Ensemble(int n, int K, SUNContext sunctx);
+
+// The matrix of K blocks of n x n, and its data
+SUNMatrix SUNEnsembleMatrix(int n, int K, SUNContext sunctx);
+sunrealtype *SUNEnsembleMatrix_Data(SUNMatrix A);
+
+// A is a SUNEnsembleMatrix of the length of y
+SUNLinearSolver SUNLinSol_Ensemble(N_Vector y, SUNMatrix A, SUNContext sunctx);
+
+#endif /* ENSEMBLE_SOLVER_H */
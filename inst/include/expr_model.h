@@ -0,0 +1,168 @@
+// File: expr_model.h
+
+#ifndef EXPR_MODEL_H
+#define EXPR_MODEL_H
+
+// Models given as R expressions, compiled to a register bytecode.
+//
+// ode_model() (src/expr_model.cpp) turns a named list of R expressions into an
+// expression graph, and the graph into an expr_program: a flat list of
+// instructions over an array of double registers. Evaluating the right-hand
+// side is then a loop over those instructions - no R, no allocation - so a
+// model written in R runs about as fast as one compiled from C++, without a
+// compiler being needed when it is used.
+//
+// The graph is hash-consed: building a node that already exists returns the
+// existing one, so repeated subexpressions are evaluated once, and operations
+// on constants are folded as the graph is built. The graph is simplified only
+// where that cannot change a result: x*1 becomes x, but 0*x stays, since it is
+// NaN for an infinite x, and so does x + 0, which is +0 for x = -0, as in R.
+//
+// A built model is never modified, so one model can be evaluated from several
+// threads at once; the registers are the only mutable state, and each caller
+// owns its own (see expr_program::init_scratch).
+//
+// Register layout of every program: 0 = t, 1..n = y, n+1..n+np = parameters,
+// followed by the constants and then the temporaries.
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum expr_op {
+  // leaves; never emitted as instructions
+  EOP_CONST, EOP_TIME, EOP_STATE, EOP_PARAM,
+  // arithmetic
+  EOP_ADD, EOP_SUB, EOP_MUL, EOP_DIV, EOP_POW, EOP_POWI, EOP_NEG,
+  // functions of one argument
+  EOP_EXP, EOP_LOG, EOP_SQRT, EOP_SIN, EOP_COS, EOP_TAN, EOP_ASIN, EOP_ACOS,
+  EOP_ATAN, EOP_SINH, EOP_COSH, EOP_TANH, EOP_ABS, EOP_SIGN,
+  // comparisons and logic, giving 1 or 0
+  EOP_LT, EOP_LE, EOP_GT, EOP_GE, EOP_EQ, EOP_NE, EOP_AND, EOP_OR, EOP_NOT,
+  // choices
+  EOP_MIN, EOP_MAX, EOP_IFELSE
+};
+
+// One node of the expression graph. Operands are node ids, always smaller than
+// the node's own id, so the node list is in evaluation order. `k` is the index
+// of a state or parameter leaf, or the integer exponent of EOP_POWI.
+struct expr_node {
+  int op;
+  int a, b, c;
+  int k;
+  double value;   // EOP_CONST only
+};
+
+class expr_graph {
+public:
+  int n_states;
+  int n_params;
+  std::vector<expr_node> nodes;
+
+  expr_graph(int n_states_ = 0, int n_params_ = 0);
+
+  int constant(double v);
+  int time();
+  int state(int j);
+  int param(int k);
+  // Build an operation node, or return an equal node built before. Constant
+  // operands are folded, and operations with 0 or 1 that leave an operand
+  // unchanged for every value, infinities, NaN and the sign of 0 included, are
+  // simplified away. x^2 is taken as x*x, as R does, and other powers by R's
+  // own R_pow().
+  int op(int code, int a, int b = -1, int c = -1, int k = 0);
+
+  bool is_const(int id) const { return nodes[id].op == EOP_CONST; }
+  bool is_const(int id, double v) const { return is_const(id) && nodes[id].value == v; }
+
+private:
+  struct key_hash { std::size_t operator()(const expr_node &n) const; };
+  struct key_eq { bool operator()(const expr_node &x, const expr_node &y) const; };
+  std::unordered_map<expr_node, int, key_hash, key_eq> index;
+  int intern(const expr_node &n);
+};
+
+// The value of one operation; shared by the constant folding above and the
+// interpreter, so both give identical results.
+double expr_apply(int op, double a, double b, double c, int k);
+
+struct expr_instr {
+  int op;
+  int dst, a, b, c;
+  int k;
+};
+
+// A compiled list of outputs of a graph.
+struct expr_program {
+  int n_states;
+  int n_params;
+  int n_regs;
+  std::vector<expr_instr> code;
+  std::vector<int> const_reg;      // registers holding the constants ...
+  std::vector<double> const_val;   // ... and their values
+  std::vector<int> out;            // register of each output
+
+  // Size regs to n_regs and store the constants in it. Done once, by whoever
+  // owns the registers, before the first eval().
+  void init_scratch(std::vector<double> &regs) const;
+
+  // Evaluate every output into out[0 .. out.size()-1].
+  void eval(double t, const double *y, const double *p, double *regs,
+            double *res) const;
+
+  // The same for K subjects at once, every array structure-of-arrays:
+  // register r of subject k at regs[r*K + k], and likewise y, p and res. Each
+  // instruction is applied to all the subjects in one loop, which the
+  // compiler vectorises for the arithmetic. regs is sized and its constants
+  // stored by init_scratch(regs, K).
+  void init_scratch(std::vector<double> &regs, int K) const;
+  void eval_ensemble(int K, double t, const double *y, const double *p,
+                     double *regs, double *res) const;
+};
+
+// Compile the nodes `outputs` of g. Only the nodes they depend on are emitted,
+// and a temporary register is reused once the value in it is no longer needed.
+expr_program expr_compile(const expr_graph &g, const std::vector<int> &outputs);
+
+// A model built by ode_model().
+struct expr_model {
+  std::vector<std::string> states;
+  std::vector<std::string> params;
+  expr_graph graph;
+  std::vector<int> rhs_nodes;   // d(y_j)/dt, one node per state
+  expr_program rhs;
+
+  // Symbolic Jacobian, when has_jac: the entries that are not structurally
+  // zero, in compressed-column order (by column, then row), and a program
+  // evaluating them in that order
+  bool has_jac;
+  std::vector<int> jac_rows;
+  std::vector<int> jac_cols;
+  expr_program jac;
+
+  expr_model() : has_jac(false) {}
+};
+
+// Differentiate the right-hand side of the model symbolically and fill in its
+// Jacobian. Derivatives that simplify to zero are left out.
+void expr_model_jacobian(expr_model &model);
+
+// Prerequisites for the three functions below: Rcpp.h
+
+// The model in x if it is one made by ode_model(), otherwise NULL. Stops with
+// an error for a model that did not survive saving and reloading the session.
+const expr_model *expr_model_get(SEXP x);
+
+// Stop with an error unless the model fits a state vector of length y_len and
+// a parameter vector of length n_params.
+void expr_model_check(const expr_model *model, int y_len, int n_params);
+
+// Compile the list of R expressions `outputs`, observables of the solution
+// given as the equations of ode_model() are, into a program evaluating them
+// in order. The states and parameters are referred to by the names of model,
+// when there is one, and as y[i] and p[i].
+expr_program expr_outputs(SEXP outputs, const expr_model *model, int n_states,
+                          int n_params);
+
+#endif /* EXPR_MODEL_H */
@@ -0,0 +1,186 @@
+// File: fd_jacobian.h
+
+#ifndef FD_JACOBIAN_H
+#define FD_JACOBIAN_H
+
+// Finite-difference Jacobian for a sparse matrix (see linear_solver.h), by
+// column colouring (Curtis, Powell and Reid).
+//
+// SUNDIALS' own difference quotients perturb one state at a time, costing one
+// evaluation of the right-hand side per state. Two columns of the Jacobian
+// that have no row in common can be perturbed together, though, since every
+// output that changes can then be credited to exactly one of them. The columns
+// are partitioned into such groups once per solve by a greedy colouring of the
+// sparsity pattern, and each Jacobian then costs one evaluation per group: for
+// a reaction network of hundreds of states where each species meets a handful
+// of others, a few evaluations instead of hundreds, each of which may be a
+// call into R.
+//
+// The increments are SUNDIALS' own: for cvode and cvsolve those of CVODE's
+// dense difference quotients, taking inequality constraints into account, and
+// for ida those of IDA's, where y_j and y'_j move together, by inc and cj * inc,
+// so that one residual difference gives dF/dy + cj * dF/dy'.
+//
+// Prerequisites: nvector_serial.h, sunmatrix_sparse.h
+
+#include <sparse_pattern.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// The right-hand side and residual as SUNDIALS calls them (CVRhsFn, IDAResFn)
+typedef int (*fd_rhs_fn)(sunrealtype t, N_Vector y, N_Vector ydot, void *user_data);
+typedef int (*fd_res_fn)(sunrealtype t, N_Vector y, N_Vector yp, N_Vector r,
+                         void *user_data);
+
+// Columns of the pattern in groups with no two sharing a row. Columns are
+// taken in decreasing order of their number of nonzeros, each given the lowest
+// group none of its rows' other columns is in yet.
+static inline std::vector<std::vector<sunindextype> > fd_color(const sparse_pattern &pattern) {
+  sunindextype n = pattern.n;
+  const sunindextype *cp = pattern.colptr.data(), *ri = pattern.rowind.data();
+
+  std::vector<std::vector<sunindextype> > row_cols(n);
+  for (sunindextype j = 0; j < n; j++)
+    for (sunindextype p = cp[j]; p < cp[j + 1]; p++) row_cols[ri[p]].push_back(j);
+
+  std::vector<sunindextype> order(n);
+  for (sunindextype j = 0; j < n; j++) order[j] = j;
+  std::stable_sort(order.begin(), order.end(), [&](sunindextype a, sunindextype b) {
+    return cp[a + 1] - cp[a] > cp[b + 1] - cp[b];
+  });
+
+  std::vector<sunindextype> color(n, -1), taken(n, -1);
+  std::vector<std::vector<sunindextype> > groups;
+  for (sunindextype j : order) {
+    for (sunindextype p = cp[j]; p < cp[j + 1]; p++)
+      for (sunindextype k : row_cols[ri[p]])
+        if (color[k] >= 0) taken[color[k]] = j;
+    sunindextype c = 0;
+    while (c < (sunindextype) groups.size() && taken[c] == j) c++;
+    if (c == (sunindextype) groups.size()) groups.push_back(std::vector<sunindextype>());
+    color[j] = c;
+    groups[c].push_back(j);
+  }
+  return groups;
+}
+
+struct fd_jacobian {
+  const sparse_pattern *pattern;   // NULL when not in use
+  std::vector<std::vector<sunindextype> > groups;
+  std::vector<sunrealtype> inc;    // the increment of each column
+  void *mem;                       // CVODE or IDA memory, for weights and step
+  N_Vector ewt;                    // the solver's error weights, owned
+  N_Vector constraints;            // CVODE's inequality constraints, or NULL
+
+  fd_jacobian() : pattern(NULL), mem(NULL), ewt(NULL), constraints(NULL) {}
+  ~fd_jacobian() { if (ewt) N_VDestroy(ewt); }
+  fd_jacobian(const fd_jacobian &) = delete;
+  fd_jacobian &operator=(const fd_jacobian &) = delete;
+
+  // Colour the pattern for a solve whose memory is mem, with states like y.
+  // Returns false when the error-weight vector cannot be allocated.
+  bool init(const sparse_pattern *pattern_, void *mem_, N_Vector y) {
+    pattern = pattern_;
+    mem = mem_;
+    groups = fd_color(*pattern);
+    inc.assign(pattern->n, 0.0);
+    ewt = N_VClone(y);
+    return ewt != NULL;
+  }
+
+  bool active() const { return pattern != NULL; }
+};
+
+// Store (f(t, y + inc e_j, ...) - f0) / inc_j, column j of the group, into the
+// rows of column j in JAC. Rows belong to one column of a group only.
+static inline void fd_store_group(const fd_jacobian &fd, const std::vector<sunindextype> &group,
+                                  const sunrealtype *f1, const sunrealtype *f0,
+                                  SUNMatrix JAC) {
+  const sparse_pattern &pat = *fd.pattern;
+  sunrealtype *x = SM_DATA_S(JAC);
+  for (sunindextype j : group) {
+    sunrealtype inc_inv = 1.0 / fd.inc[j];
+    for (sunindextype p = pat.colptr[j]; p < pat.colptr[j + 1]; p++) {
+      sunindextype i = pat.rowind[p];
+      x[p] = (f1[i] - f0[i]) * inc_inv;
+    }
+  }
+}
+
+// cvode, cvsolve: fd.ewt holds the error weights and h is the current step.
+// ytemp and ftemp are work vectors; the return value is the right-hand side's,
+// on its first failure.
+static inline int fd_jac_ode(fd_rhs_fn f, void *user_data, sunrealtype t,
+                             N_Vector y, N_Vector fy, sunrealtype h, SUNMatrix JAC,
+                             fd_jacobian &fd, N_Vector ytemp, N_Vector ftemp) {
+  sunindextype n = fd.pattern->n;
+  const sunrealtype *y_data = N_VGetArrayPointer(y);
+  const sunrealtype *ewt = N_VGetArrayPointer(fd.ewt);
+  const sunrealtype *cns = fd.constraints ? N_VGetArrayPointer(fd.constraints) : NULL;
+  sunrealtype *yt = N_VGetArrayPointer(ytemp);
+
+  sunrealtype srur = std::sqrt(SUN_UNIT_ROUNDOFF);
+  sunrealtype fnorm = N_VWrmsNorm(fy, fd.ewt);
+  sunrealtype min_inc = fnorm != 0.0 ? 1000.0 * std::fabs(h) * SUN_UNIT_ROUNDOFF * n * fnorm : 1.0;
+
+  fd.pattern->restore(JAC);
+  N_VScale(1.0, y, ytemp);
+  for (const std::vector<sunindextype> &group : fd.groups) {
+    for (sunindextype j : group) {
+      sunrealtype inc = std::max(srur * std::fabs(y_data[j]), min_inc / ewt[j]);
+      if (cns) {
+        sunrealtype c = cns[j];
+        if ((std::fabs(c) == 1.0 && (y_data[j] + inc) * c < 0.0) ||
+            (std::fabs(c) == 2.0 && (y_data[j] + inc) * c <= 0.0)) inc = -inc;
+      }
+      yt[j] = y_data[j] + inc;
+      fd.inc[j] = yt[j] - y_data[j];
+    }
+    int retval = f(t, ytemp, ftemp, user_data);
+    if (retval != 0) return retval;
+    fd_store_group(fd, group, N_VGetArrayPointer(ftemp), N_VGetArrayPointer(fy), JAC);
+    for (sunindextype j : group) yt[j] = y_data[j];
+  }
+  return 0;
+}
+
+// ida: fd.ewt holds the error weights, hh is the current step and cj the
+// scalar of the Newton matrix. ytemp, yptemp and rtemp are work vectors.
+static inline int fd_jac_dae(fd_res_fn res, void *user_data, sunrealtype t,
+                             sunrealtype cj, sunrealtype hh, N_Vector y,
+                             N_Vector yp, N_Vector rr, SUNMatrix JAC,
+                             fd_jacobian &fd, N_Vector ytemp, N_Vector yptemp,
+                             N_Vector rtemp) {
+  const sunrealtype *y_data = N_VGetArrayPointer(y);
+  const sunrealtype *yp_data = N_VGetArrayPointer(yp);
+  const sunrealtype *ewt = N_VGetArrayPointer(fd.ewt);
+  sunrealtype *yt = N_VGetArrayPointer(ytemp);
+  sunrealtype *ypt = N_VGetArrayPointer(yptemp);
+
+  sunrealtype srur = std::sqrt(SUN_UNIT_ROUNDOFF);
+
+  fd.pattern->restore(JAC);
+  N_VScale(1.0, y, ytemp);
+  N_VScale(1.0, yp, yptemp);
+  for (const std::vector<sunindextype> &group : fd.groups) {
+    for (sunindextype j : group) {
+      sunrealtype inc = std::max(srur * std::max(std::fabs(y_data[j]), std::fabs(hh * yp_data[j])),
+                                 1.0 / ewt[j]);
+      if (hh * yp_data[j] < 0.0) inc = -inc;
+      yt[j] = y_data[j] + inc;
+      fd.inc[j] = yt[j] - y_data[j];
+      ypt[j] = yp_data[j] + cj * fd.inc[j];
+    }
+    int retval = res(t, ytemp, yptemp, rtemp, user_data);
+    if (retval != 0) return retval;
+    fd_store_group(fd, group, N_VGetArrayPointer(rtemp), N_VGetArrayPointer(rr), JAC);
+    for (sunindextype j : group) {
+      yt[j] = y_data[j];
+      ypt[j] = yp_data[j];
+    }
+  }
+  return 0;
+}
+
+#endif /* FD_JACOBIAN_H */
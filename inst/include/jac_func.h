@@ -1,28 +1,290 @@
 #ifndef JAC_FUNC_H
 #define JAC_FUNC_H
 
-// Prerequisites: Rcpp.h, nvector_serial.h, sunmatrix_dense.h
+// Prerequisites: Rcpp.h, nvector_serial.h, sunmatrix_dense.h, sunmatrix_band.h,
+// sunmatrix_sparse.h
+//
+// JAC is a dense, band or sparse matrix (see linear_solver.h). A band matrix
+// keeps only the entries inside its band, so any entry a Jacobian gives outside
+// it is dropped, as SUNDIALS' own band finite differences would. A sparse one
+// is the same with its sparsity pattern, which is passed as `pattern`; that is
+// NULL for the other two.
+//
+// clock is the solve's solver_clock when it is being profiled, or NULL; only
+// the call of the user's function counts as its time (see callback_timer.h).
+
+#include <callback_timer.h>
+#include <expr_model.h>
+#include <sparse_pattern.h>
+#include <sundialr_capi.h>
+#include <vector>
+
+// Store the n-by-n column-major matrix J in JAC
+static inline void jac_store(SUNMatrix JAC, const double *J, sunindextype n,
+                             const sparse_pattern *pattern) {
+  if (pattern) {
+    pattern->restore(JAC);
+    sunrealtype *x = SM_DATA_S(JAC);
+    for (sunindextype j = 0; j < n; j++)
+      for (sunindextype p = pattern->colptr[j]; p < pattern->colptr[j + 1]; p++)
+        x[p] = J[j * n + pattern->rowind[p]];
+    return;
+  }
+  if (SUNMatGetID(JAC) == SUNMATRIX_BAND) {
+    sunindextype mu = SM_UBAND_B(JAC), ml = SM_LBAND_B(JAC);
+    for (sunindextype j = 0; j < n; j++) {
+      sunrealtype *col = SM_COLUMN_B(JAC, j);
+      sunindextype i0 = j - mu > 0 ? j - mu : 0;
+      sunindextype i1 = j + ml < n - 1 ? j + ml : n - 1;
+      for (sunindextype i = i0; i <= i1; i++)
+        SM_COLUMN_ELEMENT_B(col, i, j) = J[j * n + i];
+    }
+    return;
+  }
+  for (sunindextype j = 0; j < n; j++)
+    for (sunindextype i = 0; i < n; i++)
+      SM_ELEMENT_D(JAC, i, j) = J[j * n + i];
+}
+
+// Store the value an R Jacobian function returned in JAC. That is an n-by-n
+// matrix, or for a sparse JAC also any of
+//   - a numeric vector of the nonzero values in the order of the pattern,
+//     column by column;
+//   - a sparse matrix in the form of the Matrix package's dgCMatrix (slots i,
+//     p, x and Dim) or dgTMatrix (slots i, j, x and Dim), which is read without
+//     being made dense. Entries repeated in a dgTMatrix are summed.
+static inline void jac_store_r(SUNMatrix JAC, SEXP J, int n,
+                               const sparse_pattern *pattern) {
+  if (pattern && Rf_isS4(J)) {
+    SEXP dim = R_has_slot(J, Rf_install("Dim")) ? R_do_slot(J, Rf_install("Dim")) : R_NilValue;
+    bool csc = R_has_slot(J, Rf_install("p"));
+    bool triplet = R_has_slot(J, Rf_install("j"));
+    if (TYPEOF(dim) != INTSXP || Rf_length(dim) != 2 || (!csc && !triplet) ||
+        !R_has_slot(J, Rf_install("i")) || !R_has_slot(J, Rf_install("x"))) {
+      Rcpp::stop("A sparse Jacobian must be a dgCMatrix or dgTMatrix");
+    }
+    if (INTEGER(dim)[0] != n || INTEGER(dim)[1] != n) {
+      Rcpp::stop("The Jacobian function must return a %d-by-%d matrix; got %d-by-%d",
+                 n, n, INTEGER(dim)[0], INTEGER(dim)[1]);
+    }
+    SEXP i = R_do_slot(J, Rf_install("i")), x = R_do_slot(J, Rf_install("x"));
+    SEXP j = triplet ? R_do_slot(J, Rf_install("j")) : R_do_slot(J, Rf_install("p"));
+    R_xlen_t nnz = Rf_xlength(x);
+    if (TYPEOF(i) != INTSXP || TYPEOF(j) != INTSXP || TYPEOF(x) != REALSXP ||
+        Rf_xlength(i) != nnz || Rf_xlength(j) != (triplet ? nnz : n + 1) ||
+        (!triplet && (INTEGER(j)[0] != 0 || INTEGER(j)[n] != nnz))) {
+      Rcpp::stop("The sparse Jacobian's slots i, %s and x do not describe a %d-by-%d matrix",
+                 triplet ? "j" : "p", n, n);
+    }
+    const int *ii = INTEGER(i), *jj = INTEGER(j);
+    const double *xx = REAL(x);
+    pattern->restore(JAC);
+    sunrealtype *xd = SM_DATA_S(JAC);
+    for (int col = 0, k = 0; k < nnz; k++) {
+      if (triplet) {
+        col = jj[k];
+      } else {
+        while (col < n && k >= jj[col + 1]) col++;
+      }
+      if (ii[k] < 0 || ii[k] >= n || col < 0 || col >= n) {
+        Rcpp::stop("The sparse Jacobian has an entry outside its %d-by-%d dimensions", n, n);
+      }
+      sunindextype p = pattern->find(ii[k], col);
+      if (p >= 0) xd[p] += xx[k];
+    }
+    return;
+  }
+  if (pattern && TYPEOF(J) == REALSXP && !Rf_isMatrix(J)) {
+    if (Rf_xlength(J) != pattern->nnz()) {
+      Rcpp::stop("The Jacobian function returned %d values, but the sparsity pattern has %d nonzeros, the diagonal included",
+                 (int) Rf_xlength(J), (int) pattern->nnz());
+    }
+    pattern->restore(JAC);
+    std::copy(REAL(J), REAL(J) + pattern->nnz(), SM_DATA_S(JAC));
+    return;
+  }
+
+  Rcpp::NumericMatrix Jm(J);
+  if (Jm.nrow() != n || Jm.ncol() != n) {
+    Rcpp::stop("The Jacobian function must return a %d-by-%d matrix; got %d-by-%d",
+               n, n, Jm.nrow(), Jm.ncol());
+  }
+  jac_store(JAC, Jm.begin(), n, pattern);
+}
+
+// Used by cvode, cvodes, cvsolve for a compiled Jacobian (see sundialr_jac in
+// sundialr_capi.h), which writes a dense column-major matrix: a dense JAC's own
+// storage in place, or for a band or sparse JAC the zeroed n-by-n scratch,
+// whose band or pattern is then copied into JAC. That costs n^2 memory and
+// time per call, which a large band or sparse system avoids with the band and
+// sparse forms below.
+static inline int jac_eval_native(sundialr_jac jac, sunrealtype t, N_Vector y,
+                                  SUNMatrix JAC, double *params,
+                                  std::vector<double> &scratch,
+                                  const sparse_pattern *pattern,
+                                  solver_clock *clock = NULL) {
+  if (SUNMatGetID(JAC) == SUNMATRIX_DENSE) {
+    user_section user(clock);
+    return jac(t, N_VGetArrayPointer(y), SM_DATA_D(JAC), params);
+  }
+  sunindextype n = NV_LENGTH_S(y);
+  scratch.assign((size_t) n * n, 0.0);
+  int flag;
+  {
+    user_section user(clock);
+    flag = jac(t, N_VGetArrayPointer(y), scratch.data(), params);
+  }
+  if (flag == 0) jac_store(JAC, scratch.data(), n, pattern);
+  return flag;
+}
+
+// The same for ida (see sundialr_jac_ida in sundialr_capi.h)
+static inline int jac_eval_ida_native(sundialr_jac_ida jac, sunrealtype t,
+                                      sunrealtype cj, N_Vector y, N_Vector yp,
+                                      SUNMatrix JAC, double *params,
+                                      std::vector<double> &scratch,
+                                      const sparse_pattern *pattern,
+                                      solver_clock *clock = NULL) {
+  if (SUNMatGetID(JAC) == SUNMATRIX_DENSE) {
+    user_section user(clock);
+    return jac(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp),
+               SM_DATA_D(JAC), params);
+  }
+  sunindextype n = NV_LENGTH_S(y);
+  scratch.assign((size_t) n * n, 0.0);
+  int flag;
+  {
+    user_section user(clock);
+    flag = jac(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp),
+               scratch.data(), params);
+  }
+  if (flag == 0) jac_store(JAC, scratch.data(), n, pattern);
+  return flag;
+}
+
+// A compiled Jacobian written for band or sparse storage needs that matrix to
+// write into
+static inline void jac_native_check(bool band_form, bool sparse_form, bool band,
+                                    bool sparse) {
+  if (band_form && !band) {
+    Rcpp::stop("A compiled band Jacobian needs a band matrix: give mupper and mlower, or a Jacobian made with sundialr_xptr_jac()");
+  }
+  if (sparse_form && !sparse) {
+    Rcpp::stop("A compiled sparse Jacobian needs a sparse matrix: give a sparsity pattern whose storage is not \"band\", or a Jacobian made with sundialr_xptr_jac()");
+  }
+}
+
+// The storage of a band JAC as the band forms of sundialr_capi.h see it, with
+// element (i, j) at [(i - j + mupper) + j*ldim]: SUNDIALS keeps mlower more
+// superdiagonals above the band, for the fill-in of its factorisation
+static inline double *jac_band_data(SUNMatrix JAC) {
+  return SM_DATA_B(JAC) + (SM_SUBAND_B(JAC) - SM_UBAND_B(JAC));
+}
+
+// Used by cvode, cvsolve for a compiled band Jacobian (see sundialr_jac_band in
+// sundialr_capi.h), which writes the band matrix's storage in place
+static inline int jac_eval_native_band(sundialr_jac_band jac, sunrealtype t,
+                                       N_Vector y, SUNMatrix JAC, double *params,
+                                       solver_clock *clock = NULL) {
+  user_section user(clock);
+  return jac(t, N_VGetArrayPointer(y), jac_band_data(JAC), (int) SM_UBAND_B(JAC),
+             (int) SM_LBAND_B(JAC), (int) SM_LDIM_B(JAC), params);
+}
+
+// The same for ida (see sundialr_jac_ida_band in sundialr_capi.h)
+static inline int jac_eval_ida_native_band(sundialr_jac_ida_band jac, sunrealtype t,
+                                           sunrealtype cj, N_Vector y, N_Vector yp,
+                                           SUNMatrix JAC, double *params,
+                                           solver_clock *clock = NULL) {
+  user_section user(clock);
+  return jac(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp), jac_band_data(JAC),
+             (int) SM_UBAND_B(JAC), (int) SM_LBAND_B(JAC), (int) SM_LDIM_B(JAC),
+             params);
+}
+
+// Used by cvode, cvsolve for a compiled sparse Jacobian (see sundialr_jac_sparse
+// in sundialr_capi.h), which writes the values of the pattern in place
+static inline int jac_eval_native_sparse(sundialr_jac_sparse jac, sunrealtype t,
+                                         N_Vector y, SUNMatrix JAC, double *params,
+                                         const sparse_pattern *pattern,
+                                         solver_clock *clock = NULL) {
+  pattern->restore(JAC);
+  user_section user(clock);
+  return jac(t, N_VGetArrayPointer(y), SM_DATA_S(JAC), (int) pattern->nnz(), params);
+}
+
+// The same for ida (see sundialr_jac_ida_sparse in sundialr_capi.h)
+static inline int jac_eval_ida_native_sparse(sundialr_jac_ida_sparse jac, sunrealtype t,
+                                             sunrealtype cj, N_Vector y, N_Vector yp,
+                                             SUNMatrix JAC, double *params,
+                                             const sparse_pattern *pattern,
+                                             solver_clock *clock = NULL) {
+  pattern->restore(JAC);
+  user_section user(clock);
+  return jac(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp), SM_DATA_S(JAC),
+             (int) pattern->nnz(), params);
+}
 
 // Used by cvode, cvodes, cvsolve.
 // R function signature: f(t, y, p)  ->  n-by-n matrix of d(ydot_i)/d(y_j)
 static inline int jac_eval(sunrealtype t, N_Vector y, SUNMatrix JAC,
-                           SEXP jac_eqn, Rcpp::NumericVector params) {
+                           SEXP jac_eqn, Rcpp::NumericVector params,
+                           const sparse_pattern *pattern,
+                           solver_clock *clock = NULL) {
   int n = NV_LENGTH_S(y);
   Rcpp::NumericVector y1(n);
   sunrealtype *y_ptr = N_VGetArrayPointer(y);
   for (int i = 0; i < n; i++) y1[i] = y_ptr[i];
 
   Rcpp::Function jac_fun(jac_eqn);
-  Rcpp::NumericMatrix J = jac_fun(t, y1, params);
+  SEXP J_sexp;
+  {
+    user_section user(clock);
+    J_sexp = jac_fun(t, y1, params);
+  }
+  Rcpp::RObject J(J_sexp);
 
-  if (J.nrow() != n || J.ncol() != n) {
-    Rcpp::stop("The Jacobian function must return a %d-by-%d matrix; got %d-by-%d",
-               n, n, J.nrow(), J.ncol());
+  jac_store_r(JAC, J, n, pattern);
+  return 0;
+}
+
+// Used by cvode, cvodes, cvsolve for a model built by ode_model(): evaluates the
+// entries of its symbolic Jacobian that are not structurally zero into vals and
+// stores them in JAC. The rest of JAC is left alone, since SUNDIALS zeroes the
+// matrix before asking for the Jacobian.
+static inline int jac_eval_model(const expr_model *model, sunrealtype t, N_Vector y,
+                                 SUNMatrix JAC, const double *params,
+                                 double *regs, double *vals,
+                                 const sparse_pattern *pattern,
+                                 solver_clock *clock = NULL) {
+  {
+    user_section user(clock);
+    model->jac.eval(t, N_VGetArrayPointer(y), params, regs, vals);
   }
 
-  for (int j = 0; j < n; j++)
-    for (int i = 0; i < n; i++)
-      SM_ELEMENT_D(JAC, i, j) = J(i, j);
+  const int *rows = model->jac_rows.data();
+  const int *cols = model->jac_cols.data();
+  int nnz = (int) model->jac_rows.size();
+  if (pattern) {
+    pattern->restore(JAC);
+    sunrealtype *x = SM_DATA_S(JAC);
+    for (int e = 0; e < nnz; e++) {
+      sunindextype p = pattern->find(rows[e], cols[e]);
+      if (p >= 0) x[p] = vals[e];
+    }
+    return 0;
+  }
+  if (SUNMatGetID(JAC) == SUNMATRIX_BAND) {
+    int mu = (int) SM_UBAND_B(JAC), ml = (int) SM_LBAND_B(JAC);
+    for (int e = 0; e < nnz; e++) {
+      if (rows[e] - cols[e] <= ml && cols[e] - rows[e] <= mu)
+        SM_ELEMENT_B(JAC, rows[e], cols[e]) = vals[e];
+    }
+    return 0;
+  }
+  sunrealtype *J = SM_DATA_D(JAC);
+  sunindextype ld = SM_ROWS_D(JAC);
+  for (int e = 0; e < nnz; e++) J[cols[e] * ld + rows[e]] = vals[e];
   return 0;
 }
 
@@ -30,7 +292,9 @@ static inline int jac_eval(sunrealtype t, N_Vector y, SUNMatrix JAC,
 // R function signature: f(t, y, ydot, cj, p)  ->  n-by-n matrix of dF/dy + cj * dF/dydot
 static inline int jac_eval_ida(sunrealtype t, sunrealtype cj,
                                N_Vector y, N_Vector yp, SUNMatrix JAC,
-                               SEXP jac_eqn, Rcpp::NumericVector params) {
+                               SEXP jac_eqn, Rcpp::NumericVector params,
+                               const sparse_pattern *pattern,
+                               solver_clock *clock = NULL) {
   int n = NV_LENGTH_S(y);
   Rcpp::NumericVector y1(n), yp1(n);
   sunrealtype *y_ptr  = N_VGetArrayPointer(y);
@@ -38,16 +302,14 @@ static inline int jac_eval_ida(sunrealtype t, sunrealtype cj,
   for (int i = 0; i < n; i++) { y1[i] = y_ptr[i]; yp1[i] = yp_ptr[i]; }
 
   Rcpp::Function jac_fun(jac_eqn);
-  Rcpp::NumericMatrix J = jac_fun(t, y1, yp1, cj, params);
-
-  if (J.nrow() != n || J.ncol() != n) {
-    Rcpp::stop("The Jacobian function must return a %d-by-%d matrix; got %d-by-%d",
-               n, n, J.nrow(), J.ncol());
+  SEXP J_sexp;
+  {
+    user_section user(clock);
+    J_sexp = jac_fun(t, y1, yp1, cj, params);
   }
+  Rcpp::RObject J(J_sexp);
 
-  for (int j = 0; j < n; j++)
-    for (int i = 0; i < n; i++)
-      SM_ELEMENT_D(JAC, i, j) = J(i, j);
+  jac_store_r(JAC, J, n, pattern);
   return 0;
 }
 
@@ -0,0 +1,99 @@
+// File: krylov_func.h
+
+#ifndef KRYLOV_FUNC_H
+#define KRYLOV_FUNC_H
+
+// The Jacobian-times-vector and preconditioner functions of a Krylov linear
+// solver (see linear_solver.h), each an R function or a compiled function
+// passed as an external pointer (see sundialr_xptr.h and the sundialr_jtimes,
+// sundialr_psetup and sundialr_psolve types in sundialr_capi.h).
+//
+// The Krylov solver solves the Newton system M x = b using only products of M
+// with vectors. M is I - gamma * J for cvode and cvsolve, J being d(ydot)/dy,
+// and dF/dy + cj * dF/dydot for ida. jtimes gives J v (for ida, M v) in place
+// of SUNDIALS' finite-difference approximation. A preconditioner is a matrix P
+// close to M but cheap to solve with, such as its diagonal blocks or the part
+// of it coming from the stiff local terms; psetup prepares P whenever the
+// solver updates M, and psolve solves P z = r. Either of jtimes and the pair
+// may be given without the other, and psetup may be left out when psolve needs
+// no preparation.
+//
+// R function signatures, p being the Parameters:
+//   cvode, cvsolve:
+//     jtimes(t, y, v, p)           -> J v
+//     psetup(t, y, jok, gamma, p)  -> TRUE when it evaluated J afresh, FALSE
+//                                     when jok was TRUE and it reused what it
+//                                     kept from an earlier call; NULL is TRUE
+//     psolve(t, y, r, gamma, p)    -> z
+//   ida:
+//     jtimes(t, y, ydot, v, cj, p) -> (dF/dy + cj * dF/dydot) v
+//     psetup(t, y, ydot, cj, p)    -> ignored
+//     psolve(t, y, ydot, r, cj, p) -> z
+// An R psetup keeps what it prepares for psolve in an environment the two
+// share, such as that of the function that created them.
+//
+// jtimes and psolve are called on every Krylov iteration, so their R calls are
+// built once, as for the right-hand side (see r_callback.h).
+//
+// Prerequisites: Rcpp.h, nvector_serial.h
+
+#include <sundials_err_record.h>
+#include <sundialr_capi.h>
+#include <r_callback.h>
+
+struct krylov_func {
+  bool dae;                   // ida's signatures rather than cvode's
+  sundials_err_record *err;   // collects errors raised inside the callbacks
+  solver_clock *clock;        // the solve's, when it is profiled; else NULL
+  Rcpp::NumericVector params;
+
+  // R functions, or R_NilValue when compiled or absent
+  SEXP jtimes, psetup, psolve;
+
+  // Compiled functions, called directly with the parameter values as udata;
+  // NULL when the corresponding function is an R function (or absent)
+  sundialr_jtimes jtimes_native;
+  sundialr_psetup psetup_native;
+  sundialr_psolve psolve_native;
+  sundialr_jtimes_ida jtimes_ida_native;
+  sundialr_psetup_ida psetup_ida_native;
+  sundialr_psolve_ida psolve_ida_native;
+
+  // Argument buffers shared by the prebuilt calls below
+  Rcpp::NumericVector t_arg;     // length 1
+  Rcpp::NumericVector y_arg;     // length of the state vector
+  Rcpp::NumericVector yp_arg;    // length of the state vector, for ida
+  Rcpp::NumericVector v_arg;     // v for jtimes, r for psolve
+  Rcpp::NumericVector s_arg;     // gamma, or cj for ida
+  Rcpp::LogicalVector jok_arg;   // length 1
+  Rcpp::RObject jtimes_call, psetup_call, psolve_call;
+
+  // Nothing given
+  krylov_func();
+
+  // Each of jtimes_, psetup_ and psolve_ is NULL, an R function, or an external
+  // pointer tagged with the signature for cvode (dae false) or ida (dae true);
+  // anything else is rejected with an error, as is psetup_ without psolve_
+  krylov_func(SEXP jtimes_, SEXP psetup_, SEXP psolve_,
+              Rcpp::NumericVector params_, sundials_err_record *err_,
+              int y_len, bool dae_);
+
+  bool has_jtimes() const { return jtimes != R_NilValue || jtimes_native || jtimes_ida_native; }
+  bool has_psetup() const { return psetup != R_NilValue || psetup_native || psetup_ida_native; }
+  bool has_psolve() const { return psolve != R_NilValue || psolve_native || psolve_ida_native; }
+  bool given() const { return has_jtimes() || has_psolve(); }
+
+  // For cvode and cvsolve
+  int jtimes_eval(sunrealtype t, N_Vector y, N_Vector v, N_Vector Jv);
+  int psetup_eval(sunrealtype t, N_Vector y, int jok, int *jcur, sunrealtype gamma);
+  int psolve_eval(sunrealtype t, N_Vector y, N_Vector r, N_Vector z, sunrealtype gamma);
+
+  // For ida
+  int jtimes_ida_eval(sunrealtype t, sunrealtype cj, N_Vector y, N_Vector yp,
+                      N_Vector v, N_Vector Jv);
+  int psetup_ida_eval(sunrealtype t, sunrealtype cj, N_Vector y, N_Vector yp);
+  int psolve_ida_eval(sunrealtype t, sunrealtype cj, N_Vector y, N_Vector yp,
+                      N_Vector r, N_Vector z);
+};
+
+#endif /* KRYLOV_FUNC_H */
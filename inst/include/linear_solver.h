@@ -0,0 +1,344 @@
+// File: linear_solver.h
+
+#ifndef LINEAR_SOLVER_H
+#define LINEAR_SOLVER_H
+
+// The matrix and linear solver behind the Newton iteration of cvode, cvsolve
+// and ida, chosen from the solver's arguments.
+//
+// Dense is the default, factored by the package's LU specialised to the size
+// of the system (see sunlinsol_small_dense.h) for up to SMALL_DENSE_MAX states
+// and by SUNDIALS' dense LU above. A system whose Jacobian is banded - each equation
+// involving only its neighbours, as in a discretised PDE - can ask for a band
+// matrix instead by giving its half-bandwidths: the factorisation then costs
+// O(n * mupper * mlower) instead of O(n^3), and the finite-difference Jacobian
+// needs mupper + mlower + 1 evaluations of the right-hand side instead of n.
+//
+// A large system whose Jacobian is mostly zeros without being banded, such as
+// a reaction network, can instead give its sparsity pattern, for a sparse
+// matrix factored by the package's own sparse LU (see sunlinsol_sparse_lu.h).
+// Memory and work then scale with the nonzeros. The pattern may be one found
+// by detect_sparsity() (see sparsity.cpp), which also recommends band storage
+// when the nonzeros lie in a narrow band. SUNDIALS has no finite-
+// difference Jacobian for a sparse matrix; without a Jacobian, the package
+// approximates one itself by differences over groups of columns that share no
+// row (see fd_jacobian.h).
+//
+// A dense system of a hundred states or more can ask for linear_solver =
+// "lapack_dense", which factors the same matrix with R's LAPACK (see
+// sunlinsol_lapack_dense.h) and so benefits from an optimised BLAS.
+//
+// A system too large for any matrix can name one of SUNDIALS' Krylov solvers
+// in the linear_solver argument. These never form the Jacobian: they only need
+// its product with a vector, which SUNDIALS approximates by one extra
+// evaluation of the right-hand side unless a Jacobian-times-vector function is
+// given, and they converge in few iterations only with a preconditioner, which
+// the user supplies (see krylov_func.h).
+//
+// Prerequisites: Rcpp.h, nvector_serial.h
+
+#include <sunmatrix/sunmatrix_dense.h>
+#include <sunmatrix/sunmatrix_band.h>
+#include <sunmatrix/sunmatrix_sparse.h>
+#include <sunlinsol/sunlinsol_dense.h>
+#include <sunlinsol/sunlinsol_band.h>
+#include <sunlinsol/sunlinsol_spgmr.h>
+#include <sunlinsol/sunlinsol_spfgmr.h>
+#include <sunlinsol/sunlinsol_spbcgs.h>
+#include <sunlinsol/sunlinsol_sptfqmr.h>
+#include <sunlinsol/sunlinsol_pcg.h>
+#include <string.h>
+#include <sparse_pattern.h>
+#include <sunlinsol_sparse_lu.h>
+#include <sunlinsol_lapack_dense.h>
+#include <sunlinsol_small_dense.h>
+
+// The Krylov solvers, or LINSOL_DIRECT for a matrix and its factorisation
+enum linsol_krylov {
+  LINSOL_DIRECT = 0,
+  LINSOL_SPGMR,
+  LINSOL_SPFGMR,
+  LINSOL_SPBCGS,
+  LINSOL_SPTFQMR,
+  LINSOL_PCG
+};
+
+struct linsol_spec {
+  linsol_krylov krylov;
+  bool precondition;     // for a Krylov solver; set by the solver once it
+                         // knows whether a preconditioner was given
+  bool lapack;           // a dense matrix factored by R's LAPACK
+  bool band;
+  sunindextype mupper;   // upper and lower half-bandwidths, when band
+  sunindextype mlower;
+  bool sparse;
+  sparse_pattern pattern;   // when sparse
+};
+
+// One half-bandwidth argument as an integer in [0, n - 1]
+static inline sunindextype linsol_bandwidth(SEXP x, const char *name, int n) {
+  if (Rf_length(x) != 1 || !Rf_isNumeric(x)) {
+    Rcpp::stop("%s must be a single whole number", name);
+  }
+  double v = Rf_asReal(x);
+  if (ISNAN(v) || v < 0 || v > n - 1 || v != (double)(long) v) {
+    Rcpp::stop("%s must be a whole number between 0 and %d, the number of states less one",
+               name, n - 1);
+  }
+  return (sunindextype) v;
+}
+
+// An element of the list x by name, or R_NilValue
+static inline SEXP linsol_list_elt(SEXP x, const char *name) {
+  SEXP names = Rf_getAttrib(x, R_NamesSymbol);
+  if (names == R_NilValue) return R_NilValue;
+  for (R_xlen_t k = 0; k < Rf_xlength(x); k++) {
+    if (strcmp(CHAR(STRING_ELT(names, k)), name) == 0) return VECTOR_ELT(x, k);
+  }
+  return R_NilValue;
+}
+
+// A pattern found by detect_sparsity(): a list of class "sundialr_sparsity"
+// holding the slots i, p and Dim of a dgCMatrix, its half-bandwidths mupper and
+// mlower, and the storage, "sparse" or "band", recommended for it
+static inline bool linsol_is_detected(SEXP sparsity) {
+  return TYPEOF(sparsity) == VECSXP && Rf_inherits(sparsity, "sundialr_sparsity");
+}
+
+// The sparsity argument as a pattern: an n-by-n logical or numeric matrix whose
+// nonzero entries mark the nonzeros of the Jacobian, a sparse matrix from the
+// Matrix package in compressed-column (slots i, p and Dim, as a dgCMatrix or
+// ngCMatrix) or triplet form (slots i, j and Dim, as a dgTMatrix), whose
+// stored entries do, or a pattern found by detect_sparsity(). The diagonal is
+// always added.
+static inline sparse_pattern linsol_pattern(SEXP sparsity, int n) {
+  std::vector<std::vector<sunindextype> > cols(n);
+
+  bool detected = linsol_is_detected(sparsity);
+  if (Rf_isS4(sparsity) || detected) {
+    // the slots of a sparse matrix, or the elements of the same names
+    auto part = [&](const char *name) -> SEXP {
+      if (detected) return linsol_list_elt(sparsity, name);
+      return R_has_slot(sparsity, Rf_install(name)) ? R_do_slot(sparsity, Rf_install(name)) : R_NilValue;
+    };
+    bool triplet = part("j") != R_NilValue;
+    SEXP dim = part("Dim");
+    if (TYPEOF(dim) != INTSXP || Rf_length(dim) != 2 || part("i") == R_NilValue ||
+        !(triplet || part("p") != R_NilValue)) {
+      Rcpp::stop("sparsity must be a matrix, or a sparse matrix such as a dgCMatrix or dgTMatrix");
+    }
+    if (INTEGER(dim)[0] != n || INTEGER(dim)[1] != n) {
+      Rcpp::stop("sparsity must be %d-by-%d, the number of states; got %d-by-%d",
+                 n, n, INTEGER(dim)[0], INTEGER(dim)[1]);
+    }
+    SEXP i = part("i");
+    SEXP j = part(triplet ? "j" : "p");
+    R_xlen_t nnz = Rf_xlength(i);
+    if (TYPEOF(i) != INTSXP || TYPEOF(j) != INTSXP ||
+        Rf_xlength(j) != (triplet ? nnz : n + 1) ||
+        (!triplet && (INTEGER(j)[0] != 0 || INTEGER(j)[n] != nnz))) {
+      Rcpp::stop("sparsity's slots i and %s do not describe a %d-by-%d matrix",
+                 triplet ? "j" : "p", n, n);
+    }
+    const int *ii = INTEGER(i), *jj = INTEGER(j);
+    for (int col = 0, k = 0; k < nnz; k++) {
+      if (triplet) {
+        col = jj[k];
+      } else {
+        while (col < n && k >= jj[col + 1]) col++;
+      }
+      if (ii[k] < 0 || ii[k] >= n || col < 0 || col >= n) {
+        Rcpp::stop("sparsity has an entry outside its %d-by-%d dimensions", n, n);
+      }
+      cols[col].push_back(ii[k]);
+    }
+  } else {
+    if (!Rf_isMatrix(sparsity) || (TYPEOF(sparsity) != LGLSXP &&
+        TYPEOF(sparsity) != INTSXP && TYPEOF(sparsity) != REALSXP)) {
+      Rcpp::stop("sparsity must be a matrix, or a sparse matrix such as a dgCMatrix or dgTMatrix");
+    }
+    if (Rf_nrows(sparsity) != n || Rf_ncols(sparsity) != n) {
+      Rcpp::stop("sparsity must be %d-by-%d, the number of states; got %d-by-%d",
+                 n, n, Rf_nrows(sparsity), Rf_ncols(sparsity));
+    }
+    Rcpp::NumericMatrix S(sparsity);
+    for (int col = 0; col < n; col++) {
+      for (int row = 0; row < n; row++) {
+        if (ISNAN(S(row, col))) Rcpp::stop("sparsity must not contain NA");
+        if (S(row, col) != 0) cols[col].push_back(row);
+      }
+    }
+  }
+
+  sparse_pattern pattern;
+  pattern.n = n;
+  pattern.colptr.assign(1, 0);
+  for (int col = 0; col < n; col++) {
+    std::vector<sunindextype> &c = cols[col];
+    c.push_back(col);
+    std::sort(c.begin(), c.end());
+    c.erase(std::unique(c.begin(), c.end()), c.end());
+    pattern.rowind.insert(pattern.rowind.end(), c.begin(), c.end());
+    pattern.colptr.push_back((sunindextype) pattern.rowind.size());
+  }
+  return pattern;
+}
+
+// The linear_solver argument: NULL, "dense", "lapack_dense", or the name of a
+// Krylov solver. *dense is set for the two dense ones, *lapack for the second.
+static inline linsol_krylov linsol_kind(SEXP linear_solver, bool *dense, bool *lapack) {
+  static const char *names[] = { "dense", "spgmr", "spfgmr", "spbcgs", "sptfqmr", "pcg" };
+  *dense = *lapack = false;
+  if (linear_solver == R_NilValue) return LINSOL_DIRECT;
+  if (TYPEOF(linear_solver) != STRSXP || Rf_length(linear_solver) != 1 ||
+      STRING_ELT(linear_solver, 0) == NA_STRING) {
+    Rcpp::stop("linear_solver must be a single string");
+  }
+  const char *name = CHAR(STRING_ELT(linear_solver, 0));
+  if (strcmp(name, "lapack_dense") == 0) {
+    if (!sundialr_has_lapack()) {
+      Rcpp::stop("linear_solver = \"lapack_dense\" is not available: no LAPACK could be linked when sundialr was installed");
+    }
+    *dense = *lapack = true;
+    return LINSOL_DIRECT;
+  }
+  for (int k = 0; k < (int) (sizeof(names) / sizeof(names[0])); k++) {
+    if (strcmp(name, names[k]) == 0) {
+      *dense = k == 0;
+      return (linsol_krylov) k;   // "dense" is LINSOL_DIRECT
+    }
+  }
+  Rcpp::stop("Unknown linear_solver \"%s\": use \"dense\", \"lapack_dense\", \"spgmr\", \"spfgmr\", \"spbcgs\", \"sptfqmr\" or \"pcg\"",
+             name);
+}
+
+// The linear solver asked for by the linear_solver, mupper, mlower and sparsity
+// arguments: a Krylov solver when linear_solver names one, otherwise dense when
+// the rest are NULL, band when both bandwidths are given, sparse when the
+// pattern is
+static inline linsol_spec linsol_parse(SEXP mupper, SEXP mlower, SEXP sparsity,
+                                       SEXP linear_solver, int n) {
+  linsol_spec spec;
+  bool dense;
+  spec.krylov = linsol_kind(linear_solver, &dense, &spec.lapack);
+  spec.precondition = false;
+  spec.band = false;
+  spec.mupper = spec.mlower = 0;
+  spec.sparse = false;
+  bool matrix_args = mupper != R_NilValue || mlower != R_NilValue || sparsity != R_NilValue;
+  if (spec.krylov != LINSOL_DIRECT || dense) {
+    if (matrix_args) {
+      Rcpp::stop("mupper, mlower and sparsity choose a band or sparse matrix, and cannot be combined with linear_solver = \"%s\"",
+                 CHAR(STRING_ELT(linear_solver, 0)));
+    }
+    return spec;
+  }
+  if (sparsity != R_NilValue) {
+    if (mupper != R_NilValue || mlower != R_NilValue) {
+      Rcpp::stop("sparsity cannot be combined with mupper and mlower: give one or the other");
+    }
+    // a detected pattern may recommend a band matrix instead
+    if (linsol_is_detected(sparsity)) {
+      SEXP storage = linsol_list_elt(sparsity, "storage");
+      if (TYPEOF(storage) != STRSXP || Rf_length(storage) != 1 ||
+          (strcmp(CHAR(STRING_ELT(storage, 0)), "band") != 0 &&
+           strcmp(CHAR(STRING_ELT(storage, 0)), "sparse") != 0)) {
+        Rcpp::stop("The storage of a detected sparsity pattern must be \"sparse\" or \"band\"");
+      }
+      if (strcmp(CHAR(STRING_ELT(storage, 0)), "band") == 0) {
+        spec.band = true;
+        spec.mupper = linsol_bandwidth(linsol_list_elt(sparsity, "mupper"), "The pattern's mupper", n);
+        spec.mlower = linsol_bandwidth(linsol_list_elt(sparsity, "mlower"), "The pattern's mlower", n);
+        return spec;
+      }
+    }
+    spec.sparse = true;
+    spec.pattern = linsol_pattern(sparsity, n);
+    return spec;
+  }
+  if (mupper == R_NilValue && mlower == R_NilValue) return spec;
+  if (mupper == R_NilValue || mlower == R_NilValue) {
+    Rcpp::stop("mupper and mlower must be given together, for a band linear solver");
+  }
+  spec.band = true;
+  spec.mupper = linsol_bandwidth(mupper, "mupper", n);
+  spec.mlower = linsol_bandwidth(mlower, "mlower", n);
+  return spec;
+}
+
+// The pattern a sparse Jacobian is written in (see jac_func.h); NULL otherwise
+static inline const sparse_pattern *linsol_pattern_of(const linsol_spec &spec) {
+  return spec.sparse ? &spec.pattern : NULL;
+}
+
+// A Krylov solver has no matrix to put a Jacobian in, and the preconditioner
+// and Jacobian-times-vector functions have no use without one
+static inline void linsol_check_krylov(const linsol_spec &spec, SEXP jacobian,
+                                       bool has_krylov_funcs) {
+  if (spec.krylov != LINSOL_DIRECT && jacobian != R_NilValue) {
+    Rcpp::stop("A Krylov linear_solver uses no Jacobian matrix: give jtimes, the Jacobian times a vector, instead of jacobian");
+  }
+  if (spec.krylov == LINSOL_DIRECT && has_krylov_funcs) {
+    Rcpp::stop("jtimes, psetup and psolve are used only with a Krylov linear_solver, such as \"spgmr\"");
+  }
+}
+
+// Create the matrix and linear solver for spec into SM and LS. Returns NULL, or
+// the name of the SUNDIALS constructor that failed for the caller to report;
+// whatever was created is left in SM and LS for the caller to free. A Krylov
+// solver has no matrix, and leaves SM NULL.
+static inline const char *linsol_create(const linsol_spec &spec, N_Vector y,
+                                        SUNContext sunctx,
+                                        SUNMatrix *SM, SUNLinearSolver *LS) {
+  sunindextype n = NV_LENGTH_S(y);
+  // left preconditioning, which IDA requires; SPFGMR switches it to right, the
+  // only side it supports. maxl 0 is SUNDIALS' default Krylov dimension of 5.
+  int pretype = spec.precondition ? SUN_PREC_LEFT : SUN_PREC_NONE;
+  switch (spec.krylov) {
+  case LINSOL_SPGMR:
+    *LS = SUNLinSol_SPGMR(y, pretype, 0, sunctx);
+    return *LS ? NULL : "SUNLinSol_SPGMR";
+  case LINSOL_SPFGMR:
+    *LS = SUNLinSol_SPFGMR(y, pretype, 0, sunctx);
+    return *LS ? NULL : "SUNLinSol_SPFGMR";
+  case LINSOL_SPBCGS:
+    *LS = SUNLinSol_SPBCGS(y, pretype, 0, sunctx);
+    return *LS ? NULL : "SUNLinSol_SPBCGS";
+  case LINSOL_SPTFQMR:
+    *LS = SUNLinSol_SPTFQMR(y, pretype, 0, sunctx);
+    return *LS ? NULL : "SUNLinSol_SPTFQMR";
+  case LINSOL_PCG:
+    *LS = SUNLinSol_PCG(y, pretype, 0, sunctx);
+    return *LS ? NULL : "SUNLinSol_PCG";
+  case LINSOL_DIRECT:
+    break;
+  }
+  if (spec.sparse) {
+    *SM = SUNSparseMatrix(n, n, spec.pattern.nnz(), CSC_MAT, sunctx);
+    if (*SM == NULL) return "SUNSparseMatrix";
+    spec.pattern.restore(*SM);
+    *LS = SUNLinSol_SparseLU(y, *SM, sunctx);
+    if (*LS == NULL) return "SUNLinSol_SparseLU";
+  } else if (spec.band) {
+    *SM = SUNBandMatrix(n, spec.mupper, spec.mlower, sunctx);
+    if (*SM == NULL) return "SUNBandMatrix";
+    *LS = SUNLinSol_Band(y, *SM, sunctx);
+    if (*LS == NULL) return "SUNLinSol_Band";
+  } else {
+    *SM = SUNDenseMatrix(n, n, sunctx);
+    if (*SM == NULL) return "SUNDenseMatrix";
+    if (spec.lapack) {
+      *LS = SUNLinSol_RLapackDense(y, *SM, sunctx);
+      if (*LS == NULL) return "SUNLinSol_RLapackDense";
+    } else if (n <= SMALL_DENSE_MAX) {
+      *LS = SUNLinSol_SmallDense(y, *SM, sunctx);
+      if (*LS == NULL) return "SUNLinSol_SmallDense";
+    } else {
+      *LS = SUNLinSol_Dense(y, *SM, sunctx);
+      if (*LS == NULL) return "SUNLinSol_Dense";
+    }
+  }
+  return NULL;
+}
+
+#endif /* LINEAR_SOLVER_H */
@@ -0,0 +1,108 @@
+// File: output_select.h
+
+#ifndef OUTPUT_SELECT_H
+#define OUTPUT_SELECT_H
+
+// The columns cvode() and cvode_batch() store at each output time, given by
+// their outputs argument: every state, which is the default; some of them, by
+// index or, for a model built by ode_model(), by name; or observables of the
+// solution, computed from the state at each output time, either by R
+// expressions compiled to the bytecode of ode_model() (see expr_model.h) or by
+// a compiled function made with sundialr_xptr_outputs(). Only those columns
+// are allocated, so a large network of which a few observables are wanted
+// costs a few columns per output time rather than one per state.
+//
+// A selection is never modified once made, so the workers of cvode_batch()
+// share one, each with its own scratch (see init_scratch()).
+//
+// Prerequisites: Rcpp.h, expr_model.h, sundialr_xptr.h
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct output_select {
+  bool all;                  // every state, in order
+  int n_out;                 // values stored after the time
+  std::vector<int> states;   // the states stored, 0-based, by index or name
+  sundialr_outputs native;   // or a compiled function ...
+  bool has_program;          // ... or compiled expressions
+  expr_program program;
+
+  output_select() : all(true), n_out(0), native(NULL), has_program(false) {}
+
+  // The registers of the compiled expressions, for each caller its own
+  void init_scratch(std::vector<double> &regs) const {
+    if (has_program) program.init_scratch(regs);
+  }
+
+  // The values stored for the state y at t: y itself for every state, and
+  // otherwise out filled. NULL when a compiled function fails.
+  const double *row(double t, const double *y, const double *p, double *regs,
+                    double *out) const {
+    if (all) return y;
+    if (native) return native(t, y, out, (void *) p) == 0 ? out : NULL;
+    if (has_program) {
+      program.eval(t, y, p, regs, out);
+      return out;
+    }
+    for (int j = 0; j < n_out; j++) out[j] = y[states[j]];
+    return out;
+  }
+};
+
+// The outputs argument, for a system of y_len states and n_params parameters
+// whose right-hand side is input_function
+static inline output_select output_select_parse(SEXP outputs, SEXP input_function,
+                                                int y_len, int n_params) {
+  output_select sel;
+  sel.n_out = y_len;
+  if (outputs == R_NilValue) return sel;
+  sel.all = false;
+
+  const expr_model *model = expr_model_get(input_function);
+  if (TYPEOF(outputs) == EXTPTRSXP) {
+    sel.native = (sundialr_outputs) sundialr_xptr_get(outputs, "sundialr_outputs");
+    SEXP n = R_ExternalPtrProtected(outputs);
+    if (!sel.native || TYPEOF(n) != INTSXP || Rf_length(n) != 1 || INTEGER(n)[0] < 1) {
+      Rcpp::stop("outputs is an external pointer but not a valid compiled outputs function: make it with sundialr_xptr_outputs() from sundialr_xptr.h");
+    }
+    sel.n_out = INTEGER(n)[0];
+  } else if (TYPEOF(outputs) == VECSXP || TYPEOF(outputs) == EXPRSXP) {
+    if (Rf_length(outputs) == 0) Rcpp::stop("outputs must not be empty");
+    if (model) expr_model_check(model, y_len, n_params);
+    sel.program = expr_outputs(outputs, model, y_len, n_params);
+    sel.has_program = true;
+    sel.n_out = Rf_length(outputs);
+  } else if (TYPEOF(outputs) == STRSXP) {
+    if (!model) {
+      Rcpp::stop("outputs names states, which only a model built by ode_model() has: give their indices instead");
+    }
+    expr_model_check(model, y_len, n_params);
+    for (R_xlen_t j = 0; j < Rf_xlength(outputs); j++) {
+      const char *name = CHAR(STRING_ELT(outputs, j));
+      int i = 0;
+      while (i < y_len && std::strcmp(model->states[i].c_str(), name) != 0) i++;
+      if (i == y_len) Rcpp::stop("outputs: the model has no state named '%s'", name);
+      sel.states.push_back(i);
+    }
+  } else if (TYPEOF(outputs) == INTSXP || TYPEOF(outputs) == REALSXP) {
+    Rcpp::NumericVector index(outputs);
+    for (R_xlen_t j = 0; j < index.size(); j++) {
+      double i = index[j];
+      if (ISNAN(i) || i < 1 || i > y_len || i != (double)(long) i) {
+        Rcpp::stop("outputs must be whole numbers between 1 and %d, the number of states", y_len);
+      }
+      sel.states.push_back((int) i - 1);
+    }
+  } else {
+    Rcpp::stop("outputs must be NULL, the indices or names of states, a list of R expressions, or a compiled function made with sundialr_xptr_outputs()");
+  }
+  if (!sel.native && !sel.has_program) {
+    if (sel.states.empty()) Rcpp::stop("outputs must not be empty");
+    sel.n_out = (int) sel.states.size();
+  }
+  return sel;
+}
+
+#endif /* OUTPUT_SELECT_H */
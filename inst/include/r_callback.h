@@ -0,0 +1,72 @@
+// File: r_callback.h
+
+#ifndef R_CALLBACK_H
+#define R_CALLBACK_H
+
+// Prerequisites: Rcpp.h
+
+#include <callback_timer.h>
+
+// Helpers for calling a user's R function from a SUNDIALS callback without
+// allocating on every call.
+//
+// SUNDIALS evaluates the right-hand side (or residual) hundreds of thousands of
+// times in a stiff solve. Building the argument vectors and the call afresh
+// each time made allocation and garbage collection the largest cost in the
+// solve, so the solvers now allocate the arguments and the call once, in the
+// user-data struct, and each callback only overwrites the argument values and
+// evaluates the same call again.
+//
+// The arguments are marked not mutable, so an R function that assigns into its
+// argument gets a copy rather than writing into the buffer. A function that
+// keeps a reference to its argument beyond the call (for instance by assigning
+// it with <<-) sees it change on the next call, since the vector is reused.
+
+// A length-n double vector to be passed to R on every call.
+static inline Rcpp::NumericVector r_arg_buffer(int n) {
+  Rcpp::NumericVector v(n);
+  MARK_NOT_MUTABLE(v);
+  return v;
+}
+
+// Evaluate a prebuilt call and copy its result into out, which has n elements.
+// `what` names the user function in the error message when the result has the
+// wrong length. A double result is read in place; anything else is coerced
+// first, which throws as before when it is not numeric.
+//
+// Errors raised by the R function propagate as the same C++ exceptions
+// Rcpp::Function raises, so sundials_callback_guard handles them unchanged.
+// When the solve is being profiled, clock is its solver_clock, and the
+// evaluation is counted as the user's time (see callback_timer.h).
+static inline void r_call_into(SEXP call, double *out, int n, const char *what,
+                               solver_clock *clock = NULL) {
+  SEXP res_sexp;
+  {
+    user_section user(clock);
+    res_sexp = Rcpp::Rcpp_fast_eval(call, R_GlobalEnv);
+  }
+  Rcpp::Shield<SEXP> res(res_sexp);
+
+  Rcpp::NumericVector coerced;
+  const double *res_ptr;
+  int res_len;
+  if (TYPEOF(res) == REALSXP) {
+    res_ptr = REAL(res);
+    res_len = Rf_length(res);
+  } else {
+    coerced = Rcpp::NumericVector(res);
+    res_ptr = coerced.begin();
+    res_len = coerced.length();
+  }
+
+  // The values are copied out element by element, so a short return would
+  // read past the end of the result instead of being reported.
+  if (res_len != n) {
+    Rcpp::stop("The %s function must return a vector of the same length as the state vector: expected %d, got %d",
+               what, n, res_len);
+  }
+
+  for (int i = 0; i < n; i++) out[i] = res_ptr[i];
+}
+
+#endif /* R_CALLBACK_H */
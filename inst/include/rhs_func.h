@@ -4,15 +4,112 @@
 #define RHS_FUNC_H
 
 #include <sundials_err_record.h>
+#include <sundialr_capi.h>
+#include <r_callback.h>
+#include <expr_model.h>
+#include <krylov_func.h>
+#include <cvode/cvode_ls.h>
+#include <sunmatrix/sunmatrix_sparse.h>
+#include <fd_jacobian.h>
+#include <solver_stats.h>
+#include <vector>
 
-// struct to use if R or Rcpp function is input as RHS function
+// struct to use as user data for an RHS given as an R or Rcpp function, as a
+// compiled function passed as an external pointer (see sundialr_xptr.h), or as
+// a model built by ode_model() (see expr_model.h)
 struct rhs_func{
-  Rcpp::Function rhs_eqn;
   Rcpp::NumericVector params;
   SEXP jac_eqn;        // user-supplied jacobian, if provided, else R_NilValue
   sundials_err_record *err;  // collects errors raised inside the callbacks
+
+  // Compiled RHS and Jacobian, called directly with the parameter values as
+  // udata; NULL when the corresponding function is an R function (or absent)
+  sundialr_rhs rhs_native;
+  sundialr_jac jac_native;
+  sundialr_jac_band jac_band;        // or the Jacobian for a band matrix
+  sundialr_jac_sparse jac_sparse;    // or for a sparse one
+  std::vector<double> jac_scratch;   // for jac_native with a band or sparse matrix
+
+  // Sparsity pattern of the Jacobian with a sparse matrix (see linear_solver.h),
+  // set by the solver after construction; NULL otherwise
+  const sparse_pattern *pattern;
+
+  // Model built by ode_model(), evaluated by the bytecode interpreter into the
+  // registers below; NULL otherwise
+  const expr_model *model;
+  std::vector<double> model_regs;
+
+  // Set when the model's symbolic Jacobian is used, which is when it has one
+  // and no other Jacobian is given; its registers and nonzero values
+  bool model_jac;
+  std::vector<double> jac_regs;
+  std::vector<double> jac_vals;
+
+  // Jacobian-times-vector and preconditioner functions for a Krylov linear
+  // solver (see krylov_func.h), set by the solver after construction
+  krylov_func krylov;
+
+  // With a sparse matrix and no Jacobian, the coloured finite differences that
+  // approximate it (see fd_jacobian.h), set up by the solver
+  fd_jacobian fd;
+
+  // Times the callbacks below when the solver reports stats or a profile (see
+  // callback_timer.h); NULL otherwise
+  solver_clock *clock;
+
+  // Allocated once per solve and reused by every call of rhs_function, which
+  // only overwrites the values (see r_callback.h). Unused for a compiled RHS.
+  Rcpp::NumericVector t_arg;    // length 1
+  Rcpp::NumericVector y_arg;    // length of the state vector
+  Rcpp::RObject rhs_call;       // rhs_eqn(t_arg, y_arg, params)
+
+  // rhs_eqn and jac_eqn are each an R function or a tagged external pointer;
+  // anything else is rejected with an error
+  rhs_func(SEXP rhs_eqn, Rcpp::NumericVector params_, SEXP jac_eqn_,
+           sundials_err_record *err_, int y_len);
+
+  // The function to give to CVodeInit for this RHS
+  CVRhsFn rhs_callback() const;
+
+  // The Jacobian-times-vector setup and product to give to CVodeSetJacTimes
+  // with a Krylov linear solver: the user's jtimes, else the product with the
+  // model's symbolic Jacobian; both NULL (SUNDIALS' finite-difference
+  // approximation) when there is neither
+  CVLsJacTimesSetupFn jtsetup_callback() const;
+  CVLsJacTimesVecFn jtimes_callback() const;
+
+  // true when a Jacobian is to be given to CVodeSetJacFn
+  bool has_jacobian() const { return jac_eqn != R_NilValue || model_jac || fd.active(); }
 };
 
+// For an RHS written in R
 int rhs_function(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data);
 
+// For a compiled RHS
+int rhs_function_native(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data);
+
+// For a model built by ode_model()
+int rhs_function_model(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data);
+
+// Given to CVodeSetJacTimes and CVodeSetPreconditioner for the functions in
+// krylov
+int rhs_jtimes(N_Vector v, N_Vector Jv, sunrealtype t, N_Vector y, N_Vector fy,
+               void *user_data, N_Vector tmp);
+int rhs_psetup(sunrealtype t, N_Vector y, N_Vector fy, sunbooleantype jok,
+               sunbooleantype *jcurPtr, sunrealtype gamma, void *user_data);
+int rhs_psolve(sunrealtype t, N_Vector y, N_Vector fy, N_Vector r, N_Vector z,
+               sunrealtype gamma, sunrealtype delta, int lr, void *user_data);
+
+// A sparse Jacobian by coloured finite differences of the right-hand side, for
+// the Jacobian functions given to CVodeSetJacFn; tmp1 and tmp2 are their work
+// vectors
+int rhs_jac_fd(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
+               void *user_data, N_Vector tmp1, N_Vector tmp2);
+
+// For a model's symbolic Jacobian with a Krylov solver: the setup evaluates the
+// Jacobian's nonzeros once per linear solve, and each product uses them
+int rhs_jtsetup_model(sunrealtype t, N_Vector y, N_Vector fy, void *user_data);
+int rhs_jtimes_model(N_Vector v, N_Vector Jv, sunrealtype t, N_Vector y,
+                     N_Vector fy, void *user_data, N_Vector tmp);
+
 #endif /* rhs_func */
@@ -0,0 +1,116 @@
+// File: solver_stats.h
+
+#ifndef SOLVER_STATS_H
+#define SOLVER_STATS_H
+
+// The integrator's counters for one solve, and the wall-clock time it took,
+// returned as the "stats" attribute of the solution when a solver is called
+// with stats = TRUE.
+//
+// The time is split between the user's callbacks - the right-hand side or
+// residual, the Jacobian, the sensitivity right-hand side and the Krylov
+// functions, in whatever form they are given - and everything else, which is
+// SUNDIALS' own work plus the package's setup (see callback_timer.h).
+//
+// The counters are read with the Get functions of CVODE (or CVODES) and IDA,
+// whose headers are included before this one for solver_stats_cvode() and
+// solver_stats_ida() to be defined.
+//
+// Prerequisites: Rcpp.h; cvode.h, cvodes.h or ida.h for the readers
+
+#include <callback_timer.h>
+
+struct solver_stats {
+  long int nsteps, nfevals, nfevals_ls, njevals, nlinsetups;
+  long int nniters, nncfails, netfails;
+  long int nfSevals;               // cvodes only; -1 elsewhere
+  int qlast, qcur;
+  double hinused, hlast, hcur;
+  long int lenrw, leniw;           // integrator and linear solver together
+
+  solver_stats()
+    : nsteps(0), nfevals(0), nfevals_ls(0), njevals(0), nlinsetups(0),
+      nniters(0), nncfails(0), netfails(0), nfSevals(-1), qlast(0), qcur(0),
+      hinused(0), hlast(0), hcur(0), lenrw(0), leniw(0) {}
+
+  // Add the counters of a later stretch of the same solve, after a restart
+  // that set the integrator's own counters back to zero (cvsolve's events).
+  // The step sizes and orders are those of the later stretch, except the
+  // first step, which is the solve's.
+  void add(const solver_stats &s) {
+    bool first = nsteps == 0;
+    nsteps += s.nsteps; nfevals += s.nfevals; nfevals_ls += s.nfevals_ls;
+    njevals += s.njevals; nlinsetups += s.nlinsetups; nniters += s.nniters;
+    nncfails += s.nncfails; netfails += s.netfails;
+    if (s.nfSevals >= 0) nfSevals = (nfSevals < 0 ? 0 : nfSevals) + s.nfSevals;
+    qlast = s.qlast; qcur = s.qcur;
+    if (first) hinused = s.hinused;
+    hlast = s.hlast; hcur = s.hcur;
+    lenrw = s.lenrw; leniw = s.leniw;
+  }
+};
+
+// The stats attribute. total_sec is the wall-clock time of the whole call.
+static inline Rcpp::List solver_stats_list(const solver_stats &s,
+                                           const solver_clock &clock,
+                                           double total_sec) {
+  Rcpp::List out = Rcpp::List::create(
+    Rcpp::_["steps"]             = (double) s.nsteps,
+    Rcpp::_["rhs_evals"]         = (double) s.nfevals,
+    Rcpp::_["rhs_evals_lin"]     = (double) s.nfevals_ls,
+    Rcpp::_["jac_evals"]         = (double) s.njevals,
+    Rcpp::_["lin_setups"]        = (double) s.nlinsetups,
+    Rcpp::_["nonlin_iters"]      = (double) s.nniters,
+    Rcpp::_["nonlin_conv_fails"] = (double) s.nncfails,
+    Rcpp::_["err_test_fails"]    = (double) s.netfails,
+    Rcpp::_["order_last"]        = s.qlast,
+    Rcpp::_["order_cur"]         = s.qcur,
+    Rcpp::_["step_initial"]      = s.hinused,
+    Rcpp::_["step_last"]         = s.hlast,
+    Rcpp::_["step_cur"]          = s.hcur,
+    Rcpp::_["workspace_real"]    = (double) s.lenrw,
+    Rcpp::_["workspace_int"]     = (double) s.leniw,
+    Rcpp::_["time_total"]        = total_sec,
+    Rcpp::_["time_callbacks"]    = clock.callback_sec,
+    Rcpp::_["time_solver"]       = total_sec - clock.callback_sec);
+  if (s.nfSevals >= 0) out["sens_rhs_evals"] = (double) s.nfSevals;
+  return out;
+}
+
+#if defined(_CVODE_H) || defined(_CVODES_H)
+// The counters of a CVODE solve, since its initialisation or last restart
+static inline void solver_stats_cvode(void *cvode_mem, solver_stats &s) {
+  sunrealtype tcur, hinused, hlast, hcur;
+  long int lenrw_ls = 0, leniw_ls = 0;
+  CVodeGetIntegratorStats(cvode_mem, &s.nsteps, &s.nfevals, &s.nlinsetups,
+                          &s.netfails, &s.qlast, &s.qcur, &hinused, &hlast,
+                          &hcur, &tcur);
+  s.hinused = hinused; s.hlast = hlast; s.hcur = hcur;
+  CVodeGetNonlinSolvStats(cvode_mem, &s.nniters, &s.nncfails);
+  CVodeGetNumJacEvals(cvode_mem, &s.njevals);
+  CVodeGetNumLinRhsEvals(cvode_mem, &s.nfevals_ls);
+  CVodeGetWorkSpace(cvode_mem, &s.lenrw, &s.leniw);
+  CVodeGetLinWorkSpace(cvode_mem, &lenrw_ls, &leniw_ls);
+  s.lenrw += lenrw_ls; s.leniw += leniw_ls;
+}
+#endif
+
+#ifdef _IDA_H
+// The counters of an IDA solve; the right-hand-side counts are of the residual
+static inline void solver_stats_ida(void *ida_mem, solver_stats &s) {
+  sunrealtype tcur, hinused, hlast, hcur;
+  long int lenrw_ls = 0, leniw_ls = 0;
+  IDAGetIntegratorStats(ida_mem, &s.nsteps, &s.nfevals, &s.nlinsetups,
+                        &s.netfails, &s.qlast, &s.qcur, &hinused, &hlast,
+                        &hcur, &tcur);
+  s.hinused = hinused; s.hlast = hlast; s.hcur = hcur;
+  IDAGetNonlinSolvStats(ida_mem, &s.nniters, &s.nncfails);
+  IDAGetNumJacEvals(ida_mem, &s.njevals);
+  IDAGetNumLinResEvals(ida_mem, &s.nfevals_ls);
+  IDAGetWorkSpace(ida_mem, &s.lenrw, &s.leniw);
+  IDAGetLinWorkSpace(ida_mem, &lenrw_ls, &leniw_ls);
+  s.lenrw += lenrw_ls; s.leniw += leniw_ls;
+}
+#endif
+
+#endif /* SOLVER_STATS_H */
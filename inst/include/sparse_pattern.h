@@ -0,0 +1,43 @@
+// File: sparse_pattern.h
+
+#ifndef SPARSE_PATTERN_H
+#define SPARSE_PATTERN_H
+
+// The structurally nonzero entries of a sparse Jacobian, in compressed-column
+// (CSC) form with the rows of each column sorted and the diagonal always
+// included, since the solvers add to it.
+//
+// SUNDIALS zeroes a SUNSparseMatrix's structure along with its values before
+// asking for the Jacobian, so every Jacobian written into one starts by
+// restoring the structure from here (see jac_func.h).
+//
+// Prerequisites: sunmatrix_sparse.h
+
+#include <algorithm>
+#include <vector>
+
+struct sparse_pattern {
+  sunindextype n;
+  std::vector<sunindextype> colptr;   // length n + 1
+  std::vector<sunindextype> rowind;   // length colptr[n]
+
+  sunindextype nnz() const { return colptr[n]; }
+
+  // Position of entry (i, j) in rowind, and so in the matrix data, or -1 when
+  // it is not in the pattern
+  sunindextype find(sunindextype i, sunindextype j) const {
+    const sunindextype *b = rowind.data() + colptr[j];
+    const sunindextype *e = rowind.data() + colptr[j + 1];
+    const sunindextype *p = std::lower_bound(b, e, i);
+    return (p != e && *p == i) ? (sunindextype)(p - rowind.data()) : -1;
+  }
+
+  // Write the pattern into JAC's structure and zero its values
+  void restore(SUNMatrix JAC) const {
+    std::copy(colptr.begin(), colptr.end(), SM_INDEXPTRS_S(JAC));
+    std::copy(rowind.begin(), rowind.end(), SM_INDEXVALS_S(JAC));
+    std::fill(SM_DATA_S(JAC), SM_DATA_S(JAC) + nnz(), 0.0);
+  }
+};
+
+#endif /* SPARSE_PATTERN_H */
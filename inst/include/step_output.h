@@ -0,0 +1,182 @@
+// File: step_output.h
+
+#ifndef STEP_OUTPUT_H
+#define STEP_OUTPUT_H
+
+// The solution at the solver's own internal steps, returned by cvode(),
+// cvsolve() and ida() with output = "steps" in place of the solution at the
+// times asked for. The solver is called in CV_ONE_STEP or IDA_ONE_STEP mode,
+// with the end of the interval as its stop time, and every step it takes is
+// recorded here: where the solution changes fast the rows are close together,
+// and no output time costs an interpolation.
+//
+// The number of steps is not known until the solve ends, so the rows are kept
+// in chunks of a fixed size, each allocated once and never moved, rather than
+// in a matrix grown by copying; as_matrix() copies them into the solution
+// once, at the end.
+//
+// With max_rows, the rows are thinned as they come: every stride-th step is
+// kept, and whenever twice max_rows are kept every other one is dropped and
+// the stride doubled, so the kept steps stay evenly spread over the solve and
+// the memory is bounded by twice max_rows whatever the number of steps.
+// as_matrix() then picks max_rows - 1 of them, evenly, and the last step, so
+// that the solution ends at the end of the interval.
+//
+// Prerequisites: Rcpp.h, sundials_err_record.h
+
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <vector>
+
+// The output argument: true for "steps", false for "times"
+static inline bool output_is_steps(const std::string &output) {
+  if (output == "steps") return true;
+  if (output != "times") Rcpp::stop("output must be \"times\" or \"steps\"");
+  return false;
+}
+
+// The max_rows argument: 0, for no limit, when NULL
+static inline int output_max_rows(SEXP max_rows) {
+  if (max_rows == R_NilValue) return 0;
+  if (Rf_length(max_rows) != 1 || !Rf_isNumeric(max_rows)) {
+    Rcpp::stop("max_rows must be a single whole number");
+  }
+  double v = Rf_asReal(max_rows);
+  if (ISNAN(v) || v < 2 || v > INT_MAX || v != (double)(long) v) {
+    Rcpp::stop("max_rows must be a whole number of 2 or more");
+  }
+  return (int) v;
+}
+
+class step_output {
+ public:
+  // A row is a time and n values; max_rows is 0 for no limit
+  step_output(int n, int max_rows)
+    : width(n + 1), max_rows(max_rows), chunk_rows(std::max(1, CHUNK / (n + 1))),
+      steps(0), stride(1), rows(0), last(n + 1), last_kept(false) {}
+
+  // The solution y at the end of a step, at t; the first row is the initial
+  // conditions
+  void push(double t, const double *y) {
+    long k = steps++;
+    if (max_rows > 0) {
+      last[0] = t;
+      std::copy(y, y + width - 1, last.begin() + 1);
+      last_kept = false;
+      if (k % stride) return;
+      if (rows == 2 * (long) max_rows) {
+        thin();
+        if (k % stride) return;
+      }
+    }
+    double *r = append();
+    r[0] = t;
+    std::copy(y, y + width - 1, r + 1);
+    last_kept = true;
+  }
+
+  // The rows, as the solution matrix
+  Rcpp::NumericMatrix as_matrix() const {
+    // the rows before the last step, and how many of them to return
+    long body = rows - (last_kept ? 1 : 0);
+    long n_body = max_rows > 0 ? std::min(body, (long) max_rows - 1) : body;
+    long n_rows = n_body + 1;
+    Rcpp::NumericMatrix out(n_rows, width);
+    double *o = out.begin();
+    for (long i = 0; i < n_rows; i++) {
+      const double *r = i < n_body ? row(i * body / n_body)
+                                   : (last_kept ? row(rows - 1) : last.data());
+      for (int j = 0; j < width; j++) o[i + j * n_rows] = r[j];
+    }
+    return out;
+  }
+
+ private:
+  static const int CHUNK = 1 << 16;   // doubles in a chunk
+
+  int width, max_rows, chunk_rows;
+  long steps;                         // pushed, counting the first row
+  long stride;                        // of the steps kept, when thinning
+  long rows;                          // kept
+  std::vector<std::vector<double> > chunks;
+  std::vector<double> last;           // the last step pushed, when thinning
+  bool last_kept;
+
+  double *row(long i) {
+    return chunks[i / chunk_rows].data() + (i % chunk_rows) * width;
+  }
+  const double *row(long i) const {
+    return chunks[i / chunk_rows].data() + (i % chunk_rows) * width;
+  }
+
+  double *append() {
+    if (rows == (long) chunks.size() * chunk_rows) {
+      chunks.push_back(std::vector<double>((size_t) chunk_rows * width));
+    }
+    return row(rows++);
+  }
+
+  // Keep the rows of the steps at multiples of twice the stride
+  void thin() {
+    long kept = (rows + 1) / 2;
+    for (long i = 1; i < kept; i++) {
+      std::copy(row(2 * i), row(2 * i) + width, row(i));
+    }
+    rows = kept;
+    stride *= 2;
+  }
+};
+
+// The most steps CV_NORMAL and IDA_NORMAL take to one output time (mxstep),
+// which the R solvers leave at SUNDIALS' default. CVODE and IDA count only the
+// steps of a single call against it, so a solve taken one step at a time
+// counts its own, and fails where a solve to each output time would fail,
+// rather than running on without bound.
+static const long SOLVER_MXSTEP = 500;
+
+// Records the failure SUNDIALS would have reported for a solve that reached
+// SOLVER_MXSTEP in solver_func, at t
+static inline void solver_mxstep_record(sundials_err_record &err,
+                                        const char *solver_func, double t) {
+  err.record(std::string("SUNDIALS error in ") + solver_func + ": At t = " +
+             std::to_string(t) + ", mxstep steps taken before reaching tout.");
+}
+
+// Calls step(&t), one internal step of the solver, until it returns
+// stop_flag, at the stop time, pushing the row row(t) - the solution, or what
+// is stored of it - after every step, or after all but the last one when
+// push_last is false. Returns the solver's flag: stop_flag, or the first
+// negative one, or too_much_work, recorded in err, once SOLVER_MXSTEP steps
+// are taken without passing one of times, the n_times output times after the
+// solver's current time, in order, the last of which is its stop time.
+template <typename Step, typename Row>
+static inline int step_output_until(Step step, int stop_flag, int too_much_work,
+                                    const double *times, int n_times, Row row,
+                                    step_output &out, bool push_last,
+                                    sundials_err_record &err, const char *solver_func) {
+  int next = 0;        // the first output time not yet passed
+  long since = 0;      // the steps taken since the last one passed
+  long taken = 0;
+  double dir = 0.0, t = 0.0;
+  for (;;) {
+    if (since >= SOLVER_MXSTEP) {
+      solver_mxstep_record(err, solver_func, t);
+      return too_much_work;
+    }
+    int flag = step(&t);
+    if (flag < 0) return flag;
+    since++;
+    // the first step stops short of the stop time, or at it
+    if (dir == 0.0) dir = times[n_times - 1] >= t ? 1.0 : -1.0;
+    while (next < n_times && dir * (t - times[next]) >= 0) {
+      next++;
+      since = 0;
+    }
+    if (flag != stop_flag || push_last) out.push(t, row(t));
+    if (flag == stop_flag) return flag;
+    if (++taken % 4096 == 0) Rcpp::checkUserInterrupt();
+  }
+}
+
+#endif /* STEP_OUTPUT_H */
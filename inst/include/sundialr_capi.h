@@ -61,6 +61,20 @@
  *     sundialr_cvode_reinit(m, t0, y0);       // only when the state jumps
  *     sundialr_cvode_solve (m, tout, y, &tr); // check return < 0
  *   sundialr_cvode_free(m);
+ *
+ * Threads:
+ *   - Handles are independent: each owns its SUNDIALS context, integrator
+ *     memory and error record, and the library keeps no mutable global state -
+ *     the error handler writes only to the record of the handle it belongs to.
+ *     So different handles may be used at the same time from different threads,
+ *     with no locking by the caller.
+ *   - One handle must not be used from two threads at once.
+ *   - Callbacks run on the thread that called solve(). If handles on different
+ *     threads share a udata, the callbacks must be safe to run concurrently on
+ *     it (read-only data is).
+ *   - No entry point calls R, so all of them may be called from threads R does
+ *     not know about. sundialr_cvode_solve_batch() below runs a batch of
+ *     independent problems over threads of its own.
  */
 
 #ifdef __cplusplus
@@ -106,12 +120,138 @@ typedef int (*sundialr_rhs)(double t, const double* y, double* ydot, void* udata
  * storage, so the buffer handed in is the matrix's own data - write it in place. */
 typedef int (*sundialr_jac)(double t, const double* y, double* J, void* udata);
 
+/* --- Callback types for ensembles ------------------------------------------ *
+ * An ensemble handle (sundialr_cvode_create_ensemble() below) integrates K
+ * subjects with the same neq equations together, its state stored
+ * structure-of-arrays: state i of subject k is y[i*K + k]. Its callbacks are
+ * called once for all K subjects, so that a loop over k innermost - over
+ * contiguous memory - can be vectorised. The return convention is the one
+ * above.
+ *
+ * Right-hand side: fill ydot[i*K + k] = d(y[i*K + k])/dt. */
+typedef int (*sundialr_rhs_ensemble)(int K, double t, const double* y,
+                                     double* ydot, void* udata);
+
+/* Jacobian: fill the neq-by-neq block of every subject, element (i, j) of the
+ * block of subject k being J[(i + j*neq)*K + k] = d(ydot[i*K + k])/d(y[j*K + k]).
+ * J is the solver's own storage, zeroed before the call, so only the nonzeros
+ * need writing. With K = 1 the layouts are those of sundialr_rhs and
+ * sundialr_jac. */
+typedef int (*sundialr_jac_ensemble)(int K, double t, const double* y,
+                                     double* J, void* udata);
+
+/* --- Callback types for the R-level solvers -------------------------------- *
+ * Not used by the entry points below; declared here so that compiled models for
+ * ida() and the other R solvers are written against the same header (see
+ * sundialr_xptr.h). The return convention is the one above, and `udata` is the
+ * solver's `Parameters` vector as a double*.                                   */
+
+/* DAE residual: fill r[i] = F_i(t, y, yp), i = 0..neq-1. */
+typedef int (*sundialr_res)(double t, const double* y, const double* yp,
+                            double* r, void* udata);
+
+/* DAE Jacobian: fill J = dF/dy + cj * dF/dyp in COLUMN-MAJOR order, i.e.
+ * J[i + j*neq] = dF_i/dy_j + cj * dF_i/dyp_j, cj being the scalar IDA supplies.
+ * As for sundialr_jac, J is IDA's own dense matrix storage. */
+typedef int (*sundialr_jac_ida)(double t, double cj, const double* y,
+                                const double* yp, double* J, void* udata);
+
+/* Band Jacobians, for a band matrix (the mupper and mlower arguments): fill
+ * the entries within the band, element (i, j), for -mupper <= i - j <= mlower,
+ * being J[(i - j + mupper) + j*ldim]. J is the band matrix's own storage,
+ * zeroed before the call, so only the band is touched and its nonzeros need
+ * writing; ldim is at least mupper + mlower + 1. */
+typedef int (*sundialr_jac_band)(double t, const double* y, double* J,
+                                 int mupper, int mlower, int ldim, void* udata);
+typedef int (*sundialr_jac_ida_band)(double t, double cj, const double* y,
+                                     const double* yp, double* J, int mupper,
+                                     int mlower, int ldim, void* udata);
+
+/* Sparse Jacobians, for a sparse matrix (the sparsity argument): fill x with
+ * the nnz values of the pattern in compressed-column order, column by column
+ * and by row within a column, the diagonal included - the order an R Jacobian
+ * returning a numeric vector uses. x is zeroed before the call. */
+typedef int (*sundialr_jac_sparse)(double t, const double* y, double* x,
+                                   int nnz, void* udata);
+typedef int (*sundialr_jac_ida_sparse)(double t, double cj, const double* y,
+                                       const double* yp, double* x, int nnz,
+                                       void* udata);
+
+/* Forward sensitivity right-hand side for cvodes(), all parameters at once:
+ * fill ySdot[iS][i] = d(yS[iS][i])/dt = (J yS[iS])_i + df_i/dp_iS for
+ * iS = 0..Ns-1, where ydot is f(t, y) as already computed by the solver. */
+typedef int (*sundialr_sens_rhs)(int Ns, double t, const double* y,
+                                 const double* ydot, const double* const* yS,
+                                 double* const* ySdot, void* udata);
+
+/* The same for one parameter, iS (0-based), per call. */
+typedef int (*sundialr_sens_rhs1)(int Ns, double t, const double* y,
+                                  const double* ydot, int iS, const double* yS,
+                                  double* ySdot, void* udata);
+
+/* Krylov linear solvers (cvode(), cvsolve()). The Newton matrix is
+ * M = I - gamma * J, J = d(ydot)/dy at (t, y).
+ *
+ * Jacobian-times-vector: fill Jv = J v. */
+typedef int (*sundialr_jtimes)(double t, const double* y, const double* v,
+                               double* Jv, void* udata);
+
+/* Preconditioner setup, called when the solver updates M. jok is 1 when data
+ * saved from an earlier call may be reused; set *jcur to 1 if J was evaluated
+ * afresh, to 0 if saved data was reused. */
+typedef int (*sundialr_psetup)(double t, const double* y, int jok, int* jcur,
+                               double gamma, void* udata);
+
+/* Preconditioner solve: fill z with the solution of P z = r, P approximating M. */
+typedef int (*sundialr_psolve)(double t, const double* y, const double* r,
+                               double* z, double gamma, void* udata);
+
+/* The same for ida(), whose Newton matrix is M = dF/dy + cj * dF/dyp. */
+typedef int (*sundialr_jtimes_ida)(double t, double cj, const double* y,
+                                   const double* yp, const double* v, double* Jv,
+                                   void* udata);
+typedef int (*sundialr_psetup_ida)(double t, double cj, const double* y,
+                                   const double* yp, void* udata);
+typedef int (*sundialr_psolve_ida)(double t, double cj, const double* y,
+                                   const double* yp, const double* r, double* z,
+                                   void* udata);
+
+/* Observables stored in place of the states by cvode(outputs = ...) and
+ * cvode_batch(): fill out[j], j = 0..n_outputs-1, from the state at an output
+ * time. n_outputs is given with the function to sundialr_xptr_outputs(). */
+typedef int (*sundialr_outputs)(double t, const double* y, double* out,
+                                void* udata);
+
 /* --- Lifecycle ------------------------------------------------------------- */
 
 /* Allocate a handle for a system of neq equations. udata is passed unchanged to
  * every callback. Returns NULL on allocation failure. */
 void* sundialr_cvode_create(int neq, void* udata);
 
+/* Allocate a handle integrating K subjects of neq equations each together, in
+ * lockstep: one CVODE over the neq*K states, laid out as described for
+ * sundialr_rhs_ensemble, whose every step is taken by all the subjects. The
+ * step is sized for the subject that needs the smallest, and accepted only
+ * when every subject passes its own error test, so each is solved to its
+ * tolerance as if alone, while the integrator's overhead is paid once for K
+ * subjects. The Newton matrix is block diagonal, factored subject by subject
+ * with the subjects side by side.
+ *
+ * On an ensemble handle every entry point below takes the same arguments,
+ * except that:
+ *   - the callbacks are set with set_rhs_ensemble() and set_jac_ensemble(),
+ *     not set_rhs() and set_jac(), which return SUNDIALR_CV_ILL_INPUT;
+ *   - without a Jacobian, one is approximated by differences of the whole
+ *     ensemble, one right-hand side evaluation per state (not per state and
+ *     subject);
+ *   - tolerances are given for the neq states and apply to every subject;
+ *   - states passed in and out - y0, y - hold neq*K values, and an item of
+ *     solve_batch() is an ensemble of K subjects;
+ *   - the steps counted are the ensemble's, shared by all its subjects.
+ * A subject that fails fails the step, and so the whole ensemble. Returns
+ * NULL on allocation failure. */
+void* sundialr_cvode_create_ensemble(int neq, int K, void* udata);
+
 /* Release the handle and every SUNDIALS object it owns. NULL-tolerant. */
 void  sundialr_cvode_free(void* m);
 
@@ -124,6 +264,11 @@ int sundialr_cvode_set_rhs(void* m, sundialr_rhs f);
  * finite-difference approximation (the default). */
 int sundialr_cvode_set_jac(void* m, sundialr_jac J);
 
+/* The same for an ensemble handle, with the layouts of sundialr_rhs_ensemble
+ * and sundialr_jac_ensemble. */
+int sundialr_cvode_set_rhs_ensemble(void* m, sundialr_rhs_ensemble f);
+int sundialr_cvode_set_jac_ensemble(void* m, sundialr_jac_ensemble J);
+
 /* Scalar relative and absolute tolerance (CVODE itol == 1). */
 int sundialr_cvode_set_tol_scalar(void* m, double rtol, double atol);
 
@@ -154,9 +299,31 @@ int sundialr_cvode_reinit(void* m, double t0, const double* y0);
  * successful point). */
 int sundialr_cvode_solve(void* m, double tout, double* y, double* treached);
 
+/* --- Batches --------------------------------------------------------------- */
+
+/* Solve n_items independent problems of m's system over n_threads threads (0
+ * for one per core): item k starts at t0 from y0 + k*neq and is solved through
+ * the n_times increasing output times, all after t0, with udata[k] passed to
+ * the callbacks (m's own udata for every item if udata is NULL). The state of
+ * item k at times[i] is written to y + (k*n_times + i)*neq, so y holds
+ * n_items*n_times*neq values. If status is not NULL, status[k] receives the
+ * item's code: 0, or CVODE's negative code when it failed, in which case its
+ * outputs from the failing time on are NaN.
+ *
+ * Each thread solves on its own clone of m, with m's right-hand side,
+ * Jacobian, tolerances and step limits. The clones are kept in m and reused by
+ * later batches; m itself is not advanced. Returns 0 when every item was
+ * solved, otherwise the code of the lowest-numbered failed item, whose message,
+ * prefixed with its (0-based) number, is then m's last_err(). Items fail independently:
+ * one failure does not stop the others. Must not be called on one handle from
+ * two threads at once. */
+int sundialr_cvode_solve_batch(void* m, int n_items, double t0, const double* y0,
+                               void* const* udata, int n_times, const double* times,
+                               double* y, int* status, int n_threads);
+
 /* --- Introspection --------------------------------------------------------- */
 
-/* Total internal steps taken since the first reinit, or -1 if unavailable. */
+/* Internal steps taken since the last reinit, or -1 if unavailable. */
 long sundialr_cvode_get_num_steps(void* m);
 
 /* The message recorded for the most recent failure, or NULL if none. The string
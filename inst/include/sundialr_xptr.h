@@ -0,0 +1,189 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SUNDIALR_XPTR_H
+#define SUNDIALR_XPTR_H
+
+/*
+ * Passing compiled functions to the R solvers.
+ *
+ * cvode() and the other R-level solvers accept, in place of an R function, an
+ * external pointer to a C function with one of the signatures declared in
+ * sundialr_capi.h. SUNDIALS then calls that function directly, with no R in
+ * the loop. The pointer is made with one of the sundialr_xptr_*() helpers
+ * below, which tag it with the name of its signature; the solvers check the tag
+ * before calling through the pointer, so a function of the wrong type is
+ * rejected with an error rather than called with the wrong arguments.
+ *
+ * The `udata` argument of the callback receives a pointer to the values of the
+ * `Parameters` vector passed to the solver, as a double*.
+ *
+ * Typical use, from Rcpp::sourceCpp() or a package with LinkingTo: sundialr:
+ *
+ *   // [[Rcpp::depends(sundialr)]]
+ *   #include <Rcpp.h>
+ *   #include <sundialr_xptr.h>
+ *
+ *   extern "C" int decay(double t, const double* y, double* ydot, void* udata) {
+ *     const double* p = (const double*) udata;
+ *     ydot[0] = -p[0] * y[0];
+ *     return 0;
+ *   }
+ *
+ *   // [[Rcpp::export]]
+ *   SEXP decay_ptr() { return sundialr_xptr_rhs(decay); }
+ *
+ * and in R: cvode(times, IC, decay_ptr(), Parameters).
+ *
+ * The function is called from SUNDIALS' integration loop, so it must not call
+ * back into R, and must not throw; it reports failure through its return
+ * value, as described in sundialr_capi.h.
+ */
+
+#include <string.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+
+#include <sundialr_capi.h>
+
+// Wrap f in an external pointer tagged with `type`, the name of its signature.
+static inline SEXP sundialr_xptr_make(DL_FUNC f, const char *type) {
+  SEXP ptr = PROTECT(R_MakeExternalPtrFn(f, Rf_install(type), R_NilValue));
+  Rf_setAttrib(ptr, R_ClassSymbol, Rf_mkString("sundialr_native"));
+  UNPROTECT(1);
+  return ptr;
+}
+
+static inline SEXP sundialr_xptr_rhs(sundialr_rhs f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_rhs");
+}
+
+static inline SEXP sundialr_xptr_jac(sundialr_jac f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac");
+}
+
+// For cvode_batch(ensemble = K): called once for K sets, with their states,
+// and their parameters as `udata`, structure-of-arrays (see sundialr_capi.h)
+static inline SEXP sundialr_xptr_rhs_ensemble(sundialr_rhs_ensemble f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_rhs_ensemble");
+}
+
+static inline SEXP sundialr_xptr_jac_ensemble(sundialr_jac_ensemble f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac_ensemble");
+}
+
+static inline SEXP sundialr_xptr_res(sundialr_res f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_res");
+}
+
+static inline SEXP sundialr_xptr_jac_ida(sundialr_jac_ida f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac_ida");
+}
+
+// For a band matrix, written into its storage rather than as n-by-n
+static inline SEXP sundialr_xptr_jac_band(sundialr_jac_band f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac_band");
+}
+
+static inline SEXP sundialr_xptr_jac_ida_band(sundialr_jac_ida_band f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac_ida_band");
+}
+
+// For a sparse matrix, written as the values of its pattern
+static inline SEXP sundialr_xptr_jac_sparse(sundialr_jac_sparse f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac_sparse");
+}
+
+static inline SEXP sundialr_xptr_jac_ida_sparse(sundialr_jac_ida_sparse f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jac_ida_sparse");
+}
+
+static inline SEXP sundialr_xptr_sens_rhs(sundialr_sens_rhs f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_sens_rhs");
+}
+
+static inline SEXP sundialr_xptr_sens_rhs1(sundialr_sens_rhs1 f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_sens_rhs1");
+}
+
+static inline SEXP sundialr_xptr_jtimes(sundialr_jtimes f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jtimes");
+}
+
+static inline SEXP sundialr_xptr_psetup(sundialr_psetup f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_psetup");
+}
+
+static inline SEXP sundialr_xptr_psolve(sundialr_psolve f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_psolve");
+}
+
+static inline SEXP sundialr_xptr_jtimes_ida(sundialr_jtimes_ida f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_jtimes_ida");
+}
+
+static inline SEXP sundialr_xptr_psetup_ida(sundialr_psetup_ida f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_psetup_ida");
+}
+
+static inline SEXP sundialr_xptr_psolve_ida(sundialr_psolve_ida f) {
+  return sundialr_xptr_make((DL_FUNC) f, "sundialr_psolve_ida");
+}
+
+// For cvode(outputs = ...) and cvode_batch(): n_outputs, the number of values
+// f fills, is kept with the pointer
+static inline SEXP sundialr_xptr_outputs(sundialr_outputs f, int n_outputs) {
+  SEXP n = PROTECT(Rf_ScalarInteger(n_outputs));
+  SEXP ptr = PROTECT(R_MakeExternalPtrFn((DL_FUNC) f, Rf_install("sundialr_outputs"), n));
+  Rf_setAttrib(ptr, R_ClassSymbol, Rf_mkString("sundialr_native"));
+  UNPROTECT(2);
+  return ptr;
+}
+
+// The name a pointer made by sundialr_xptr_make() was tagged with, or NULL if
+// x is not such a pointer.
+static inline const char *sundialr_xptr_type(SEXP x) {
+  if (TYPEOF(x) != EXTPTRSXP) return NULL;
+  SEXP tag = R_ExternalPtrTag(x);
+  if (TYPEOF(tag) != SYMSXP) return NULL;
+  return CHAR(PRINTNAME(tag));
+}
+
+// The function in x if it is tagged `type`, otherwise NULL. Used by the
+// solvers, which turn NULL into an error naming the expected signature. An
+// external pointer does not survive saving and reloading an R session, and
+// comes back as NULL here too.
+static inline DL_FUNC sundialr_xptr_get(SEXP x, const char *type) {
+  const char *tag = sundialr_xptr_type(x);
+  if (tag == NULL || strcmp(tag, type) != 0) return NULL;
+  return R_ExternalPtrAddrFn(x);
+}
+
+#endif /* SUNDIALR_XPTR_H */
@@ -0,0 +1,33 @@
+// File: sunlinsol_lapack_dense.h
+
+#ifndef SUNLINSOL_LAPACK_DENSE_H
+#define SUNLINSOL_LAPACK_DENSE_H
+
+// A dense direct SUNLinearSolver that factors with R's own LAPACK (dgetrf and
+// dgetrs), and so with whatever BLAS R is linked against. With an optimised
+// BLAS such as OpenBLAS or MKL the blocked, multithreaded factorisation is much
+// faster than SUNDIALS' own dense LU for systems of more than a few dozen
+// states; with R's reference BLAS it does the same work as that LU.
+//
+// SUNDIALS has a LAPACK dense solver of its own, but it must find a LAPACK
+// when SUNDIALS itself is configured, which need not be the one R uses; this
+// one is compiled with the package and links against R's LAPACK_LIBS.
+//
+// configure defines SUNDIALR_HAVE_LAPACK when a program calling dgetrf links
+// against R's LAPACK. Without it SUNLinSol_RLapackDense() returns NULL, and
+// sundialr_has_lapack() false.
+//
+// setup() returns SUNLS_LUFACT_FAIL, which SUNDIALS treats as recoverable, when
+// the matrix is singular.
+//
+// Prerequisites: nvector_serial.h, sunmatrix_dense.h
+
+#include <sundials/sundials_linearsolver.h>
+
+// A is a square dense SUNMatrix of the length of y
+SUNLinearSolver SUNLinSol_RLapackDense(N_Vector y, SUNMatrix A, SUNContext sunctx);
+
+// true when the package was built with SUNDIALR_HAVE_LAPACK
+bool sundialr_has_lapack();
+
+#endif /* SUNLINSOL_LAPACK_DENSE_H */
@@ -0,0 +1,32 @@
+// File: sunlinsol_small_dense.h
+
+#ifndef SUNLINSOL_SMALL_DENSE_H
+#define SUNLINSOL_SMALL_DENSE_H
+
+// A dense direct SUNLinearSolver for systems of at most SMALL_DENSE_MAX
+// states, which is what most ODE models are. SUNDIALS' dense solver runs LU
+// loops whose bounds are known only at run time, over the column pointers of
+// the matrix; this one is a template on the size, instantiated for every n up
+// to SMALL_DENSE_MAX, so every loop has a constant bound and the compiler
+// unrolls it, and the factorisation and solve work on arrays on the stack.
+//
+// It takes the same SUNDenseMatrix as SUNDIALS' dense solver, so the Jacobian
+// is filled as before - by CVODE's and IDA's own difference quotients or by a
+// Jacobian function - and only the factorisation changes. That is LU with
+// partial pivoting in the same order of operations as SUNDIALS' denseGETRF
+// and denseGETRS, so the two give the same factors and solutions.
+//
+// setup() returns SUNLS_LUFACT_FAIL, which SUNDIALS treats as recoverable, when
+// the matrix is singular.
+//
+// Prerequisites: nvector_serial.h, sunmatrix_dense.h
+
+#include <sundials/sundials_linearsolver.h>
+
+#define SMALL_DENSE_MAX 16
+
+// A is a square dense SUNMatrix of the length of y, at most SMALL_DENSE_MAX;
+// NULL for a larger one
+SUNLinearSolver SUNLinSol_SmallDense(N_Vector y, SUNMatrix A, SUNContext sunctx);
+
+#endif /* SUNLINSOL_SMALL_DENSE_H */
@@ -0,0 +1,32 @@
+// File: sunlinsol_sparse_lu.h
+
+#ifndef SUNLINSOL_SPARSE_LU_H
+#define SUNLINSOL_SPARSE_LU_H
+
+// A sparse direct SUNLinearSolver, bundled with the package so that a sparse
+// Jacobian needs no external library (SUNDIALS' own sparse direct solvers wrap
+// KLU or SuperLU, which are not part of SUNDIALS).
+//
+// It factors a CSC SUNSparseMatrix as P A Q = L U with the left-looking
+// Gilbert-Peierls algorithm, which computes each column of L and U by a sparse
+// triangular solve whose nonzero pattern is found by a depth-first search, so
+// the work is proportional to the floating-point operations rather than to n^2.
+// Q is a minimum-degree ordering of the pattern of A + A', computed at the
+// first setup and again only when the pattern changes; P comes from partial
+// pivoting that prefers the diagonal whenever it is within a factor
+// SPARSE_LU_PIVOT_TOL of the largest candidate, as the Newton matrices of a
+// stiff solver are usually close to diagonally dominant.
+//
+// setup() returns SUNLS_LUFACT_FAIL, which SUNDIALS treats as recoverable, when
+// the matrix is singular.
+//
+// Prerequisites: nvector_serial.h, sunmatrix_sparse.h
+
+#include <sundials/sundials_linearsolver.h>
+
+#define SPARSE_LU_PIVOT_TOL 0.1
+
+// A is a square CSC SUNSparseMatrix of the length of y
+SUNLinearSolver SUNLinSol_SparseLU(N_Vector y, SUNMatrix A, SUNContext sunctx);
+
+#endif /* SUNLINSOL_SPARSE_LU_H */
@@ -11,6 +11,34 @@ Rcpp::Rostream<true>&  Rcpp::Rcout = Rcpp::Rcpp_cout_get();
 Rcpp::Rostream<false>& Rcpp::Rcerr = Rcpp::Rcpp_cerr_get();
 #endif
 
+// bench_xptr
+List bench_xptr(std::string name);
+RcppExport SEXP _sundialr_bench_xptr(SEXP nameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type name(nameSEXP);
+    rcpp_result_gen = Rcpp::wrap(bench_xptr(name));
+    return rcpp_result_gen;
+END_RCPP
+}
+// bench_capi
+List bench_capi(std::string name, NumericVector times, NumericVector IC, NumericVector Parameters, double rtol, NumericVector atol, bool jacobian);
+RcppExport SEXP _sundialr_bench_capi(SEXP nameSEXP, SEXP timesSEXP, SEXP ICSEXP, SEXP ParametersSEXP, SEXP rtolSEXP, SEXP atolSEXP, SEXP jacobianSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type name(nameSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type times(timesSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type IC(ICSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type Parameters(ParametersSEXP);
+    Rcpp::traits::input_parameter< double >::type rtol(rtolSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type atol(atolSEXP);
+    Rcpp::traits::input_parameter< bool >::type jacobian(jacobianSEXP);
+    rcpp_result_gen = Rcpp::wrap(bench_capi(name, times, IC, Parameters, rtol, atol, jacobian));
+    return rcpp_result_gen;
+END_RCPP
+}
 // register_capi
 void register_capi();
 RcppExport SEXP _sundialr_register_capi() {
@@ -93,9 +121,52 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// capi_test_threads
+double capi_test_threads(int n_threads, int rounds);
+RcppExport SEXP _sundialr_capi_test_threads(SEXP n_threadsSEXP, SEXP roundsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type rounds(roundsSEXP);
+    rcpp_result_gen = Rcpp::wrap(capi_test_threads(n_threads, rounds));
+    return rcpp_result_gen;
+END_RCPP
+}
+// capi_test_batch
+List capi_test_batch(NumericVector times, NumericVector y10, NumericVector k1, double k2, bool use_jac, int n_threads);
+RcppExport SEXP _sundialr_capi_test_batch(SEXP timesSEXP, SEXP y10SEXP, SEXP k1SEXP, SEXP k2SEXP, SEXP use_jacSEXP, SEXP n_threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type times(timesSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type y10(y10SEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type k1(k1SEXP);
+    Rcpp::traits::input_parameter< double >::type k2(k2SEXP);
+    Rcpp::traits::input_parameter< bool >::type use_jac(use_jacSEXP);
+    Rcpp::traits::input_parameter< int >::type n_threads(n_threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(capi_test_batch(times, y10, k1, k2, use_jac, n_threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// capi_test_ensemble
+List capi_test_ensemble(NumericVector times, NumericVector y10, NumericVector k1, double k2, bool use_jac);
+RcppExport SEXP _sundialr_capi_test_ensemble(SEXP timesSEXP, SEXP y10SEXP, SEXP k1SEXP, SEXP k2SEXP, SEXP use_jacSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type times(timesSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type y10(y10SEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type k1(k1SEXP);
+    Rcpp::traits::input_parameter< double >::type k2(k2SEXP);
+    Rcpp::traits::input_parameter< bool >::type use_jac(use_jacSEXP);
+    rcpp_result_gen = Rcpp::wrap(capi_test_ensemble(times, y10, k1, k2, use_jac));
+    return rcpp_result_gen;
+END_RCPP
+}
 // cvode
-NumericMatrix cvode(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, Nullable<Function> jacobian);
-RcppExport SEXP _sundialr_cvode(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP) {
+NumericMatrix cvode(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, SEXP jacobian, SEXP mupper, SEXP mlower, SEXP sparsity, SEXP linear_solver, SEXP jtimes, SEXP psetup, SEXP psolve, bool stats, bool profile, bool dense_output, std::string output, SEXP max_rows, SEXP outputs);
+RcppExport SEXP _sundialr_cvode(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP, SEXP mupperSEXP, SEXP mlowerSEXP, SEXP sparsitySEXP, SEXP linear_solverSEXP, SEXP jtimesSEXP, SEXP psetupSEXP, SEXP psolveSEXP, SEXP statsSEXP, SEXP profileSEXP, SEXP dense_outputSEXP, SEXP outputSEXP, SEXP max_rowsSEXP, SEXP outputsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -105,14 +176,98 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< NumericVector >::type Parameters(ParametersSEXP);
     Rcpp::traits::input_parameter< double >::type reltolerance(reltoleranceSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type abstolerance(abstoleranceSEXP);
-    Rcpp::traits::input_parameter< Nullable<Function> >::type jacobian(jacobianSEXP);
-    rcpp_result_gen = Rcpp::wrap(cvode(time_vector, IC, input_function, Parameters, reltolerance, abstolerance, jacobian));
+    Rcpp::traits::input_parameter< SEXP >::type jacobian(jacobianSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mupper(mupperSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mlower(mlowerSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sparsity(sparsitySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type linear_solver(linear_solverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type jtimes(jtimesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psetup(psetupSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psolve(psolveSEXP);
+    Rcpp::traits::input_parameter< bool >::type stats(statsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< bool >::type dense_output(dense_outputSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type max_rows(max_rowsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type outputs(outputsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cvode(time_vector, IC, input_function, Parameters, reltolerance, abstolerance, jacobian, mupper, mlower, sparsity, linear_solver, jtimes, psetup, psolve, stats, profile, dense_output, output, max_rows, outputs));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cvode_batch
+NumericVector cvode_batch(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, SEXP jacobian, int threads, SEXP cost, int ensemble, SEXP outputs);
+RcppExport SEXP _sundialr_cvode_batch(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP, SEXP threadsSEXP, SEXP costSEXP, SEXP ensembleSEXP, SEXP outputsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type time_vector(time_vectorSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type IC(ICSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type input_function(input_functionSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type Parameters(ParametersSEXP);
+    Rcpp::traits::input_parameter< double >::type reltolerance(reltoleranceSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type abstolerance(abstoleranceSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type jacobian(jacobianSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type cost(costSEXP);
+    Rcpp::traits::input_parameter< int >::type ensemble(ensembleSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type outputs(outputsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cvode_batch(time_vector, IC, input_function, Parameters, reltolerance, abstolerance, jacobian, threads, cost, ensemble, outputs));
+    return rcpp_result_gen;
+END_RCPP
+}
+// cvode_solver
+SEXP cvode_solver(double t0, NumericVector IC, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, SEXP jacobian, SEXP mupper, SEXP mlower, SEXP sparsity, SEXP linear_solver, SEXP jtimes, SEXP psetup, SEXP psolve);
+RcppExport SEXP _sundialr_cvode_solver(SEXP t0SEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP, SEXP mupperSEXP, SEXP mlowerSEXP, SEXP sparsitySEXP, SEXP linear_solverSEXP, SEXP jtimesSEXP, SEXP psetupSEXP, SEXP psolveSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< double >::type t0(t0SEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type IC(ICSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type input_function(input_functionSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type Parameters(ParametersSEXP);
+    Rcpp::traits::input_parameter< double >::type reltolerance(reltoleranceSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type abstolerance(abstoleranceSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type jacobian(jacobianSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mupper(mupperSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mlower(mlowerSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sparsity(sparsitySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type linear_solver(linear_solverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type jtimes(jtimesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psetup(psetupSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psolve(psolveSEXP);
+    rcpp_result_gen = Rcpp::wrap(cvode_solver(t0, IC, input_function, Parameters, reltolerance, abstolerance, jacobian, mupper, mlower, sparsity, linear_solver, jtimes, psetup, psolve));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solver_reinit
+SEXP solver_reinit(SEXP solver, double t0, NumericVector IC, SEXP Parameters);
+RcppExport SEXP _sundialr_solver_reinit(SEXP solverSEXP, SEXP t0SEXP, SEXP ICSEXP, SEXP ParametersSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type solver(solverSEXP);
+    Rcpp::traits::input_parameter< double >::type t0(t0SEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type IC(ICSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type Parameters(ParametersSEXP);
+    rcpp_result_gen = Rcpp::wrap(solver_reinit(solver, t0, IC, Parameters));
+    return rcpp_result_gen;
+END_RCPP
+}
+// solver_solve
+NumericMatrix solver_solve(SEXP solver, NumericVector time_vector);
+RcppExport SEXP _sundialr_solver_solve(SEXP solverSEXP, SEXP time_vectorSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type solver(solverSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type time_vector(time_vectorSEXP);
+    rcpp_result_gen = Rcpp::wrap(solver_solve(solver, time_vector));
     return rcpp_result_gen;
 END_RCPP
 }
 // cvodes
-NumericMatrix cvodes(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, std::string SensType, bool ErrCon, Nullable<Function> jacobian, Nullable<Function> sensitivity);
-RcppExport SEXP _sundialr_cvodes(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP SensTypeSEXP, SEXP ErrConSEXP, SEXP jacobianSEXP, SEXP sensitivitySEXP) {
+NumericMatrix cvodes(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, std::string SensType, bool ErrCon, SEXP jacobian, SEXP sensitivity, bool stats, bool profile);
+RcppExport SEXP _sundialr_cvodes(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP SensTypeSEXP, SEXP ErrConSEXP, SEXP jacobianSEXP, SEXP sensitivitySEXP, SEXP statsSEXP, SEXP profileSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -124,15 +279,17 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< NumericVector >::type abstolerance(abstoleranceSEXP);
     Rcpp::traits::input_parameter< std::string >::type SensType(SensTypeSEXP);
     Rcpp::traits::input_parameter< bool >::type ErrCon(ErrConSEXP);
-    Rcpp::traits::input_parameter< Nullable<Function> >::type jacobian(jacobianSEXP);
-    Rcpp::traits::input_parameter< Nullable<Function> >::type sensitivity(sensitivitySEXP);
-    rcpp_result_gen = Rcpp::wrap(cvodes(time_vector, IC, input_function, Parameters, reltolerance, abstolerance, SensType, ErrCon, jacobian, sensitivity));
+    Rcpp::traits::input_parameter< SEXP >::type jacobian(jacobianSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sensitivity(sensitivitySEXP);
+    Rcpp::traits::input_parameter< bool >::type stats(statsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    rcpp_result_gen = Rcpp::wrap(cvodes(time_vector, IC, input_function, Parameters, reltolerance, abstolerance, SensType, ErrCon, jacobian, sensitivity, stats, profile));
     return rcpp_result_gen;
 END_RCPP
 }
 // cvsolve
-NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, Nullable<DataFrame> Events, double reltolerance, NumericVector abstolerance, Nullable<Function> jacobian);
-RcppExport SEXP _sundialr_cvsolve(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP EventsSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP) {
+NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC, SEXP input_function, NumericVector Parameters, Nullable<DataFrame> Events, double reltolerance, NumericVector abstolerance, SEXP jacobian, SEXP mupper, SEXP mlower, SEXP sparsity, SEXP linear_solver, SEXP jtimes, SEXP psetup, SEXP psolve, bool stats, bool profile, std::string output, SEXP max_rows);
+RcppExport SEXP _sundialr_cvsolve(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP EventsSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP, SEXP mupperSEXP, SEXP mlowerSEXP, SEXP sparsitySEXP, SEXP linear_solverSEXP, SEXP jtimesSEXP, SEXP psetupSEXP, SEXP psolveSEXP, SEXP statsSEXP, SEXP profileSEXP, SEXP outputSEXP, SEXP max_rowsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -143,14 +300,51 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< Nullable<DataFrame> >::type Events(EventsSEXP);
     Rcpp::traits::input_parameter< double >::type reltolerance(reltoleranceSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type abstolerance(abstoleranceSEXP);
-    Rcpp::traits::input_parameter< Nullable<Function> >::type jacobian(jacobianSEXP);
-    rcpp_result_gen = Rcpp::wrap(cvsolve(time_vector, IC, input_function, Parameters, Events, reltolerance, abstolerance, jacobian));
+    Rcpp::traits::input_parameter< SEXP >::type jacobian(jacobianSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mupper(mupperSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mlower(mlowerSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sparsity(sparsitySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type linear_solver(linear_solverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type jtimes(jtimesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psetup(psetupSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psolve(psolveSEXP);
+    Rcpp::traits::input_parameter< bool >::type stats(statsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type max_rows(max_rowsSEXP);
+    rcpp_result_gen = Rcpp::wrap(cvsolve(time_vector, IC, input_function, Parameters, Events, reltolerance, abstolerance, jacobian, mupper, mlower, sparsity, linear_solver, jtimes, psetup, psolve, stats, profile, output, max_rows));
+    return rcpp_result_gen;
+END_RCPP
+}
+// dense_eval
+NumericMatrix dense_eval(SEXP solution, NumericVector times, int deriv);
+RcppExport SEXP _sundialr_dense_eval(SEXP solutionSEXP, SEXP timesSEXP, SEXP derivSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< SEXP >::type solution(solutionSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type times(timesSEXP);
+    Rcpp::traits::input_parameter< int >::type deriv(derivSEXP);
+    rcpp_result_gen = Rcpp::wrap(dense_eval(solution, times, deriv));
+    return rcpp_result_gen;
+END_RCPP
+}
+// ode_model
+SEXP ode_model(List equations, Nullable<CharacterVector> parameters, bool jacobian);
+RcppExport SEXP _sundialr_ode_model(SEXP equationsSEXP, SEXP parametersSEXP, SEXP jacobianSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< List >::type equations(equationsSEXP);
+    Rcpp::traits::input_parameter< Nullable<CharacterVector> >::type parameters(parametersSEXP);
+    Rcpp::traits::input_parameter< bool >::type jacobian(jacobianSEXP);
+    rcpp_result_gen = Rcpp::wrap(ode_model(equations, parameters, jacobian));
     return rcpp_result_gen;
 END_RCPP
 }
 // ida
-NumericMatrix ida(NumericVector time_vector, NumericVector IC, NumericVector IRes, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, Nullable<Function> jacobian);
-RcppExport SEXP _sundialr_ida(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP IResSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP) {
+NumericMatrix ida(NumericVector time_vector, NumericVector IC, NumericVector IRes, SEXP input_function, NumericVector Parameters, double reltolerance, NumericVector abstolerance, SEXP jacobian, SEXP mupper, SEXP mlower, SEXP sparsity, SEXP linear_solver, SEXP jtimes, SEXP psetup, SEXP psolve, bool stats, bool profile, std::string output, SEXP max_rows);
+RcppExport SEXP _sundialr_ida(SEXP time_vectorSEXP, SEXP ICSEXP, SEXP IResSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP reltoleranceSEXP, SEXP abstoleranceSEXP, SEXP jacobianSEXP, SEXP mupperSEXP, SEXP mlowerSEXP, SEXP sparsitySEXP, SEXP linear_solverSEXP, SEXP jtimesSEXP, SEXP psetupSEXP, SEXP psolveSEXP, SEXP statsSEXP, SEXP profileSEXP, SEXP outputSEXP, SEXP max_rowsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -161,13 +355,75 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< NumericVector >::type Parameters(ParametersSEXP);
     Rcpp::traits::input_parameter< double >::type reltolerance(reltoleranceSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type abstolerance(abstoleranceSEXP);
-    Rcpp::traits::input_parameter< Nullable<Function> >::type jacobian(jacobianSEXP);
-    rcpp_result_gen = Rcpp::wrap(ida(time_vector, IC, IRes, input_function, Parameters, reltolerance, abstolerance, jacobian));
+    Rcpp::traits::input_parameter< SEXP >::type jacobian(jacobianSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mupper(mupperSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type mlower(mlowerSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type sparsity(sparsitySEXP);
+    Rcpp::traits::input_parameter< SEXP >::type linear_solver(linear_solverSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type jtimes(jtimesSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psetup(psetupSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type psolve(psolveSEXP);
+    Rcpp::traits::input_parameter< bool >::type stats(statsSEXP);
+    Rcpp::traits::input_parameter< bool >::type profile(profileSEXP);
+    Rcpp::traits::input_parameter< std::string >::type output(outputSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type max_rows(max_rowsSEXP);
+    rcpp_result_gen = Rcpp::wrap(ida(time_vector, IC, IRes, input_function, Parameters, reltolerance, abstolerance, jacobian, mupper, mlower, sparsity, linear_solver, jtimes, psetup, psolve, stats, profile, output, max_rows));
+    return rcpp_result_gen;
+END_RCPP
+}
+// native_test_xptr
+SEXP native_test_xptr(std::string name);
+RcppExport SEXP _sundialr_native_test_xptr(SEXP nameSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< std::string >::type name(nameSEXP);
+    rcpp_result_gen = Rcpp::wrap(native_test_xptr(name));
+    return rcpp_result_gen;
+END_RCPP
+}
+// small_dense_test
+List small_dense_test(NumericMatrix A, NumericVector b);
+RcppExport SEXP _sundialr_small_dense_test(SEXP ASEXP, SEXP bSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericMatrix >::type A(ASEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type b(bSEXP);
+    rcpp_result_gen = Rcpp::wrap(small_dense_test(A, b));
+    return rcpp_result_gen;
+END_RCPP
+}
+// detect_sparsity
+List detect_sparsity(NumericVector IC, SEXP input_function, NumericVector Parameters, SEXP IRes, int samples, double time);
+RcppExport SEXP _sundialr_detect_sparsity(SEXP ICSEXP, SEXP input_functionSEXP, SEXP ParametersSEXP, SEXP IResSEXP, SEXP samplesSEXP, SEXP timeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< NumericVector >::type IC(ICSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type input_function(input_functionSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type Parameters(ParametersSEXP);
+    Rcpp::traits::input_parameter< SEXP >::type IRes(IResSEXP);
+    Rcpp::traits::input_parameter< int >::type samples(samplesSEXP);
+    Rcpp::traits::input_parameter< double >::type time(timeSEXP);
+    rcpp_result_gen = Rcpp::wrap(detect_sparsity(IC, input_function, Parameters, IRes, samples, time));
+    return rcpp_result_gen;
+END_RCPP
+}
+// sundialr_has_lapack
+bool sundialr_has_lapack();
+RcppExport SEXP _sundialr_sundialr_has_lapack() {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    rcpp_result_gen = Rcpp::wrap(sundialr_has_lapack());
     return rcpp_result_gen;
 END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
+    {"_sundialr_bench_xptr", (DL_FUNC) &_sundialr_bench_xptr, 1},
+    {"_sundialr_bench_capi", (DL_FUNC) &_sundialr_bench_capi, 7},
     {"_sundialr_register_capi", (DL_FUNC) &_sundialr_register_capi, 0},
     {"_sundialr_capi_test_decay", (DL_FUNC) &_sundialr_capi_test_decay, 5},
     {"_sundialr_capi_test_twocmt", (DL_FUNC) &_sundialr_capi_test_twocmt, 5},
@@ -175,10 +431,23 @@ static const R_CallMethodDef CallEntries[] = {
     {"_sundialr_capi_test_num_steps", (DL_FUNC) &_sundialr_capi_test_num_steps, 3},
     {"_sundialr_capi_test_clean_err", (DL_FUNC) &_sundialr_capi_test_clean_err, 0},
     {"_sundialr_capi_test_abi", (DL_FUNC) &_sundialr_capi_test_abi, 0},
-    {"_sundialr_cvode", (DL_FUNC) &_sundialr_cvode, 7},
-    {"_sundialr_cvodes", (DL_FUNC) &_sundialr_cvodes, 10},
-    {"_sundialr_cvsolve", (DL_FUNC) &_sundialr_cvsolve, 8},
-    {"_sundialr_ida", (DL_FUNC) &_sundialr_ida, 8},
+    {"_sundialr_capi_test_threads", (DL_FUNC) &_sundialr_capi_test_threads, 2},
+    {"_sundialr_capi_test_batch", (DL_FUNC) &_sundialr_capi_test_batch, 6},
+    {"_sundialr_capi_test_ensemble", (DL_FUNC) &_sundialr_capi_test_ensemble, 5},
+    {"_sundialr_cvode", (DL_FUNC) &_sundialr_cvode, 20},
+    {"_sundialr_cvode_batch", (DL_FUNC) &_sundialr_cvode_batch, 11},
+    {"_sundialr_cvode_solver", (DL_FUNC) &_sundialr_cvode_solver, 14},
+    {"_sundialr_solver_reinit", (DL_FUNC) &_sundialr_solver_reinit, 4},
+    {"_sundialr_solver_solve", (DL_FUNC) &_sundialr_solver_solve, 2},
+    {"_sundialr_cvodes", (DL_FUNC) &_sundialr_cvodes, 12},
+    {"_sundialr_cvsolve", (DL_FUNC) &_sundialr_cvsolve, 19},
+    {"_sundialr_dense_eval", (DL_FUNC) &_sundialr_dense_eval, 3},
+    {"_sundialr_ode_model", (DL_FUNC) &_sundialr_ode_model, 3},
+    {"_sundialr_ida", (DL_FUNC) &_sundialr_ida, 19},
+    {"_sundialr_native_test_xptr", (DL_FUNC) &_sundialr_native_test_xptr, 1},
+    {"_sundialr_small_dense_test", (DL_FUNC) &_sundialr_small_dense_test, 2},
+    {"_sundialr_detect_sparsity", (DL_FUNC) &_sundialr_detect_sparsity, 6},
+    {"_sundialr_sundialr_has_lapack", (DL_FUNC) &_sundialr_sundialr_has_lapack, 0},
     {NULL, NULL, 0}
 };
 
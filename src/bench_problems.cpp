@@ -0,0 +1,419 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Compiled forms of the stiff benchmark problems of
+// inst/benchmarks/stiff_problems.R, which defines each one again as R closures
+// together with its initial conditions, parameters and reference solution.
+// inst/benchmarks/stiff_suite.R runs both forms through the R solvers and the
+// C API and compares them.
+//
+// Every function reads its constants from udata, the solver's Parameters, so
+// that cvodes() can perturb them, and a problem whose size is not fixed
+// (Brusselator, the PK population) carries its size as the first or last
+// parameter. The residuals for ida() and their Jacobians are made from the
+// right-hand sides by the adapters below, as F(t, y, y') = f(t, y) - y'.
+//
+// The R wrappers are named ".bench_*": the leading dot keeps them out of the
+// package namespace (exportPattern only exports alpha-initial names), so they
+// ship without being user-visible and need no documentation for R CMD check.
+
+#include <Rcpp.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <sundialr_capi.h>
+#include <sundialr_xptr.h>
+
+using namespace Rcpp;
+
+// --- Right-hand sides and Jacobians (C linkage, as in native_test.cpp) -------
+extern "C" {
+
+// Robertson chemical kinetics; p = (0.04, 1e4, 3e7)
+static int bench_robertson_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  ydot[0] = -p[0]*y[0] + p[1]*y[1]*y[2];
+  ydot[2] =  p[2]*y[1]*y[1];
+  ydot[1] = -ydot[0] - ydot[2];
+  return 0;
+}
+
+static int bench_robertson_jac(double t, const double* y, double* J, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  J[0] = -p[0];  J[3] =  p[1]*y[2];                  J[6] =  p[1]*y[1];
+  J[1] =  p[0];  J[4] = -p[1]*y[2] - 2.0*p[2]*y[1];  J[7] = -p[1]*y[1];
+  J[2] =  0.0;   J[5] =  2.0*p[2]*y[1];              J[8] =  0.0;
+  return 0;
+}
+
+// HIRES, the plant physiology model of Schaefer (1975); p holds its twelve
+// distinct rate constants, 1.71, 0.43, 8.32, 0.0007, 8.75, 10.03, 0.035, 1.12,
+// 1.745, 280, 0.69 and 1.81
+static int bench_hires_rhs(double t, const double* y, double* f, void* udata) {
+  (void) t;
+  const double* k = (const double*) udata;
+  f[0] = -k[0]*y[0] + k[1]*y[1] + k[2]*y[2] + k[3];
+  f[1] =  k[0]*y[0] - k[4]*y[1];
+  f[2] = -k[5]*y[2] + k[1]*y[3] + k[6]*y[4];
+  f[3] =  k[2]*y[1] + k[0]*y[2] - k[7]*y[3];
+  f[4] = -k[8]*y[4] + k[1]*y[5] + k[1]*y[6];
+  f[5] = -k[9]*y[5]*y[7] + k[10]*y[3] + k[0]*y[4] - k[1]*y[5] + k[10]*y[6];
+  f[6] =  k[9]*y[5]*y[7] - k[11]*y[6];
+  f[7] = -f[6];
+  return 0;
+}
+
+static int bench_hires_jac(double t, const double* y, double* J, void* udata) {
+  (void) t;
+  const double* k = (const double*) udata;
+  for (int i = 0; i < 64; i++) J[i] = 0.0;
+#define JH(i, j) J[(i) + 8*(j)]
+  JH(0, 0) = -k[0];  JH(0, 1) =  k[1];  JH(0, 2) = k[2];
+  JH(1, 0) =  k[0];  JH(1, 1) = -k[4];
+  JH(2, 2) = -k[5];  JH(2, 3) =  k[1];  JH(2, 4) = k[6];
+  JH(3, 1) =  k[2];  JH(3, 2) =  k[0];  JH(3, 3) = -k[7];
+  JH(4, 4) = -k[8];  JH(4, 5) =  k[1];  JH(4, 6) = k[1];
+  JH(5, 3) = k[10];  JH(5, 4) = k[0];   JH(5, 5) = -k[9]*y[7] - k[1];
+  JH(5, 6) = k[10];  JH(5, 7) = -k[9]*y[5];
+  JH(6, 5) =  k[9]*y[7];  JH(6, 6) = -k[11];  JH(6, 7) =  k[9]*y[5];
+  JH(7, 5) = -k[9]*y[7];  JH(7, 6) =  k[11];  JH(7, 7) = -k[9]*y[5];
+#undef JH
+  return 0;
+}
+
+// Pollution, the air pollution model of Verwer (1994): 20 species in 25
+// reactions whose rate constants are p
+static int bench_pollution_rhs(double t, const double* y, double* d, void* udata) {
+  (void) t;
+  const double* k = (const double*) udata;
+  double r[25];
+  r[0]  = k[0]*y[0];        r[1]  = k[1]*y[1]*y[3];   r[2]  = k[2]*y[4]*y[1];
+  r[3]  = k[3]*y[6];        r[4]  = k[4]*y[6];        r[5]  = k[5]*y[6]*y[5];
+  r[6]  = k[6]*y[8];        r[7]  = k[7]*y[8]*y[5];   r[8]  = k[8]*y[10]*y[1];
+  r[9]  = k[9]*y[10]*y[0];  r[10] = k[10]*y[12];      r[11] = k[11]*y[9]*y[1];
+  r[12] = k[12]*y[13];      r[13] = k[13]*y[0]*y[5];  r[14] = k[14]*y[2];
+  r[15] = k[15]*y[3];       r[16] = k[16]*y[3];       r[17] = k[17]*y[15];
+  r[18] = k[18]*y[15];      r[19] = k[19]*y[16]*y[5]; r[20] = k[20]*y[18];
+  r[21] = k[21]*y[18];      r[22] = k[22]*y[0]*y[3];  r[23] = k[23]*y[18]*y[0];
+  r[24] = k[24]*y[19];
+  d[0]  = -r[0] - r[9] - r[13] - r[22] - r[23] + r[1] + r[2] + r[8] + r[10] + r[11] +
+           r[21] + r[24];
+  d[1]  = -r[1] - r[2] - r[8] - r[11] + r[0] + r[20];
+  d[2]  = -r[14] + r[0] + r[16] + r[18] + r[21];
+  d[3]  = -r[1] - r[15] - r[16] - r[22] + r[14];
+  d[4]  = -r[2] + 2.0*r[3] + r[5] + r[6] + r[12] + r[19];
+  d[5]  = -r[5] - r[7] - r[13] - r[19] + r[2] + 2.0*r[17];
+  d[6]  = -r[3] - r[4] - r[5] + r[12];
+  d[7]  =  r[3] + r[4] + r[5] + r[6];
+  d[8]  = -r[6] - r[7];
+  d[9]  = -r[11] + r[6] + r[8];
+  d[10] = -r[8] - r[9] + r[7] + r[10];
+  d[11] =  r[8];
+  d[12] = -r[10] + r[9];
+  d[13] = -r[12] + r[11];
+  d[14] =  r[13];
+  d[15] = -r[17] - r[18] + r[15];
+  d[16] = -r[19];
+  d[17] =  r[19];
+  d[18] = -r[20] - r[21] - r[23] + r[22] + r[24];
+  d[19] = -r[24] + r[23];
+  return 0;
+}
+
+// Van der Pol's oscillator in the Test Set's stiff scaling, y1'' =
+// ((1 - y1^2) y1' - y1) / eps; p = eps
+static int bench_vdp_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  double eps = *((const double*) udata);
+  ydot[0] = y[1];
+  ydot[1] = ((1.0 - y[0]*y[0])*y[1] - y[0])/eps;
+  return 0;
+}
+
+static int bench_vdp_jac(double t, const double* y, double* J, void* udata) {
+  (void) t;
+  double eps = *((const double*) udata);
+  J[0] = 0.0;                            J[2] = 1.0;
+  J[1] = (-2.0*y[0]*y[1] - 1.0)/eps;     J[3] = (1.0 - y[0]*y[0])/eps;
+  return 0;
+}
+
+// OREGO, the Oregonator model of the Belousov-Zhabotinskii reaction;
+// p = (s, w, q) = (77.27, 0.161, 8.375e-6)
+static int bench_orego_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  double s = p[0], w = p[1], q = p[2];
+  ydot[0] = s*(y[1] - y[0]*y[1] + y[0] - q*y[0]*y[0]);
+  ydot[1] = (-y[1] - y[0]*y[1] + y[2])/s;
+  ydot[2] = w*(y[0] - y[2]);
+  return 0;
+}
+
+static int bench_orego_jac(double t, const double* y, double* J, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  double s = p[0], w = p[1], q = p[2];
+  J[0] = s*(1.0 - y[1] - 2.0*q*y[0]);  J[3] = s*(1.0 - y[0]);       J[6] = 0.0;
+  J[1] = -y[1]/s;                      J[4] = (-1.0 - y[0])/s;      J[7] = 1.0/s;
+  J[2] = w;                            J[5] = 0.0;                  J[8] = -w;
+  return 0;
+}
+
+// E5, the chemical pyrolysis problem of Enright et al. (1975);
+// p = (A, B, C, M) = (7.89e-10, 1.1e7, 1.13e3, 1e6)
+static int bench_e5_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  double r1 = p[0]*y[0], r2 = p[1]*y[0]*y[2], r3 = p[3]*p[2]*y[1]*y[2], r4 = p[2]*y[3];
+  ydot[0] = -r1 - r2;
+  ydot[1] =  r1 - r3;
+  ydot[3] =  r2 - r4;
+  ydot[2] =  ydot[1] - ydot[3];
+  return 0;
+}
+
+static int bench_e5_jac(double t, const double* y, double* J, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  double A = p[0], B = p[1], C = p[2], M = p[3];
+  // rows of d(r1..r4)/dy, combined as the right-hand side combines the rates
+  double dr1[4] = { A, 0.0, 0.0, 0.0 };
+  double dr2[4] = { B*y[2], 0.0, B*y[0], 0.0 };
+  double dr3[4] = { 0.0, M*C*y[2], M*C*y[1], 0.0 };
+  double dr4[4] = { 0.0, 0.0, 0.0, C };
+  for (int j = 0; j < 4; j++) {
+    J[0 + 4*j] = -dr1[j] - dr2[j];
+    J[1 + 4*j] =  dr1[j] - dr3[j];
+    J[3 + 4*j] =  dr2[j] - dr4[j];
+    J[2 + 4*j] =  J[1 + 4*j] - J[3 + 4*j];
+  }
+  return 0;
+}
+
+// Brusselator in one space dimension by the method of lines, N grid points with
+// u and v interleaved, so that the Jacobian is banded with half-bandwidth 2,
+// and Dirichlet boundaries u = 1, v = 3; p = (A, B, alpha, N)
+static int bench_brusselator_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  double A = p[0], B = p[1];
+  int N = (int) p[3];
+  double c = p[2]*(N + 1.0)*(N + 1.0);
+  for (int i = 0; i < N; i++) {
+    double u = y[2*i], v = y[2*i + 1];
+    double ul = i > 0 ? y[2*i - 2] : 1.0, ur = i < N - 1 ? y[2*i + 2] : 1.0;
+    double vl = i > 0 ? y[2*i - 1] : 3.0, vr = i < N - 1 ? y[2*i + 3] : 3.0;
+    ydot[2*i]     = A + u*u*v - (B + 1.0)*u + c*(ul - 2.0*u + ur);
+    ydot[2*i + 1] = B*u - u*u*v + c*(vl - 2.0*v + vr);
+  }
+  return 0;
+}
+
+// A population of M subjects given an oral dose, each with a two-compartment
+// model with first-order absorption: depot, central and peripheral amounts,
+// three states per subject. p = (M, ka[M], CL[M], V1[M], Q[M], V2[M]).
+static int bench_pk_population_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  int M = (int) p[0];
+  const double *ka = p + 1, *CL = ka + M, *V1 = CL + M, *Q = V1 + M, *V2 = Q + M;
+  for (int i = 0; i < M; i++) {
+    const double* a = y + 3*i;
+    double* d = ydot + 3*i;
+    double k10 = CL[i]/V1[i], k12 = Q[i]/V1[i], k21 = Q[i]/V2[i];
+    d[0] = -ka[i]*a[0];
+    d[1] =  ka[i]*a[0] - (k10 + k12)*a[1] + k21*a[2];
+    d[2] =  k12*a[1] - k21*a[2];
+  }
+  return 0;
+}
+
+}  // extern "C"
+
+// The number of states of each problem, from its parameters
+static int neq_robertson(const double* p)  { (void) p; return 3; }
+static int neq_hires(const double* p)      { (void) p; return 8; }
+static int neq_pollution(const double* p)  { (void) p; return 20; }
+static int neq_vdp(const double* p)        { (void) p; return 2; }
+static int neq_orego(const double* p)      { (void) p; return 3; }
+static int neq_e5(const double* p)         { (void) p; return 4; }
+static int neq_brusselator(const double* p)   { return 2*(int) p[3]; }
+static int neq_pk_population(const double* p) { return 3*(int) p[0]; }
+
+// F(t, y, y') = f(t, y) - y' and its Newton matrix dF/dy + cj dF/dy' = J - cj I
+template <sundialr_rhs F, int (*NEQ)(const double*)>
+static int bench_res(double t, const double* y, const double* yp, double* r,
+                     void* udata) {
+  int flag = F(t, y, r, udata);
+  int n = NEQ((const double*) udata);
+  for (int i = 0; i < n; i++) r[i] -= yp[i];
+  return flag;
+}
+
+template <sundialr_jac JF, int (*NEQ)(const double*)>
+static int bench_jac_ida(double t, double cj, const double* y, const double* yp,
+                         double* J, void* udata) {
+  (void) yp;
+  int flag = JF(t, y, J, udata);
+  int n = NEQ((const double*) udata);
+  for (int i = 0; i < n; i++) J[i + i*n] -= cj;
+  return flag;
+}
+
+struct bench_problem {
+  const char* name;
+  sundialr_rhs rhs;
+  sundialr_jac jac;           // NULL when the problem has none
+  sundialr_res res;
+  sundialr_jac_ida jac_ida;   // NULL when the problem has none
+};
+
+#define BENCH_PROBLEM(name) \
+  { #name, bench_##name##_rhs, NULL, bench_res<bench_##name##_rhs, neq_##name>, NULL }
+#define BENCH_PROBLEM_JAC(name) \
+  { #name, bench_##name##_rhs, bench_##name##_jac, \
+    bench_res<bench_##name##_rhs, neq_##name>, \
+    bench_jac_ida<bench_##name##_jac, neq_##name> }
+
+static const bench_problem bench_problems[] = {
+  BENCH_PROBLEM_JAC(robertson),
+  BENCH_PROBLEM_JAC(hires),
+  BENCH_PROBLEM(pollution),
+  BENCH_PROBLEM_JAC(vdp),
+  BENCH_PROBLEM_JAC(orego),
+  BENCH_PROBLEM_JAC(e5),
+  BENCH_PROBLEM(brusselator),
+  BENCH_PROBLEM(pk_population)
+};
+
+static const bench_problem& bench_find(const std::string& name) {
+  for (const bench_problem& b : bench_problems) {
+    if (name == b.name) return b;
+  }
+  stop("unknown benchmark problem '%s'", name);
+  return bench_problems[0];
+}
+
+// The compiled functions of a problem as external pointers for the R solvers:
+// rhs, jac, res and jac_ida, each NULL when the problem has no such function
+// [[Rcpp::export(".bench_xptr")]]
+List bench_xptr(std::string name) {
+  const bench_problem& b = bench_find(name);
+  return List::create(
+    _["rhs"]     = sundialr_xptr_rhs(b.rhs),
+    _["jac"]     = b.jac ? sundialr_xptr_jac(b.jac) : R_NilValue,
+    _["res"]     = sundialr_xptr_res(b.res),
+    _["jac_ida"] = b.jac_ida ? sundialr_xptr_jac_ida(b.jac_ida) : R_NilValue);
+}
+
+// --- Through the C API -------------------------------------------------------
+
+// The C API keeps no evaluation counts, so the callbacks are counted here, on
+// their way to the problem's own functions
+struct bench_counter {
+  const bench_problem* problem;
+  const double* params;
+  double rhs_evals, jac_evals;
+};
+
+extern "C" {
+
+static int bench_counted_rhs(double t, const double* y, double* ydot, void* udata) {
+  bench_counter* c = (bench_counter*) udata;
+  c->rhs_evals++;
+  return c->problem->rhs(t, y, ydot, (void*) c->params);
+}
+
+static int bench_counted_jac(double t, const double* y, double* J, void* udata) {
+  bench_counter* c = (bench_counter*) udata;
+  c->jac_evals++;
+  return c->problem->jac(t, y, J, (void*) c->params);
+}
+
+}  // extern "C"
+
+// Solve a problem through sundialr_cvode_*, as another package's compiled code
+// would: one reinit at times[0], then one solve per further output time. The
+// tolerances are CVODE's (rtol scalar, atol scalar or per state), and the
+// analytic Jacobian is used when the problem has one and jacobian is TRUE.
+// Returns the solution in cvode()'s layout, with the steps and evaluations.
+// [[Rcpp::export(".bench_capi")]]
+List bench_capi(std::string name, NumericVector times, NumericVector IC,
+                NumericVector Parameters, double rtol, NumericVector atol,
+                bool jacobian = true) {
+  const bench_problem& b = bench_find(name);
+  int n = IC.size(), nt = times.size();
+  if (atol.size() != 1 && atol.size() != n) {
+    stop("atol must have length 1 or length(IC)");
+  }
+
+  NumericVector p = clone(Parameters);
+  bench_counter counter = { &b, p.begin(), 0.0, 0.0 };
+  void* m = sundialr_cvode_create(n, &counter);
+  if (!m) stop("sundialr_cvode_create returned NULL");
+
+  sundialr_cvode_set_rhs(m, bench_counted_rhs);
+  if (jacobian && b.jac) sundialr_cvode_set_jac(m, bench_counted_jac);
+  if (atol.size() == 1) {
+    sundialr_cvode_set_tol_scalar(m, rtol, atol[0]);
+  } else {
+    std::vector<double> rtol_v(n, rtol);
+    sundialr_cvode_set_tol_vector(m, rtol_v.data(), atol.begin());
+  }
+
+  NumericMatrix soln(nt, n + 1);
+  std::vector<double> y(IC.begin(), IC.end());
+  soln(0, 0) = times[0];
+  for (int i = 0; i < n; i++) soln(0, i + 1) = y[i];
+
+  int flag = sundialr_cvode_reinit(m, times[0], y.data());
+  for (int k = 1; flag >= 0 && k < nt; k++) {
+    double tr;
+    flag = sundialr_cvode_solve(m, times[k], y.data(), &tr);
+    if (flag < 0) break;
+    soln(k, 0) = tr;
+    for (int i = 0; i < n; i++) soln(k, i + 1) = y[i];
+  }
+  if (flag < 0) {
+    const char* e = sundialr_cvode_last_err(m);
+    std::string msg = e ? std::string(e) : std::string("sundialr_cvode_solve failed");
+    sundialr_cvode_free(m);
+    stop(msg);
+  }
+
+  double steps = (double) sundialr_cvode_get_num_steps(m);
+  sundialr_cvode_free(m);
+  return List::create(_["solution"] = soln, _["steps"] = steps,
+                      _["rhs_evals"] = counter.rhs_evals,
+                      _["jac_evals"] = counter.jac_evals);
+}
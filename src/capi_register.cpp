@@ -18,9 +18,12 @@
 // [[Rcpp::export(".register_capi")]]
 void register_capi() {
   R_RegisterCCallable("sundialr", "sundialr_cvode_create",     (DL_FUNC) sundialr_cvode_create);
+  R_RegisterCCallable("sundialr", "sundialr_cvode_create_ensemble", (DL_FUNC) sundialr_cvode_create_ensemble);
   R_RegisterCCallable("sundialr", "sundialr_cvode_free",       (DL_FUNC) sundialr_cvode_free);
   R_RegisterCCallable("sundialr", "sundialr_cvode_set_rhs",    (DL_FUNC) sundialr_cvode_set_rhs);
   R_RegisterCCallable("sundialr", "sundialr_cvode_set_jac",    (DL_FUNC) sundialr_cvode_set_jac);
+  R_RegisterCCallable("sundialr", "sundialr_cvode_set_rhs_ensemble", (DL_FUNC) sundialr_cvode_set_rhs_ensemble);
+  R_RegisterCCallable("sundialr", "sundialr_cvode_set_jac_ensemble", (DL_FUNC) sundialr_cvode_set_jac_ensemble);
   R_RegisterCCallable("sundialr", "sundialr_cvode_set_tol_scalar", (DL_FUNC) sundialr_cvode_set_tol_scalar);
   R_RegisterCCallable("sundialr", "sundialr_cvode_set_tol_vector", (DL_FUNC) sundialr_cvode_set_tol_vector);
   R_RegisterCCallable("sundialr", "sundialr_cvode_set_max_steps",  (DL_FUNC) sundialr_cvode_set_max_steps);
@@ -28,6 +31,7 @@ void register_capi() {
   R_RegisterCCallable("sundialr", "sundialr_cvode_set_min_step",   (DL_FUNC) sundialr_cvode_set_min_step);
   R_RegisterCCallable("sundialr", "sundialr_cvode_reinit",     (DL_FUNC) sundialr_cvode_reinit);
   R_RegisterCCallable("sundialr", "sundialr_cvode_solve",      (DL_FUNC) sundialr_cvode_solve);
+  R_RegisterCCallable("sundialr", "sundialr_cvode_solve_batch", (DL_FUNC) sundialr_cvode_solve_batch);
   R_RegisterCCallable("sundialr", "sundialr_cvode_get_num_steps", (DL_FUNC) sundialr_cvode_get_num_steps);
   R_RegisterCCallable("sundialr", "sundialr_cvode_last_err",   (DL_FUNC) sundialr_cvode_last_err);
   R_RegisterCCallable("sundialr", "sundialr_abi_version",      (DL_FUNC) sundialr_abi_version);
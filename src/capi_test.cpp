@@ -12,7 +12,10 @@
 // ship without being user-visible and need no documentation for R CMD check.
 
 #include <Rcpp.h>
+#include <cmath>
 #include <string>
+#include <thread>
+#include <vector>
 #include <sundialr_capi.h>
 
 using namespace Rcpp;
@@ -50,6 +53,40 @@ static int twocmt_jac(double t, const double* y, double* J, void* udata) {
   return 0;
 }
 
+// The two-compartment system, failing on purpose for a negative k1, to check
+// that one failed item of a batch leaves the others alone.
+static int twocmt_or_fail_rhs(double t, const double* y, double* ydot, void* udata) {
+  if (((double*) udata)[0] < 0) return -1;
+  return twocmt_rhs(t, y, ydot, udata);
+}
+
+// The two-compartment system of K subjects at once, for an ensemble handle:
+// state i of subject k is y[i*K + k], and udata is (k1, k2) of every subject,
+// k1 of subject k at p[k] and k2 at p[K + k].
+static int twocmt_rhs_ensemble(int K, double t, const double* y, double* ydot,
+                               void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  for (int k = 0; k < K; k++) {
+    ydot[k]     = -p[k] * y[k];
+    ydot[K + k] =  p[k] * y[k] - p[K + k] * y[K + k];
+  }
+  return 0;
+}
+
+// Element (i, j) of the Jacobian of subject k at J[(i + j*2)*K + k].
+static int twocmt_jac_ensemble(int K, double t, const double* y, double* J,
+                               void* udata) {
+  (void) t; (void) y;
+  const double* p = (const double*) udata;
+  for (int k = 0; k < K; k++) {
+    J[0*K + k] = -p[k];      // (0,0)
+    J[1*K + k] =  p[k];      // (1,0)
+    J[3*K + k] = -p[K + k];  // (1,1)
+  }
+  return 0;
+}
+
 }  // extern "C"
 
 // Fetch the recorded message (or a fallback) and free the handle before raising.
@@ -201,3 +238,118 @@ bool capi_test_clean_err() {
 int capi_test_abi() {
   return sundialr_abi_version();
 }
+
+// Decay solves on n_threads threads at once, each thread on its own handle
+// with its own rate, reinitialising and solving many times over; then the same
+// solves one after another on the calling thread. Returns the largest
+// difference between the two, which is 0 if handles on different threads do
+// not interfere.
+// [[Rcpp::export(".capi_test_threads")]]
+double capi_test_threads(int n_threads, int rounds) {
+  const int n_out = 8;
+  auto run = [rounds](int t, double* out) {
+    double k = 0.1 * (t + 1);
+    void* m = sundialr_cvode_create(1, &k);
+    if (!m) { out[0] = NAN; return; }
+    sundialr_cvode_set_rhs(m, decay_rhs);
+    sundialr_cvode_set_tol_scalar(m, 1e-10, 1e-12);
+    for (int r = 0; r < rounds; r++) {
+      double y0 = 1.0 + r;
+      sundialr_cvode_reinit(m, 0.0, &y0);
+      for (int i = 0; i < n_out; i++) {
+        double tr;
+        if (sundialr_cvode_solve(m, i + 1.0, out + i, &tr) < 0) out[i] = NAN;
+      }
+    }
+    sundialr_cvode_free(m);
+  };
+
+  std::vector<double> threaded(n_threads * n_out), serial(n_threads * n_out);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < n_threads; t++) threads.emplace_back(run, t, threaded.data() + t * n_out);
+  for (std::thread& th : threads) th.join();
+  for (int t = 0; t < n_threads; t++) run(t, serial.data() + t * n_out);
+
+  double diff = 0;
+  for (size_t i = 0; i < serial.size(); i++) {
+    if (std::isnan(threaded[i]) || std::isnan(serial[i])) return NA_REAL;
+    diff = std::fmax(diff, std::fabs(threaded[i] - serial[i]));
+  }
+  return diff;
+}
+
+// The two-compartment system solved for every k1 by sundialr_cvode_solve_batch,
+// with p = (k1[k], k2) as the udata of item k and y(t0) = (y10[k], 0). A
+// negative k1 makes its item fail. Returns the states as a 2 x times x items
+// array, with each item's status and the batch's return code and message.
+// [[Rcpp::export(".capi_test_batch")]]
+List capi_test_batch(NumericVector times, NumericVector y10, NumericVector k1,
+                     double k2, bool use_jac, int n_threads) {
+  int n_items = k1.size(), n_times = times.size() - 1;
+  std::vector<double> p(2 * n_items), y0(2 * n_items);
+  std::vector<void*> udata(n_items);
+  for (int k = 0; k < n_items; k++) {
+    p[2 * k] = k1[k];
+    p[2 * k + 1] = k2;
+    y0[2 * k] = y10[k];
+    y0[2 * k + 1] = 0.0;
+    udata[k] = p.data() + 2 * k;
+  }
+
+  void* m = sundialr_cvode_create(2, NULL);
+  if (!m) stop("sundialr_cvode_create returned NULL");
+  sundialr_cvode_set_rhs(m, twocmt_or_fail_rhs);
+  if (use_jac) sundialr_cvode_set_jac(m, twocmt_jac);
+  sundialr_cvode_set_tol_scalar(m, 1e-10, 1e-12);
+  sundialr_cvode_set_max_steps(m, 100000);
+
+  NumericVector y(Dimension(2, n_times, n_items));
+  IntegerVector status(n_items);
+  int flag = sundialr_cvode_solve_batch(m, n_items, times[0], y0.data(), udata.data(),
+                                        n_times, times.begin() + 1, y.begin(),
+                                        status.begin(), n_threads);
+  const char* e = sundialr_cvode_last_err(m);
+  std::string es = e ? std::string(e) : std::string("");
+  sundialr_cvode_free(m);
+
+  return List::create(_["y"] = y, _["status"] = status, _["flag"] = flag, _["err"] = es);
+}
+
+// The two-compartment system for every k1 on one ensemble handle, subject k
+// starting from (y10[k], 0). Returns the states as a 2 x times x subjects
+// array, the ensemble's steps, and the code of set_rhs() on the handle, which
+// an ensemble refuses.
+// [[Rcpp::export(".capi_test_ensemble")]]
+List capi_test_ensemble(NumericVector times, NumericVector y10, NumericVector k1,
+                        double k2, bool use_jac) {
+  int K = k1.size(), n_times = times.size();
+  std::vector<double> p(2 * K), y(2 * K);
+  for (int k = 0; k < K; k++) {
+    p[k] = k1[k];
+    p[K + k] = k2;
+    y[k] = y10[k];
+    y[K + k] = 0.0;
+  }
+
+  void* m = sundialr_cvode_create_ensemble(2, K, p.data());
+  if (!m) stop("sundialr_cvode_create_ensemble returned NULL");
+  int rhs_flag = sundialr_cvode_set_rhs(m, twocmt_rhs);
+  sundialr_cvode_set_rhs_ensemble(m, twocmt_rhs_ensemble);
+  if (use_jac) sundialr_cvode_set_jac_ensemble(m, twocmt_jac_ensemble);
+  sundialr_cvode_set_tol_scalar(m, 1e-10, 1e-12);
+  sundialr_cvode_set_max_steps(m, 100000);
+
+  NumericVector out(Dimension(2, n_times, K));
+  if (sundialr_cvode_reinit(m, times[0], y.data()) < 0) capi_test_fail(m, "reinit failed");
+  for (int i = 0; i < n_times; i++) {
+    if (i > 0 && sundialr_cvode_solve(m, times[i], y.data(), NULL) < 0) capi_test_fail(m, "solve failed");
+    for (int k = 0; k < K; k++) {
+      out[(R_xlen_t) (k * n_times + i) * 2]     = y[k];
+      out[(R_xlen_t) (k * n_times + i) * 2 + 1] = y[K + k];
+    }
+  }
+  long steps = sundialr_cvode_get_num_steps(m);
+  sundialr_cvode_free(m);
+
+  return List::create(_["y"] = out, _["steps"] = (double) steps, _["rhs_flag"] = rhs_flag);
+}
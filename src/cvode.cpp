@@ -33,12 +33,16 @@
 #include <cvode/cvode.h>             /* prototypes for CVODE fcts., consts. */
 #include <nvector/nvector_serial.h>  /* serial N_Vector types, fcts., macros */
 #include <sundials/sundials_types.h> /* definition of type realtype */
-#include <sunmatrix/sunmatrix_dense.h>
-#include <sunlinsol/sunlinsol_dense.h>
 
 #include <check_retval.h>
+#include <linear_solver.h>
 #include <rhs_func.h>
 #include <jac_func.h>
+#include <solver_stats.h>
+#include <dense_output.h>
+#include <step_output.h>
+#include <sundialr_xptr.h>
+#include <output_select.h>
 #include <sundials_scope_guard.h>
 
 // CRAN fix: replace SUNDIALS' default abort()-based error handler with one that
@@ -58,8 +62,38 @@ static int jac_cvode(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
 
   struct rhs_func *data = (struct rhs_func*)user_data;
   if (!data) { return -1; }
+  callback_timer timer(data->clock, CB_JAC);
+
+  // a sparse Jacobian nobody gave is approximated (see fd_jacobian.h)
+  if (data->fd.active()) {
+    return rhs_jac_fd(t, y, fy, JAC, user_data, tmp1, tmp2);
+  }
+
+  // a compiled Jacobian writes a dense column-major matrix, or the storage of
+  // a band or sparse one (see jac_func.h)
+  if (data->jac_band) {
+    return jac_eval_native_band(data->jac_band, t, y, JAC, data->params.begin(),
+                                data->clock);
+  }
+  if (data->jac_sparse) {
+    return jac_eval_native_sparse(data->jac_sparse, t, y, JAC, data->params.begin(),
+                                  data->pattern, data->clock);
+  }
+  if (data->jac_native) {
+    return jac_eval_native(data->jac_native, t, y, JAC, data->params.begin(),
+                           data->jac_scratch, data->pattern, data->clock);
+  }
+
+  // a model's symbolic Jacobian is evaluated by the bytecode interpreter
+  if (data->model_jac) {
+    return jac_eval_model(data->model, t, y, JAC, data->params.begin(),
+                          data->jac_regs.data(), data->jac_vals.data(),
+                          data->pattern, data->clock);
+  }
+
   return sundials_callback_guard(data->err, [&]() -> int {
-    return jac_eval(t, y, JAC, data->jac_eqn, data->params);
+    return jac_eval(t, y, JAC, data->jac_eqn, data->params, data->pattern,
+                    data->clock);
   });
 }
 
@@ -69,12 +103,23 @@ static int jac_cvode(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
 //' CVODE solver to solve stiff ODEs
 //'@param time_vector time vector
 //'@param IC Initial Conditions
-//'@param input_function Right Hand Side function of ODEs
-//'@param Parameters Parameters input to ODEs
+//'@param input_function Right Hand Side function of ODEs, either an R or Rcpp function with signature \code{function(t, y, p)}, or a compiled C function passed as an external pointer made with \code{sundialr_xptr_rhs()} (see \code{sundialr_xptr.h} in the package's \code{include} directory), which SUNDIALS then calls without going through R, or a model built from R expressions by \code{\link{ode_model}}, which is evaluated without going through R either
+//'@param Parameters Parameters input to ODEs. A compiled right-hand side or Jacobian receives a pointer to these values as its \code{udata} argument
 //'@param reltolerance Relative Tolerance (a scalar, default value  = 1e-04)
 //'@param abstolerance Absolute Tolerance (a scalar or vector with length equal to ydot (dy/dx), default = 1e-04)
-//'@param jacobian (Optional) Jacobian of the RHS with signature \code{function(t, y, p)} returning an n-by-n matrix where entry [i,j] is d(ydot_i)/d(y_j). Default is NULL and SUNDIALS uses internal finite-difference approximation.
-//'@returns A Matrix. First column is the time-vector, the other columns are values of y in order they are provided.
+//'@param jacobian (Optional) Jacobian of the RHS with signature \code{function(t, y, p)} returning an n-by-n matrix where entry [i,j] is d(ydot_i)/d(y_j), or a compiled Jacobian made with \code{sundialr_xptr_jac()}, or for a band matrix with \code{sundialr_xptr_jac_band()}, which writes only the band, into the band matrix's own storage, rather than an n-by-n matrix, and for a sparse one with \code{sundialr_xptr_jac_sparse()}, which writes only the values of the pattern. Either form may be used with either form of \code{input_function}. Default is NULL and SUNDIALS uses internal finite-difference approximation, unless \code{input_function} is a model built by \code{\link{ode_model}} with its symbolic Jacobian, which is then used.
+//'@param mupper,mlower (Optional) Upper and lower half-bandwidths of the Jacobian, for a system in which d(y_i)/dt involves only the states within mupper above and mlower below its own, as in a discretised PDE. When both are given, a band matrix and band linear solver are used in place of the dense ones, which is much cheaper for a large system: the finite-difference Jacobian then costs mupper + mlower + 1 evaluations of the right-hand side instead of one per state. Entries of a supplied Jacobian outside the band are ignored. Default NULL (dense)
+//'@param sparsity (Optional) Sparsity pattern of the Jacobian, for a large system whose Jacobian is mostly zeros, such as a reaction network: an n-by-n logical or numeric matrix whose nonzero entries mark the entries of the Jacobian that can be nonzero, or a sparse matrix from the Matrix package (such as a \code{dgCMatrix}), or a pattern found automatically by \code{\link{detect_sparsity}}, which selects a band matrix in place of a sparse one when its \code{storage} is \code{"band"}. The diagonal is always included. A sparse matrix and the package's sparse direct solver are then used in place of the dense ones, so memory and work grow with the number of nonzeros rather than with n^2 and n^3. Without a \code{jacobian}, the Jacobian is approximated by finite differences over groups of columns that share no row, costing one evaluation of the right-hand side per group rather than one per state, so the pattern must include every entry that can be nonzero. An R \code{jacobian} may return an n-by-n matrix, a \code{dgCMatrix} or \code{dgTMatrix}, or a numeric vector of the nonzero values in the column-by-column order of the pattern, and is read only inside the pattern. Cannot be combined with \code{mupper} and \code{mlower}. Default NULL (dense)
+//'@param linear_solver (Optional) \code{"dense"}, factored by an LU specialised at compile time to the size of the system for up to 16 states and by SUNDIALS' dense LU above; \code{"lapack_dense"}, the same dense matrix factored by R's LAPACK and so by the BLAS R is linked against, which with an optimised BLAS such as OpenBLAS or MKL is much faster for a hundred states or more (unavailable if no LAPACK could be linked when the package was installed); or one of SUNDIALS' matrix-free Krylov solvers: \code{"spgmr"} (GMRES), \code{"spfgmr"} (flexible GMRES), \code{"spbcgs"} (BiCGStab), \code{"sptfqmr"} (TFQMR) or \code{"pcg"} (conjugate gradients, for a symmetric Newton matrix). A Krylov solver stores no matrix, so it suits systems too large for even a band or sparse one, such as a finely discretised PDE, and is fast when given a good preconditioner (\code{psolve}). It needs only products of the Jacobian with vectors: from \code{jtimes} when given, from the symbolic Jacobian of a model built by \code{\link{ode_model}}, and otherwise approximated by one evaluation of the right-hand side each. Cannot be combined with \code{jacobian}, \code{mupper}, \code{mlower} or \code{sparsity}. Default NULL, a direct solver chosen by those arguments
+//'@param jtimes (Optional) With a Krylov \code{linear_solver}, the product of the Jacobian with a vector, as \code{function(t, y, v, p)} returning J v, or a compiled function made with \code{sundialr_xptr_jtimes()}. Default NULL
+//'@param psetup,psolve (Optional) With a Krylov \code{linear_solver}, a left preconditioner P approximating the Newton matrix I - gamma * J. \code{psolve(t, y, r, gamma, p)} returns z solving P z = r. \code{psetup(t, y, jok, gamma, p)}, which may be left out, is called whenever the Newton matrix changes, to prepare P for \code{psolve} (keeping it, for instance, in an environment the two functions share); when \code{jok} is TRUE it may reuse Jacobian data saved from an earlier call, and it returns FALSE if it did so and TRUE (or NULL) if it evaluated the Jacobian afresh. Either may be a compiled function made with \code{sundialr_xptr_psetup()} or \code{sundialr_xptr_psolve()}. Default NULL, no preconditioning
+//'@param stats (Optional) If TRUE, the solution gets a \code{stats} attribute, a list of the integrator's counters for the solve: \code{steps}, the number of internal steps; \code{rhs_evals}, evaluations of the right-hand side by the integrator, and \code{rhs_evals_lin}, those made to approximate the Jacobian or its products with vectors; \code{jac_evals}; \code{lin_setups}, the number of times the Newton matrix was set up; \code{nonlin_iters} and \code{nonlin_conv_fails}, the Newton iterations and their convergence failures; \code{err_test_fails}; \code{order_last} and \code{order_cur}, the BDF order of the last step and of the next; \code{step_initial}, \code{step_last} and \code{step_cur}, the sizes of the first, last and next steps; \code{workspace_real} and \code{workspace_int}, the numbers of reals and integers the integrator and linear solver allocated; and the wall-clock seconds of the call, \code{time_total}, split into \code{time_callbacks}, spent in the right-hand side, Jacobian and Krylov functions, and \code{time_solver}, the rest. Default FALSE
+//'@param profile (Optional) If TRUE, the solution gets a \code{profile} attribute, a data frame with a row for each kind of callback SUNDIALS made into the user's functions: \code{callback}, one of \code{"rhs"}, \code{"jacobian"}, \code{"jtimes"}, \code{"psetup"} and \code{"psolve"}; \code{calls}, the number of calls; \code{total_ns} and \code{mean_ns}, the nanoseconds spent in them in all and per call; and the total split into \code{user_ns}, spent in the user's function itself, be it an R function, a compiled one or a model built by \code{\link{ode_model}}, and \code{marshal_ns}, the package's work around it, copying the state into R and the result back, checking it and storing a Jacobian. The right-hand side evaluations of the coloured finite-difference Jacobian of a \code{sparsity} solve count as the Jacobian's user time, while those of SUNDIALS' own difference quotients are counted as calls of the right-hand side. Each callback is timed, which adds a little to every call. Default FALSE
+//'@param dense_output (Optional) If TRUE, the solution gets a \code{dense_output} attribute, the continuous solution over the whole solve: the interpolating polynomial of every internal step CVODE took, which \code{\link{dense_eval}} evaluates, with its derivatives, at any times afterwards without solving again. It holds the order and up to six vectors of the states' derivatives per step. The steps and the solution at \code{time_vector} are the same as without it. Default FALSE
+//'@param output (Optional) \code{"times"}, the default, for the solution at \code{time_vector}, or \code{"steps"} for the solution at every internal step CVODE takes from the first time in \code{time_vector} to the last, which it is not then asked to interpolate at any others: the rows are close together where the solution changes fast and far apart where it does not, which shows where the solver worked hard and plots the solution at the resolution it was computed at
+//'@param max_rows (Optional) With \code{output = "steps"}, the most rows to return, 2 or more: the steps are thinned as the solve goes, keeping ones evenly spread over the solve and always the first and last, so a long solve never holds more than twice that many. Default NULL, every step
+//'@param outputs (Optional) What to store at each output time in place of every state, for a large system of which only a few quantities are wanted: only those columns are allocated. Either the indices of the states to keep, or their names for a model built by \code{\link{ode_model}}; or observables of the solution, as a list of R expressions in the states, parameters and \code{t}, written as the equations of \code{\link{ode_model}} are, such as \code{list(total = quote(A + B), ratio = quote(A / B))}, which are compiled to the same bytecode and evaluated without calling R; or a compiled function made with \code{sundialr_xptr_outputs()}, which fills the observables from the state and receives a pointer to \code{Parameters} as its \code{udata}. The expressions refer to the states and parameters by the names of a model built by \code{\link{ode_model}}, and always as \code{y[i]} and \code{p[i]}. A \code{dense_output} attribute still holds every state. Default NULL, every state
+//'@returns A Matrix. First column is the time-vector, or the times of the steps with \code{output = "steps"}, the other columns are values of y in order they are provided, or the \code{outputs} in the order they are given.
 //'@example /inst/examples/cv_Roberts_dns.r
 // [[Rcpp::export]]
 NumericMatrix cvode(NumericVector time_vector, NumericVector IC,
@@ -82,7 +127,24 @@ NumericMatrix cvode(NumericVector time_vector, NumericVector IC,
                      NumericVector Parameters,
                      double reltolerance = 0.0001,
                      NumericVector abstolerance = 0.0001,
-                     Nullable<Function> jacobian = R_NilValue){
+                     SEXP jacobian = R_NilValue,
+                     SEXP mupper = R_NilValue,
+                     SEXP mlower = R_NilValue,
+                     SEXP sparsity = R_NilValue,
+                     SEXP linear_solver = R_NilValue,
+                     SEXP jtimes = R_NilValue,
+                     SEXP psetup = R_NilValue,
+                     SEXP psolve = R_NilValue,
+                     bool stats = false,
+                     bool profile = false,
+                     bool dense_output = false,
+                     std::string output = "times",
+                     SEXP max_rows = R_NilValue,
+                     SEXP outputs = R_NilValue){
+
+   // the wall-clock time of the whole call, and of the callbacks within it
+   auto call_start = solver_clock::now();
+   solver_clock clock(profile);
 
    int flag;
 
@@ -94,9 +156,29 @@ NumericMatrix cvode(NumericVector time_vector, NumericVector IC,
    // Initial Conditions
    int y_len = IC.length();
 
+   // the solution at time_vector, or at every internal step (see step_output.h)
+   bool steps = output_is_steps(output);
+   int steps_max = output_max_rows(max_rows);
+
+   // every state, some of them or observables computed from them, stored in
+   // that many columns (see output_select.h)
+   output_select outs = output_select_parse(outputs, input_function, y_len,
+                                            Parameters.length());
+   std::vector<double> outs_regs, outs_row(outs.n_out);
+   outs.init_scratch(outs_regs);
+   auto outs_at = [&](double t, const double *y) {
+     const double *v = outs.row(t, y, Parameters.begin(), outs_regs.data(), outs_row.data());
+     if (!v) stop("Stopping cvode, the outputs function failed at t = %g", t);
+     return v;
+   };
+
    // Relative tolerance
    sunrealtype reltol = reltolerance;
 
+   // dense, band when the half-bandwidths are given, sparse when the pattern
+   // is, or a Krylov solver when linear_solver names one
+   linsol_spec ls_spec = linsol_parse(mupper, mlower, sparsity, linear_solver, y_len);
+
    // Receives SUNDIALS errors. Declared before the guard so that it is
    // destroyed after it - the SUNContext freed there holds a pointer to it.
    sundials_err_record sun_err;
@@ -169,38 +251,70 @@ NumericMatrix cvode(NumericVector time_vector, NumericVector IC,
    //-- assign user input to the struct based on SEXP type of input_function
    if (!input_function){ stop("There is no input function, stopping!"); }
 
-   if(TYPEOF(input_function) != CLOSXP) { stop("Incorrect input function type - input function can be an R or Rcpp function"); }
+   // an R function, or a compiled function passed as an external pointer
+   if(TYPEOF(input_function) != CLOSXP && TYPEOF(input_function) != EXTPTRSXP) {
+     stop("Incorrect input function type - input function can be an R or Rcpp function, a compiled function made with sundialr_xptr_rhs(), or a model built by ode_model()");
+   }
 
-   // Check if jacobian is not NULL, fill the jac_sexp with input value
-   SEXP jac_sexp = R_NilValue;
-   if (jacobian.isNotNull()) jac_sexp = as<SEXP>(jacobian);
-   struct rhs_func my_rhs_function = {input_function, Parameters, jac_sexp, &sun_err};
+   // jac_sexp is R_NilValue when no jacobian is supplied; rhs_func sorts an
+   // R function from a compiled one
+   SEXP jac_sexp = jacobian;
+   struct rhs_func my_rhs_function(input_function, Parameters, jac_sexp, &sun_err, y_len);
+   my_rhs_function.pattern = linsol_pattern_of(ls_spec);
+   jac_native_check(my_rhs_function.jac_band != NULL, my_rhs_function.jac_sparse != NULL,
+                    ls_spec.band, ls_spec.sparse);
+   // a sparse solve without a Jacobian approximates one by coloured finite
+   // differences, with one evaluation of the right-hand side per group of
+   // columns sharing no row (see fd_jacobian.h)
+   if (ls_spec.sparse && !my_rhs_function.has_jacobian()) {
+     if (!my_rhs_function.fd.init(&ls_spec.pattern, cvode_mem, y0)) {
+       sundials_stop(sun_err, "N_VClone", "Stopping cvode, cannot allocate memory for the finite-difference Jacobian!");
+     }
+   }
+   linsol_check_krylov(ls_spec, jacobian, jtimes != R_NilValue || psetup != R_NilValue ||
+                       psolve != R_NilValue);
+   my_rhs_function.krylov = krylov_func(jtimes, psetup, psolve, Parameters, &sun_err, y_len, false);
+   ls_spec.precondition = my_rhs_function.krylov.has_psolve();
+   if (stats || profile) {
+     my_rhs_function.clock = &clock;
+     my_rhs_function.krylov.clock = &clock;
+   }
 
    // setting the user_data in rhs function
    flag = CVodeSetUserData(cvode_mem, (void*)&my_rhs_function);
    if (check_retval(flag, "CVodeSetUserData")) { sundials_stop(sun_err, "CVodeSetUserData", "Stopping cvode, something went wrong in setting user data!"); }
 
-   flag = CVodeInit(cvode_mem, rhs_function, T0, y0);
+   flag = CVodeInit(cvode_mem, my_rhs_function.rhs_callback(), T0, y0);
    if (check_retval(flag, "CVodeInit")) { sundials_stop(sun_err, "CVodeInit", "Stopping cvode, something went wrong in initializing CVODE!"); }
 
    // Call CVodeSVtolerances to specify the scalar relative tolerance and vector absolute tol
    flag = CVodeSVtolerances(cvode_mem, reltol, abstol);
    if (check_retval(flag, "CVodeSVtolerances")) { sundials_stop(sun_err, "CVodeSVtolerances", "Stopping cvode, something went wrong in setting solver tolerances!"); }
 
-   // Create dense SUNMatrix for use in linear solves
-   sunindextype y_len_M = y_len;
-   SM = SUNDenseMatrix(y_len_M, y_len_M, sunctx);
-   if(check_retval(SM, "SUNDenseMatrix")) { sundials_stop(sun_err, "SUNDenseMatrix", "Stopping cvode, something went wrong in setting the dense matrix!"); }
-
-   // Create dense SUNLinearSolver object for use by CVode
-   LS = SUNLinSol_Dense(y0, SM, sunctx);
-   if(check_retval(LS, "SUNLinSol_Dense")) { sundials_stop(sun_err, "SUNLinSol_Dense", "Stopping cvode, something went wrong in setting the linear solver!"); }
+   // Create the dense, band or sparse SUNMatrix and SUNLinearSolver, or the
+   // Krylov solver, for use by CVode
+   const char *ls_failed = linsol_create(ls_spec, y0, sunctx, &SM, &LS);
+   if (ls_failed) { sundials_stop(sun_err, ls_failed, "Stopping cvode, something went wrong in setting the linear solver!"); }
 
    // Call CVodeSetLinearSolver to attach the matrix and linear solver to CVode
    flag = CVodeSetLinearSolver(cvode_mem, LS, SM);
    if(check_retval(flag, "CVodeSetLinearSolver")) { sundials_stop(sun_err, "CVodeSetLinearSolver", "Stopping cvode, something went wrong in setting the linear solver!"); }
 
-   if (jacobian.isNotNull()) {
+   if (ls_spec.krylov != LINSOL_DIRECT) {
+     // the Jacobian times a vector, if there is a better one than SUNDIALS'
+     // finite differences, and the preconditioner, if given (see krylov_func.h)
+     if (my_rhs_function.jtimes_callback()) {
+       flag = CVodeSetJacTimes(cvode_mem, my_rhs_function.jtsetup_callback(),
+                               my_rhs_function.jtimes_callback());
+       if(check_retval(flag, "CVodeSetJacTimes")) { sundials_stop(sun_err, "CVodeSetJacTimes", "Stopping cvode, something went wrong in setting the Jacobian-times-vector function!"); }
+     }
+     if (my_rhs_function.krylov.has_psolve()) {
+       flag = CVodeSetPreconditioner(cvode_mem,
+                                     my_rhs_function.krylov.has_psetup() ? rhs_psetup : NULL,
+                                     rhs_psolve);
+       if(check_retval(flag, "CVodeSetPreconditioner")) { sundials_stop(sun_err, "CVodeSetPreconditioner", "Stopping cvode, something went wrong in setting the preconditioner!"); }
+     }
+   } else if (my_rhs_function.has_jacobian()) {
      flag = CVodeSetJacFn(cvode_mem, jac_cvode);
      if(check_retval(flag, "CVodeSetJacFn")) { sundials_stop(sun_err, "CVodeSetJacFn", "Stopping cvode, something went wrong in setting the Jacobian function!"); }
    }
@@ -211,36 +325,82 @@ NumericMatrix cvode(NumericVector time_vector, NumericVector IC,
    // // the inital time T0, and the initial dependent variable vector y.
    sunrealtype tout;  // For output times
 
-   int y_len_1 = y_len + 1; // remove later
-   NumericMatrix soln(Dimension(time_vec_len,y_len_1));  // remove later
+   // every internal step, for the continuous solution (see dense_output.h)
+   struct dense_output dense(y_len, T0);
+
+   NumericMatrix soln;
+
+   if (steps) {
+     // every internal step up to the last time, which is CVODE's stop time
+     step_output rows(outs.n_out, steps_max);
+     rows.push(T0, outs_at(T0, y0_ptr));
+     if (NOUT > 1) {
+       tout = time_vector[NOUT-1];
+       flag = CVodeSetStopTime(cvode_mem, tout);
+       if (check_retval(flag, "CVodeSetStopTime")) { sundials_stop(sun_err, "CVodeSetStopTime", "Stopping cvode, something went wrong in setting the stop time!"); }
+
+       flag = step_output_until([&](double *t) {
+         int step_flag = CVode(cvode_mem, tout, y0, t, CV_ONE_STEP);
+         if (step_flag >= 0 && dense_output) {
+           int rec_flag = dense.record(cvode_mem, *t, y0);
+           if (rec_flag < 0) return rec_flag;
+         }
+         return step_flag;
+       }, CV_TSTOP_RETURN, CV_TOO_MUCH_WORK, time_vector.begin() + 1, NOUT - 1,
+          [&](double t) { return outs_at(t, y0_ptr); }, rows, true, sun_err, "CVode");
+
+       if (check_retval(flag, "CVode")) {
+         sundials_stop(sun_err, "CVode", "Stopping CVODE, something went wrong in solving the system of ODEs!");
+       }
+     }
+     soln = rows.as_matrix();
+   } else {
 
-   // fill the first row of soln matrix with Initial Conditions
-   soln(0,0) = time_vector[0];   // get the first time value
-   for(int i = 0; i<y_len; i++){
-     soln(0,i+1) = IC[i];
-   }
+     int y_len_1 = outs.n_out + 1; // remove later
+     soln = NumericMatrix(Dimension(time_vec_len,y_len_1));  // remove later
 
-   for(int iout = 0; iout < NOUT-1; iout++) {
+     // fill the first row of soln matrix with Initial Conditions
+     soln(0,0) = time_vector[0];   // get the first time value
+     const double *vals = outs_at(T0, y0_ptr);
+     for(int i = 0; i<outs.n_out; i++){
+       soln(0,i+1) = vals[i];
+     }
 
-     // output times start from the index after initial time
-     tout = time_vector[iout+1];
+     for(int iout = 0; iout < NOUT-1; iout++) {
 
-     flag = CVode(cvode_mem, tout, y0, &time, CV_NORMAL);
+       // output times start from the index after initial time
+       tout = time_vector[iout+1];
 
-     // If something went wrong in solving it!
-     if (check_retval(flag, "CVode")) {
-       sundials_stop(sun_err, "CVode", "Stopping CVODE, something went wrong in solving the system of ODEs!");
-     }
+       if (dense_output) {
+         flag = dense_output_solve(cvode_mem, tout, y0, &time, dense, SOLVER_MXSTEP, sun_err);
+       } else {
+         flag = CVode(cvode_mem, tout, y0, &time, CV_NORMAL);
+       }
+
+       // If something went wrong in solving it!
+       if (check_retval(flag, "CVode")) {
+         sundials_stop(sun_err, "CVode", "Stopping CVODE, something went wrong in solving the system of ODEs!");
+       }
 
-     if (flag == CV_SUCCESS) {
-       // store results in soln matrix
-       soln(iout+1, 0) = time;           // first column is for time
-       for (int i = 0; i<y_len; i++){
-         soln(iout+1, i+1) = y0_ptr[i];
+       if (flag == CV_SUCCESS) {
+         // store results in soln matrix
+         soln(iout+1, 0) = time;           // first column is for time
+         vals = outs_at(time, y0_ptr);
+         for (int i = 0; i<outs.n_out; i++){
+           soln(iout+1, i+1) = vals[i];
+         }
        }
      }
    }
 
+   if (stats) {
+     solver_stats counters;
+     solver_stats_cvode(cvode_mem, counters);
+     soln.attr("stats") = solver_stats_list(counters, clock, solver_clock::since(call_start));
+   }
+   if (profile) { soln.attr("profile") = callback_profile_frame(clock, "rhs"); }
+   if (dense_output) { soln.attr("dense_output") = dense.as_list(); }
+
    // SUNDIALS objects are released by sundials_cleanup on scope exit
 
    return soln;
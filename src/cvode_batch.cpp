@@ -0,0 +1,531 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// cvode_batch(): one system solved for many initial states and parameter sets
+// at once, the sets spread over a pool of threads by work stealing, the most
+// costly first when their costs are known (see batch_pool.h).
+//
+// Each worker thread owns a handle of the C API (sundialr_capi.h), and so its
+// own SUNContext, CVODE memory, vectors, matrix and linear solver, made once
+// and restarted with CVodeReInit for every set it solves. Workers share only
+// the model, which is never written to, and the result array, of which each
+// set owns its own slice. No R is called on the worker threads, which is why
+// the right-hand side must be compiled or a model built by ode_model().
+//
+// With ensemble = K > 1 the tasks are groups of K sets, which a worker solves
+// together, in lockstep, on an ensemble handle of the C API (see
+// ensemble_solver.h): the right-hand side of all K is evaluated in one call,
+// with the states, parameters and model registers structure-of-arrays, and the
+// K Newton matrices are factored side by side. A group that fails is solved
+// again set by set on the worker's ordinary handle, so that a set fails only
+// if it fails alone.
+
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <batch_pool.h>
+#include <expr_model.h>
+#include <sundialr_capi.h>
+#include <sundialr_xptr.h>
+#include <output_select.h>
+
+using namespace Rcpp;
+
+// The right-hand side and Jacobian every worker evaluates: compiled functions,
+// or a model built by ode_model() with, unless a compiled Jacobian is given,
+// its symbolic Jacobian
+struct batch_model {
+  sundialr_rhs rhs_native;
+  sundialr_jac jac_native;
+  sundialr_rhs_ensemble rhs_ens;
+  sundialr_jac_ensemble jac_ens;
+  const expr_model *model;
+  bool model_jac;
+  int n;
+  int n_params;
+
+  batch_model() : rhs_native(NULL), jac_native(NULL), rhs_ens(NULL),
+                  jac_ens(NULL), model(NULL), model_jac(false), n(0),
+                  n_params(0) {}
+
+  bool has_jac() const { return jac_native || jac_ens || model_jac; }
+};
+
+// One worker's state: its C API handles, and the state, parameters and model
+// registers of the set it is solving - and, for ensembles, of the group of K
+// sets, structure-of-arrays. The handles' udata points here.
+struct batch_worker {
+  const batch_model *fn;
+  void *cvode;
+  std::vector<double> y;
+  std::vector<double> p;
+  std::vector<double> regs;
+  std::vector<double> jac_regs;
+  std::vector<double> jac_vals;
+  std::vector<double> out_regs;     // for the outputs of a set
+  std::vector<double> out_row;
+
+  void *ens;
+  int K;
+  std::vector<double> ens_y;
+  std::vector<double> ens_p;        // parameter j of lane k at j*K + k ...
+  std::vector<double> ens_p_sets;   // ... and at k*n_params + j, for compiled
+                                    // functions of one set
+  std::vector<double> ens_regs;
+  std::vector<double> ens_jac_regs;
+  std::vector<double> ens_jac_vals;
+  std::vector<double> lane_y;       // one lane, for compiled functions of one set
+  std::vector<double> lane_f;
+  std::vector<double> lane_J;
+
+  batch_worker() : fn(NULL), cvode(NULL), ens(NULL), K(0) {}
+  ~batch_worker() {
+    sundialr_cvode_free(cvode);
+    sundialr_cvode_free(ens);
+  }
+
+  batch_worker(const batch_worker &) = delete;
+  batch_worker &operator=(const batch_worker &) = delete;
+};
+
+// --- Callbacks given to the handles (C linkage, never throw) ----------------
+extern "C" {
+
+static int batch_rhs(double t, const double *y, double *ydot, void *udata) {
+  batch_worker *w = (batch_worker *) udata;
+  if (w->fn->rhs_native) return w->fn->rhs_native(t, y, ydot, w->p.data());
+  if (w->fn->rhs_ens) return w->fn->rhs_ens(1, t, y, ydot, w->p.data());
+  w->fn->model->rhs.eval(t, y, w->p.data(), w->regs.data(), ydot);
+  return 0;
+}
+
+// CVODE zeroes the matrix before asking for it, so a model's Jacobian needs
+// only its nonzeros written
+static int batch_jac(double t, const double *y, double *J, void *udata) {
+  batch_worker *w = (batch_worker *) udata;
+  if (w->fn->jac_native) return w->fn->jac_native(t, y, J, w->p.data());
+  if (w->fn->jac_ens) return w->fn->jac_ens(1, t, y, J, w->p.data());
+  const expr_model *model = w->fn->model;
+  model->jac.eval(t, y, w->p.data(), w->jac_regs.data(), w->jac_vals.data());
+  int n = w->fn->n;
+  for (size_t e = 0; e < model->jac_rows.size(); e++) {
+    J[model->jac_rows[e] + model->jac_cols[e] * n] = w->jac_vals[e];
+  }
+  return 0;
+}
+
+// The same for a group of K sets. A compiled function of one set is called
+// for each lane in turn, its state gathered from and its result scattered to
+// the structure-of-arrays layout.
+static int batch_rhs_ensemble(int K, double t, const double *y, double *ydot,
+                              void *udata) {
+  batch_worker *w = (batch_worker *) udata;
+  const batch_model *fn = w->fn;
+  if (fn->rhs_ens) return fn->rhs_ens(K, t, y, ydot, w->ens_p.data());
+  if (fn->model) {
+    fn->model->rhs.eval_ensemble(K, t, y, w->ens_p.data(), w->ens_regs.data(), ydot);
+    return 0;
+  }
+  int n = fn->n;
+  for (int k = 0; k < K; k++) {
+    for (int i = 0; i < n; i++) w->lane_y[i] = y[i * K + k];
+    int flag = fn->rhs_native(t, w->lane_y.data(), w->lane_f.data(),
+                              w->ens_p_sets.data() + (size_t) k * fn->n_params);
+    if (flag != 0) return flag;
+    for (int i = 0; i < n; i++) ydot[i * K + k] = w->lane_f[i];
+  }
+  return 0;
+}
+
+static int batch_jac_ensemble(int K, double t, const double *y, double *J,
+                              void *udata) {
+  batch_worker *w = (batch_worker *) udata;
+  const batch_model *fn = w->fn;
+  int n = fn->n;
+  if (fn->jac_ens) return fn->jac_ens(K, t, y, J, w->ens_p.data());
+  if (fn->model_jac) {
+    const expr_model *model = fn->model;
+    model->jac.eval_ensemble(K, t, y, w->ens_p.data(), w->ens_jac_regs.data(),
+                             w->ens_jac_vals.data());
+    for (size_t e = 0; e < model->jac_rows.size(); e++) {
+      double *Je = J + (size_t) (model->jac_rows[e] + model->jac_cols[e] * n) * K;
+      const double *v = w->ens_jac_vals.data() + e * K;
+      for (int k = 0; k < K; k++) Je[k] = v[k];
+    }
+    return 0;
+  }
+  for (int k = 0; k < K; k++) {
+    for (int i = 0; i < n; i++) w->lane_y[i] = y[i * K + k];
+    std::fill(w->lane_J.begin(), w->lane_J.end(), 0.0);
+    int flag = fn->jac_native(t, w->lane_y.data(), w->lane_J.data(),
+                              w->ens_p_sets.data() + (size_t) k * fn->n_params);
+    if (flag != 0) return flag;
+    for (int e = 0; e < n * n; e++) J[(size_t) e * K + k] = w->lane_J[e];
+  }
+  return 0;
+}
+
+}  // extern "C"
+
+// Called through R_ToplevelExec(), which returns FALSE when it raises
+static void batch_check_interrupt(void *) { R_CheckUserInterrupt(); }
+
+// The number of sets given by x, a vector (one set, shared by all) or a matrix
+// with one row per set and `len` columns
+static int batch_rows(SEXP x, int len, const char *what) {
+  NumericVector v(x);
+  if (!Rf_isMatrix(x)) {
+    if (v.length() != len) stop("%s has %d values, but %d were expected", what, (int) v.length(), len);
+    return 1;
+  }
+  if (Rf_ncols(x) != len) stop("%s has %d columns, but %d were expected", what, Rf_ncols(x), len);
+  return Rf_nrows(x);
+}
+
+//'cvode_batch
+//'
+//' Solve one system of ODEs for many initial conditions or parameter sets,
+//' such as a virtual population or the samples of a global sensitivity
+//' analysis, on several threads. Each thread has its own CVODE solver, made
+//' once and restarted for every set it solves, and its own queue of sets; a
+//' thread that empties its queue takes half of what is left in the fullest
+//' other one, so that no thread idles while sets remain. As the threads cannot
+//' call R, the right-hand side must be a compiled function or a model built by
+//' \code{\link{ode_model}}.
+//'
+//' For small systems, such as the compartments of a pharmacokinetic model,
+//' the cost of a solve is mostly CVODE's own, for every step, rather than the
+//' right-hand side's. With \code{ensemble} greater than 1 the sets are solved
+//' in groups of that many, each group by one CVODE stepping all its sets
+//' together: the states are stored set-minor, so that the right-hand side of a
+//' model, or of a compiled function made with \code{sundialr_xptr_rhs_ensemble()},
+//' is evaluated for the whole group in loops the compiler vectorises, and the
+//' Newton matrices of the group are factored side by side. Every set keeps its
+//' own error test, and so its own accuracy, but the sets of a group share their
+//' steps, which are sized for the one that needs the smallest; the mode pays
+//' off when the sets are alike, as those of a population are.
+//'@param time_vector time vector, as in \code{\link{cvode}}, the same for every set
+//'@param IC Initial Conditions: a vector, used for every set, or a matrix with one row per set
+//'@param input_function Right Hand Side function of ODEs: a compiled function made with \code{sundialr_xptr_rhs()} or \code{sundialr_xptr_rhs_ensemble()}, or a model built by \code{\link{ode_model}}, as in \code{\link{cvode}}
+//'@param Parameters Parameters input to ODEs: a vector, used for every set, or a matrix with one row per set. When both \code{IC} and \code{Parameters} are matrices they must have the same number of rows
+//'@param reltolerance Relative Tolerance (a scalar, default value  = 1e-04)
+//'@param abstolerance Absolute Tolerance (a scalar or vector with length equal to ydot (dy/dx), default = 1e-04)
+//'@param jacobian (Optional) A compiled Jacobian made with \code{sundialr_xptr_jac()} or \code{sundialr_xptr_jac_ensemble()}. Default NULL, the symbolic Jacobian of a model built by \code{\link{ode_model}} with one, and otherwise SUNDIALS' finite-difference approximation
+//'@param threads (Optional) The number of threads. Default 0, one per core
+//'@param cost (Optional) The expected cost of each set, one value per set, such as the \code{steps} attribute of an earlier result for the same sets. The sets are then queued most costly first, so that the few slow ones, of a very stiff corner of a population, say, are started at once rather than left to run alone at the end. Default NULL, the sets in their order. With \code{ensemble}, sets of similar cost are also grouped together
+//'@param ensemble (Optional) The number of sets each group solved in lockstep has. Default 1, every set solved on its own with its own steps. A group one of whose sets fails is solved again set by set, so that only the sets that fail alone have NA
+//'@param outputs (Optional) What to store for each set at each output time in place of every state: the indices or names of states, a list of R expressions or a compiled function made with \code{sundialr_xptr_outputs()}, as in \code{\link{cvode}}, evaluated with each set's own parameters. Only those columns of the array are allocated, so that the solutions of a large population of a large model fit in memory. A compiled function that fails gives NA for that set and time. Default NULL, every state
+//'@returns A 3-D array whose slice \code{[, , k]} is the solution for the k-th set, the matrix \code{cvode()} would return: the first column is the time-vector, the other columns are values of y, or the \code{outputs}. A set that fails to solve has NA from the output time it failed at, and a warning names the first such set. The array has an attribute \code{status}, the return code of CVODE for each set: 0 when it was solved, negative when it failed; \code{steps}, the internal steps CVODE took for each set (with \code{ensemble}, for its group), to see how unevenly the work was spread and to pass as \code{cost} to a later call; and \code{thread}, the number of the thread that solved each set.
+//'@example /inst/examples/cvode_batch.r
+// [[Rcpp::export]]
+NumericVector cvode_batch(NumericVector time_vector, NumericVector IC,
+                          SEXP input_function, NumericVector Parameters,
+                          double reltolerance = 0.0001,
+                          NumericVector abstolerance = 0.0001,
+                          SEXP jacobian = R_NilValue,
+                          int threads = 0,
+                          SEXP cost = R_NilValue,
+                          int ensemble = 1,
+                          SEXP outputs = R_NilValue){
+
+  int NOUT = time_vector.length();
+  if (NOUT < 1) stop("time_vector must have at least one value");
+
+  // the states and parameters per set, and the number of sets
+  int y_len = Rf_isMatrix(IC) ? Rf_ncols(IC) : IC.length();
+  int p_len = Rf_isMatrix(Parameters) ? Rf_ncols(Parameters) : Parameters.length();
+  int ic_rows = batch_rows(IC, y_len, "IC");
+  int p_rows = batch_rows(Parameters, p_len, "Parameters");
+  if (ic_rows != 1 && p_rows != 1 && ic_rows != p_rows) {
+    stop("IC has %d rows and Parameters %d: they must have the same number, one per set", ic_rows, p_rows);
+  }
+  int n_sets = std::max(ic_rows, p_rows);
+
+  NumericVector cost_v;
+  if (cost != R_NilValue) {
+    cost_v = NumericVector(cost);
+    if (cost_v.length() != n_sets) stop("cost has %d values but there are %d sets", (int) cost_v.length(), n_sets);
+    for (int k = 0; k < n_sets; k++) {
+      if (!R_FINITE(cost_v[k])) stop("cost must be finite; set %d has %g", k + 1, cost_v[k]);
+    }
+  }
+
+  int abstol_len = abstolerance.length();
+  if(abstol_len != 1 && abstol_len != y_len){
+    stop("Absolute tolerance must be a scalar or a vector of same length as IC\n");
+  }
+  if (ensemble < 1) stop("ensemble must be at least 1");
+  // no bigger a group than there are sets
+  const int K = std::min(ensemble, n_sets);
+
+  // the right-hand side and Jacobian, compiled or a model, never R
+  batch_model fn;
+  fn.n = y_len;
+  fn.n_params = p_len;
+  if ((fn.model = expr_model_get(input_function)) != NULL) {
+    expr_model_check(fn.model, y_len, p_len);
+  } else if (TYPEOF(input_function) == EXTPTRSXP) {
+    fn.rhs_native = (sundialr_rhs) sundialr_xptr_get(input_function, "sundialr_rhs");
+    fn.rhs_ens = (sundialr_rhs_ensemble) sundialr_xptr_get(input_function, "sundialr_rhs_ensemble");
+    if (!fn.rhs_native && !fn.rhs_ens) {
+      stop("The input function is an external pointer but not a valid compiled RHS: make it with sundialr_xptr_rhs() or sundialr_xptr_rhs_ensemble() from sundialr_xptr.h");
+    }
+  } else {
+    stop("cvode_batch() solves on threads that cannot call R: the input function must be a compiled function made with sundialr_xptr_rhs() or a model built by ode_model()");
+  }
+  if (TYPEOF(jacobian) == EXTPTRSXP) {
+    fn.jac_native = (sundialr_jac) sundialr_xptr_get(jacobian, "sundialr_jac");
+    fn.jac_ens = (sundialr_jac_ensemble) sundialr_xptr_get(jacobian, "sundialr_jac_ensemble");
+    if (!fn.jac_native && !fn.jac_ens) {
+      stop("The Jacobian is an external pointer but not a valid compiled Jacobian: make it with sundialr_xptr_jac() or sundialr_xptr_jac_ensemble() from sundialr_xptr.h");
+    }
+  } else if (jacobian != R_NilValue) {
+    stop("cvode_batch() solves on threads that cannot call R: the Jacobian must be a compiled Jacobian made with sundialr_xptr_jac()");
+  }
+  fn.model_jac = fn.model && fn.model->has_jac && !fn.jac_native && !fn.jac_ens;
+
+  // every state, or what is stored of it instead (see output_select.h)
+  output_select outs = output_select_parse(outputs, input_function, y_len, p_len);
+  const int n_cols = outs.n_out + 1;
+
+  // the sets of each group, in groups of K: by cost when it is known, so that
+  // sets that take about the same steps share them, otherwise in order. The
+  // last group may have fewer.
+  int n_groups = (n_sets + K - 1) / K;
+  std::vector<int> order(n_sets);
+  for (int k = 0; k < n_sets; k++) order[k] = k;
+  std::vector<double> group_cost;
+  if (K > 1 && cost != R_NilValue) {
+    const double *c = cost_v.begin();
+    std::stable_sort(order.begin(), order.end(), [c](int a, int b) { return c[a] > c[b]; });
+    group_cost.resize(n_groups);
+    for (int g = 0; g < n_groups; g++) group_cost[g] = c[order[(size_t) g * K]];
+  }
+
+  // one handle per worker, set up here, where a failure can still stop()
+  std::vector<double> rtol_v(y_len, reltolerance), atol_v(y_len);
+  for (int i = 0; i < y_len; i++) atol_v[i] = abstolerance[abstol_len == 1 ? 0 : i];
+
+  int n_workers = batch_workers(threads, K > 1 ? n_groups : n_sets);
+  std::vector<std::unique_ptr<batch_worker>> workers;
+  for (int w = 0; w < n_workers; w++) {
+    workers.emplace_back(new batch_worker());
+    batch_worker &wk = *workers.back();
+    wk.fn = &fn;
+    wk.y.resize(y_len);
+    wk.p.resize(p_len);
+    outs.init_scratch(wk.out_regs);
+    wk.out_row.resize(outs.n_out);
+    if (fn.model) fn.model->rhs.init_scratch(wk.regs);
+    if (fn.model_jac) {
+      fn.model->jac.init_scratch(wk.jac_regs);
+      wk.jac_vals.resize(fn.model->jac_rows.size());
+    }
+    wk.cvode = sundialr_cvode_create(y_len, &wk);
+    if (!wk.cvode) stop("Stopping cvode_batch, cannot allocate memory for the solver of a thread!");
+    int flag = sundialr_cvode_set_rhs(wk.cvode, batch_rhs);
+    if (flag >= 0 && fn.has_jac()) flag = sundialr_cvode_set_jac(wk.cvode, batch_jac);
+    if (flag >= 0) {
+      flag = abstol_len == 1 ? sundialr_cvode_set_tol_scalar(wk.cvode, reltolerance, abstolerance[0])
+                             : sundialr_cvode_set_tol_vector(wk.cvode, rtol_v.data(), atol_v.data());
+    }
+    if (flag < 0) {
+      const char *msg = sundialr_cvode_last_err(wk.cvode);
+      stop("Stopping cvode_batch, something went wrong in setting up the solver: %s",
+           msg ? msg : "unknown error");
+    }
+    if (K == 1) continue;
+
+    // and the ensemble's
+    wk.K = K;
+    wk.ens_y.resize((size_t) y_len * K);
+    wk.ens_p.resize((size_t) p_len * K);
+    wk.ens_p_sets.resize((size_t) p_len * K);
+    wk.lane_y.resize(y_len);
+    wk.lane_f.resize(y_len);
+    wk.lane_J.resize((size_t) y_len * y_len);
+    if (fn.model) fn.model->rhs.init_scratch(wk.ens_regs, K);
+    if (fn.model_jac) {
+      fn.model->jac.init_scratch(wk.ens_jac_regs, K);
+      wk.ens_jac_vals.resize(fn.model->jac_rows.size() * K);
+    }
+    wk.ens = sundialr_cvode_create_ensemble(y_len, K, &wk);
+    if (!wk.ens) stop("Stopping cvode_batch, cannot allocate memory for the solver of a thread!");
+    flag = sundialr_cvode_set_rhs_ensemble(wk.ens, batch_rhs_ensemble);
+    if (flag >= 0 && fn.has_jac()) flag = sundialr_cvode_set_jac_ensemble(wk.ens, batch_jac_ensemble);
+    if (flag >= 0) {
+      flag = abstol_len == 1 ? sundialr_cvode_set_tol_scalar(wk.ens, reltolerance, abstolerance[0])
+                             : sundialr_cvode_set_tol_vector(wk.ens, rtol_v.data(), atol_v.data());
+    }
+    if (flag < 0) {
+      const char *msg = sundialr_cvode_last_err(wk.ens);
+      stop("Stopping cvode_batch, something went wrong in setting up the solver: %s",
+           msg ? msg : "unknown error");
+    }
+  }
+
+  // filled in by the workers, each set in its own slice
+  NumericVector soln(Dimension(NOUT, n_cols, n_sets));
+  IntegerVector status(n_sets), steps(n_sets), thread(n_sets);
+  double *out = soln.begin();
+  int *status_ptr = status.begin(), *steps_ptr = steps.begin(), *thread_ptr = thread.begin();
+  const double *ic = IC.begin(), *params = Parameters.begin(), *times = time_vector.begin();
+  const double na = NA_REAL;
+
+  // the failure of the lowest-numbered set that failed
+  std::mutex fail_mutex;
+  int fail_set = -1;
+  std::string fail_msg;
+
+  // row iout of a set's slice: the time, and what is stored of its state y
+  // with parameters p, NA where a compiled outputs function fails
+  auto store = [&](batch_worker &wk, double *slice, int iout, double t,
+                   const double *y, const double *p) {
+    slice[iout] = t;
+    const double *v = outs.row(t, y, p, wk.out_regs.data(), wk.out_row.data());
+    for (int j = 0; j < outs.n_out; j++) {
+      slice[iout + (R_xlen_t) (j + 1) * NOUT] = v ? v[j] : na;
+    }
+  };
+
+  auto solve_set = [&](int worker, int k) {
+    batch_worker &wk = *workers[worker];
+    for (int i = 0; i < y_len; i++) wk.y[i] = ic[ic_rows == 1 ? i : k + (R_xlen_t) i * ic_rows];
+    for (int j = 0; j < p_len; j++) wk.p[j] = params[p_rows == 1 ? j : k + (R_xlen_t) j * p_rows];
+
+    double *slice = out + (R_xlen_t) k * NOUT * n_cols;
+    store(wk, slice, 0, times[0], wk.y.data(), wk.p.data());
+
+    int flag = sundialr_cvode_reinit(wk.cvode, times[0], wk.y.data());
+    int iout = 1;
+    for (; flag >= 0 && iout < NOUT; iout++) {
+      double t;
+      flag = sundialr_cvode_solve(wk.cvode, times[iout], wk.y.data(), &t);
+      if (flag < 0) break;
+      store(wk, slice, iout, t, wk.y.data(), wk.p.data());
+    }
+    status_ptr[k] = flag < 0 ? flag : 0;
+    steps_ptr[k] = (int) std::max(0L, sundialr_cvode_get_num_steps(wk.cvode));
+    thread_ptr[k] = worker + 1;
+    if (flag < 0) {
+      for (; iout < NOUT; iout++) {
+        slice[iout] = times[iout];
+        for (int j = 0; j < outs.n_out; j++) slice[iout + (R_xlen_t) (j + 1) * NOUT] = na;
+      }
+      const char *msg = sundialr_cvode_last_err(wk.cvode);
+      std::lock_guard<std::mutex> lock(fail_mutex);
+      if (fail_set < 0 || k < fail_set) {
+        fail_set = k;
+        fail_msg = msg ? msg : "CVODE returned error code " + std::to_string(flag);
+      }
+    }
+  };
+
+  // the same for lane k of a group, whose state is structure-of-arrays
+  auto store_lane = [&](batch_worker &wk, int k, double *slice, int iout, double t) {
+    if (outs.all) {
+      slice[iout] = t;
+      for (int i = 0; i < y_len; i++) {
+        slice[iout + (R_xlen_t) (i + 1) * NOUT] = wk.ens_y[(size_t) i * K + k];
+      }
+      return;
+    }
+    for (int i = 0; i < y_len; i++) wk.lane_y[i] = wk.ens_y[(size_t) i * K + k];
+    store(wk, slice, iout, t, wk.lane_y.data(), wk.ens_p_sets.data() + (size_t) k * p_len);
+  };
+
+  // a group of sets in lockstep: lane k takes set k of the group, and the
+  // lanes past the last set copies of it, whose results are dropped
+  auto solve_group = [&](int worker, int g) {
+    batch_worker &wk = *workers[worker];
+    const int *sets = order.data() + (size_t) g * K;
+    const int n_in = std::min(K, n_sets - g * K);
+    for (int k = 0; k < K; k++) {
+      int set = sets[std::min(k, n_in - 1)];
+      for (int i = 0; i < y_len; i++) {
+        wk.ens_y[(size_t) i * K + k] = ic[ic_rows == 1 ? i : set + (R_xlen_t) i * ic_rows];
+      }
+      for (int j = 0; j < p_len; j++) {
+        double pj = params[p_rows == 1 ? j : set + (R_xlen_t) j * p_rows];
+        wk.ens_p[(size_t) j * K + k] = pj;
+        wk.ens_p_sets[(size_t) k * p_len + j] = pj;
+      }
+    }
+
+    int flag = sundialr_cvode_reinit(wk.ens, times[0], wk.ens_y.data());
+    for (int k = 0; k < n_in; k++) {
+      store_lane(wk, k, out + (R_xlen_t) sets[k] * NOUT * n_cols, 0, times[0]);
+    }
+    for (int iout = 1; flag >= 0 && iout < NOUT; iout++) {
+      double t;
+      flag = sundialr_cvode_solve(wk.ens, times[iout], wk.ens_y.data(), &t);
+      if (flag < 0) break;
+      for (int k = 0; k < n_in; k++) {
+        store_lane(wk, k, out + (R_xlen_t) sets[k] * NOUT * n_cols, iout, t);
+      }
+    }
+    if (flag < 0) {
+      for (int k = 0; k < n_in; k++) solve_set(worker, sets[k]);
+      return;
+    }
+    int group_steps = (int) std::max(0L, sundialr_cvode_get_num_steps(wk.ens));
+    for (int k = 0; k < n_in; k++) {
+      status_ptr[sets[k]] = 0;
+      steps_ptr[sets[k]] = group_steps;
+      thread_ptr[sets[k]] = worker + 1;
+    }
+  };
+
+  auto poll = [] { return R_ToplevelExec(batch_check_interrupt, NULL) == TRUE; };
+  bool completed = K > 1
+    ? batch_run(n_workers, n_groups, solve_group, poll,
+                group_cost.empty() ? NULL : group_cost.data())
+    : batch_run(n_workers, n_sets, solve_set, poll,
+                cost == R_NilValue ? NULL : cost_v.begin());
+  if (!completed) stop("cvode_batch was interrupted");
+
+  if (fail_set >= 0) {
+    int n_failed = 0;
+    for (int k = 0; k < n_sets; k++) n_failed += status[k] != 0;
+    Rcpp::warning("%d of %d sets could not be solved and have NA from where they failed; the first, set %d: %s",
+                  n_failed, n_sets, fail_set + 1, fail_msg.c_str());
+  }
+
+  soln.attr("status") = status;
+  soln.attr("steps") = steps;
+  soln.attr("thread") = thread;
+  return soln;
+}
+//--- cvode_batch definition ends ----------------------------------------------
@@ -0,0 +1,322 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Rcpp.h>
+
+#include <cvode/cvode.h>             /* prototypes for CVODE fcts., consts. */
+#include <nvector/nvector_serial.h>  /* serial N_Vector types, fcts., macros */
+#include <sundials/sundials_types.h> /* definition of type realtype */
+
+#include <check_retval.h>
+#include <cvode_solver.h>
+#include <jac_func.h>
+
+// CRAN fix: replace SUNDIALS' default abort()-based error handler with one that
+// records the error for the solver to raise via stop() (see the header)
+#include <sundials_err_handler.h>
+
+using namespace Rcpp;
+
+// The Jacobian, as jac_cvode in cvode.cpp
+static int jac_solver(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
+                      void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3) {
+
+  struct rhs_func *data = (struct rhs_func*)user_data;
+  if (!data) { return -1; }
+
+  if (data->fd.active()) {
+    return rhs_jac_fd(t, y, fy, JAC, user_data, tmp1, tmp2);
+  }
+  if (data->jac_band) {
+    return jac_eval_native_band(data->jac_band, t, y, JAC, data->params.begin());
+  }
+  if (data->jac_sparse) {
+    return jac_eval_native_sparse(data->jac_sparse, t, y, JAC, data->params.begin(),
+                                  data->pattern);
+  }
+  if (data->jac_native) {
+    return jac_eval_native(data->jac_native, t, y, JAC, data->params.begin(),
+                           data->jac_scratch, data->pattern);
+  }
+  if (data->model_jac) {
+    return jac_eval_model(data->model, t, y, JAC, data->params.begin(),
+                          data->jac_regs.data(), data->jac_vals.data(),
+                          data->pattern);
+  }
+  return sundials_callback_guard(data->err, [&]() -> int {
+    return jac_eval(t, y, JAC, data->jac_eqn, data->params, data->pattern);
+  });
+}
+
+static void cvode_solver_finalize(SEXP ptr) {
+  cvode_solver_handle *h = (cvode_solver_handle*) R_ExternalPtrAddr(ptr);
+  if (h) {
+    delete h;
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+cvode_solver_handle *cvode_solver_get(SEXP solver) {
+  if (TYPEOF(solver) != EXTPTRSXP || R_ExternalPtrTag(solver) != Rf_install("sundialr_cvode_solver")) {
+    stop("solver must be a solver made by cvode_solver()");
+  }
+  cvode_solver_handle *h = (cvode_solver_handle*) R_ExternalPtrAddr(solver);
+  if (!h) {
+    stop("The solver is no longer valid, as after saving and reloading the session: make it again with cvode_solver()");
+  }
+  return h;
+}
+
+// Copy new values into the state and, unless NULL, the parameters
+static void cvode_solver_set(cvode_solver_handle *h, NumericVector IC, SEXP Parameters) {
+  if (IC.length() != h->n) {
+    stop("IC must have %d values, one per state of the solver; got %d", h->n, (int) IC.length());
+  }
+  sunrealtype *y_ptr = N_VGetArrayPointer(h->y);
+  for (int i = 0; i < h->n; i++) y_ptr[i] = IC[i];
+
+  if (Parameters != R_NilValue) {
+    NumericVector p(Parameters);
+    NumericVector &params = h->rhs->params;
+    if (p.length() != params.length()) {
+      stop("Parameters must have %d values, as when the solver was made; got %d",
+           (int) params.length(), (int) p.length());
+    }
+    std::copy(p.begin(), p.end(), params.begin());
+  }
+}
+
+//'cvode_solver
+//'
+//' A CVODE solver kept between calls, for many short solves of the same system
+//' with new initial conditions or parameters, as in an optimiser or a fit.
+//' \code{cvode()} sets up and frees the integrator, its vectors, matrix and
+//' linear solver on every call; a solver made here owns them once, and
+//' \code{\link{solver_reinit}} and \code{\link{solver_solve}} reuse them, so a
+//' further solve costs only the integration.
+//'@param t0 Initial time
+//'@param IC Initial Conditions
+//'@param input_function Right Hand Side function of ODEs, an R or Rcpp function, a compiled function or a model built by \code{\link{ode_model}}, as in \code{\link{cvode}}
+//'@param Parameters Parameters input to ODEs. The solver keeps its own copy, which \code{\link{solver_reinit}} may change
+//'@param reltolerance Relative Tolerance (a scalar, default value  = 1e-04)
+//'@param abstolerance Absolute Tolerance (a scalar or vector with length equal to ydot (dy/dx), default = 1e-04)
+//'@param jacobian (Optional) Jacobian of the RHS, as in \code{\link{cvode}}. Default NULL
+//'@param mupper,mlower (Optional) Half-bandwidths of the Jacobian, for a band matrix, as in \code{\link{cvode}}. Default NULL (dense)
+//'@param sparsity (Optional) Sparsity pattern of the Jacobian, for a sparse matrix, as in \code{\link{cvode}}. Default NULL (dense)
+//'@param linear_solver (Optional) The linear solver, as in \code{\link{cvode}}. Default NULL
+//'@param jtimes,psetup,psolve (Optional) Jacobian-times-vector and preconditioner functions for a Krylov \code{linear_solver}, as in \code{\link{cvode}}. Default NULL
+//'@returns An external pointer of class \code{sundialr_solver}, at time \code{t0} and state \code{IC}. Like any external pointer it is not saved with the workspace. The SUNDIALS objects it owns are freed when it is garbage collected.
+//'@example /inst/examples/cvode_solver.r
+// [[Rcpp::export]]
+SEXP cvode_solver(double t0, NumericVector IC, SEXP input_function,
+                  NumericVector Parameters,
+                  double reltolerance = 0.0001,
+                  NumericVector abstolerance = 0.0001,
+                  SEXP jacobian = R_NilValue,
+                  SEXP mupper = R_NilValue,
+                  SEXP mlower = R_NilValue,
+                  SEXP sparsity = R_NilValue,
+                  SEXP linear_solver = R_NilValue,
+                  SEXP jtimes = R_NilValue,
+                  SEXP psetup = R_NilValue,
+                  SEXP psolve = R_NilValue){
+
+  int flag;
+  int y_len = IC.length();
+
+  // everything is freed by the handle's destructor until the external pointer
+  // takes it over at the end
+  std::unique_ptr<cvode_solver_handle> h(new cvode_solver_handle());
+  sundials_err_record &sun_err = h->err;
+  h->n = y_len;
+  h->t = t0;
+  h->ls_spec = linsol_parse(mupper, mlower, sparsity, linear_solver, y_len);
+
+  if(TYPEOF(input_function) != CLOSXP && TYPEOF(input_function) != EXTPTRSXP) {
+    stop("Incorrect input function type - input function can be an R or Rcpp function, a compiled function made with sundialr_xptr_rhs(), or a model built by ode_model()");
+  }
+
+  int abstol_len = abstolerance.length();
+  if(abstol_len != 1 && abstol_len != y_len){
+    stop("Absolute tolerance must be a scalar or a vector of same length as IC\n");
+  }
+
+  SUNContext_Create(SUN_COMM_NULL, &h->sunctx);
+  SUNContext_PushErrHandler(h->sunctx, sundials_r_err_handler, &sun_err);
+  sundials_check(sun_err);
+
+  h->abstol = N_VNew_Serial(y_len, h->sunctx);
+  h->y = N_VNew_Serial(y_len, h->sunctx);
+  sundials_check(sun_err);
+  sunrealtype *abstol_ptr = N_VGetArrayPointer(h->abstol);
+  sunrealtype *y_ptr = N_VGetArrayPointer(h->y);
+  for (int i = 0; i < y_len; i++) {
+    abstol_ptr[i] = abstolerance[abstol_len == 1 ? 0 : i];
+    y_ptr[i] = IC[i];
+  }
+
+  h->cvode_mem = CVodeCreate(CV_BDF, h->sunctx);
+  if (check_retval(h->cvode_mem, "CVodeCreate")) {
+    sundials_stop(sun_err, "CVodeCreate", "Something went wrong in assigning memory, stopping cvode_solver!");
+  }
+
+  // a private copy of the parameters, for solver_reinit() to overwrite
+  NumericVector params = Rcpp::clone(Parameters);
+  h->rhs.reset(new rhs_func(input_function, params, jacobian, &sun_err, y_len));
+  rhs_func &my_rhs_function = *h->rhs;
+  linsol_spec &ls_spec = h->ls_spec;
+  my_rhs_function.pattern = linsol_pattern_of(ls_spec);
+  jac_native_check(my_rhs_function.jac_band != NULL, my_rhs_function.jac_sparse != NULL,
+                   ls_spec.band, ls_spec.sparse);
+  if (ls_spec.sparse && !my_rhs_function.has_jacobian()) {
+    if (!my_rhs_function.fd.init(&ls_spec.pattern, h->cvode_mem, h->y)) {
+      sundials_stop(sun_err, "N_VClone", "Stopping cvode_solver, cannot allocate memory for the finite-difference Jacobian!");
+    }
+  }
+  linsol_check_krylov(ls_spec, jacobian, jtimes != R_NilValue || psetup != R_NilValue ||
+                      psolve != R_NilValue);
+  my_rhs_function.krylov = krylov_func(jtimes, psetup, psolve, params, &sun_err, y_len, false);
+  ls_spec.precondition = my_rhs_function.krylov.has_psolve();
+
+  flag = CVodeSetUserData(h->cvode_mem, (void*)&my_rhs_function);
+  if (check_retval(flag, "CVodeSetUserData")) { sundials_stop(sun_err, "CVodeSetUserData", "Stopping cvode_solver, something went wrong in setting user data!"); }
+
+  flag = CVodeInit(h->cvode_mem, my_rhs_function.rhs_callback(), t0, h->y);
+  if (check_retval(flag, "CVodeInit")) { sundials_stop(sun_err, "CVodeInit", "Stopping cvode_solver, something went wrong in initializing CVODE!"); }
+
+  flag = CVodeSVtolerances(h->cvode_mem, reltolerance, h->abstol);
+  if (check_retval(flag, "CVodeSVtolerances")) { sundials_stop(sun_err, "CVodeSVtolerances", "Stopping cvode_solver, something went wrong in setting solver tolerances!"); }
+
+  const char *ls_failed = linsol_create(ls_spec, h->y, h->sunctx, &h->SM, &h->LS);
+  if (ls_failed) { sundials_stop(sun_err, ls_failed, "Stopping cvode_solver, something went wrong in setting the linear solver!"); }
+
+  flag = CVodeSetLinearSolver(h->cvode_mem, h->LS, h->SM);
+  if(check_retval(flag, "CVodeSetLinearSolver")) { sundials_stop(sun_err, "CVodeSetLinearSolver", "Stopping cvode_solver, something went wrong in setting the linear solver!"); }
+
+  if (ls_spec.krylov != LINSOL_DIRECT) {
+    if (my_rhs_function.jtimes_callback()) {
+      flag = CVodeSetJacTimes(h->cvode_mem, my_rhs_function.jtsetup_callback(),
+                              my_rhs_function.jtimes_callback());
+      if(check_retval(flag, "CVodeSetJacTimes")) { sundials_stop(sun_err, "CVodeSetJacTimes", "Stopping cvode_solver, something went wrong in setting the Jacobian-times-vector function!"); }
+    }
+    if (my_rhs_function.krylov.has_psolve()) {
+      flag = CVodeSetPreconditioner(h->cvode_mem,
+                                    my_rhs_function.krylov.has_psetup() ? rhs_psetup : NULL,
+                                    rhs_psolve);
+      if(check_retval(flag, "CVodeSetPreconditioner")) { sundials_stop(sun_err, "CVodeSetPreconditioner", "Stopping cvode_solver, something went wrong in setting the preconditioner!"); }
+    }
+  } else if (my_rhs_function.has_jacobian()) {
+    flag = CVodeSetJacFn(h->cvode_mem, jac_solver);
+    if(check_retval(flag, "CVodeSetJacFn")) { sundials_stop(sun_err, "CVodeSetJacFn", "Stopping cvode_solver, something went wrong in setting the Jacobian function!"); }
+  }
+
+  // the pointer is tagged so that solver_reinit() and solver_solve() can tell
+  // it from any other external pointer. The handle keeps the model, and the R
+  // functions, by their address alone, so the pointer protects them: a model
+  // or Jacobian made inline in the call would otherwise be collected, and
+  // the model freed by its finalizer, while the solver is still in use.
+  SEXP keep = PROTECT(Rf_allocVector(VECSXP, 5));
+  SET_VECTOR_ELT(keep, 0, input_function);
+  SET_VECTOR_ELT(keep, 1, jacobian);
+  SET_VECTOR_ELT(keep, 2, jtimes);
+  SET_VECTOR_ELT(keep, 3, psetup);
+  SET_VECTOR_ELT(keep, 4, psolve);
+  SEXP ptr = PROTECT(R_MakeExternalPtr(h.release(), Rf_install("sundialr_cvode_solver"), keep));
+  R_RegisterCFinalizerEx(ptr, cvode_solver_finalize, TRUE);
+  Rf_setAttrib(ptr, R_ClassSymbol, Rf_mkString("sundialr_solver"));
+  UNPROTECT(2);
+  return ptr;
+}
+
+//'solver_reinit
+//'
+//' Restart a solver made by \code{\link{cvode_solver}} at a new time and
+//' state, and optionally with new parameter values, reusing all its memory.
+//' CVODE forgets its step history, exactly as at the start of a new
+//' \code{cvode()} call.
+//'@param solver A solver made by \code{\link{cvode_solver}}
+//'@param t0 Initial time
+//'@param IC Initial Conditions, one per state
+//'@param Parameters (Optional) New values of the parameters, as many as the solver was made with. Default NULL, to keep the current ones
+//'@returns The solver, which is changed in place
+// [[Rcpp::export]]
+SEXP solver_reinit(SEXP solver, double t0, NumericVector IC,
+                   SEXP Parameters = R_NilValue){
+
+  cvode_solver_handle *h = cvode_solver_get(solver);
+  cvode_solver_set(h, IC, Parameters);
+
+  h->err = sundials_err_record();
+  int flag = CVodeReInit(h->cvode_mem, t0, h->y);
+  if (check_retval(flag, "CVodeReInit")) { sundials_stop(h->err, "CVodeReInit", "Stopping solver_reinit, something went wrong in reinitializing CVODE!"); }
+  h->t = t0;
+  return solver;
+}
+
+//'solver_solve
+//'
+//' Integrate a solver made by \code{\link{cvode_solver}} from its current time
+//' through the output times. The solver is left at the last of them, so a
+//' further call continues from there.
+//'@param solver A solver made by \code{\link{cvode_solver}}
+//'@param time_vector Output times, increasing, none before the solver's current time. A time equal to it gives the current state, so a \code{time_vector} starting at the \code{t0} of \code{\link{solver_reinit}} gives the same matrix as \code{cvode()}
+//'@returns A Matrix. First column is the time-vector, the other columns are values of y in order they are provided.
+// [[Rcpp::export]]
+NumericMatrix solver_solve(SEXP solver, NumericVector time_vector){
+
+  cvode_solver_handle *h = cvode_solver_get(solver);
+  int NOUT = time_vector.length();
+  for (int k = 0; k < NOUT; k++) {
+    if (ISNAN(time_vector[k]) || time_vector[k] < (k == 0 ? h->t : time_vector[k - 1])) {
+      stop("time_vector must be increasing and start no earlier than the solver's current time, %g", h->t);
+    }
+  }
+
+  NumericMatrix soln(Dimension(NOUT, h->n + 1));
+  sunrealtype *y_ptr = N_VGetArrayPointer(h->y);
+  h->err = sundials_err_record();
+
+  for (int iout = 0; iout < NOUT; iout++) {
+    sunrealtype tout = time_vector[iout];
+    if (tout > h->t) {
+      int flag = CVode(h->cvode_mem, tout, h->y, &h->t, CV_NORMAL);
+      if (check_retval(flag, "CVode")) {
+        sundials_stop(h->err, "CVode", "Stopping solver_solve, something went wrong in solving the system of ODEs!");
+      }
+    }
+    soln(iout, 0) = tout;
+    for (int i = 0; i < h->n; i++) {
+      soln(iout, i + 1) = y_ptr[i];
+    }
+  }
+
+  return soln;
+}
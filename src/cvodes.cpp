@@ -30,6 +30,7 @@
 
 #include <Rcpp.h>
 #include <algorithm>                   // to convert SensType to upper case - input cleaning
+#include <vector>
 
 #include <cvodes/cvodes.h>
 #include <nvector/nvector_serial.h>    /* access to serial N_Vector            */
@@ -37,9 +38,16 @@
 #include <sundials/sundials_types.h>   /* defs. of realtype, sunindextype      */
 #include <sunlinsol/sunlinsol_dense.h> /* access to dense SUNLinearSolver      */
 #include <sunmatrix/sunmatrix_dense.h>
+#include <sunmatrix/sunmatrix_band.h>  /* used by jac_func.h                   */
+#include <sunmatrix/sunmatrix_sparse.h>
 
 #include <check_retval.h>
+#include <sunlinsol_small_dense.h>
 #include <jac_func.h>
+#include <r_callback.h>
+#include <sundialr_xptr.h>
+#include <expr_model.h>
+#include <solver_stats.h>
 #include <sundials_scope_guard.h>
 // CRAN fix: replace SUNDIALS' default abort()-based error handler with one that
 // records the error for the solver to raise via stop() (see the header)
@@ -50,15 +58,115 @@
 
 using namespace Rcpp;
 
-// struct to use if R or Rcpp function is input as RHS function----------------
+// struct to use as user data for cvodes. The RHS, Jacobian and sensitivity RHS
+// are each an R or Rcpp function or a compiled function passed as an external
+// pointer (see sundialr_xptr.h); the Jacobian and sensitivity RHS may be absent.
+// The RHS may also be a model built by ode_model() (see expr_model.h).
 struct rhs_func_sens{
-  Function rhs_eqn;
   NumericVector params;
   double rtol;
   NumericVector atol;
   SEXP jac_eqn;
   SEXP sens_eqn;              // user sensitivity RHS, or R_NilValue
   sundials_err_record *err;   // collects errors raised inside the callbacks
+
+  // Compiled functions, called directly with the parameter values as udata;
+  // NULL when the corresponding function is an R function (or absent). At most
+  // one of the two compiled sensitivity forms is set.
+  sundialr_rhs rhs_native;
+  sundialr_jac jac_native;
+  sundialr_sens_rhs sens_native;
+  sundialr_sens_rhs1 sens1_native;
+
+  // Model built by ode_model(), and the registers it is evaluated in
+  const expr_model *model;
+  std::vector<double> model_regs;
+
+  // Set when the model's symbolic Jacobian is used (see rhs_func.h)
+  bool model_jac;
+  std::vector<double> jac_regs;
+  std::vector<double> jac_vals;
+
+  // Allocated once per solve and reused by every call of rhs_function_sens and
+  // sens_rhs1_cvodes (see r_callback.h). Unused for compiled functions.
+  NumericVector t_arg;        // length 1
+  NumericVector y_arg;        // length of the state vector
+  NumericVector ydot_arg;     // length of the state vector
+  IntegerVector iS_arg;       // length 1, the 1-based parameter index
+  NumericVector yS_arg;       // length of the state vector
+  RObject rhs_call;           // rhs_eqn(t_arg, y_arg, params)
+  RObject sens_call;          // sens_eqn(t_arg, y_arg, ydot_arg, iS_arg, yS_arg, params)
+
+  // Row pointers handed to an all-at-once compiled sensitivity RHS, one per
+  // parameter, refilled on every call from the N_Vector arrays CVODES passes
+  std::vector<const double*> yS_ptrs;
+  std::vector<double*> ySdot_ptrs;
+
+  // Times the callbacks below when cvodes reports stats or a profile (see
+  // callback_timer.h); NULL otherwise
+  solver_clock *clock;
+
+  // A compiled function is called through the pointer without any further
+  // check, so the tag naming its signature is verified here, before the solve
+  rhs_func_sens(SEXP rhs_eqn, NumericVector params_, double rtol_,
+                NumericVector atol_, SEXP jac_eqn_, SEXP sens_eqn_,
+                sundials_err_record *err_, int y_len)
+    : params(params_), rtol(rtol_), atol(atol_),
+      jac_eqn(jac_eqn_), sens_eqn(sens_eqn_), err(err_),
+      rhs_native(NULL), jac_native(NULL), sens_native(NULL), sens1_native(NULL),
+      model(NULL), model_jac(false), clock(NULL) {
+
+    t_arg = r_arg_buffer(1);
+    y_arg = r_arg_buffer(y_len);
+
+    if ((model = expr_model_get(rhs_eqn)) != NULL) {
+      expr_model_check(model, y_len, params.length());
+      model->rhs.init_scratch(model_regs);
+      if (model->has_jac && jac_eqn == R_NilValue) {
+        model_jac = true;
+        model->jac.init_scratch(jac_regs);
+        jac_vals.resize(model->jac_rows.size());
+      }
+    } else if (TYPEOF(rhs_eqn) == EXTPTRSXP) {
+      rhs_native = (sundialr_rhs) sundialr_xptr_get(rhs_eqn, "sundialr_rhs");
+      if (!rhs_native) {
+        stop("The input function is an external pointer but not a valid compiled RHS: make it with sundialr_xptr_rhs() from sundialr_xptr.h");
+      }
+    } else {
+      Function rhs_fun(rhs_eqn);
+      rhs_call = Language(rhs_fun, t_arg, y_arg, params);
+    }
+
+    if (TYPEOF(jac_eqn) == EXTPTRSXP) {
+      jac_native = (sundialr_jac) sundialr_xptr_get(jac_eqn, "sundialr_jac");
+      if (!jac_native) {
+        stop("The Jacobian is an external pointer but not a valid compiled Jacobian: make it with sundialr_xptr_jac() from sundialr_xptr.h");
+      }
+    } else if (jac_eqn != R_NilValue && !Rf_isFunction(jac_eqn)) {
+      stop("The Jacobian must be an R or Rcpp function, or a compiled Jacobian made with sundialr_xptr_jac()");
+    }
+
+    // the sensitivity RHS may be compiled in either of the two CVODES forms
+    if (TYPEOF(sens_eqn) == EXTPTRSXP) {
+      sens_native = (sundialr_sens_rhs) sundialr_xptr_get(sens_eqn, "sundialr_sens_rhs");
+      sens1_native = (sundialr_sens_rhs1) sundialr_xptr_get(sens_eqn, "sundialr_sens_rhs1");
+      if (!sens_native && !sens1_native) {
+        stop("The sensitivity function is an external pointer but not a valid compiled sensitivity RHS: make it with sundialr_xptr_sens_rhs() or sundialr_xptr_sens_rhs1() from sundialr_xptr.h");
+      }
+      yS_ptrs.resize(params.length());
+      ySdot_ptrs.resize(params.length());
+    } else if (sens_eqn != R_NilValue) {
+      if (!Rf_isFunction(sens_eqn)) {
+        stop("The sensitivity function must be an R or Rcpp function, or a compiled sensitivity RHS made with sundialr_xptr_sens_rhs() or sundialr_xptr_sens_rhs1()");
+      }
+      Function sens_fun(sens_eqn);
+      ydot_arg = r_arg_buffer(y_len);
+      yS_arg = r_arg_buffer(y_len);
+      iS_arg = IntegerVector(1);
+      MARK_NOT_MUTABLE(iS_arg);
+      sens_call = Language(sens_fun, t_arg, y_arg, ydot_arg, iS_arg, yS_arg, params);
+    }
+  }
 };
 
 // function called by CVodeInit if user inputs R function
@@ -71,45 +179,55 @@ int rhs_function_sens(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data)
 
   // nothing to record against, so just report the failure to SUNDIALS
   if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock);
 
   return sundials_callback_guard(my_rhs_fun->err, [&]() -> int {
 
-    // convert y (N_Vector) to NumericVector y1
     int y_len = NV_LENGTH_S(y);
 
-    NumericVector y1(y_len);    // filled with zeros
+    // copy t and y into the argument buffers the prebuilt call refers to
+    REAL(my_rhs_fun->t_arg)[0] = t;
     sunrealtype *y_ptr = N_VGetArrayPointer(y);
+    double *y_arg = REAL(my_rhs_fun->y_arg);
     for (int i = 0; i < y_len; i++){
-      y1[i] = y_ptr[i];
+      y_arg[i] = y_ptr[i];
     }
 
-    NumericVector ydot1(y_len);    // filled with zeros
+    // use the function to calculate value of RHS, straight into ydot ----
+    r_call_into(my_rhs_fun->rhs_call, N_VGetArrayPointer(ydot), y_len, "RHS",
+                my_rhs_fun->clock);
 
-    Function rhs_fun = (*my_rhs_fun).rhs_eqn;                // function
-    NumericVector p_values = (*my_rhs_fun).params;           // rate parameters
+    // If everything went smoothly, return 0
+    return(0);
+  });
+}
 
-    if (!rhs_fun || (TYPEOF(rhs_fun) != CLOSXP)){
-      stop("The RHS function is not an R or Rcpp function, stopping!");
-    }
+// function called by CVodeInit if user inputs a compiled RHS; see
+// rhs_function_native in rhs_func.cpp
+int rhs_function_sens_native(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data){
 
-    // use the function to calculate value of RHS ----
-    ydot1 = rhs_fun(t, y1, p_values);
+  struct rhs_func_sens *my_rhs_fun = (struct rhs_func_sens*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock);
+  user_section user(my_rhs_fun->clock);
 
-    // guards the element-by-element copy below against a short return
-    if (ydot1.length() != y_len){
-      stop("The RHS function must return a vector of the same length as the state vector: expected %d, got %d",
-           y_len, ydot1.length());
-    }
+  return my_rhs_fun->rhs_native(t, N_VGetArrayPointer(y), N_VGetArrayPointer(ydot),
+                                my_rhs_fun->params.begin());
+}
 
-    // convert NumericVector ydot1 to N_Vector ydot
-    sunrealtype *ydot_ptr = N_VGetArrayPointer(ydot);
-    for (int i = 0; i<  y_len; i++){
-      ydot_ptr[i] = ydot1[i];
-    }
+// function called by CVodeInit for a model built by ode_model(). The
+// parameters are read from params on every call, so the finite-difference
+// sensitivities, which perturb them in place, see the perturbed values.
+int rhs_function_sens_model(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data){
 
-    // If everything went smoothly, return 0
-    return(0);
-  });
+  struct rhs_func_sens *my_rhs_fun = (struct rhs_func_sens*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock);
+  user_section user(my_rhs_fun->clock);
+
+  my_rhs_fun->model->rhs.eval(t, N_VGetArrayPointer(y), my_rhs_fun->params.begin(),
+                              my_rhs_fun->model_regs.data(), N_VGetArrayPointer(ydot));
+  return(0);
 }
 
 // EwtSet Function. Computes the error weights at the current solution.
@@ -119,6 +237,8 @@ int ewt(N_Vector y, N_Vector w, void *user_data)
 
   struct rhs_func_sens *my_rhs_fun = (struct rhs_func_sens*)user_data;
   if(!my_rhs_fun){ return(-1); }
+  // timed only in a profile: no user code runs here (see callback_timer.h)
+  callback_timer timer(my_rhs_fun->clock, CB_EWT);
 
   rtol = my_rhs_fun->rtol;
 
@@ -147,8 +267,25 @@ static int jac_cvodes(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
                       void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3) {
     struct rhs_func_sens *data = (struct rhs_func_sens*)user_data;
     if (!data) { return -1; }
+    callback_timer timer(data->clock, CB_JAC);
+
+    // a compiled Jacobian writes the dense matrix's own column-major storage
+    // in place (see sundialr_jac in sundialr_capi.h)
+    if (data->jac_native) {
+      user_section user(data->clock);
+      return data->jac_native(t, N_VGetArrayPointer(y), SM_DATA_D(JAC),
+                              data->params.begin());
+    }
+
+    // a model's symbolic Jacobian is evaluated by the bytecode interpreter
+    if (data->model_jac) {
+      return jac_eval_model(data->model, t, y, JAC, data->params.begin(),
+                            data->jac_regs.data(), data->jac_vals.data(), NULL,
+                            data->clock);
+    }
+
     return sundials_callback_guard(data->err, [&]() -> int {
-      return jac_eval(t, y, JAC, data->jac_eqn, data->params);
+      return jac_eval(t, y, JAC, data->jac_eqn, data->params, NULL, data->clock);
     });
 }
 
@@ -164,46 +301,75 @@ static int sens_rhs1_cvodes(int Ns, sunrealtype t, N_Vector y, N_Vector ydot,
                             void *user_data, N_Vector tmp1, N_Vector tmp2) {
     struct rhs_func_sens *data = (struct rhs_func_sens*)user_data;
     if (!data) { return -1; }
+    callback_timer timer(data->clock, CB_SENS);
     return sundials_callback_guard(data->err, [&]() -> int {
 
       int n = NV_LENGTH_S(y);
 
-      NumericVector y1(n), ydot1(n), yS1(n);
+      // copy the arguments into the buffers the prebuilt call refers to
+      REAL(data->t_arg)[0] = t;
       sunrealtype *y_ptr    = N_VGetArrayPointer(y);
       sunrealtype *ydot_ptr = N_VGetArrayPointer(ydot);
       sunrealtype *yS_ptr   = N_VGetArrayPointer(yS);
+      double *y1 = REAL(data->y_arg), *ydot1 = REAL(data->ydot_arg), *yS1 = REAL(data->yS_arg);
       for (int i = 0; i < n; i++) { y1[i] = y_ptr[i]; ydot1[i] = ydot_ptr[i]; yS1[i] = yS_ptr[i]; }
-
-      Function sens_fun(data->sens_eqn);
       // iS arrives 0-based from CVODES; hand R the 1-based parameter index
-      NumericVector ySdot1 = sens_fun(t, y1, ydot1, iS + 1, yS1, data->params);
-
-      // guards the element-by-element copy below against a short return
-      if (ySdot1.length() != n) {
-        stop("The sensitivity function must return a vector of the same length as the state vector: expected %d, got %d",
-             n, ySdot1.length());
-      }
+      INTEGER(data->iS_arg)[0] = iS + 1;
 
-      sunrealtype *ySdot_ptr = N_VGetArrayPointer(ySdot);
-      for (int i = 0; i < n; i++) ySdot_ptr[i] = ySdot1[i];
+      r_call_into(data->sens_call, N_VGetArrayPointer(ySdot), n, "sensitivity",
+                  data->clock);
 
       return 0;
     });
 }
+
+// The same, for a compiled per-parameter sensitivity RHS. iS stays 0-based.
+static int sens_rhs1_cvodes_native(int Ns, sunrealtype t, N_Vector y, N_Vector ydot,
+                                   int iS, N_Vector yS, N_Vector ySdot,
+                                   void *user_data, N_Vector tmp1, N_Vector tmp2) {
+    struct rhs_func_sens *data = (struct rhs_func_sens*)user_data;
+    if (!data) { return -1; }
+    callback_timer timer(data->clock, CB_SENS);
+    user_section user(data->clock);
+    return data->sens1_native(Ns, t, N_VGetArrayPointer(y), N_VGetArrayPointer(ydot),
+                              iS, N_VGetArrayPointer(yS), N_VGetArrayPointer(ySdot),
+                              data->params.begin());
+}
+
+// All-at-once sensitivity RHS (a CVSensRhsFn) for a compiled function, which
+// fills every ySdot[iS] in one call. Lets a model share the work common to all
+// parameters, such as the Jacobian, instead of redoing it Ns times.
+static int sens_rhs_cvodes_native(int Ns, sunrealtype t, N_Vector y, N_Vector ydot,
+                                  N_Vector *yS, N_Vector *ySdot,
+                                  void *user_data, N_Vector tmp1, N_Vector tmp2) {
+    struct rhs_func_sens *data = (struct rhs_func_sens*)user_data;
+    if (!data) { return -1; }
+    callback_timer timer(data->clock, CB_SENS);
+    for (int is = 0; is < Ns; is++) {
+      data->yS_ptrs[is] = N_VGetArrayPointer(yS[is]);
+      data->ySdot_ptrs[is] = N_VGetArrayPointer(ySdot[is]);
+    }
+    user_section user(data->clock);
+    return data->sens_native(Ns, t, N_VGetArrayPointer(y), N_VGetArrayPointer(ydot),
+                             data->yS_ptrs.data(), data->ySdot_ptrs.data(),
+                             data->params.begin());
+}
 //------------------------------------------------------------------------------
 //' cvodes
 //'
 //' CVODES solver to solve ODEs and calculate sensitivities
 //'@param time_vector time vector
 //'@param IC Initial Conditions
-//'@param input_function Right Hand Side function of ODEs
-//'@param Parameters Parameters input to ODEs
+//'@param input_function Right Hand Side function of ODEs, either an R or Rcpp function with signature \code{function(t, y, p)}, or a compiled C function passed as an external pointer made with \code{sundialr_xptr_rhs()}, or a model built by \code{\link{ode_model}}, as in \code{\link{cvode}}
+//'@param Parameters Parameters input to ODEs. A compiled function receives a pointer to these values as its \code{udata} argument; when CVODES approximates the sensitivities by finite differences it perturbs these values in place, so a compiled right-hand side must read the parameters from \code{udata}
 //'@param reltolerance Relative Tolerance (a scalar, default value  = 1e-04)
 //'@param abstolerance Absolute Tolerance (a scalar or vector with length equal to ydot, default = 1e-04)
 //'@param SensType Sensitivity Type - allowed values are "STG" (for Staggered, default) or "SIM" (for Simultaneous)
 //'@param ErrCon Error Control - allowed values are TRUE or FALSE (default)
-//'@param jacobian (Optional) Jacobian of the RHS with signature \code{function(t, y, p)}. Default is NULL
-//'@param sensitivity (Optional) Sensitivity right-hand side with signature \code{function(t, y, ydot, iS, yS, p)} returning the derivative \code{d(yS_iS)/dt = J \%*\% yS_iS + df/dp_iS} as a numeric vector of \code{length(y)}, where \code{iS} is the 1-based parameter index. Default is NULL, in which case the sensitivity equations are approximated by finite differences of the RHS
+//'@param jacobian (Optional) Jacobian of the RHS with signature \code{function(t, y, p)}, or a compiled Jacobian made with \code{sundialr_xptr_jac()}. Default is NULL, in which case the symbolic Jacobian of a model built by \code{\link{ode_model}} is used, and a finite-difference approximation otherwise
+//'@param sensitivity (Optional) Sensitivity right-hand side with signature \code{function(t, y, ydot, iS, yS, p)} returning the derivative \code{d(yS_iS)/dt = J \%*\% yS_iS + df/dp_iS} as a numeric vector of \code{length(y)}, where \code{iS} is the 1-based parameter index. It may also be a compiled sensitivity right-hand side, either one filling the derivatives for all parameters in a single call, made with \code{sundialr_xptr_sens_rhs()}, or one called once per parameter with the 0-based index, made with \code{sundialr_xptr_sens_rhs1()} (see \code{sundialr_xptr.h}). Default is NULL, in which case the sensitivity equations are approximated by finite differences of the RHS
+//'@param stats (Optional) If TRUE, the solution gets a \code{stats} attribute, a list of the integrator's counters and the call's wall-clock time split between the callbacks and the rest, as in \code{\link{cvode}}, with \code{sens_rhs_evals}, the evaluations of the sensitivity right-hand side, in addition. The time in callbacks includes the sensitivity right-hand side. Default FALSE
+//'@param profile (Optional) If TRUE, the solution gets a \code{profile} attribute, a data frame of the calls of each kind of callback and the nanoseconds spent in them, split between the user's function and the package's marshalling around it, as in \code{\link{cvode}}, with a row \code{"sensitivity"} for the sensitivity right-hand side and a row \code{"ewt"} for the error weights, which run no user code and are counted as the package's own time. Default FALSE
 //'@returns A Matrix. First column is the time-vector, the next y * p columns are sensitivities of y1 w.r.t all parameters, then y2 w.r.t all parameters etc. y is the state vector, p is the parameter vector
 //'@example /inst/examples/cvs_Roberts_dns.r
 // [[Rcpp::export]]
@@ -214,8 +380,14 @@ NumericMatrix cvodes(NumericVector time_vector, NumericVector IC,
                       NumericVector abstolerance = 0.0001,
                       std::string SensType = "STG",
                       bool ErrCon = 'F',
-                      Nullable<Function> jacobian = R_NilValue,
-                      Nullable<Function> sensitivity = R_NilValue){
+                      SEXP jacobian = R_NilValue,
+                      SEXP sensitivity = R_NilValue,
+                      bool stats = false,
+                      bool profile = false){
+
+  // the wall-clock time of the whole call, and of the callbacks within it
+  auto call_start = solver_clock::now();
+  solver_clock clock(profile);
 
   int flag;
 
@@ -321,29 +493,35 @@ NumericMatrix cvodes(NumericVector time_vector, NumericVector IC,
 
   if (!input_function){ stop("There is no input function, stopping!"); }
 
-  if(TYPEOF(input_function) != CLOSXP) { stop("Incorrect input function type - input function can be an R or Rcpp function"); }
+  // an R function, or a compiled function passed as an external pointer
+  if(TYPEOF(input_function) != CLOSXP && TYPEOF(input_function) != EXTPTRSXP) {
+    stop("Incorrect input function type - input function can be an R or Rcpp function, a compiled function made with sundialr_xptr_rhs(), or a model built by ode_model()");
+  }
 
   // realtype *params = Parameters.begin();
   // Initialize the struct for user data
-  // Jacobian and sensitivity RHS have initial value of NULL
-  SEXP jac_sexp = R_NilValue;
-  if (jacobian.isNotNull()) jac_sexp = as<SEXP>(jacobian);
-  SEXP sens_sexp = R_NilValue;
-  if (sensitivity.isNotNull()) sens_sexp = as<SEXP>(sensitivity);
-  struct rhs_func_sens my_rhs_function = {input_function,
-                                          Parameters,
-                                          reltol,
-                                          abstol,
-                                          jac_sexp,
-                                          sens_sexp,
-                                          &sun_err};
+  // Jacobian and sensitivity RHS are R_NilValue when not supplied
+  SEXP jac_sexp = jacobian;
+  SEXP sens_sexp = sensitivity;
+  struct rhs_func_sens my_rhs_function(input_function,
+                                       Parameters,
+                                       reltol,
+                                       abstol,
+                                       jac_sexp,
+                                       sens_sexp,
+                                       &sun_err,
+                                       y_len);
 
   // setting the user_data in rhs function
+  if (stats || profile) { my_rhs_function.clock = &clock; }
   flag = CVodeSetUserData(cvode_mem, (void*)&my_rhs_function);
   if (check_retval(flag, "CVodeSetUserData")) { sundials_stop(sun_err, "CVodeSetUserData", "Stopping cvodes, something went wrong in setting user data!"); }
 
   /* Allocate space for CVODES */
-  flag = CVodeInit(cvode_mem, rhs_function_sens, T0, y0);
+  CVRhsFn f = rhs_function_sens;
+  if (my_rhs_function.model) f = rhs_function_sens_model;
+  else if (my_rhs_function.rhs_native) f = rhs_function_sens_native;
+  flag = CVodeInit(cvode_mem, f, T0, y0);
   if (check_retval(flag, "CVodeInit")) { sundials_stop(sun_err, "CVodeInit", "Stopping cvodes, something went wrong in allocating space for CVODES!"); }
 
   /* Use private function to compute error weights */
@@ -355,16 +533,21 @@ NumericMatrix cvodes(NumericVector time_vector, NumericVector IC,
   SM = SUNDenseMatrix(y_len_M, y_len_M, sunctx);
   if (check_retval(SM, "SUNDenseMatrix")) { sundials_stop(sun_err, "SUNDenseMatrix", "Stopping cvodes, something went wrong in setting SUNDenseMatrix!"); }
 
-  /* Create dense SUNLinearSolver */
-  LS = SUNLinSol_Dense(y0, SM, sunctx);
-  if (check_retval(LS, "SUNLinSol_Dense")) { sundials_stop(sun_err, "SUNLinSol_Dense", "Stopping cvodes, something went wrong in setting Linear Solver!"); }
+  /* Create dense SUNLinearSolver, specialised to the size of a small system */
+  if (y_len <= SMALL_DENSE_MAX) {
+    LS = SUNLinSol_SmallDense(y0, SM, sunctx);
+    if (check_retval(LS, "SUNLinSol_SmallDense")) { sundials_stop(sun_err, "SUNLinSol_SmallDense", "Stopping cvodes, something went wrong in setting Linear Solver!"); }
+  } else {
+    LS = SUNLinSol_Dense(y0, SM, sunctx);
+    if (check_retval(LS, "SUNLinSol_Dense")) { sundials_stop(sun_err, "SUNLinSol_Dense", "Stopping cvodes, something went wrong in setting Linear Solver!"); }
+  }
 
   /* Attach the matrix and linear solver */
   flag = CVodeSetLinearSolver(cvode_mem, LS, SM);
   if (check_retval(flag, "CVodeSetLinearSolver")) { sundials_stop(sun_err, "CVodeSetLinearSolver", "Stopping cvodes, something went wrong in attaching SUNDenseMatrix and Linear Solver!"); }
 
   /* If manual Jacobian is provided, use the jacobian */
-  if (jacobian.isNotNull()){
+  if (jacobian != R_NilValue || my_rhs_function.model_jac){
     flag = CVodeSetJacFn(cvode_mem, jac_cvodes);
     if(check_retval(flag, "CVodeSetJacFn")) { sundials_stop(sun_err, "CVodeSetJacFn", "Stopping cvodes, something went wrong in setting the Jacobian function!"); }
   }
@@ -375,7 +558,8 @@ NumericMatrix cvodes(NumericVector time_vector, NumericVector IC,
   /* Call CVodeSensInit1 to activate forward sensitivity computations
    and allocate internal memory for CVODES related to sensitivity
    calculations. Computes the right-hand sides of the sensitivity
-   ODE, one at a time */
+   ODE, one at a time - or CVodeSensInit, all at once, for a compiled
+   sensitivity RHS of that form */
   //
   // The fourth argument is the sensitivity right-hand side. When the caller
   // supplies `sensitivity`, sens_rhs1_cvodes is passed and CVODES uses that R
@@ -386,12 +570,23 @@ NumericMatrix cvodes(NumericVector time_vector, NumericVector IC,
   // callback, the most expensive thing in the solve - and is only as accurate
   // as the difference quotients.
   //
+  // A compiled sensitivity RHS skips R altogether. The all-at-once form is
+  // registered with CVodeSensInit instead; both staggered and simultaneous
+  // corrections accept it.
+  //
   // (int) flag to set sensitivity solution method - see CVodeSensInit1
   int ism = CV_STAGGERED;
   if (SensType.compare("SIM") == 0) ism = CV_SIMULTANEOUS;
-  CVSensRhs1Fn fS1 = sensitivity.isNotNull() ? sens_rhs1_cvodes : NULL;
-  flag = CVodeSensInit1(cvode_mem, NP, ism, fS1, yS);
-  if(check_retval(flag, "CVodeSensInit1")) { sundials_stop(sun_err, "CVodeSensInit1", "Stopping cvodes, something went wrong in calculating Sensitivities!"); }
+  if (my_rhs_function.sens_native) {
+    flag = CVodeSensInit(cvode_mem, NP, ism, sens_rhs_cvodes_native, yS);
+    if(check_retval(flag, "CVodeSensInit")) { sundials_stop(sun_err, "CVodeSensInit", "Stopping cvodes, something went wrong in calculating Sensitivities!"); }
+  } else {
+    CVSensRhs1Fn fS1 = NULL;
+    if (my_rhs_function.sens1_native) fS1 = sens_rhs1_cvodes_native;
+    else if (sensitivity != R_NilValue) fS1 = sens_rhs1_cvodes;
+    flag = CVodeSensInit1(cvode_mem, NP, ism, fS1, yS);
+    if(check_retval(flag, "CVodeSensInit1")) { sundials_stop(sun_err, "CVodeSensInit1", "Stopping cvodes, something went wrong in calculating Sensitivities!"); }
+  }
 
   /* Call CVodeSensEEtolerances to estimate tolerances for sensitivity
    variables based on the rolerances supplied for states variables and
@@ -460,6 +655,14 @@ NumericMatrix cvodes(NumericVector time_vector, NumericVector IC,
 
   }
 
+  if (stats) {
+    solver_stats counters;
+    solver_stats_cvode(cvode_mem, counters);
+    CVodeGetSensNumRhsEvals(cvode_mem, &counters.nfSevals);
+    sens.attr("stats") = solver_stats_list(counters, clock, solver_clock::since(call_start));
+  }
+  if (profile) { sens.attr("profile") = callback_profile_frame(clock, "rhs"); }
+
   /* SUNDIALS objects are released by sundials_cleanup on scope exit */
 
   return sens;
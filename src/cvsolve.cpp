@@ -34,12 +34,13 @@
 #include <cvode/cvode.h>               /* prototypes for CVODE fcts., consts. */
 #include <nvector/nvector_serial.h>    /* serial N_Vector types, fcts., macros */
 #include <sundials/sundials_types.h>   /* definition of type realtype */
-#include <sunmatrix/sunmatrix_dense.h>
-#include <sunlinsol/sunlinsol_dense.h>
 
 #include <check_retval.h>
+#include <linear_solver.h>
 #include <rhs_func.h>
 #include <jac_func.h>
+#include <solver_stats.h>
+#include <step_output.h>
 #include <sundials_scope_guard.h>
 
 // CRAN fix: replace SUNDIALS' default abort()-based error handler with one that
@@ -58,8 +59,38 @@ static int jac_cvsolve(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
 
   struct rhs_func *data = (struct rhs_func*)user_data;
   if (!data) { return -1; }
+  callback_timer timer(data->clock, CB_JAC);
+
+  // a sparse Jacobian nobody gave is approximated (see fd_jacobian.h)
+  if (data->fd.active()) {
+    return rhs_jac_fd(t, y, fy, JAC, user_data, tmp1, tmp2);
+  }
+
+  // a compiled Jacobian writes a dense column-major matrix, or the storage of
+  // a band or sparse one (see jac_func.h)
+  if (data->jac_band) {
+    return jac_eval_native_band(data->jac_band, t, y, JAC, data->params.begin(),
+                                data->clock);
+  }
+  if (data->jac_sparse) {
+    return jac_eval_native_sparse(data->jac_sparse, t, y, JAC, data->params.begin(),
+                                  data->pattern, data->clock);
+  }
+  if (data->jac_native) {
+    return jac_eval_native(data->jac_native, t, y, JAC, data->params.begin(),
+                           data->jac_scratch, data->pattern, data->clock);
+  }
+
+  // a model's symbolic Jacobian is evaluated by the bytecode interpreter
+  if (data->model_jac) {
+    return jac_eval_model(data->model, t, y, JAC, data->params.begin(),
+                          data->jac_regs.data(), data->jac_vals.data(),
+                          data->pattern, data->clock);
+  }
+
   return sundials_callback_guard(data->err, [&]() -> int {
-    return jac_eval(t, y, JAC, data->jac_eqn, data->params);
+    return jac_eval(t, y, JAC, data->jac_eqn, data->params, data->pattern,
+                    data->clock);
   });
 }
 
@@ -70,13 +101,22 @@ static int jac_cvsolve(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
 //'CVSOLVE solver to solve stiff ODEs with discontinuties
 //'@param time_vector time vector
 //'@param IC Initial Conditions
-//'@param input_function Right Hand Side function of ODEs
-//'@param Parameters Parameters input to ODEs
+//'@param input_function Right Hand Side function of ODEs, either an R or Rcpp function with signature \code{function(t, y, p)}, or a compiled C function passed as an external pointer made with \code{sundialr_xptr_rhs()}, or a model built by \code{\link{ode_model}}, as in \code{\link{cvode}}
+//'@param Parameters Parameters input to ODEs. A compiled right-hand side or Jacobian receives a pointer to these values as its \code{udata} argument
 //'@param Events Discontinuities in the solution (a DataFrame, default value is NULL). Three columns, names ignored: the 1-based index of the state, the time of the discontinuity, and the value to add to that state at that time. The value is always added to the current value of the state, including at the initial time, so the initial conditions in \code{IC} are the starting point and an event at t = 0 adds to them.
 //'@param reltolerance Relative Tolerance (a scalar, default value  = 1e-04)
 //'@param abstolerance Absolute Tolerance (a scalar or vector with length equal to ydot, default = 1e-04)
-//'@param jacobian (Optional) Jacobian of the RHS with signature \code{function(t, y, p)} returning an n-by-n matrix where entry [i,j] is d(ydot_i)/d(y_j). Default is NULL and SUNDIALS uses internal finite-difference approximation.
-//'@returns A Matrix. First column is the time-vector, the other columns are values of y in order they are provided.
+//'@param jacobian (Optional) Jacobian of the RHS with signature \code{function(t, y, p)} returning an n-by-n matrix where entry [i,j] is d(ydot_i)/d(y_j), or a compiled Jacobian made with \code{sundialr_xptr_jac()}, or for a band matrix with \code{sundialr_xptr_jac_band()}, which writes only the band, into the band matrix's own storage, rather than an n-by-n matrix, and for a sparse one with \code{sundialr_xptr_jac_sparse()}, which writes only the values of the pattern. Default is NULL and SUNDIALS uses internal finite-difference approximation, unless \code{input_function} is a model built by \code{\link{ode_model}} with its symbolic Jacobian, which is then used.
+//'@param mupper,mlower (Optional) Upper and lower half-bandwidths of the Jacobian. When both are given, a band matrix and band linear solver are used in place of the dense ones, as in \code{\link{cvode}}. Default NULL (dense)
+//'@param sparsity (Optional) Sparsity pattern of the Jacobian, for a sparse matrix and sparse direct solver in place of the dense ones, as in \code{\link{cvode}}, including the finite-difference Jacobian by groups of columns when no Jacobian is given. Default NULL (dense)
+//'@param linear_solver (Optional) \code{"dense"}, \code{"lapack_dense"} (factored by R's LAPACK), or a matrix-free Krylov solver: \code{"spgmr"}, \code{"spfgmr"}, \code{"spbcgs"}, \code{"sptfqmr"} or \code{"pcg"}, as in \code{\link{cvode}}. Default NULL, a direct solver chosen by \code{mupper}, \code{mlower} and \code{sparsity}
+//'@param jtimes (Optional) With a Krylov \code{linear_solver}, the product of the Jacobian with a vector, as \code{function(t, y, v, p)}, or a compiled function made with \code{sundialr_xptr_jtimes()}, as in \code{\link{cvode}}. Default NULL
+//'@param psetup,psolve (Optional) With a Krylov \code{linear_solver}, the preconditioner setup \code{function(t, y, jok, gamma, p)} and solve \code{function(t, y, r, gamma, p)}, or compiled functions, as in \code{\link{cvode}}. Default NULL
+//'@param stats (Optional) If TRUE, the solution gets a \code{stats} attribute, a list of the integrator's counters and the call's wall-clock time split between the callbacks and the rest, as in \code{\link{cvode}}. The counters are totals over the whole solve, across the restarts at each event. Default FALSE
+//'@param profile (Optional) If TRUE, the solution gets a \code{profile} attribute, a data frame of the calls of each kind of callback and the nanoseconds spent in them, split between the user's function and the package's marshalling around it, as in \code{\link{cvode}}. Default FALSE
+//'@param output (Optional) \code{"times"}, the default, for the solution at \code{time_vector} and the event times, or \code{"steps"} for the solution at every internal step CVODE takes from the first time in \code{time_vector} to the last, as in \code{\link{cvode}}. The solver stops at each event time, and the row there is the state after the event
+//'@param max_rows (Optional) With \code{output = "steps"}, the most rows to return, 2 or more, as in \code{\link{cvode}}. Default NULL, every step
+//'@returns A Matrix. First column is the time-vector, or the times of the steps with \code{output = "steps"}, the other columns are values of y in order they are provided.
 //'@example /inst/examples/cvsolve_1D.r
 // [[Rcpp::export]]
 NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC,
@@ -85,7 +125,23 @@ NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC,
                       Nullable<DataFrame> Events = R_NilValue,
                       double reltolerance = 0.0001,
                       NumericVector abstolerance = 0.0001,
-                      Nullable<Function> jacobian = R_NilValue){
+                      SEXP jacobian = R_NilValue,
+                      SEXP mupper = R_NilValue,
+                      SEXP mlower = R_NilValue,
+                      SEXP sparsity = R_NilValue,
+                      SEXP linear_solver = R_NilValue,
+                      SEXP jtimes = R_NilValue,
+                      SEXP psetup = R_NilValue,
+                      SEXP psolve = R_NilValue,
+                      bool stats = false,
+                      bool profile = false,
+                      std::string output = "times",
+                      SEXP max_rows = R_NilValue){
+
+  // the wall-clock time of the whole call, and of the callbacks within it
+  auto call_start = solver_clock::now();
+  solver_clock clock(profile);
+  solver_stats counters;   // of the stretches before each restart
 
   int y_len = IC.length();
   int NSTATES = IC.length();
@@ -97,6 +153,14 @@ NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC,
     stop("Absolute tolerance must be a scalar or a vector of same length as IC \n");
   }
 
+  // the solution at time_vector, or at every internal step (see step_output.h)
+  bool steps = output_is_steps(output);
+  int steps_max = output_max_rows(max_rows);
+
+  // dense, band when the half-bandwidths are given, sparse when the pattern
+  // is, or a Krylov solver when linear_solver names one
+  linsol_spec ls_spec = linsol_parse(mupper, mlower, sparsity, linear_solver, y_len);
+
   // Receives SUNDIALS errors. Declared before the guard so that it is
   // destroyed after it - the SUNContext freed there holds a pointer to it.
   sundials_err_record sun_err;
@@ -154,8 +218,7 @@ NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC,
     }
   }
 
-  SEXP jac_sexp = R_NilValue;
-  if (jacobian.isNotNull()) jac_sexp = as<SEXP>(jacobian);
+  SEXP jac_sexp = jacobian;
 
 
   // If Events is not NULL, change IC and generate a combined dataset-----------
@@ -256,33 +319,63 @@ NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC,
   if (!input_function){ stop("There is no input function, stopping!"); }
 
   // order of input is rhs input function, Parameters and User-supplied Jacobian (optional)
-  struct rhs_func my_rhs_function = {input_function, Parameters, jac_sexp, &sun_err};
+  struct rhs_func my_rhs_function(input_function, Parameters, jac_sexp, &sun_err, y_len);
+  my_rhs_function.pattern = linsol_pattern_of(ls_spec);
+  jac_native_check(my_rhs_function.jac_band != NULL, my_rhs_function.jac_sparse != NULL,
+                   ls_spec.band, ls_spec.sparse);
+  // a sparse solve without a Jacobian approximates one by coloured finite
+  // differences, with one evaluation of the right-hand side per group of
+  // columns sharing no row (see fd_jacobian.h)
+  if (ls_spec.sparse && !my_rhs_function.has_jacobian()) {
+    if (!my_rhs_function.fd.init(&ls_spec.pattern, cvode_mem, y0)) {
+      sundials_stop(sun_err, "N_VClone", "Stopping cvsolve, cannot allocate memory for the finite-difference Jacobian!");
+    }
+    my_rhs_function.fd.constraints = constraints;
+  }
+  linsol_check_krylov(ls_spec, jacobian, jtimes != R_NilValue || psetup != R_NilValue ||
+                      psolve != R_NilValue);
+  my_rhs_function.krylov = krylov_func(jtimes, psetup, psolve, Parameters, &sun_err, y_len, false);
+  ls_spec.precondition = my_rhs_function.krylov.has_psolve();
+  if (stats || profile) {
+    my_rhs_function.clock = &clock;
+    my_rhs_function.krylov.clock = &clock;
+  }
 
   // setting the user_data in rhs function
   flag = CVodeSetUserData(cvode_mem, (void*)&my_rhs_function);
   if (check_retval(flag, "CVodeSetUserData")) { sundials_stop(sun_err, "CVodeSetUserData", "Stopping cvsolve, something went wrong in setting user data!"); }
 
-  flag = CVodeInit(cvode_mem, rhs_function, T0, y0);
+  flag = CVodeInit(cvode_mem, my_rhs_function.rhs_callback(), T0, y0);
   if (check_retval(flag, "CVodeInit")) { sundials_stop(sun_err, "CVodeInit", "Stopping cvsolve, something went wrong in initializing CVODE!"); }
 
   // Call CVodeSVtolerances to specify the scalar relative tolerance and vector absolute tol
   flag = CVodeSVtolerances(cvode_mem, reltol, abstol);
   if (check_retval(flag, "CVodeSVtolerances")) { sundials_stop(sun_err, "CVodeSVtolerances", "Stopping cvsolve, something went wrong in setting solver tolerances!"); }
 
-  // Create dense SUNMatrix for use in linear solves
-  sunindextype y_len_M = y_len;
-  SM = SUNDenseMatrix(y_len_M, y_len_M, sunctx);
-  if(check_retval(SM, "SUNDenseMatrix")) { sundials_stop(sun_err, "SUNDenseMatrix", "Stopping cvsolve, something went wrong in setting the dense matrix!"); }
-
-  // Create dense SUNLinearSolver object for use by CVode
-  LS = SUNLinSol_Dense(y0, SM, sunctx);
-  if(check_retval(LS, "SUNLinSol_Dense")) { sundials_stop(sun_err, "SUNLinSol_Dense", "Stopping cvsolve, something went wrong in setting the linear solver!"); }
+  // Create the dense, band or sparse SUNMatrix and SUNLinearSolver, or the
+  // Krylov solver, for use by CVode
+  const char *ls_failed = linsol_create(ls_spec, y0, sunctx, &SM, &LS);
+  if (ls_failed) { sundials_stop(sun_err, ls_failed, "Stopping cvsolve, something went wrong in setting the linear solver!"); }
 
   // Call CVodeSetLinearSolver to attach the matrix and linear solver to CVode
   flag = CVodeSetLinearSolver(cvode_mem, LS, SM);
   if(check_retval(flag, "CVodeSetLinearSolver")) { sundials_stop(sun_err, "CVodeSetLinearSolver", "Stopping cvsolve, something went wrong in setting the linear solver!"); }
 
-  if (jacobian.isNotNull()) {
+  if (ls_spec.krylov != LINSOL_DIRECT) {
+    // the Jacobian times a vector, if there is a better one than SUNDIALS'
+    // finite differences, and the preconditioner, if given (see krylov_func.h)
+    if (my_rhs_function.jtimes_callback()) {
+      flag = CVodeSetJacTimes(cvode_mem, my_rhs_function.jtsetup_callback(),
+                              my_rhs_function.jtimes_callback());
+      if(check_retval(flag, "CVodeSetJacTimes")) { sundials_stop(sun_err, "CVodeSetJacTimes", "Stopping cvsolve, something went wrong in setting the Jacobian-times-vector function!"); }
+    }
+    if (my_rhs_function.krylov.has_psolve()) {
+      flag = CVodeSetPreconditioner(cvode_mem,
+                                    my_rhs_function.krylov.has_psetup() ? rhs_psetup : NULL,
+                                    rhs_psolve);
+      if(check_retval(flag, "CVodeSetPreconditioner")) { sundials_stop(sun_err, "CVodeSetPreconditioner", "Stopping cvsolve, something went wrong in setting the preconditioner!"); }
+    }
+  } else if (my_rhs_function.has_jacobian()) {
     flag = CVodeSetJacFn(cvode_mem, jac_cvsolve);
     if(check_retval(flag, "CVodeSetJacFn")) { sundials_stop(sun_err, "CVodeSetJacFn", "Stopping cvsolve, something went wrong in setting the Jacobian function!"); }
   }
@@ -293,82 +386,151 @@ NumericMatrix cvsolve(NumericVector time_vector, NumericVector IC,
 
   sunrealtype tout;  // For output times
 
-  // Solution vector has length equal to number of rows in TCOMB
-  // Solution vector has width equal to number of IC + 1 (first column for time)
-  int soln_rows = TCOMB.nrow();
-  NumericMatrix soln(Dimension(soln_rows,y_len + 1));
+  NumericMatrix soln;
 
-  // fill the first row of soln matrix with Initial Conditions
-  soln(0,0) = TCOMB(0, 1);   // get the first time value
-  for(int i = 0; i<y_len; i++){
-    soln(0,i+1) = ICchanged[i];
-  }
+  if (steps) {
+    // every internal step up to each event time in turn, and then up to the
+    // last time, each of which is CVODE's stop time; the row at an event time
+    // is the state after the event, as it is at the times of time_vector
+    step_output rows(y_len, steps_max);
+    rows.push(T0, y0_ptr);
+    sunrealtype tprev = T0;
+    int iprev = 0;        // the row of TCOMB of tprev
 
-  for(int iout = 0; iout < NOUT-1; iout++) {
+    for(int iout = 1; iout < NOUT; iout++) {
 
-    sunrealtype tprev = TCOMB(iout, 1);
-    // output times start from the index after initial time
-    tout = TCOMB(iout + 1, 1);
+      tout = TCOMB(iout, 1);
+      bool event = TCOMB(iout, 3) == 1;
 
-    // A record at the initial time is already accounted for by the initial
-    // conditions, and one at the same time as the previous record was already
-    // applied there. Neither advances the solution, so carry the current state
-    // into the row rather than leaving it zero-filled.
-    if (tout == time_vector[0] || tout == tprev){
-      soln(iout+1, 0) = tout;
-      for (int i = 0; i<y_len; i++){
-        soln(iout+1, i+1) = y0_ptr[i];
-      }
-      continue;
-    }
-    else {
+      // the sampling times in between need no stop, and the events at a time
+      // already reached were applied there
+      if (tout == tprev) { iprev = iout; continue; }
+      if (!event && iout < NOUT-1) { continue; }
 
-      // integrate upto the next time point (whether a sampling time or a discontinuity)
-      flag = CVode(cvode_mem, tout, y0, &time, CV_NORMAL);
-      if (check_retval(flag, "CVode")) { sundials_stop(sun_err, "CVode", "Stopping cvsolve, something went wrong in solving the system of ODEs!"); }
+      flag = CVodeSetStopTime(cvode_mem, tout);
+      if (check_retval(flag, "CVodeSetStopTime")) { sundials_stop(sun_err, "CVodeSetStopTime", "Stopping cvsolve, something went wrong in setting the stop time!"); }
 
-      // check whether the this records is sampling or discontinuity using the
-      // fourth column of the TCOMB matrix to confirm discontinuity
-      if(TCOMB(iout+1,3) == 1){
+      flag = step_output_until([&](double *t) {
+        return CVode(cvode_mem, tout, y0, t, CV_ONE_STEP);
+      }, CV_TSTOP_RETURN, CV_TOO_MUCH_WORK, &TCOMB(iprev + 1, 1), iout - iprev,
+         [&](double) { return y0_ptr; }, rows, !event, sun_err, "CVode");
+      if (check_retval(flag, "CVode")) { sundials_stop(sun_err, "CVode", "Stopping cvsolve, something went wrong in solving the system of ODEs!"); }
+      tprev = tout;
+      iprev = iout;
 
-        // include the discontinuity, i.e. ADD to the solution
-        // add the event value to the current value of the state
+      if (event) {
+        // add the value of every event at this time to its state
         for(int i = 0; i < TCOMB.nrow();  i++){
-
           if(TCOMB(i,1) == tout && TCOMB(i,3) == 1){
-
-            // update y0 - index for y0 needs to be an integer
             int disc_index = static_cast<int>(TCOMB(i,0));
             y0_ptr[disc_index] = y0_ptr[disc_index] + TCOMB(i,2);
           }
         }
+        rows.push(tout, y0_ptr);
 
-        if (flag == CV_SUCCESS) {
-          // store results in soln matrix
-          soln(iout+1, 0) = time;           // first column is for time
-          for (int i = 0; i<y_len; i++){
-            soln(iout+1, i+1) = y0_ptr[i];
-          }
+        // re-initialize the solver, which sets its counters back to zero
+        if (stats) {
+          solver_stats stretch;
+          solver_stats_cvode(cvode_mem, stretch);
+          counters.add(stretch);
         }
-
-        // re-initialize the solver
         flag = CVodeReInit(cvode_mem, tout, y0);
         if (check_retval(flag, "CVodeReInit")) { sundials_stop(sun_err, "CVodeReInit", "Stopping cvsolve, something went wrong in reinitializing the ODE system!"); }
+      }
+    }
+    soln = rows.as_matrix();
+  } else {
+
+    // Solution vector has length equal to number of rows in TCOMB
+    // Solution vector has width equal to number of IC + 1 (first column for time)
+    int soln_rows = TCOMB.nrow();
+    soln = NumericMatrix(Dimension(soln_rows,y_len + 1));
+
+    // fill the first row of soln matrix with Initial Conditions
+    soln(0,0) = TCOMB(0, 1);   // get the first time value
+    for(int i = 0; i<y_len; i++){
+      soln(0,i+1) = ICchanged[i];
+    }
+
+    for(int iout = 0; iout < NOUT-1; iout++) {
+
+      sunrealtype tprev = TCOMB(iout, 1);
+      // output times start from the index after initial time
+      tout = TCOMB(iout + 1, 1);
+
+      // A record at the initial time is already accounted for by the initial
+      // conditions, and one at the same time as the previous record was already
+      // applied there. Neither advances the solution, so carry the current state
+      // into the row rather than leaving it zero-filled.
+      if (tout == time_vector[0] || tout == tprev){
+        soln(iout+1, 0) = tout;
+        for (int i = 0; i<y_len; i++){
+          soln(iout+1, i+1) = y0_ptr[i];
+        }
+        continue;
+      }
+      else {
+
+        // integrate upto the next time point (whether a sampling time or a discontinuity)
+        flag = CVode(cvode_mem, tout, y0, &time, CV_NORMAL);
+        if (check_retval(flag, "CVode")) { sundials_stop(sun_err, "CVode", "Stopping cvsolve, something went wrong in solving the system of ODEs!"); }
+
+        // check whether the this records is sampling or discontinuity using the
+        // fourth column of the TCOMB matrix to confirm discontinuity
+        if(TCOMB(iout+1,3) == 1){
 
-      } else {                                     // store results for the sampling record
+          // include the discontinuity, i.e. ADD to the solution
+          // add the event value to the current value of the state
+          for(int i = 0; i < TCOMB.nrow();  i++){
 
-        if (flag == CV_SUCCESS) {
-          // store results in soln matrix
-          soln(iout+1, 0) = time;           // first column is for time
-          for (int i = 0; i<y_len; i++){
-            soln(iout+1, i+1) = y0_ptr[i];
+            if(TCOMB(i,1) == tout && TCOMB(i,3) == 1){
+
+              // update y0 - index for y0 needs to be an integer
+              int disc_index = static_cast<int>(TCOMB(i,0));
+              y0_ptr[disc_index] = y0_ptr[disc_index] + TCOMB(i,2);
+            }
+          }
+
+          if (flag == CV_SUCCESS) {
+            // store results in soln matrix
+            soln(iout+1, 0) = time;           // first column is for time
+            for (int i = 0; i<y_len; i++){
+              soln(iout+1, i+1) = y0_ptr[i];
+            }
+          }
+
+          // re-initialize the solver, which sets its counters back to zero
+          if (stats) {
+            solver_stats stretch;
+            solver_stats_cvode(cvode_mem, stretch);
+            counters.add(stretch);
+          }
+          flag = CVodeReInit(cvode_mem, tout, y0);
+          if (check_retval(flag, "CVodeReInit")) { sundials_stop(sun_err, "CVodeReInit", "Stopping cvsolve, something went wrong in reinitializing the ODE system!"); }
+
+        } else {                                     // store results for the sampling record
+
+          if (flag == CV_SUCCESS) {
+            // store results in soln matrix
+            soln(iout+1, 0) = time;           // first column is for time
+            for (int i = 0; i<y_len; i++){
+              soln(iout+1, i+1) = y0_ptr[i];
+            }
           }
         }
       }
-    }
 
 
+    }
+  }
+
+  if (stats) {
+    solver_stats stretch;
+    solver_stats_cvode(cvode_mem, stretch);
+    counters.add(stretch);
+    soln.attr("stats") = solver_stats_list(counters, clock, solver_clock::since(call_start));
   }
+  if (profile) { soln.attr("profile") = callback_profile_frame(clock, "rhs"); }
 
   // SUNDIALS objects are released by sundials_cleanup on scope exit
 
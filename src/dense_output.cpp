@@ -0,0 +1,122 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// dense_eval(): the continuous solution kept by cvode(dense_output = TRUE),
+// evaluated at any times (see dense_output.h for how it is kept).
+
+#include <Rcpp.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Rcpp;
+
+//'dense_eval
+//'
+//' Evaluate the continuous solution of a \code{\link{cvode}} solve, or its
+//' derivatives, at any times within the solve, without integrating again.
+//'
+//' A solve made with \code{dense_output = TRUE} keeps, for every internal step
+//' CVODE took, the interpolating polynomial CVODE itself reads its output
+//' times from. This evaluates those polynomials, so a solve on a coarse
+//' \code{time_vector} can be plotted or aligned with data on as fine a grid as
+//' wanted afterwards, and a value at one of the solve's own output times is the
+//' one \code{cvode()} returned, up to rounding.
+//'@param solution The matrix returned by \code{cvode(..., dense_output = TRUE)}, or its \code{dense_output} attribute
+//'@param times Times at which to evaluate, in any order, each within the interval the solve covered: from its first output time to the end of its last internal step, which may lie a little beyond its last output time
+//'@param deriv (Optional) The derivative to evaluate: 0, the default, for the solution itself, 1 for its first derivative and so on. Where the order of the step is less than \code{deriv}, the derivative is 0
+//'@returns A Matrix, as from \code{cvode()}: the first column is \code{times}, the other columns are the values of y, or of its derivative, in the order they are provided.
+//'@example /inst/examples/dense_eval.r
+// [[Rcpp::export]]
+NumericMatrix dense_eval(SEXP solution, NumericVector times, int deriv = 0) {
+  SEXP rec = solution;
+  if (!Rf_inherits(rec, "sundialr_dense_output")) {
+    rec = Rf_getAttrib(solution, Rf_install("dense_output"));
+    if (!Rf_inherits(rec, "sundialr_dense_output")) {
+      stop("solution has no dense output: solve with cvode(..., dense_output = TRUE)");
+    }
+  }
+  if (deriv < 0) stop("deriv must be 0 or more");
+
+  List dense(rec);
+  const int n = as<int>(dense["states"]);
+  NumericVector time = dense["time"], start = dense["start"], values = dense["deriv"];
+  IntegerVector order = dense["order"];
+  const int n_steps = order.size();
+  if (n < 1 || n_steps < 1 || time.size() != n_steps + 1 || start.size() != n_steps) {
+    stop("solution's dense output is malformed");
+  }
+  // the list has been through R and may have been changed there: every step's
+  // order must be one CVODE's BDF can have, and its derivatives must lie within
+  // deriv, before any is read
+  const double n_values = (double) values.size();
+  for (int s = 0; s < n_steps; s++) {
+    const double st = start[s];
+    if (order[s] < 1 || order[s] > 5 || !(st >= 0) || st != std::floor(st) ||
+        st + (order[s] + 1.0) * n > n_values) {
+      stop("solution's dense output is malformed: the derivatives of step %d are not in deriv",
+           s + 1);
+    }
+  }
+
+  // the step times run in the direction of integration; search them as
+  // increasing
+  const double dir = time[n_steps] >= time[0] ? 1.0 : -1.0;
+  std::vector<double> ends(n_steps);
+  for (int s = 0; s < n_steps; s++) ends[s] = dir * time[s + 1];
+  const double lo = dir * time[0];
+
+  const int n_times = times.size();
+  NumericMatrix out(n_times, n + 1);
+  for (int r = 0; r < n_times; r++) {
+    double t = times[r];
+    if (ISNAN(t) || dir * t < lo || dir * t > ends[n_steps - 1]) {
+      stop("times[%d] = %g is outside the interval the solve covered, [%g, %g]",
+           r + 1, t, time[0], time[n_steps]);
+    }
+    // the first step ending at or after t
+    int s = (int) (std::lower_bound(ends.begin(), ends.end(), dir * t) - ends.begin());
+    const int q = order[s];
+    const double *d = values.begin() + (R_xlen_t) start[s];
+    const double dt = t - time[s + 1];
+
+    out(r, 0) = t;
+    for (int i = 0; i < n; i++) {
+      // sum over j = deriv..q of y^(j)(tn) dt^(j - deriv) / (j - deriv)!, by
+      // Horner's rule
+      double acc = 0.0;
+      for (int m = q - deriv; m >= 0; m--) {
+        acc = d[(R_xlen_t) (deriv + m) * n + i] + acc * dt / (m + 1);
+      }
+      out(r, i + 1) = acc;
+    }
+  }
+  return out;
+}
@@ -0,0 +1,417 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <nvector/nvector_serial.h>     /* serial N_Vector types, fcts., macros */
+
+#include <ensemble_solver.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// N_Vector: the serial vector, with the norm of the worst subject
+
+// The serial content comes first, so that every serial operation works on the
+// vector unchanged; K and the per-subject sums of the norm follow. Allocated
+// with malloc, as the serial content is.
+struct ensemble_vector {
+  struct _N_VectorContent_Serial serial;
+  int K;
+  sunrealtype *lane;
+};
+
+#define ENV(v) ((ensemble_vector*)(v)->content)
+
+static void ensemble_vector_destroy(N_Vector v) {
+  if (v == NULL) return;
+  ensemble_vector *c = ENV(v);
+  if (c != NULL) {
+    if (c->serial.own_data) free(c->serial.data);
+    free(c->lane);
+    free(c);
+    v->content = NULL;
+  }
+  N_VFreeEmpty(v);
+}
+
+// Give v, whose ops are set, the content of a vector of `length` values of K
+// subjects, with its own data if with_data
+static bool ensemble_vector_attach(N_Vector v, sunindextype length, int K,
+                                   bool with_data) {
+  ensemble_vector *c = (ensemble_vector*) malloc(sizeof *c);
+  if (c == NULL) return false;
+  c->serial.length = length;
+  c->serial.own_data = SUNFALSE;
+  c->serial.data = NULL;
+  c->K = K;
+  c->lane = (sunrealtype*) malloc(K * sizeof(sunrealtype));
+  v->content = c;
+  if (c->lane == NULL) return false;
+  if (with_data) {
+    c->serial.data = (sunrealtype*) malloc(length * sizeof(sunrealtype));
+    if (c->serial.data == NULL) return false;
+    c->serial.own_data = SUNTRUE;
+  }
+  return true;
+}
+
+static N_Vector ensemble_vector_clone_with(N_Vector w, bool with_data) {
+  N_Vector v = N_VNewEmpty(w->sunctx);
+  if (v == NULL) return NULL;
+  if (N_VCopyOps(w, v) != SUN_SUCCESS ||
+      !ensemble_vector_attach(v, ENV(w)->serial.length, ENV(w)->K, with_data)) {
+    ensemble_vector_destroy(v);
+    return NULL;
+  }
+  return v;
+}
+
+static N_Vector ensemble_vector_clone(N_Vector w) {
+  return ensemble_vector_clone_with(w, true);
+}
+
+static N_Vector ensemble_vector_clone_empty(N_Vector w) {
+  return ensemble_vector_clone_with(w, false);
+}
+
+// The largest over the subjects of sqrt(sum_i (x_ik w_ik)^2 / n)
+static sunrealtype ensemble_vector_wrmsnorm(N_Vector x, N_Vector w) {
+  ensemble_vector *c = ENV(x);
+  const int K = c->K;
+  const sunindextype n = c->serial.length / K;
+  const sunrealtype *xd = c->serial.data, *wd = NV_DATA_S(w);
+  sunrealtype *sum = c->lane;
+
+  for (int k = 0; k < K; k++) sum[k] = 0.0;
+  for (sunindextype i = 0; i < n; i++) {
+    const sunrealtype *xi = xd + i * K, *wi = wd + i * K;
+    for (int k = 0; k < K; k++) {
+      sunrealtype prod = xi[k] * wi[k];
+      sum[k] += prod * prod;
+    }
+  }
+  sunrealtype most = 0.0;
+  for (int k = 0; k < K; k++) most = sum[k] > most ? sum[k] : most;
+  return std::sqrt(most / n);
+}
+
+N_Vector N_VNew_Ensemble(int n, int K, SUNContext sunctx) {
+  if (n < 1 || K < 1) return NULL;
+  sunindextype length = (sunindextype) n * K;
+  N_Vector v = N_VNewEmpty_Serial(length, sunctx);
+  if (v == NULL) return NULL;
+
+  // the serial content is replaced by the ensemble's
+  free(v->content);
+  v->content = NULL;
+  v->ops->nvclone      = ensemble_vector_clone;
+  v->ops->nvcloneempty = ensemble_vector_clone_empty;
+  v->ops->nvdestroy    = ensemble_vector_destroy;
+  v->ops->nvwrmsnorm   = ensemble_vector_wrmsnorm;
+  if (!ensemble_vector_attach(v, length, K, true)) {
+    ensemble_vector_destroy(v);
+    return NULL;
+  }
+  return v;
+}
+
+//------------------------------------------------------------------------------
+// SUNMatrix: K blocks of n x n, element-major and subject-minor
+
+struct ensemble_matrix {
+  int n, K;
+  std::vector<sunrealtype> data;   // element (i, j) of block k at (i + j*n)*K + k
+};
+
+#define ENM(A) ((ensemble_matrix*)(A)->content)
+
+static SUNMatrix_ID ensemble_matrix_getid(SUNMatrix A) {
+  return SUNMATRIX_CUSTOM;
+}
+
+static void ensemble_matrix_destroy(SUNMatrix A) {
+  if (A == NULL) return;
+  delete ENM(A);
+  A->content = NULL;
+  SUNMatFreeEmpty(A);
+}
+
+static SUNMatrix ensemble_matrix_clone(SUNMatrix A) {
+  return SUNEnsembleMatrix(ENM(A)->n, ENM(A)->K, A->sunctx);
+}
+
+static SUNErrCode ensemble_matrix_zero(SUNMatrix A) {
+  std::vector<sunrealtype> &a = ENM(A)->data;
+  std::fill(a.begin(), a.end(), 0.0);
+  return SUN_SUCCESS;
+}
+
+// B = A
+static SUNErrCode ensemble_matrix_copy(SUNMatrix A, SUNMatrix B) {
+  ENM(B)->data = ENM(A)->data;
+  return SUN_SUCCESS;
+}
+
+// A = c A + I
+static SUNErrCode ensemble_matrix_scaleaddi(sunrealtype c, SUNMatrix A) {
+  ensemble_matrix *m = ENM(A);
+  const int n = m->n, K = m->K;
+  sunrealtype *a = m->data.data();
+  for (size_t e = 0; e < m->data.size(); e++) a[e] *= c;
+  for (int i = 0; i < n; i++) {
+    sunrealtype *aii = a + (size_t) (i + i * n) * K;
+    for (int k = 0; k < K; k++) aii[k] += 1.0;
+  }
+  return SUN_SUCCESS;
+}
+
+static SUNErrCode ensemble_matrix_space(SUNMatrix A, long int *lenrw, long int *leniw) {
+  *lenrw = (long int) ENM(A)->data.size();
+  *leniw = 2;
+  return SUN_SUCCESS;
+}
+
+SUNMatrix SUNEnsembleMatrix(int n, int K, SUNContext sunctx) {
+  if (n < 1 || K < 1) return NULL;
+  SUNMatrix A = SUNMatNewEmpty(sunctx);
+  if (A == NULL) return NULL;
+
+  A->ops->getid     = ensemble_matrix_getid;
+  A->ops->clone     = ensemble_matrix_clone;
+  A->ops->destroy   = ensemble_matrix_destroy;
+  A->ops->zero      = ensemble_matrix_zero;
+  A->ops->copy      = ensemble_matrix_copy;
+  A->ops->scaleaddi = ensemble_matrix_scaleaddi;
+  A->ops->space     = ensemble_matrix_space;
+
+  ensemble_matrix *m = new (std::nothrow) ensemble_matrix();
+  if (m == NULL) {
+    SUNMatFreeEmpty(A);
+    return NULL;
+  }
+  A->content = m;
+
+  try {
+    m->n = n;
+    m->K = K;
+    m->data.assign((size_t) n * n * K, 0.0);
+  } catch (std::bad_alloc &) {
+    ensemble_matrix_destroy(A);
+    return NULL;
+  }
+  return A;
+}
+
+sunrealtype *SUNEnsembleMatrix_Data(SUNMatrix A) {
+  return ENM(A)->data.data();
+}
+
+//------------------------------------------------------------------------------
+// SUNLinearSolver: LU of every block, the subjects side by side
+
+struct ensemble_lu {
+  int n, K;
+  std::vector<int> piv;            // row swapped with row j of subject k, at j*K + k
+  std::vector<int> prow;           // work: the pivot row of each subject ...
+  std::vector<sunrealtype> best;   // ... its magnitude ...
+  std::vector<sunrealtype> inv;    // ... and its inverse
+  sunindextype last_flag;
+};
+
+#define ELU(S) ((ensemble_lu*)(S)->content)
+
+static SUNLinearSolver_Type ensemble_lu_gettype(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_DIRECT;
+}
+
+static SUNLinearSolver_ID ensemble_lu_getid(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_CUSTOM;
+}
+
+static SUNErrCode ensemble_lu_initialize(SUNLinearSolver S) {
+  ELU(S)->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+// A is factored in place, rows swapped whole as LAPACK's dgetrf does, and
+// solve() reads the factors from it. On a zero pivot last_flag is the column
+// it was met in, from 1.
+static int ensemble_lu_setup(SUNLinearSolver S, SUNMatrix A) {
+  ensemble_lu *lu = ELU(S);
+  const int n = lu->n, K = lu->K;
+  sunrealtype *a = SUNEnsembleMatrix_Data(A);
+  int *prow = lu->prow.data();
+  sunrealtype *best = lu->best.data(), *inv = lu->inv.data();
+#define ENS_A(i, j) (a + (size_t) ((i) + (j) * n) * K)
+
+  for (int j = 0; j < n; j++) {
+    // the pivot of each subject: the largest magnitude in column j from row j
+    const sunrealtype *ajj = ENS_A(j, j);
+    for (int k = 0; k < K; k++) {
+      prow[k] = j;
+      best[k] = std::fabs(ajj[k]);
+    }
+    for (int i = j + 1; i < n; i++) {
+      const sunrealtype *aij = ENS_A(i, j);
+      for (int k = 0; k < K; k++) {
+        sunrealtype v = std::fabs(aij[k]);
+        if (v > best[k]) { best[k] = v; prow[k] = i; }
+      }
+    }
+    for (int k = 0; k < K; k++) {
+      if (best[k] == 0.0) {
+        lu->last_flag = j + 1;
+        return SUNLS_LUFACT_FAIL;
+      }
+      lu->piv[(size_t) j * K + k] = prow[k];
+    }
+
+    // bring the pivots to row j, subject by subject
+    for (int c = 0; c < n; c++) {
+      sunrealtype *ajc = ENS_A(j, c);
+      for (int k = 0; k < K; k++) {
+        if (prow[k] != j) std::swap(ajc[k], ENS_A(prow[k], c)[k]);
+      }
+    }
+
+    // the multipliers, then the update of the trailing blocks
+    for (int k = 0; k < K; k++) inv[k] = 1.0 / ajj[k];
+    for (int i = j + 1; i < n; i++) {
+      sunrealtype *aij = ENS_A(i, j);
+      for (int k = 0; k < K; k++) aij[k] *= inv[k];
+    }
+    for (int c = j + 1; c < n; c++) {
+      const sunrealtype *ajc = ENS_A(j, c);
+      for (int i = j + 1; i < n; i++) {
+        const sunrealtype *aij = ENS_A(i, j);
+        sunrealtype *aic = ENS_A(i, c);
+        for (int k = 0; k < K; k++) aic[k] -= aij[k] * ajc[k];
+      }
+    }
+  }
+  lu->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+static int ensemble_lu_solve(SUNLinearSolver S, SUNMatrix A, N_Vector x,
+                             N_Vector b, sunrealtype tol) {
+  ensemble_lu *lu = ELU(S);
+  const int n = lu->n, K = lu->K;
+  const sunrealtype *a = SUNEnsembleMatrix_Data(A);
+  N_VScale(1.0, b, x);
+  sunrealtype *xd = N_VGetArrayPointer(x);
+
+  // the row swaps, in the order they were made
+  for (int j = 0; j < n; j++) {
+    const int *pj = lu->piv.data() + (size_t) j * K;
+    sunrealtype *xj = xd + (size_t) j * K;
+    for (int k = 0; k < K; k++) {
+      if (pj[k] != j) std::swap(xj[k], xd[(size_t) pj[k] * K + k]);
+    }
+  }
+  // L, unit lower triangular
+  for (int j = 0; j < n; j++) {
+    const sunrealtype *xj = xd + (size_t) j * K;
+    for (int i = j + 1; i < n; i++) {
+      const sunrealtype *aij = ENS_A(i, j);
+      sunrealtype *xi = xd + (size_t) i * K;
+      for (int k = 0; k < K; k++) xi[k] -= aij[k] * xj[k];
+    }
+  }
+  // U
+  for (int j = n - 1; j >= 0; j--) {
+    const sunrealtype *ajj = ENS_A(j, j);
+    sunrealtype *xj = xd + (size_t) j * K;
+    for (int k = 0; k < K; k++) xj[k] /= ajj[k];
+    for (int i = 0; i < j; i++) {
+      const sunrealtype *aij = ENS_A(i, j);
+      sunrealtype *xi = xd + (size_t) i * K;
+      for (int k = 0; k < K; k++) xi[k] -= aij[k] * xj[k];
+    }
+  }
+#undef ENS_A
+  lu->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+static sunindextype ensemble_lu_lastflag(SUNLinearSolver S) {
+  return ELU(S)->last_flag;
+}
+
+static SUNErrCode ensemble_lu_free(SUNLinearSolver S) {
+  if (S == NULL) return SUN_SUCCESS;
+  delete ELU(S);
+  S->content = NULL;
+  SUNLinSolFreeEmpty(S);
+  return SUN_SUCCESS;
+}
+
+SUNLinearSolver SUNLinSol_Ensemble(N_Vector y, SUNMatrix A, SUNContext sunctx) {
+  if (SUNMatGetID(A) != SUNMATRIX_CUSTOM || A->ops->getid != ensemble_matrix_getid ||
+      (sunindextype) ENM(A)->n * ENM(A)->K != NV_LENGTH_S(y)) {
+    return NULL;
+  }
+
+  SUNLinearSolver S = SUNLinSolNewEmpty(sunctx);
+  if (S == NULL) return NULL;
+
+  S->ops->gettype    = ensemble_lu_gettype;
+  S->ops->getid      = ensemble_lu_getid;
+  S->ops->initialize = ensemble_lu_initialize;
+  S->ops->setup      = ensemble_lu_setup;
+  S->ops->solve      = ensemble_lu_solve;
+  S->ops->lastflag   = ensemble_lu_lastflag;
+  S->ops->free       = ensemble_lu_free;
+
+  ensemble_lu *lu = new (std::nothrow) ensemble_lu();
+  if (lu == NULL) {
+    SUNLinSolFreeEmpty(S);
+    return NULL;
+  }
+  S->content = lu;
+
+  try {
+    lu->n = ENM(A)->n;
+    lu->K = ENM(A)->K;
+    lu->piv.resize((size_t) lu->n * lu->K);
+    lu->prow.resize(lu->K);
+    lu->best.resize(lu->K);
+    lu->inv.resize(lu->K);
+    lu->last_flag = SUN_SUCCESS;
+  } catch (std::bad_alloc &) {
+    ensemble_lu_free(S);
+    return NULL;
+  }
+  return S;
+}
@@ -0,0 +1,784 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Models given as R expressions: the expression graph, the bytecode compiler
+// and interpreter, and ode_model(), which builds a model from R. See
+// expr_model.h for the design.
+
+#include <Rcpp.h>
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <stdint.h>
+
+#include <expr_model.h>
+#include <sundialr_xptr.h>
+
+using namespace Rcpp;
+
+//-- Expression graph ----------------------------------------------------------
+
+static int expr_arity(int op) {
+  switch (op) {
+  case EOP_CONST: case EOP_TIME: case EOP_STATE: case EOP_PARAM:
+    return 0;
+  case EOP_POWI: case EOP_NEG: case EOP_EXP: case EOP_LOG: case EOP_SQRT:
+  case EOP_SIN: case EOP_COS: case EOP_TAN: case EOP_ASIN: case EOP_ACOS:
+  case EOP_ATAN: case EOP_SINH: case EOP_COSH: case EOP_TANH: case EOP_ABS:
+  case EOP_SIGN: case EOP_NOT:
+    return 1;
+  case EOP_IFELSE:
+    return 3;
+  default:
+    return 2;
+  }
+}
+
+static bool expr_commutes(int op) {
+  return op == EOP_ADD || op == EOP_MUL || op == EOP_EQ || op == EOP_NE ||
+    op == EOP_AND || op == EOP_OR || op == EOP_MIN || op == EOP_MAX;
+}
+
+static double expr_powi(double x, int k) {
+  bool inv = k < 0;
+  unsigned int e = inv ? -(unsigned int) k : (unsigned int) k;
+  double r = 1.0;
+  while (e) {
+    if (e & 1u) r *= x;
+    x *= x;
+    e >>= 1;
+  }
+  return inv ? 1.0 / r : r;
+}
+
+double expr_apply(int op, double a, double b, double c, int k) {
+  switch (op) {
+  case EOP_ADD:    return a + b;
+  case EOP_SUB:    return a - b;
+  case EOP_MUL:    return a * b;
+  case EOP_DIV:    return a / b;
+  case EOP_POW:    return R_pow(a, b);   // as R's ^, not pow()
+  case EOP_POWI:   return expr_powi(a, k);
+  case EOP_NEG:    return -a;
+  case EOP_EXP:    return std::exp(a);
+  case EOP_LOG:    return std::log(a);
+  case EOP_SQRT:   return std::sqrt(a);
+  case EOP_SIN:    return std::sin(a);
+  case EOP_COS:    return std::cos(a);
+  case EOP_TAN:    return std::tan(a);
+  case EOP_ASIN:   return std::asin(a);
+  case EOP_ACOS:   return std::acos(a);
+  case EOP_ATAN:   return std::atan(a);
+  case EOP_SINH:   return std::sinh(a);
+  case EOP_COSH:   return std::cosh(a);
+  case EOP_TANH:   return std::tanh(a);
+  case EOP_ABS:    return std::fabs(a);
+  case EOP_SIGN:   return (a > 0.0) - (a < 0.0);
+  case EOP_LT:     return a <  b;
+  case EOP_LE:     return a <= b;
+  case EOP_GT:     return a >  b;
+  case EOP_GE:     return a >= b;
+  case EOP_EQ:     return a == b;
+  case EOP_NE:     return a != b;
+  case EOP_AND:    return a != 0.0 && b != 0.0;
+  case EOP_OR:     return a != 0.0 || b != 0.0;
+  case EOP_NOT:    return a == 0.0;
+  case EOP_MIN:    return a < b ? a : b;
+  case EOP_MAX:    return a > b ? a : b;
+  case EOP_IFELSE: return a != 0.0 ? b : c;
+  default:         return NAN;
+  }
+}
+
+static uint64_t expr_bits(double v) {
+  uint64_t u;
+  std::memcpy(&u, &v, sizeof u);
+  return u;
+}
+
+std::size_t expr_graph::key_hash::operator()(const expr_node &n) const {
+  uint64_t h = (uint64_t) n.op;
+  h = h * 1000003u ^ (uint64_t) (uint32_t) n.a;
+  h = h * 1000003u ^ (uint64_t) (uint32_t) n.b;
+  h = h * 1000003u ^ (uint64_t) (uint32_t) n.c;
+  h = h * 1000003u ^ (uint64_t) (uint32_t) n.k;
+  h = h * 1000003u ^ expr_bits(n.value);
+  return (std::size_t) (h ^ (h >> 29));
+}
+
+// constants compare by their bits, so 0 and -0 (and every NaN) stay distinct
+bool expr_graph::key_eq::operator()(const expr_node &x, const expr_node &y) const {
+  return x.op == y.op && x.a == y.a && x.b == y.b && x.c == y.c && x.k == y.k &&
+    expr_bits(x.value) == expr_bits(y.value);
+}
+
+expr_graph::expr_graph(int n_states_, int n_params_)
+  : n_states(n_states_), n_params(n_params_) {}
+
+int expr_graph::intern(const expr_node &n) {
+  std::unordered_map<expr_node, int, key_hash, key_eq>::iterator it = index.find(n);
+  if (it != index.end()) return it->second;
+  int id = (int) nodes.size();
+  nodes.push_back(n);
+  index[n] = id;
+  return id;
+}
+
+int expr_graph::constant(double v) {
+  expr_node n = {EOP_CONST, -1, -1, -1, 0, v};
+  return intern(n);
+}
+
+int expr_graph::time() {
+  expr_node n = {EOP_TIME, -1, -1, -1, 0, 0.0};
+  return intern(n);
+}
+
+int expr_graph::state(int j) {
+  expr_node n = {EOP_STATE, -1, -1, -1, j, 0.0};
+  return intern(n);
+}
+
+int expr_graph::param(int k) {
+  expr_node n = {EOP_PARAM, -1, -1, -1, k, 0.0};
+  return intern(n);
+}
+
+int expr_graph::op(int code, int a, int b, int c, int k) {
+  int arity = expr_arity(code);
+  if (arity < 2) b = -1;
+  if (arity < 3) c = -1;
+  if (code != EOP_POWI) k = 0;
+
+  // fold operations on constants
+  bool all_const = is_const(a) && (b < 0 || is_const(b)) && (c < 0 || is_const(c));
+  if (all_const) {
+    return constant(expr_apply(code, nodes[a].value,
+                               b < 0 ? 0.0 : nodes[b].value,
+                               c < 0 ? 0.0 : nodes[c].value, k));
+  }
+
+  // identities that leave an operand unchanged. Only those that give the same
+  // result for every value, infinities, NaN and the sign of 0 included, are
+  // applied: 0*x, x - x and 0/x are NaN for an infinite or NaN x, as in R, and
+  // x + 0 and 0 - x are +0 for x = -0 and x = 0, so they stay.
+  switch (code) {
+  case EOP_ADD:
+    if (is_const(a, 0.0) && std::signbit(nodes[a].value)) return b;
+    if (is_const(b, 0.0) && std::signbit(nodes[b].value)) return a;
+    break;
+  case EOP_SUB:
+    if (is_const(b, 0.0) && !std::signbit(nodes[b].value)) return a;
+    break;
+  case EOP_MUL:
+    if (is_const(a, 1.0)) return b;
+    if (is_const(b, 1.0)) return a;
+    if (is_const(a, -1.0)) return op(EOP_NEG, b);
+    if (is_const(b, -1.0)) return op(EOP_NEG, a);
+    if (a == b) return op(EOP_POWI, a, -1, -1, 2);
+    break;
+  case EOP_DIV:
+    if (is_const(b, 1.0)) return a;
+    // division by a power of two is multiplication by its reciprocal, which
+    // is exact; for other constants the two can differ in the last bit
+    if (is_const(b) && std::isfinite(1.0 / nodes[b].value)) {
+      int e;
+      if (std::fabs(std::frexp(nodes[b].value, &e)) == 0.5)
+        return op(EOP_MUL, a, constant(1.0 / nodes[b].value));
+    }
+    break;
+  case EOP_NEG:
+    if (nodes[a].op == EOP_NEG) return nodes[a].a;
+    break;
+  case EOP_POW:
+    // x^0 is 1 and x^1 is x, and R itself takes x^2 as x*x; every other
+    // power is left to R_pow(), as R's are, since repeated multiplication can
+    // differ from it in the last bits, or overflow where it does not
+    if (is_const(b, 0.0)) return constant(1.0);
+    if (is_const(b, 1.0)) return a;
+    if (is_const(b, 2.0)) return op(EOP_POWI, a, -1, -1, 2);
+    break;
+  case EOP_POWI:
+    if (k == 0) return constant(1.0);
+    if (k == 1) return a;
+    break;
+  case EOP_IFELSE:
+    if (is_const(a)) return nodes[a].value != 0.0 ? b : c;
+    if (b == c) return b;
+    break;
+  case EOP_MIN: case EOP_MAX:
+    if (a == b) return a;
+    break;
+  }
+
+  if (expr_commutes(code) && b < a) std::swap(a, b);
+
+  expr_node n = {code, a, b, c, k, 0.0};
+  return intern(n);
+}
+
+//-- Bytecode --------------------------------------------------------------------
+
+expr_program expr_compile(const expr_graph &g, const std::vector<int> &outputs) {
+  int n_nodes = (int) g.nodes.size();
+  int n = g.n_states, np = g.n_params;
+
+  // the nodes the outputs depend on
+  std::vector<char> live(n_nodes, 0);
+  for (size_t i = 0; i < outputs.size(); i++) live[outputs[i]] = 1;
+  for (int id = n_nodes - 1; id >= 0; id--) {
+    if (!live[id]) continue;
+    const expr_node &nd = g.nodes[id];
+    if (nd.a >= 0) live[nd.a] = 1;
+    if (nd.b >= 0) live[nd.b] = 1;
+    if (nd.c >= 0) live[nd.c] = 1;
+  }
+
+  expr_program prog;
+  prog.n_states = n;
+  prog.n_params = np;
+
+  // fixed registers for the leaves, then one per constant
+  std::vector<int> reg(n_nodes, -1);
+  int next = 1 + n + np;
+  for (int id = 0; id < n_nodes; id++) {
+    if (!live[id]) continue;
+    const expr_node &nd = g.nodes[id];
+    switch (nd.op) {
+    case EOP_TIME:  reg[id] = 0; break;
+    case EOP_STATE: reg[id] = 1 + nd.k; break;
+    case EOP_PARAM: reg[id] = 1 + n + nd.k; break;
+    case EOP_CONST:
+      reg[id] = next++;
+      prog.const_reg.push_back(reg[id]);
+      prog.const_val.push_back(nd.value);
+      break;
+    }
+  }
+
+  // the last node reading each node; outputs are read after the last one
+  std::vector<int> last_use(n_nodes, -1);
+  for (int id = 0; id < n_nodes; id++) {
+    if (!live[id]) continue;
+    const expr_node &nd = g.nodes[id];
+    if (nd.a >= 0) last_use[nd.a] = id;
+    if (nd.b >= 0) last_use[nd.b] = id;
+    if (nd.c >= 0) last_use[nd.c] = id;
+  }
+  for (size_t i = 0; i < outputs.size(); i++) last_use[outputs[i]] = INT_MAX;
+
+  // temporaries, reusing a register once its value has been read for the last
+  // time. An instruction reads its operands before writing its result, so the
+  // result may go into the register of an operand that dies with it.
+  std::vector<int> free_regs;
+  for (int id = 0; id < n_nodes; id++) {
+    if (!live[id]) continue;
+    const expr_node &nd = g.nodes[id];
+    if (expr_arity(nd.op) == 0) continue;
+
+    int operands[3] = {nd.a, nd.b, nd.c};
+    for (int i = 0; i < 3; i++) {
+      int o = operands[i];
+      if (o < 0 || expr_arity(g.nodes[o].op) == 0 || last_use[o] != id) continue;
+      if ((i > 0 && operands[0] == o) || (i > 1 && operands[1] == o)) continue;
+      free_regs.push_back(reg[o]);
+    }
+
+    if (free_regs.empty()) {
+      reg[id] = next++;
+    } else {
+      reg[id] = free_regs.back();
+      free_regs.pop_back();
+    }
+
+    expr_instr in = {nd.op, reg[id],
+                     nd.a >= 0 ? reg[nd.a] : 0,
+                     nd.b >= 0 ? reg[nd.b] : 0,
+                     nd.c >= 0 ? reg[nd.c] : 0,
+                     nd.k};
+    prog.code.push_back(in);
+  }
+
+  prog.n_regs = next;
+  for (size_t i = 0; i < outputs.size(); i++) prog.out.push_back(reg[outputs[i]]);
+  return prog;
+}
+
+void expr_program::init_scratch(std::vector<double> &regs) const {
+  regs.assign(n_regs, 0.0);
+  for (size_t i = 0; i < const_reg.size(); i++) regs[const_reg[i]] = const_val[i];
+}
+
+void expr_program::eval(double t, const double *y, const double *p, double *regs,
+                        double *res) const {
+  regs[0] = t;
+  for (int j = 0; j < n_states; j++) regs[1 + j] = y[j];
+  for (int k = 0; k < n_params; k++) regs[1 + n_states + k] = p[k];
+
+  const expr_instr *in = code.data();
+  const expr_instr *end = in + code.size();
+  for (; in != end; ++in) {
+    regs[in->dst] = expr_apply(in->op, regs[in->a], regs[in->b], regs[in->c], in->k);
+  }
+
+  for (size_t i = 0; i < out.size(); i++) res[i] = regs[out[i]];
+}
+
+void expr_program::init_scratch(std::vector<double> &regs, int K) const {
+  regs.assign((size_t) n_regs * K, 0.0);
+  for (size_t i = 0; i < const_reg.size(); i++) {
+    std::fill_n(regs.begin() + (size_t) const_reg[i] * K, K, const_val[i]);
+  }
+}
+
+void expr_program::eval_ensemble(int K, double t, const double *y, const double *p,
+                                 double *regs, double *res) const {
+  std::fill_n(regs, K, t);
+  std::copy(y, y + (size_t) n_states * K, regs + K);
+  std::copy(p, p + (size_t) n_params * K, regs + (size_t) (1 + n_states) * K);
+
+  const expr_instr *in = code.data();
+  const expr_instr *end = in + code.size();
+  for (; in != end; ++in) {
+    double *d = regs + (size_t) in->dst * K;
+    const double *a = regs + (size_t) in->a * K;
+    const double *b = regs + (size_t) in->b * K;
+    const double *c = regs + (size_t) in->c * K;
+    // the arithmetic in loops of its own, for the compiler to vectorise; the
+    // rest through expr_apply(), as eval() does
+    switch (in->op) {
+    case EOP_ADD: for (int k = 0; k < K; k++) d[k] = a[k] + b[k]; break;
+    case EOP_SUB: for (int k = 0; k < K; k++) d[k] = a[k] - b[k]; break;
+    case EOP_MUL: for (int k = 0; k < K; k++) d[k] = a[k] * b[k]; break;
+    case EOP_DIV: for (int k = 0; k < K; k++) d[k] = a[k] / b[k]; break;
+    case EOP_NEG: for (int k = 0; k < K; k++) d[k] = -a[k]; break;
+    default:
+      for (int k = 0; k < K; k++) d[k] = expr_apply(in->op, a[k], b[k], c[k], in->k);
+    }
+  }
+
+  for (size_t i = 0; i < out.size(); i++) {
+    std::copy(regs + (size_t) out[i] * K, regs + (size_t) (out[i] + 1) * K,
+              res + i * K);
+  }
+}
+
+//-- Symbolic Jacobian -----------------------------------------------------------
+
+// The states each node depends on, as a sorted list of state indices
+static std::vector<std::vector<int> > expr_dependencies(const expr_graph &g) {
+  std::vector<std::vector<int> > deps(g.nodes.size());
+  for (size_t id = 0; id < g.nodes.size(); id++) {
+    const expr_node &nd = g.nodes[id];
+    if (nd.op == EOP_STATE) {
+      deps[id].push_back(nd.k);
+      continue;
+    }
+    int operands[3] = {nd.a, nd.b, nd.c};
+    for (int i = 0; i < 3; i++) {
+      if (operands[i] < 0 || deps[operands[i]].empty()) continue;
+      std::vector<int> merged;
+      std::set_union(deps[id].begin(), deps[id].end(),
+                     deps[operands[i]].begin(), deps[operands[i]].end(),
+                     std::back_inserter(merged));
+      deps[id].swap(merged);
+    }
+  }
+  return deps;
+}
+
+// Differentiates nodes of a graph with respect to one state, adding the
+// derivatives to the same graph. Nodes that do not depend on the state have a
+// derivative of 0 without being visited, and each node is differentiated once.
+struct expr_differ {
+  expr_graph &g;
+  const std::vector<std::vector<int> > &deps;   // of the nodes before differentiating
+  int j;
+  std::unordered_map<int, int> memo;
+
+  expr_differ(expr_graph &g_, const std::vector<std::vector<int> > &deps_)
+    : g(g_), deps(deps_), j(-1) {}
+
+  bool depends(int id) const {
+    return std::binary_search(deps[id].begin(), deps[id].end(), j);
+  }
+
+  // A term of a derivative that is 0 drops out of it, which the graph does
+  // not assume of 0*x or x + 0, so that terms of variables that do not change
+  // leave no work behind and the Jacobian keeps only its structural nonzeros.
+  int add(int x, int y) {
+    if (g.is_const(x, 0.0)) return y;
+    if (g.is_const(y, 0.0)) return x;
+    return g.op(EOP_ADD, x, y);
+  }
+  int sub(int x, int y) {
+    if (g.is_const(y, 0.0)) return x;
+    if (g.is_const(x, 0.0)) return g.op(EOP_NEG, y);
+    return g.op(EOP_SUB, x, y);
+  }
+  int mul(int x, int y) {
+    if (g.is_const(x, 0.0) || g.is_const(y, 0.0)) return g.constant(0.0);
+    return g.op(EOP_MUL, x, y);
+  }
+  int div(int x, int y) {
+    if (g.is_const(x, 0.0)) return g.constant(0.0);
+    return g.op(EOP_DIV, x, y);
+  }
+
+  int d(int id) {
+    if (!depends(id)) return g.constant(0.0);
+    std::unordered_map<int, int>::iterator it = memo.find(id);
+    if (it != memo.end()) return it->second;
+
+    // a copy: building nodes below may reallocate g.nodes
+    const expr_node nd = g.nodes[id];
+    int a = nd.a, b = nd.b;
+    int one = g.constant(1.0);
+    int r;
+    switch (nd.op) {
+    case EOP_STATE: r = one; break;
+    case EOP_ADD:   r = add(d(a), d(b)); break;
+    case EOP_SUB:   r = sub(d(a), d(b)); break;
+    case EOP_MUL:   r = add(mul(d(a), b), mul(a, d(b))); break;
+    case EOP_DIV:   // (da - (a/b) db) / b
+      r = div(sub(d(a), mul(id, d(b))), b);
+      break;
+    case EOP_POW:
+      if (!depends(b)) {
+        r = mul(mul(b, g.op(EOP_POW, a, g.op(EOP_SUB, b, one))), d(a));
+      } else {      // a^b (db log(a) + b da / a)
+        r = mul(id, add(mul(d(b), g.op(EOP_LOG, a)),
+                    div(mul(b, d(a)), a)));
+      }
+      break;
+    case EOP_POWI:
+      r = mul(mul(g.constant(nd.k), g.op(EOP_POWI, a, -1, -1, nd.k - 1)), d(a));
+      break;
+    case EOP_NEG:   r = g.op(EOP_NEG, d(a)); break;
+    case EOP_EXP:   r = mul(id, d(a)); break;
+    case EOP_LOG:   r = div(d(a), a); break;
+    case EOP_SQRT:  r = div(d(a), mul(g.constant(2.0), id)); break;
+    case EOP_SIN:   r = mul(g.op(EOP_COS, a), d(a)); break;
+    case EOP_COS:   r = g.op(EOP_NEG, mul(g.op(EOP_SIN, a), d(a))); break;
+    case EOP_TAN:   r = mul(g.op(EOP_ADD, one, g.op(EOP_POWI, id, -1, -1, 2)), d(a)); break;
+    case EOP_ASIN:
+      r = div(d(a), g.op(EOP_SQRT, g.op(EOP_SUB, one, g.op(EOP_POWI, a, -1, -1, 2))));
+      break;
+    case EOP_ACOS:
+      r = g.op(EOP_NEG, div(d(a), g.op(EOP_SQRT, g.op(EOP_SUB, one, g.op(EOP_POWI, a, -1, -1, 2)))));
+      break;
+    case EOP_ATAN:  r = div(d(a), g.op(EOP_ADD, one, g.op(EOP_POWI, a, -1, -1, 2))); break;
+    case EOP_SINH:  r = mul(g.op(EOP_COSH, a), d(a)); break;
+    case EOP_COSH:  r = mul(g.op(EOP_SINH, a), d(a)); break;
+    case EOP_TANH:  r = mul(g.op(EOP_SUB, one, g.op(EOP_POWI, id, -1, -1, 2)), d(a)); break;
+    case EOP_ABS:   r = mul(g.op(EOP_SIGN, a), d(a)); break;
+    case EOP_MIN:   r = g.op(EOP_IFELSE, g.op(EOP_LE, a, b), d(a), d(b)); break;
+    case EOP_MAX:   r = g.op(EOP_IFELSE, g.op(EOP_GE, a, b), d(a), d(b)); break;
+    case EOP_IFELSE: r = g.op(EOP_IFELSE, a, d(b), d(nd.c)); break;
+    default:        // piecewise constant: sign, comparisons and logic
+      r = g.constant(0.0);
+    }
+    memo[id] = r;
+    return r;
+  }
+};
+
+void expr_model_jacobian(expr_model &model) {
+  int n = (int) model.rhs_nodes.size();
+  std::vector<std::vector<int> > deps = expr_dependencies(model.graph);
+
+  // the equations that depend on each state: the candidate nonzeros by column
+  std::vector<std::vector<int> > rows_of(n);
+  for (int i = 0; i < n; i++) {
+    const std::vector<int> &dep = deps[model.rhs_nodes[i]];
+    for (size_t e = 0; e < dep.size(); e++) rows_of[dep[e]].push_back(i);
+  }
+
+  // differentiate column by column, so the entries come out in compressed
+  // column order, and drop those that simplify to zero
+  model.jac_rows.clear();
+  model.jac_cols.clear();
+  std::vector<int> nodes;
+  expr_differ differ(model.graph, deps);
+  for (int j = 0; j < n; j++) {
+    differ.j = j;
+    differ.memo.clear();
+    for (size_t e = 0; e < rows_of[j].size(); e++) {
+      int i = rows_of[j][e];
+      int node = differ.d(model.rhs_nodes[i]);
+      if (model.graph.is_const(node, 0.0)) continue;
+      model.jac_rows.push_back(i);
+      model.jac_cols.push_back(j);
+      nodes.push_back(node);
+    }
+  }
+
+  model.jac = expr_compile(model.graph, nodes);
+  model.has_jac = true;
+}
+
+//-- R front end ---------------------------------------------------------------
+
+// Translates R expressions into nodes of the model's graph.
+struct expr_parser {
+  expr_graph &g;
+  std::unordered_map<std::string, int> states;
+  std::unordered_map<std::string, int> params;
+  std::string who;     // the function parsing, and the equation or output
+  std::string where;   // being parsed, for error messages
+
+  explicit expr_parser(expr_graph &g_) : g(g_), who("ode_model") {}
+
+  int symbol(const std::string &s) {
+    std::unordered_map<std::string, int>::iterator it = states.find(s);
+    if (it != states.end()) return g.state(it->second);
+    it = params.find(s);
+    if (it != params.end()) return g.param(it->second);
+    if (s == "t") return g.time();
+    if (s == "pi") return g.constant(M_PI);
+    stop("%s: unknown name '%s' in %s; every name must be a state, a parameter listed in `parameters`, or t",
+         who, s, where);
+    return -1;
+  }
+
+  // y[i] and p[i], with a literal 1-based index
+  int subscript(SEXP args) {
+    if (Rf_length(args) != 2 || TYPEOF(CAR(args)) != SYMSXP) {
+      stop("%s: only y[i] and p[i] may be subscripted, in %s", who, where);
+    }
+    std::string v = CHAR(PRINTNAME(CAR(args)));
+    SEXP idx = CADR(args);
+    if ((TYPEOF(idx) != REALSXP && TYPEOF(idx) != INTSXP) || Rf_length(idx) != 1) {
+      stop("%s: the index of %s[] must be a number, in %s", who, v, where);
+    }
+    double i = Rf_asReal(idx);
+    int len = v == "y" ? g.n_states : v == "p" ? g.n_params : -1;
+    if (len < 0) stop("%s: only y[i] and p[i] may be subscripted, in %s", who, where);
+    if (!(i >= 1 && i <= len && i == std::floor(i))) {
+      stop("%s: index %s[%g] is out of range 1..%d, in %s", who, v, i, len, where);
+    }
+    return v == "y" ? g.state((int) i - 1) : g.param((int) i - 1);
+  }
+
+  int call(SEXP e) {
+    SEXP head = CAR(e);
+    if (TYPEOF(head) != SYMSXP) stop("%s: unsupported call in %s", who, where);
+    std::string f = CHAR(PRINTNAME(head));
+    SEXP args = CDR(e);
+    int nargs = Rf_length(args);
+
+    if (f == "[") return subscript(args);
+
+    std::vector<int> x;
+    for (SEXP a = args; a != R_NilValue; a = CDR(a)) x.push_back(parse(CAR(a)));
+
+    if (f == "(" && nargs == 1) return x[0];
+    if (f == "+" && nargs == 1) return x[0];
+    if (f == "-" && nargs == 1) return g.op(EOP_NEG, x[0]);
+
+    static const struct { const char *name; int op; } unary[] = {
+      {"exp", EOP_EXP}, {"log", EOP_LOG}, {"sqrt", EOP_SQRT}, {"sin", EOP_SIN},
+      {"cos", EOP_COS}, {"tan", EOP_TAN}, {"asin", EOP_ASIN}, {"acos", EOP_ACOS},
+      {"atan", EOP_ATAN}, {"sinh", EOP_SINH}, {"cosh", EOP_COSH}, {"tanh", EOP_TANH},
+      {"abs", EOP_ABS}, {"sign", EOP_SIGN}, {"!", EOP_NOT}
+    };
+    static const struct { const char *name; int op; } binary[] = {
+      {"+", EOP_ADD}, {"-", EOP_SUB}, {"*", EOP_MUL}, {"/", EOP_DIV}, {"^", EOP_POW},
+      {"<", EOP_LT}, {"<=", EOP_LE}, {">", EOP_GT}, {">=", EOP_GE}, {"==", EOP_EQ},
+      {"!=", EOP_NE}, {"&", EOP_AND}, {"&&", EOP_AND}, {"|", EOP_OR}, {"||", EOP_OR}
+    };
+    for (size_t i = 0; i < sizeof unary / sizeof unary[0]; i++) {
+      if (f == unary[i].name && nargs == 1) return g.op(unary[i].op, x[0]);
+    }
+    for (size_t i = 0; i < sizeof binary / sizeof binary[0]; i++) {
+      if (f == binary[i].name && nargs == 2) return g.op(binary[i].op, x[0], x[1]);
+    }
+
+    if (f == "log" && nargs == 2) {
+      return g.op(EOP_DIV, g.op(EOP_LOG, x[0]), g.op(EOP_LOG, x[1]));
+    }
+    if (f == "log10" && nargs == 1) {
+      return g.op(EOP_DIV, g.op(EOP_LOG, x[0]), g.constant(std::log(10.0)));
+    }
+    if (f == "log2" && nargs == 1) {
+      return g.op(EOP_DIV, g.op(EOP_LOG, x[0]), g.constant(std::log(2.0)));
+    }
+    if ((f == "min" || f == "max" || f == "pmin" || f == "pmax") && nargs >= 1) {
+      int code = (f == "min" || f == "pmin") ? EOP_MIN : EOP_MAX;
+      int r = x[0];
+      for (int i = 1; i < nargs; i++) r = g.op(code, r, x[i]);
+      return r;
+    }
+    if ((f == "ifelse" || f == "if") && nargs == 3) {
+      return g.op(EOP_IFELSE, x[0], x[1], x[2]);
+    }
+
+    stop("%s: unsupported function %s() with %d argument(s) in %s", who, f, nargs, where);
+    return -1;
+  }
+
+  int parse(SEXP e) {
+    switch (TYPEOF(e)) {
+    case REALSXP: case INTSXP: case LGLSXP:
+      if (Rf_length(e) != 1) stop("%s: constants must be scalars, in %s", who, where);
+      return g.constant(Rf_asReal(e));
+    case SYMSXP:
+      return symbol(CHAR(PRINTNAME(e)));
+    case LANGSXP:
+      return call(e);
+    default:
+      stop("%s: unsupported element of type %s in %s",
+           who, Rf_type2char(TYPEOF(e)), where);
+    }
+    return -1;
+  }
+};
+
+// An equation may be a call, a name or a number, as from quote(), an
+// expression() of length one, or a one-sided formula
+static SEXP equation_body(SEXP e) {
+  if (TYPEOF(e) == EXPRSXP && Rf_length(e) == 1) return VECTOR_ELT(e, 0);
+  if (TYPEOF(e) == LANGSXP && CAR(e) == Rf_install("~")) {
+    if (Rf_length(e) != 2) stop("ode_model: a formula equation must be one-sided, as in ~ -k * A");
+    return CADR(e);
+  }
+  return e;
+}
+
+const expr_model *expr_model_get(SEXP x) {
+  const char *tag = sundialr_xptr_type(x);
+  if (tag == NULL || std::strcmp(tag, "sundialr_model") != 0) return NULL;
+  const expr_model *model = (const expr_model *) R_ExternalPtrAddr(x);
+  if (!model) {
+    stop("The model is no longer valid (an external pointer does not survive saving and reloading a session): build it again with ode_model()");
+  }
+  return model;
+}
+
+void expr_model_check(const expr_model *model, int y_len, int n_params) {
+  if ((int) model->states.size() != y_len) {
+    stop("The model has %d states but the initial conditions have %d values",
+         (int) model->states.size(), y_len);
+  }
+  if ((int) model->params.size() != n_params) {
+    stop("The model has %d parameters but Parameters has %d values",
+         (int) model->params.size(), n_params);
+  }
+}
+
+expr_program expr_outputs(SEXP outputs, const expr_model *model, int n_states,
+                          int n_params) {
+  expr_graph g(n_states, n_params);
+  expr_parser parser(g);
+  parser.who = "outputs";
+  if (model) {
+    for (int j = 0; j < n_states; j++) {
+      if (!model->states[j].empty()) parser.states[model->states[j]] = j;
+    }
+    for (int k = 0; k < n_params; k++) parser.params[model->params[k]] = k;
+  }
+
+  SEXP names = Rf_getAttrib(outputs, R_NamesSymbol);
+  std::vector<int> nodes;
+  for (R_xlen_t j = 0; j < Rf_xlength(outputs); j++) {
+    std::string name = names == R_NilValue ? "" : CHAR(STRING_ELT(names, j));
+    parser.where = name.empty() ? "output " + std::to_string(j + 1) : "the output " + name;
+    nodes.push_back(parser.parse(equation_body(VECTOR_ELT(outputs, j))));
+  }
+  return expr_compile(g, nodes);
+}
+
+//'ode_model
+//'
+//' Compile a model given as R expressions, for use as the right-hand side in
+//' \code{cvode()}, \code{cvsolve()} and \code{cvodes()}. The expressions are
+//' translated once into a compact bytecode that the solvers evaluate without
+//' calling R, so the model runs much faster than the equivalent R function and
+//' needs no C++ compiler.
+//'@param equations A list with one element per state, each giving d(state)/dt as an expression: a call made with \code{quote()}, an \code{expression()} of length one, a one-sided formula, a name or a number. The names of the list name the states, which the equations may then refer to; the states may also be referred to as \code{y[1]}, \code{y[2]} etc. The order of the list is the order of the state vector. Supported are the arithmetic operators, \code{exp}, \code{log}, \code{log10}, \code{log2}, \code{sqrt}, the trigonometric and hyperbolic functions, \code{abs}, \code{sign}, \code{min}, \code{max}, comparisons, \code{&}, \code{|}, \code{!}, \code{ifelse()} and \code{if (...) ... else ...}, and the time \code{t}
+//'@param parameters (Optional) Names of the parameters, in the order of the \code{Parameters} vector passed to the solver. The parameters may also be referred to as \code{p[1]}, \code{p[2]} etc. Default is NULL, for a model without parameters
+//'@param jacobian Derive the Jacobian of the model symbolically (TRUE, the default) or not (FALSE). The derivatives are computed once, when the model is built, and only the entries that are not structurally zero are kept. The solvers then use this analytic Jacobian when no \code{jacobian} argument is given to them, instead of approximating it by finite differences
+//'@returns An external pointer of class \code{sundialr_model}, to be passed to a solver as \code{input_function}. It has attributes \code{states} and \code{parameters} giving the names. Like any external pointer it is not saved with the workspace, so it must be built again in a new session.
+//'@example /inst/examples/ode_model.r
+// [[Rcpp::export]]
+SEXP ode_model(List equations, Nullable<CharacterVector> parameters = R_NilValue,
+               bool jacobian = true) {
+
+  int n = equations.size();
+  if (n == 0) stop("ode_model: there must be at least one equation");
+
+  CharacterVector state_names(n);
+  if (!Rf_isNull(equations.names())) state_names = equations.names();
+  CharacterVector param_names(0);
+  if (parameters.isNotNull()) param_names = parameters.get();
+  int np = param_names.length();
+
+  std::unique_ptr<expr_model> model(new expr_model());
+  model->graph = expr_graph(n, np);
+  expr_parser parser(model->graph);
+
+  for (int j = 0; j < n; j++) {
+    std::string s = as<std::string>(state_names[j]);
+    model->states.push_back(s);
+    if (s.empty()) continue;
+    if (s == "t" || parser.states.count(s)) {
+      stop("ode_model: state names must be unique and may not be t ('%s')", s);
+    }
+    parser.states[s] = j;
+  }
+  for (int k = 0; k < np; k++) {
+    std::string s = as<std::string>(param_names[k]);
+    model->params.push_back(s);
+    if (s.empty() || s == "t" || parser.states.count(s) || parser.params.count(s)) {
+      stop("ode_model: parameter names must be non-empty, unique, distinct from the state names and may not be t ('%s')", s);
+    }
+    parser.params[s] = k;
+  }
+
+  for (int j = 0; j < n; j++) {
+    parser.where = model->states[j].empty()
+      ? "equation " + std::to_string(j + 1)
+      : "the equation for " + model->states[j];
+    model->rhs_nodes.push_back(parser.parse(equation_body(equations[j])));
+  }
+  model->rhs = expr_compile(model->graph, model->rhs_nodes);
+  if (jacobian) expr_model_jacobian(*model);
+  int jac_nonzeros = (int) model->jac_rows.size();
+
+  XPtr<expr_model> ptr(model.release(), true, Rf_install("sundialr_model"), R_NilValue);
+  ptr.attr("states") = state_names;
+  ptr.attr("parameters") = param_names;
+  if (jacobian) ptr.attr("jacobian_nonzeros") = jac_nonzeros;
+  ptr.attr("class") = CharacterVector::create("sundialr_model", "sundialr_native");
+  return ptr;
+}
@@ -31,15 +31,21 @@
 #include <Rcpp.h>
 
 #include <ida/ida.h>                          /* prototypes for IDA fcts., consts.    */
+#include <ida/ida_ls.h>                       /* IDALsJacTimesVecFn etc.              */
 #include <nvector/nvector_serial.h>           /* access to serial N_Vector            */
-#include <sunmatrix/sunmatrix_dense.h>        /* access to dense SUNMatrix            */
-#include <sunlinsol/sunlinsol_dense.h>        /* access to dense SUNLinearSolver      */
 #include <sunnonlinsol/sunnonlinsol_newton.h> /* access to Newton SUNNonlinearSolver  */
 #include <sundials/sundials_types.h>          /* defs. of realtype, sunindextype      */
 #include <sundials/sundials_math.h>           /* defs. of SUNRabs, SUNRexp, etc.      */
 
 #include <check_retval.h>
+#include <linear_solver.h>
 #include <jac_func.h>
+#include <fd_jacobian.h>
+#include <krylov_func.h>
+#include <r_callback.h>
+#include <sundialr_xptr.h>
+#include <solver_stats.h>
+#include <step_output.h>
 #include <sundials_scope_guard.h>
 // CRAN fix: replace SUNDIALS' default abort()-based error handler with one that
 // records the error for the solver to raise via stop() (see the header)
@@ -47,12 +53,66 @@
 
 using namespace Rcpp;
 
-// struct to use if R or Rcpp function is input as RHS residual function
+// struct to use as user data for a residual given as an R or Rcpp function, or
+// as a compiled function passed as an external pointer (see sundialr_xptr.h)
 struct res_func{
-  Function res_eqn;
   NumericVector params;
   SEXP jac_eqn;
   sundials_err_record *err;   // collects errors raised inside the callbacks
+
+  // Compiled residual and Jacobian, called directly with the parameter values
+  // as udata; NULL when the corresponding function is an R function (or absent)
+  sundialr_res res_native;
+  sundialr_jac_ida jac_native;
+  sundialr_jac_ida_band jac_band;    // or the Jacobian for a band matrix
+  sundialr_jac_ida_sparse jac_sparse;  // or for a sparse one
+  std::vector<double> jac_scratch;   // for jac_native with a band or sparse matrix
+  const sparse_pattern *pattern;     // with a sparse matrix, else NULL
+  krylov_func krylov;                // with a Krylov solver (see krylov_func.h)
+  fd_jacobian fd;                    // with a sparse matrix and no Jacobian
+  solver_clock *clock;               // with stats or a profile, else NULL
+
+  // Allocated once per solve and reused by every call of res_function
+  // (see r_callback.h). Unused for a compiled residual.
+  NumericVector t_arg;        // length 1
+  NumericVector yy_arg;       // length of the state vector
+  NumericVector yp_arg;       // length of the state vector
+  RObject res_call;           // res_eqn(t_arg, yy_arg, yp_arg, params)
+
+  // A compiled function is called through the pointer without any further
+  // check, so the tag naming its signature is verified here, before the solve
+  res_func(SEXP res_eqn, NumericVector params_, SEXP jac_eqn_,
+           sundials_err_record *err_, int y_len)
+    : params(params_), jac_eqn(jac_eqn_), err(err_),
+      res_native(NULL), jac_native(NULL), jac_band(NULL), jac_sparse(NULL), pattern(NULL), clock(NULL) {
+
+    if (TYPEOF(res_eqn) == EXTPTRSXP) {
+      res_native = (sundialr_res) sundialr_xptr_get(res_eqn, "sundialr_res");
+      if (!res_native) {
+        stop("The input function is an external pointer but not a valid compiled residual: make it with sundialr_xptr_res() from sundialr_xptr.h");
+      }
+    } else {
+      Function res_fun(res_eqn);
+      t_arg = r_arg_buffer(1);
+      yy_arg = r_arg_buffer(y_len);
+      yp_arg = r_arg_buffer(y_len);
+      res_call = Language(res_fun, t_arg, yy_arg, yp_arg, params);
+    }
+
+    if (TYPEOF(jac_eqn) == EXTPTRSXP) {
+      jac_native = (sundialr_jac_ida) sundialr_xptr_get(jac_eqn, "sundialr_jac_ida");
+      jac_band = (sundialr_jac_ida_band) sundialr_xptr_get(jac_eqn, "sundialr_jac_ida_band");
+      jac_sparse = (sundialr_jac_ida_sparse) sundialr_xptr_get(jac_eqn, "sundialr_jac_ida_sparse");
+      if (!jac_native && !jac_band && !jac_sparse) {
+        stop("The Jacobian is an external pointer but not a valid compiled IDA Jacobian: make it with sundialr_xptr_jac_ida(), sundialr_xptr_jac_ida_band() or sundialr_xptr_jac_ida_sparse() from sundialr_xptr.h");
+      }
+    } else if (jac_eqn != R_NilValue && !Rf_isFunction(jac_eqn)) {
+      stop("The Jacobian must be an R or Rcpp function, or a compiled IDA Jacobian made with sundialr_xptr_jac_ida(), sundialr_xptr_jac_ida_band() or sundialr_xptr_jac_ida_sparse()");
+    }
+  }
+
+  // true for a compiled residual, which is given to IDAInit as res_function_native
+  bool is_native() const { return res_native != NULL; }
 };
 
 // function called by IDAInit if user inputs R function
@@ -65,52 +125,26 @@ int res_function(sunrealtype t, N_Vector yy, N_Vector yp, N_Vector rr, void* use
 
   // nothing to record against, so just report the failure to SUNDIALS
   if(!my_res_fun){ return(-1); }
+  callback_timer timer(my_res_fun->clock);
 
   return sundials_callback_guard(my_res_fun->err, [&]() -> int {
 
-    // convert y to NumericVector y1
     int yy_len = NV_LENGTH_S(yy);
 
-    // NumericVector analog of yy
-    NumericVector yy1(yy_len);                      // filled with zeros
+    // copy t, yy and yp into the argument buffers the prebuilt call refers to
+    REAL(my_res_fun->t_arg)[0] = t;
     sunrealtype *yy_ptr = N_VGetArrayPointer(yy);
-    for (int i = 0; i < yy_len; i++){
-      yy1[i] = yy_ptr[i];                           // Ith(y,i+1);
-    }
-
-    int yp_len = NV_LENGTH_S(yp);
-    // NumericVector analog of yp
-    NumericVector yp1(yp_len);                      // filled with zeros
     sunrealtype *yp_ptr = N_VGetArrayPointer(yp);
-    for (int i = 0; i < yp_len; i++){
-      yp1[i] = yp_ptr[i];                           // Ith(y,i+1);
-    }
-
-    // NumericVector analog of rr
-    int rr_len = NV_LENGTH_S(rr);
-    NumericVector rr1(rr_len);                      // filled with zeros
-
-    Function res_fun = (*my_res_fun).res_eqn;           // function
-    NumericVector p_values = (*my_res_fun).params;      // rate parameters
-
-    if (!res_fun || (TYPEOF(res_fun) != CLOSXP)){
-      stop("The residual function is not an R or Rcpp function, stopping!");
+    double *yy_arg = REAL(my_res_fun->yy_arg);
+    double *yp_arg = REAL(my_res_fun->yp_arg);
+    for (int i = 0; i < yy_len; i++){
+      yy_arg[i] = yy_ptr[i];
+      yp_arg[i] = yp_ptr[i];
     }
 
-    // use the function to calculate value of RHS ----
-    rr1 = res_fun(t, yy1, yp1, p_values);
-
-    // guards the element-by-element copy below against a short return
-    if (rr1.length() != rr_len){
-      stop("The residual function must return a vector of the same length as the state vector: expected %d, got %d",
-           rr_len, rr1.length());
-    }
-
-    // convert NumericVector rr1 to N_Vector rr
-    sunrealtype *rr_ptr = N_VGetArrayPointer(rr);
-    for (int i = 0; i <  rr_len; i++){
-      rr_ptr[i] = rr1[i];
-    }
+    // use the function to calculate value of the residual, straight into rr
+    r_call_into(my_res_fun->res_call, N_VGetArrayPointer(rr), NV_LENGTH_S(rr),
+                "residual", my_res_fun->clock);
 
     // everything went smoothly
     return(0);
@@ -118,6 +152,21 @@ int res_function(sunrealtype t, N_Vector yy, N_Vector yp, N_Vector rr, void* use
 }
 //---RHS residual function definition ends -------------------------------------
 
+// function called by IDAInit if user inputs a compiled residual
+// No R is involved, so nothing is guarded; the return value goes straight back
+// to IDA (see rhs_function_native in rhs_func.cpp).
+int res_function_native(sunrealtype t, N_Vector yy, N_Vector yp, N_Vector rr, void* user_data){
+
+  struct res_func *my_res_fun = (struct res_func*)user_data;
+  if(!my_res_fun){ return(-1); }
+  callback_timer timer(my_res_fun->clock);
+  user_section user(my_res_fun->clock);
+
+  return my_res_fun->res_native(t, N_VGetArrayPointer(yy), N_VGetArrayPointer(yp),
+                                N_VGetArrayPointer(rr), my_res_fun->params.begin());
+}
+//---compiled residual function definition ends --------------------------------
+
 //-- Manual Jacobian -----------------------------------------------------------
 /*IDA's Jacobian callback has a different SUNDIALS signature than CVODE's:
  * it receives cj (a scalar IDA manages internally) and yp (current y').
@@ -134,24 +183,97 @@ static int jac_ida(sunrealtype t, sunrealtype cj,
                      void *user_data, N_Vector tmp1, N_Vector tmp2, N_Vector tmp3) {
     struct res_func *data = (struct res_func*)user_data;
     if (!data) { return -1; }
+    callback_timer timer(data->clock, CB_JAC);
+
+    // a sparse Jacobian nobody gave is approximated by coloured finite
+    // differences of the residual (see fd_jacobian.h), which need IDA's current
+    // error weights and step
+    if (data->fd.active()) {
+      sunrealtype hh;
+      if (IDAGetErrWeights(data->fd.mem, data->fd.ewt) != IDA_SUCCESS ||
+          IDAGetCurrentStep(data->fd.mem, &hh) != IDA_SUCCESS) {
+        return -1;
+      }
+      return fd_jac_dae(data->is_native() ? res_function_native : res_function,
+                        user_data, t, cj, hh, yy, yp, rr, JAC, data->fd,
+                        tmp1, tmp2, tmp3);
+    }
+
+    // a compiled Jacobian writes a dense column-major matrix, or the storage of
+    // a band or sparse one (see jac_func.h)
+    if (data->jac_band) {
+      return jac_eval_ida_native_band(data->jac_band, t, cj, yy, yp, JAC,
+                                      data->params.begin(), data->clock);
+    }
+    if (data->jac_sparse) {
+      return jac_eval_ida_native_sparse(data->jac_sparse, t, cj, yy, yp, JAC,
+                                        data->params.begin(), data->pattern,
+                                        data->clock);
+    }
+    if (data->jac_native) {
+      return jac_eval_ida_native(data->jac_native, t, cj, yy, yp, JAC,
+                                 data->params.begin(), data->jac_scratch,
+                                 data->pattern, data->clock);
+    }
+
     return sundials_callback_guard(data->err, [&]() -> int {
-      return jac_eval_ida(t, cj, yy, yp, JAC, data->jac_eqn, data->params);
+      return jac_eval_ida(t, cj, yy, yp, JAC, data->jac_eqn, data->params,
+                          data->pattern, data->clock);
     });
 }
 //------------------------------------------------------------------------------
 
+//-- Krylov linear solver ------------------------------------------------------
+// The Jacobian (dF/dy + cj * dF/dy') times a vector and the preconditioner,
+// each an R or compiled function called by krylov_func (see krylov_func.h)
+static int jtimes_ida(sunrealtype t, N_Vector yy, N_Vector yp, N_Vector rr,
+                      N_Vector v, N_Vector Jv, sunrealtype cj, void *user_data,
+                      N_Vector tmp1, N_Vector tmp2) {
+  struct res_func *data = (struct res_func*)user_data;
+  if (!data) { return -1; }
+  callback_timer timer(data->clock, CB_JTIMES);
+  return data->krylov.jtimes_ida_eval(t, cj, yy, yp, v, Jv);
+}
+
+static int psetup_ida(sunrealtype t, N_Vector yy, N_Vector yp, N_Vector rr,
+                      sunrealtype cj, void *user_data) {
+  struct res_func *data = (struct res_func*)user_data;
+  if (!data) { return -1; }
+  callback_timer timer(data->clock, CB_PSETUP);
+  return data->krylov.psetup_ida_eval(t, cj, yy, yp);
+}
+
+static int psolve_ida(sunrealtype t, N_Vector yy, N_Vector yp, N_Vector rr,
+                      N_Vector rvec, N_Vector zvec, sunrealtype cj,
+                      sunrealtype delta, void *user_data) {
+  struct res_func *data = (struct res_func*)user_data;
+  if (!data) { return -1; }
+  callback_timer timer(data->clock, CB_PSOLVE);
+  return data->krylov.psolve_ida_eval(t, cj, yy, yp, rvec, zvec);
+}
+//------------------------------------------------------------------------------
+
 //'ida
 //'
 //' IDA solver to solve stiff DAEs
 //'@param time_vector time vector
 //'@param IC Initial Value of y
 //'@param IRes Inital Value of ydot
-//'@param input_function Right Hand Side function of DAEs
-//'@param Parameters Parameters input to ODEs
+//'@param input_function Right Hand Side function of DAEs, either an R or Rcpp function with signature \code{function(t, y, ydot, p)} returning the residual, or a compiled C function passed as an external pointer made with \code{sundialr_xptr_res()} (see \code{sundialr_xptr.h} in the package's \code{include} directory), which SUNDIALS then calls without going through R
+//'@param Parameters Parameters input to ODEs. A compiled residual or Jacobian receives a pointer to these values as its \code{udata} argument
 //'@param reltolerance Relative Tolerance (a scalar, default value  = 1e-04)
 //'@param abstolerance Absolute Tolerance (a scalar or vector with length equal to ydot, default = 1e-04)
-//'@param jacobian (Optional) Jacobian with signature \code{function(t, y, ydot, cj, p)} returning an n-by-n matrix of \code{dF/dy + cj*dF/dydot}. Default NULL.
-//'@returns A Matrix. First column is the time-vector, the other columns are values of y in order they are provided.
+//'@param jacobian (Optional) Jacobian with signature \code{function(t, y, ydot, cj, p)} returning an n-by-n matrix of \code{dF/dy + cj*dF/dydot}, or a compiled Jacobian made with \code{sundialr_xptr_jac_ida()}, or for a band matrix with \code{sundialr_xptr_jac_ida_band()}, which writes only the band, into the band matrix's own storage, rather than an n-by-n matrix, and for a sparse one with \code{sundialr_xptr_jac_ida_sparse()}, which writes only the values of the pattern. Either form may be used with either form of \code{input_function}. Default NULL.
+//'@param mupper,mlower (Optional) Upper and lower half-bandwidths of the Jacobian, for a DAE whose residual i involves only the states (and their derivatives) from i - mlower to i + mupper. When both are given, IDA uses a band matrix and band linear solver in place of the dense ones, and its finite-difference Jacobian needs mupper + mlower + 1 residual evaluations rather than one per state. A supplied Jacobian is read only inside the band. Default NULL (dense)
+//'@param sparsity (Optional) Sparsity pattern of the Jacobian, for a sparse matrix and the package's sparse direct solver in place of the dense ones, as in \code{\link{cvode}}. Without \code{jacobian}, the Jacobian is approximated by finite differences of the residual over groups of columns that share no row, one evaluation per group; a \code{jacobian} may return an n-by-n matrix, a \code{dgCMatrix} or \code{dgTMatrix}, or the values of the nonzeros in the order of the pattern, and is read only inside the pattern. Default NULL (dense)
+//'@param linear_solver (Optional) \code{"dense"}, \code{"lapack_dense"} (factored by R's LAPACK), or a matrix-free Krylov solver: \code{"spgmr"}, \code{"spfgmr"}, \code{"spbcgs"}, \code{"sptfqmr"} or \code{"pcg"}, as in \code{\link{cvode}}. The Newton matrix it solves with is dF/dy + cj * dF/dydot. Cannot be combined with \code{jacobian}, \code{mupper}, \code{mlower} or \code{sparsity}. Default NULL, a direct solver chosen by those arguments
+//'@param jtimes (Optional) With a Krylov \code{linear_solver}, the product of the Newton matrix with a vector, as \code{function(t, y, ydot, v, cj, p)} returning (dF/dy + cj * dF/dydot) v, or a compiled function made with \code{sundialr_xptr_jtimes_ida()}. Default NULL, a finite-difference approximation
+//'@param psetup,psolve (Optional) With a Krylov \code{linear_solver}, a left preconditioner P approximating dF/dy + cj * dF/dydot. \code{psolve(t, y, ydot, r, cj, p)} returns z solving P z = r; \code{psetup(t, y, ydot, cj, p)}, which may be left out, is called whenever the Newton matrix changes, to prepare P for \code{psolve}. Either may be a compiled function made with \code{sundialr_xptr_psetup_ida()} or \code{sundialr_xptr_psolve_ida()}. Default NULL, no preconditioning
+//'@param stats (Optional) If TRUE, the solution gets a \code{stats} attribute, a list of the integrator's counters and the call's wall-clock time split between the callbacks and the rest, as in \code{\link{cvode}}; \code{rhs_evals} and \code{rhs_evals_lin} count evaluations of the residual, and the orders are those of IDA's BDF method. Default FALSE
+//'@param profile (Optional) If TRUE, the solution gets a \code{profile} attribute, a data frame of the calls of each kind of callback and the nanoseconds spent in them, split between the user's function and the package's marshalling around it, as in \code{\link{cvode}}, with \code{"residual"} in place of \code{"rhs"}. Default FALSE
+//'@param output (Optional) \code{"times"}, the default, for the solution at \code{time_vector}, or \code{"steps"} for the solution at every internal step IDA takes from the first time in \code{time_vector} to the last, as in \code{\link{cvode}}
+//'@param max_rows (Optional) With \code{output = "steps"}, the most rows to return, 2 or more, as in \code{\link{cvode}}. Default NULL, every step
+//'@returns A Matrix. First column is the time-vector, or the times of the steps with \code{output = "steps"}, the other columns are values of y in order they are provided.
 //'@example /inst/examples/ida_Roberts_dns.r
 // [[Rcpp::export]]
 NumericMatrix ida(NumericVector time_vector, NumericVector IC,
@@ -159,10 +281,34 @@ NumericMatrix ida(NumericVector time_vector, NumericVector IC,
                   NumericVector Parameters,
                   double reltolerance = 0.0001,
                   NumericVector abstolerance = 0.0001,
-                  Nullable<Function> jacobian = R_NilValue){
+                  SEXP jacobian = R_NilValue,
+                  SEXP mupper = R_NilValue,
+                  SEXP mlower = R_NilValue,
+                  SEXP sparsity = R_NilValue,
+                  SEXP linear_solver = R_NilValue,
+                  SEXP jtimes = R_NilValue,
+                  SEXP psetup = R_NilValue,
+                  SEXP psolve = R_NilValue,
+                  bool stats = false,
+                  bool profile = false,
+                  std::string output = "times",
+                  SEXP max_rows = R_NilValue){
+
+  // the wall-clock time of the whole call, and of the callbacks within it
+  auto call_start = solver_clock::now();
+  solver_clock clock(profile);
 
   int time_vec_len = time_vector.length();
   int y_len = IC.length();
+
+  // the solution at time_vector, or at every internal step (see step_output.h)
+  bool steps = output_is_steps(output);
+  int steps_max = output_max_rows(max_rows);
+
+  // dense, band when the half-bandwidths are given, sparse when the pattern
+  // is, or a Krylov solver when linear_solver names one
+  linsol_spec ls_spec = linsol_parse(mupper, mlower, sparsity, linear_solver, y_len);
+
   // Receives SUNDIALS errors. Declared before the guard so that it is
   // destroyed after it - the SUNContext freed there holds a pointer to it.
   sundials_err_record sun_err;
@@ -258,39 +404,68 @@ NumericMatrix ida(NumericVector time_vector, NumericVector IC,
   // -- assign user input to the struct based on SEXP type of input_function
   if(!input_function){ stop("Something is wrong with the input function, stopping!"); }
 
-  if(TYPEOF(input_function) != CLOSXP) { stop("Incorrect input function type - input function can be an R or Rcpp function"); }
+  // an R function, or a compiled function passed as an external pointer
+  if(TYPEOF(input_function) != CLOSXP && TYPEOF(input_function) != EXTPTRSXP) {
+    stop("Incorrect input function type - input function can be an R or Rcpp function, or a compiled function made with sundialr_xptr_res()");
+  }
 
-  SEXP jac_sexp = R_NilValue;  // for manual jacobian, if provided
-  if (jacobian.isNotNull()) jac_sexp = as<SEXP>(jacobian);
-  struct res_func my_res_function = {input_function, Parameters, jac_sexp, &sun_err};
+  SEXP jac_sexp = jacobian;  // for manual jacobian, if provided; R_NilValue otherwise
+  struct res_func my_res_function(input_function, Parameters, jac_sexp, &sun_err, y_len);
+  my_res_function.pattern = linsol_pattern_of(ls_spec);
+  jac_native_check(my_res_function.jac_band != NULL, my_res_function.jac_sparse != NULL,
+                   ls_spec.band, ls_spec.sparse);
+  // a sparse solve without a Jacobian approximates one by coloured finite
+  // differences, with one evaluation of the residual per group of columns
+  // sharing no row (see fd_jacobian.h)
+  if (ls_spec.sparse && jacobian == R_NilValue &&
+      !my_res_function.fd.init(&ls_spec.pattern, ida_mem, yy0)) {
+    sundials_stop(sun_err, "N_VClone", "Stopping IDA, cannot allocate memory for the finite-difference Jacobian!");
+  }
+  linsol_check_krylov(ls_spec, jacobian, jtimes != R_NilValue || psetup != R_NilValue ||
+                      psolve != R_NilValue);
+  my_res_function.krylov = krylov_func(jtimes, psetup, psolve, Parameters, &sun_err, y_len, true);
+  ls_spec.precondition = my_res_function.krylov.has_psolve();
+  if (stats || profile) {
+    my_res_function.clock = &clock;
+    my_res_function.krylov.clock = &clock;
+  }
 
   // setting the user data in the rhs residual function
   flag = IDASetUserData(ida_mem, (void*)&my_res_function);
   if (check_retval(flag, "IDASetUserData")) { sundials_stop(sun_err, "IDASetUserData", "Stopping IDA, something went wrong in setting user data!"); }
 
-  flag = IDAInit(ida_mem, res_function, T0, yy0, yp0);
+  flag = IDAInit(ida_mem,
+                 my_res_function.is_native() ? res_function_native : res_function,
+                 T0, yy0, yp0);
   if(check_retval(flag, "IDAInit")) { sundials_stop(sun_err, "IDAInit", "Stopping, something went wrong in initializing IDA!"); };
 
   /* Call IDASVtolerances to set tolerances */
   flag = IDASVtolerances(ida_mem, reltol, abstol);
   if(check_retval(flag, "IDASVtolerances")) { sundials_stop(sun_err, "IDASVtolerances", "Stopping, something went wrong in setting tolerances!"); };
 
-  /* Create dense SUNMatrix for use in linear solves */
-  sunindextype y_len_M = y_len;
-  SM = SUNDenseMatrix(y_len_M, y_len_M, sunctx);
-  if(check_retval(SM, "SUNDenseMatrix")) { sundials_stop(sun_err, "SUNDenseMatrix", "Stopping IDA, something went wrong in setting the dense matrix!"); }
-
-
-  // Create dense SUNLinearSolver object for use by IDA
-  LS = SUNLinSol_Dense(yy0, SM, sunctx);
-  if(check_retval(LS, "SUNLinSol_Dense")) { sundials_stop(sun_err, "SUNLinSol_Dense", "Stopping IDA, something went wrong in setting the linear solver!"); }
+  /* Create the dense, band or sparse SUNMatrix and SUNLinearSolver, or the
+   * Krylov solver, for use by IDA */
+  const char *ls_failed = linsol_create(ls_spec, yy0, sunctx, &SM, &LS);
+  if (ls_failed) { sundials_stop(sun_err, ls_failed, "Stopping IDA, something went wrong in setting the linear solver!"); }
 
   /* Attach the matrix and linear solver */
   flag = IDASetLinearSolver(ida_mem, LS, SM);
   if(check_retval(flag, "IDASetLinearSolver"))  { sundials_stop(sun_err, "IDASetLinearSolver", "Stopping IDA, something went wrong in setting the linear solver!"); }
 
-  // Add user-provided Jacobian, if not NULL
-  if (jacobian.isNotNull()) {
+  // Add the Jacobian-times-vector function and preconditioner for a Krylov
+  // solver, or the user-provided Jacobian, if not NULL
+  if (ls_spec.krylov != LINSOL_DIRECT) {
+    if (my_res_function.krylov.has_jtimes()) {
+      flag = IDASetJacTimes(ida_mem, NULL, jtimes_ida);
+      if(check_retval(flag, "IDASetJacTimes")) { sundials_stop(sun_err, "IDASetJacTimes", "Stopping IDA, something went wrong in setting the Jacobian-times-vector function!"); }
+    }
+    if (my_res_function.krylov.has_psolve()) {
+      flag = IDASetPreconditioner(ida_mem,
+                                  my_res_function.krylov.has_psetup() ? psetup_ida : NULL,
+                                  psolve_ida);
+      if(check_retval(flag, "IDASetPreconditioner")) { sundials_stop(sun_err, "IDASetPreconditioner", "Stopping IDA, something went wrong in setting the preconditioner!"); }
+    }
+  } else if (jacobian != R_NilValue || my_res_function.fd.active()) {
     flag = IDASetJacFn(ida_mem, jac_ida);
     if(check_retval(flag, "IDASetJacFn")) { sundials_stop(sun_err, "IDASetJacFn", "Stopping IDA, something went wrong in setting the Jacobian function!"); }
   }
@@ -310,42 +485,72 @@ NumericMatrix ida(NumericVector time_vector, NumericVector IC,
 
   sunrealtype tout;  // For output times
 
-  int y_len_1 = y_len + 1; // remove later
-  NumericMatrix soln(Dimension(time_vec_len,y_len_1));  // remove later
+  NumericMatrix soln;
+
+  if (steps) {
+    // every internal step up to the last time, which is IDA's stop time
+    step_output rows(y_len, steps_max);
+    rows.push(T0, yy0_ptr);
+    if (NOUT > 1) {
+      tout = time_vector[NOUT-1];
+      flag = IDASetStopTime(ida_mem, tout);
+      if (check_retval(flag, "IDASetStopTime")) { sundials_stop(sun_err, "IDASetStopTime", "Stopping IDA, something went wrong in setting the stop time!"); }
+
+      flag = step_output_until([&](double *t) {
+        return IDASolve(ida_mem, tout, t, yy0, yp0, IDA_ONE_STEP);
+      }, IDA_TSTOP_RETURN, IDA_TOO_MUCH_WORK, time_vector.begin() + 1, NOUT - 1,
+         [&](double) { return yy0_ptr; }, rows, true, sun_err, "IDASolve");
+      if (check_retval(flag, "IDASolve")) {
+        sundials_stop(sun_err, "IDASolve", "Stopping IDA, something went wrong in solving the system of DAEs!");
+      }
+    }
+    soln = rows.as_matrix();
+  } else {
 
+    int y_len_1 = y_len + 1; // remove later
+    soln = NumericMatrix(Dimension(time_vec_len,y_len_1));  // remove later
 
-  // nothing to do with Events - single initialization of the ODE system
-  // First row for initial conditions, First column is for time
-  // int y_len_1 = y_len + 1;
-  // NumericMatrix soln(Dimension(time_vec_len,y_len_1));
 
-  // fill the first row of soln matrix with Initial Conditions
-  soln(0,0) = time_vector[0];   // get the first time value
-  for(int i = 0; i<y_len; i++){
-    soln(0,i+1) = IC[i];
-  }
+    // nothing to do with Events - single initialization of the ODE system
+    // First row for initial conditions, First column is for time
+    // int y_len_1 = y_len + 1;
+    // NumericMatrix soln(Dimension(time_vec_len,y_len_1));
 
-  for(int iout = 0; iout < NOUT-1; iout++) {
+    // fill the first row of soln matrix with Initial Conditions
+    soln(0,0) = time_vector[0];   // get the first time value
+    for(int i = 0; i<y_len; i++){
+      soln(0,i+1) = IC[i];
+    }
 
-    // output times start from the index after initial time
-    tout = time_vector[iout+1];
+    for(int iout = 0; iout < NOUT-1; iout++) {
 
-    flag = IDASolve(ida_mem, tout, &time, yy0, yp0, IDA_NORMAL);
+      // output times start from the index after initial time
+      tout = time_vector[iout+1];
 
-    if (check_retval(flag, "IDASolve")) {
-      sundials_stop(sun_err, "IDASolve", "Stopping IDA, something went wrong in solving the system of DAEs!");
-    } // Something went wrong in solving it!
+      flag = IDASolve(ida_mem, tout, &time, yy0, yp0, IDA_NORMAL);
 
-    if (flag == IDA_SUCCESS) {
+      if (check_retval(flag, "IDASolve")) {
+        sundials_stop(sun_err, "IDASolve", "Stopping IDA, something went wrong in solving the system of DAEs!");
+      } // Something went wrong in solving it!
 
-      // store results in soln matrix
-      soln(iout+1, 0) = time;           // first column is for time
-      for (int i = 0; i<y_len; i++){
-        soln(iout+1, i+1) = yy0_ptr[i];
+      if (flag == IDA_SUCCESS) {
+
+        // store results in soln matrix
+        soln(iout+1, 0) = time;           // first column is for time
+        for (int i = 0; i<y_len; i++){
+          soln(iout+1, i+1) = yy0_ptr[i];
+        }
       }
     }
   }
 
+  if (stats) {
+    solver_stats counters;
+    solver_stats_ida(ida_mem, counters);
+    soln.attr("stats") = solver_stats_list(counters, clock, solver_clock::since(call_start));
+  }
+  if (profile) { soln.attr("profile") = callback_profile_frame(clock, "residual"); }
+
   /* SUNDIALS objects are released by sundials_cleanup on scope exit */
 
   return soln;
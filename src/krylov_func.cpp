@@ -0,0 +1,236 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Rcpp.h>
+#include <nvector/nvector_serial.h>    /* serial N_Vector types, fcts., macros */
+#include <sundials/sundials_types.h>   /* definition of type realtype */
+
+#include <algorithm>
+
+#include <krylov_func.h>
+#include <sundialr_xptr.h>
+
+using namespace Rcpp;
+
+krylov_func::krylov_func()
+  : dae(false), err(NULL), clock(NULL),
+    jtimes(R_NilValue), psetup(R_NilValue), psolve(R_NilValue),
+    jtimes_native(NULL), psetup_native(NULL), psolve_native(NULL),
+    jtimes_ida_native(NULL), psetup_ida_native(NULL), psolve_ida_native(NULL) {}
+
+// One of the three functions: an R function is kept in *r, a compiled one is
+// returned after its tag is checked against `type`
+static DL_FUNC krylov_arg(SEXP f, const char *name, const char *type, SEXP *r) {
+  *r = R_NilValue;
+  if (f == R_NilValue) return NULL;
+  if (TYPEOF(f) == EXTPTRSXP) {
+    DL_FUNC fn = sundialr_xptr_get(f, type);
+    if (!fn) {
+      stop("%s is an external pointer but not a valid compiled function of type %s: make it with sundialr_xptr_%s() from sundialr_xptr.h",
+           name, type, type + strlen("sundialr_"));
+    }
+    return fn;
+  }
+  if (!Rf_isFunction(f)) {
+    stop("%s must be an R or Rcpp function, or a compiled function made with sundialr_xptr_%s()",
+         name, type + strlen("sundialr_"));
+  }
+  *r = f;
+  return NULL;
+}
+
+krylov_func::krylov_func(SEXP jtimes_, SEXP psetup_, SEXP psolve_,
+                         NumericVector params_, sundials_err_record *err_,
+                         int y_len, bool dae_)
+  : krylov_func() {
+  dae = dae_;
+  err = err_;
+  params = params_;
+
+  if (psetup_ != R_NilValue && psolve_ == R_NilValue) {
+    stop("psetup prepares the preconditioner for psolve, which must be given too");
+  }
+
+  if (dae) {
+    jtimes_ida_native = (sundialr_jtimes_ida) krylov_arg(jtimes_, "jtimes", "sundialr_jtimes_ida", &jtimes);
+    psetup_ida_native = (sundialr_psetup_ida) krylov_arg(psetup_, "psetup", "sundialr_psetup_ida", &psetup);
+    psolve_ida_native = (sundialr_psolve_ida) krylov_arg(psolve_, "psolve", "sundialr_psolve_ida", &psolve);
+  } else {
+    jtimes_native = (sundialr_jtimes) krylov_arg(jtimes_, "jtimes", "sundialr_jtimes", &jtimes);
+    psetup_native = (sundialr_psetup) krylov_arg(psetup_, "psetup", "sundialr_psetup", &psetup);
+    psolve_native = (sundialr_psolve) krylov_arg(psolve_, "psolve", "sundialr_psolve", &psolve);
+  }
+
+  if (jtimes == R_NilValue && psetup == R_NilValue && psolve == R_NilValue) return;
+
+  t_arg = r_arg_buffer(1);
+  y_arg = r_arg_buffer(y_len);
+  v_arg = r_arg_buffer(y_len);
+  s_arg = r_arg_buffer(1);
+  jok_arg = LogicalVector(1);
+  MARK_NOT_MUTABLE(jok_arg);
+  if (dae) {
+    yp_arg = r_arg_buffer(y_len);
+    if (jtimes != R_NilValue) jtimes_call = Language(Function(jtimes), t_arg, y_arg, yp_arg, v_arg, s_arg, params);
+    if (psetup != R_NilValue) psetup_call = Language(Function(psetup), t_arg, y_arg, yp_arg, s_arg, params);
+    if (psolve != R_NilValue) psolve_call = Language(Function(psolve), t_arg, y_arg, yp_arg, v_arg, s_arg, params);
+  } else {
+    if (jtimes != R_NilValue) jtimes_call = Language(Function(jtimes), t_arg, y_arg, v_arg, params);
+    if (psetup != R_NilValue) psetup_call = Language(Function(psetup), t_arg, y_arg, jok_arg, s_arg, params);
+    if (psolve != R_NilValue) psolve_call = Language(Function(psolve), t_arg, y_arg, v_arg, s_arg, params);
+  }
+}
+
+// Copy a state-length vector into an argument buffer
+static inline void krylov_copy(NumericVector &arg, N_Vector x) {
+  sunrealtype *x_ptr = N_VGetArrayPointer(x);
+  std::copy(x_ptr, x_ptr + NV_LENGTH_S(x), REAL(arg));
+}
+
+// The R functions are called from SUNDIALS' own C code, so their bodies run
+// under sundials_callback_guard; see the note on rhs_function in rhs_func.cpp.
+// The compiled ones neither call R nor throw, and their flags go straight back.
+
+int krylov_func::jtimes_eval(sunrealtype t, N_Vector y, N_Vector v, N_Vector Jv) {
+  if (jtimes_native) {
+    user_section user(clock);
+    return jtimes_native(t, N_VGetArrayPointer(y), N_VGetArrayPointer(v),
+                         N_VGetArrayPointer(Jv), params.begin());
+  }
+  return sundials_callback_guard(err, [&]() -> int {
+    REAL(t_arg)[0] = t;
+    krylov_copy(y_arg, y);
+    krylov_copy(v_arg, v);
+    r_call_into(jtimes_call, N_VGetArrayPointer(Jv), NV_LENGTH_S(Jv), "jtimes", clock);
+    return 0;
+  });
+}
+
+int krylov_func::psetup_eval(sunrealtype t, N_Vector y, int jok, int *jcur,
+                             sunrealtype gamma) {
+  if (psetup_native) {
+    user_section user(clock);
+    return psetup_native(t, N_VGetArrayPointer(y), jok, jcur, gamma, params.begin());
+  }
+  return sundials_callback_guard(err, [&]() -> int {
+    REAL(t_arg)[0] = t;
+    krylov_copy(y_arg, y);
+    LOGICAL(jok_arg)[0] = jok;
+    REAL(s_arg)[0] = gamma;
+    SEXP res_sexp;
+    {
+      user_section user(clock);
+      res_sexp = Rcpp_fast_eval(psetup_call, R_GlobalEnv);
+    }
+    Shield<SEXP> res(res_sexp);
+    if (res == R_NilValue) {
+      *jcur = 1;
+    } else if (TYPEOF(res) == LGLSXP && Rf_length(res) == 1 && LOGICAL(res)[0] != NA_LOGICAL) {
+      *jcur = LOGICAL(res)[0];
+    } else {
+      stop("The psetup function must return TRUE, FALSE or NULL");
+    }
+    return 0;
+  });
+}
+
+int krylov_func::psolve_eval(sunrealtype t, N_Vector y, N_Vector r, N_Vector z,
+                             sunrealtype gamma) {
+  if (psolve_native) {
+    user_section user(clock);
+    return psolve_native(t, N_VGetArrayPointer(y), N_VGetArrayPointer(r),
+                         N_VGetArrayPointer(z), gamma, params.begin());
+  }
+  return sundials_callback_guard(err, [&]() -> int {
+    REAL(t_arg)[0] = t;
+    krylov_copy(y_arg, y);
+    krylov_copy(v_arg, r);
+    REAL(s_arg)[0] = gamma;
+    r_call_into(psolve_call, N_VGetArrayPointer(z), NV_LENGTH_S(z), "psolve", clock);
+    return 0;
+  });
+}
+
+int krylov_func::jtimes_ida_eval(sunrealtype t, sunrealtype cj, N_Vector y,
+                                 N_Vector yp, N_Vector v, N_Vector Jv) {
+  if (jtimes_ida_native) {
+    user_section user(clock);
+    return jtimes_ida_native(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp),
+                             N_VGetArrayPointer(v), N_VGetArrayPointer(Jv),
+                             params.begin());
+  }
+  return sundials_callback_guard(err, [&]() -> int {
+    REAL(t_arg)[0] = t;
+    krylov_copy(y_arg, y);
+    krylov_copy(yp_arg, yp);
+    krylov_copy(v_arg, v);
+    REAL(s_arg)[0] = cj;
+    r_call_into(jtimes_call, N_VGetArrayPointer(Jv), NV_LENGTH_S(Jv), "jtimes", clock);
+    return 0;
+  });
+}
+
+int krylov_func::psetup_ida_eval(sunrealtype t, sunrealtype cj, N_Vector y,
+                                 N_Vector yp) {
+  if (psetup_ida_native) {
+    user_section user(clock);
+    return psetup_ida_native(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp),
+                             params.begin());
+  }
+  return sundials_callback_guard(err, [&]() -> int {
+    REAL(t_arg)[0] = t;
+    krylov_copy(y_arg, y);
+    krylov_copy(yp_arg, yp);
+    REAL(s_arg)[0] = cj;
+    user_section user(clock);
+    Rcpp_fast_eval(psetup_call, R_GlobalEnv);
+    return 0;
+  });
+}
+
+int krylov_func::psolve_ida_eval(sunrealtype t, sunrealtype cj, N_Vector y,
+                                 N_Vector yp, N_Vector r, N_Vector z) {
+  if (psolve_ida_native) {
+    user_section user(clock);
+    return psolve_ida_native(t, cj, N_VGetArrayPointer(y), N_VGetArrayPointer(yp),
+                             N_VGetArrayPointer(r), N_VGetArrayPointer(z),
+                             params.begin());
+  }
+  return sundials_callback_guard(err, [&]() -> int {
+    REAL(t_arg)[0] = t;
+    krylov_copy(y_arg, y);
+    krylov_copy(yp_arg, yp);
+    krylov_copy(v_arg, r);
+    REAL(s_arg)[0] = cj;
+    r_call_into(psolve_call, N_VGetArrayPointer(z), NV_LENGTH_S(z), "psolve", clock);
+    return 0;
+  });
+}
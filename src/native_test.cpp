@@ -0,0 +1,373 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Compiled models for testing the R solvers' external-pointer inputs. Each one
+// is handed out exactly as a consumer's own code would hand out its model, as
+// a pointer made with the sundialr_xptr_*() helpers, so tests/testthat can
+// solve the same system from R and from compiled code and compare the two.
+//
+// The R wrapper is named ".native_test_xptr": the leading dot keeps it out of
+// the package namespace (exportPattern only exports alpha-initial names), so it
+// ships without being user-visible and needs no documentation for R CMD check.
+//
+// .small_dense_test, at the end, likewise compares the dense linear solver
+// specialised to small systems (sunlinsol_small_dense.h) with SUNDIALS' own.
+
+#include <Rcpp.h>
+#include <math.h>
+#include <string>
+#include <sundialr_xptr.h>
+
+#include <nvector/nvector_serial.h>
+#include <sunmatrix/sunmatrix_dense.h>
+#include <sunlinsol/sunlinsol_dense.h>
+#include <sunlinsol_small_dense.h>
+
+using namespace Rcpp;
+
+// --- Model callbacks (C linkage, so their type matches the C API typedefs) ---
+extern "C" {
+
+// Robertson chemical kinetics, the system of inst/examples/cv_Roberts_dns.r.
+// udata is the Parameters vector: p = (0.04, 1e4, 3e7) in the examples.
+static int robertson_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  ydot[0] = -p[0]*y[0] + p[1]*y[1]*y[2];
+  ydot[1] =  p[0]*y[0] - p[1]*y[1]*y[2] - p[2]*y[1]*y[1];
+  ydot[2] =  p[2]*y[1]*y[1];
+  return 0;
+}
+
+// Column-major Jacobian: J[i + j*3] = d(ydot_i)/d(y_j).
+static int robertson_jac(double t, const double* y, double* J, void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  J[0] = -p[0];                          // (0,0)
+  J[1] =  p[0];                          // (1,0)
+  J[2] =  0.0;                           // (2,0)
+  J[3] =  p[1]*y[2];                     // (0,1)
+  J[4] = -p[1]*y[2] - 2.0*p[2]*y[1];     // (1,1)
+  J[5] =  2.0*p[2]*y[1];                 // (2,1)
+  J[6] =  p[1]*y[1];                     // (0,2)
+  J[7] = -p[1]*y[1];                     // (1,2)
+  J[8] =  0.0;                           // (2,2)
+  return 0;
+}
+
+// The same for K sets at once, for cvode_batch(ensemble = K): state i of set
+// k is y[i*K + k], parameter j p[j*K + k], and element (i, j) of the
+// Jacobian of set k J[(i + j*3)*K + k], zeroed before the call.
+static int robertson_rhs_ensemble(int K, double t, const double* y, double* ydot,
+                                  void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  for (int k = 0; k < K; k++) {
+    double y1 = y[k], y2 = y[K + k], y3 = y[2*K + k];
+    double k1 = p[k], k2 = p[K + k], k3 = p[2*K + k];
+    ydot[k]       = -k1*y1 + k2*y2*y3;
+    ydot[K + k]   =  k1*y1 - k2*y2*y3 - k3*y2*y2;
+    ydot[2*K + k] =  k3*y2*y2;
+  }
+  return 0;
+}
+
+static int robertson_jac_ensemble(int K, double t, const double* y, double* J,
+                                  void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  for (int k = 0; k < K; k++) {
+    double y2 = y[K + k], y3 = y[2*K + k];
+    double k1 = p[k], k2 = p[K + k], k3 = p[2*K + k];
+    J[0*K + k] = -k1;                    // (0,0)
+    J[1*K + k] =  k1;                    // (1,0)
+    J[3*K + k] =  k2*y3;                 // (0,1)
+    J[4*K + k] = -k2*y3 - 2.0*k3*y2;     // (1,1)
+    J[5*K + k] =  2.0*k3*y2;             // (2,1)
+    J[6*K + k] =  k2*y2;                 // (0,2)
+    J[7*K + k] = -k2*y2;                 // (1,2)
+  }
+  return 0;
+}
+
+// Robertson sensitivity right-hand side for parameter iS (0-based):
+// ySdot = J yS + df/dp_iS.
+static void robertson_sens_one(const double* y, const double* p, int iS,
+                               const double* yS, double* ySdot) {
+  double J[9];
+  robertson_jac(0.0, y, J, (void*) p);
+  for (int i = 0; i < 3; i++) {
+    ySdot[i] = J[i]*yS[0] + J[i + 3]*yS[1] + J[i + 6]*yS[2];
+  }
+  switch (iS) {
+  case 0: ySdot[0] -= y[0];        ySdot[1] += y[0];                                break;
+  case 1: ySdot[0] += y[1]*y[2];   ySdot[1] -= y[1]*y[2];                           break;
+  case 2:                          ySdot[1] -= y[1]*y[1];  ySdot[2] += y[1]*y[1];   break;
+  }
+}
+
+static int robertson_sens(int Ns, double t, const double* y, const double* ydot,
+                          const double* const* yS, double* const* ySdot,
+                          void* udata) {
+  (void) t; (void) ydot;
+  for (int iS = 0; iS < Ns; iS++) {
+    robertson_sens_one(y, (const double*) udata, iS, yS[iS], ySdot[iS]);
+  }
+  return 0;
+}
+
+static int robertson_sens1(int Ns, double t, const double* y, const double* ydot,
+                           int iS, const double* yS, double* ySdot, void* udata) {
+  (void) Ns; (void) t; (void) ydot;
+  robertson_sens_one(y, (const double*) udata, iS, yS, ySdot);
+  return 0;
+}
+
+// The index-1 DAE of tests/testthat/test-ida.r, with a closed-form solution:
+//   y1' = -k1*y1,  y2' = k1*y1 - k2*y2,  0 = y3 - (y1 + y2);  p = (k1, k2).
+static int chain_dae_res(double t, const double* y, const double* yp, double* r,
+                         void* udata) {
+  (void) t;
+  const double* p = (const double*) udata;
+  r[0] = -p[0]*y[0] - yp[0];
+  r[1] =  p[0]*y[0] - p[1]*y[1] - yp[1];
+  r[2] =  y[2] - y[0] - y[1];
+  return 0;
+}
+
+// Column-major dF/dy + cj*dF/dyp.
+static int chain_dae_jac(double t, double cj, const double* y, const double* yp,
+                         double* J, void* udata) {
+  (void) t; (void) y; (void) yp;
+  const double* p = (const double*) udata;
+  J[0] = -p[0] - cj;  J[3] =  0.0;         J[6] = 0.0;
+  J[1] =  p[0];       J[4] = -p[1] - cj;   J[7] = 0.0;
+  J[2] = -1.0;        J[5] = -1.0;         J[8] = 1.0;
+  return 0;
+}
+
+// The same Jacobians written into a band matrix's storage, for a band solve:
+// element (i, j) at J[(i - j + mu) + j*ldim], for the entries in the band.
+static void band_from_dense3(const double* D, double* J, int mu, int ml, int ldim) {
+  for (int j = 0; j < 3; j++)
+    for (int i = 0; i < 3; i++)
+      if (i - j <= ml && j - i <= mu) J[(i - j + mu) + j*ldim] = D[i + j*3];
+}
+
+static int robertson_jac_band(double t, const double* y, double* J, int mu,
+                              int ml, int ldim, void* udata) {
+  double D[9];
+  robertson_jac(t, y, D, udata);
+  band_from_dense3(D, J, mu, ml, ldim);
+  return 0;
+}
+
+static int chain_dae_jac_band(double t, double cj, const double* y,
+                              const double* yp, double* J, int mu, int ml,
+                              int ldim, void* udata) {
+  double D[9];
+  chain_dae_jac(t, cj, y, yp, D, udata);
+  band_from_dense3(D, J, mu, ml, ldim);
+  return 0;
+}
+
+// And as the values of their sparsity patterns, column by column, for a sparse
+// solve: Robertson's Jacobian has no (2, 0), the chain DAE's is lower
+// triangular. Fails for any other pattern.
+static int robertson_jac_sparse(double t, const double* y, double* x, int nnz,
+                                void* udata) {
+  static const int at[8] = { 0, 1, 3, 4, 5, 6, 7, 8 };
+  double D[9];
+  if (nnz != 8) return -1;
+  robertson_jac(t, y, D, udata);
+  for (int k = 0; k < 8; k++) x[k] = D[at[k]];
+  return 0;
+}
+
+static int chain_dae_jac_sparse(double t, double cj, const double* y,
+                                const double* yp, double* x, int nnz, void* udata) {
+  static const int at[6] = { 0, 1, 2, 4, 5, 8 };
+  double D[9];
+  if (nnz != 6) return -1;
+  chain_dae_jac(t, cj, y, yp, D, udata);
+  for (int k = 0; k < 6; k++) x[k] = D[at[k]];
+  return 0;
+}
+
+// Solve the column-major 3-by-3 system M z = r by Gaussian elimination with
+// partial pivoting; M is overwritten.
+static int solve3(double* M, const double* r, double* z) {
+  double b[3] = { r[0], r[1], r[2] };
+  for (int k = 0; k < 3; k++) {
+    int piv = k;
+    for (int i = k + 1; i < 3; i++)
+      if (fabs(M[i + 3*k]) > fabs(M[piv + 3*k])) piv = i;
+    if (M[piv + 3*k] == 0.0) return 1;
+    for (int j = 0; j < 3; j++) { double tmp = M[k + 3*j]; M[k + 3*j] = M[piv + 3*j]; M[piv + 3*j] = tmp; }
+    double tmp = b[k]; b[k] = b[piv]; b[piv] = tmp;
+    for (int i = k + 1; i < 3; i++) {
+      double l = M[i + 3*k] / M[k + 3*k];
+      for (int j = k; j < 3; j++) M[i + 3*j] -= l * M[k + 3*j];
+      b[i] -= l * b[k];
+    }
+  }
+  for (int i = 2; i >= 0; i--) {
+    double v = b[i];
+    for (int j = i + 1; j < 3; j++) v -= M[i + 3*j] * z[j];
+    z[i] = v / M[i + 3*i];
+  }
+  return 0;
+}
+
+// Krylov functions for Robertson: J v, and an exact preconditioner solving
+// with I - gamma*J itself, which needs no setup.
+static int robertson_jtimes(double t, const double* y, const double* v,
+                            double* Jv, void* udata) {
+  double J[9];
+  robertson_jac(t, y, J, udata);
+  for (int i = 0; i < 3; i++) Jv[i] = J[i]*v[0] + J[i + 3]*v[1] + J[i + 6]*v[2];
+  return 0;
+}
+
+static int robertson_psetup(double t, const double* y, int jok, int* jcur,
+                            double gamma, void* udata) {
+  (void) t; (void) y; (void) jok; (void) gamma; (void) udata;
+  *jcur = 1;
+  return 0;
+}
+
+static int robertson_psolve(double t, const double* y, const double* r,
+                            double* z, double gamma, void* udata) {
+  double M[9];
+  robertson_jac(t, y, M, udata);
+  for (int k = 0; k < 9; k++) M[k] = (k % 4 == 0 ? 1.0 : 0.0) - gamma*M[k];
+  return solve3(M, r, z);
+}
+
+// The same for the chain DAE, whose Newton matrix is dF/dy + cj*dF/dyp.
+static int chain_dae_jtimes(double t, double cj, const double* y, const double* yp,
+                            const double* v, double* Jv, void* udata) {
+  double J[9];
+  chain_dae_jac(t, cj, y, yp, J, udata);
+  for (int i = 0; i < 3; i++) Jv[i] = J[i]*v[0] + J[i + 3]*v[1] + J[i + 6]*v[2];
+  return 0;
+}
+
+static int chain_dae_psolve(double t, double cj, const double* y, const double* yp,
+                            const double* r, double* z, void* udata) {
+  double M[9];
+  chain_dae_jac(t, cj, y, yp, M, udata);
+  return solve3(M, r, z);
+}
+
+// Robertson, failing for a negative first parameter, to check that one set
+// that fails leaves the others alone.
+static int robertson_or_fail_rhs(double t, const double* y, double* ydot, void* udata) {
+  if (((const double*) udata)[0] < 0.0) return -1;
+  return robertson_rhs(t, y, ydot, udata);
+}
+
+// Always fails, to check that a compiled function's failure code is reported.
+static int failing_rhs(double t, const double* y, double* ydot, void* udata) {
+  (void) t; (void) y; (void) ydot; (void) udata;
+  return -1;
+}
+
+// Observables of Robertson: y1 + y2 + y3, which stays 1, and k1 * y1, the
+// rate of the first reaction; fails after t = 100, to check that a compiled
+// outputs function's failure is reported.
+static int robertson_outputs(double t, const double* y, double* out, void* udata) {
+  const double* p = (const double*) udata;
+  out[0] = y[0] + y[1] + y[2];
+  out[1] = p[0]*y[0];
+  return t > 100.0 ? -1 : 0;
+}
+
+}  // extern "C"
+
+// [[Rcpp::export(".native_test_xptr")]]
+SEXP native_test_xptr(std::string name) {
+  if (name == "robertson_rhs") return sundialr_xptr_rhs(robertson_rhs);
+  if (name == "robertson_jac") return sundialr_xptr_jac(robertson_jac);
+  if (name == "robertson_jac_band") return sundialr_xptr_jac_band(robertson_jac_band);
+  if (name == "robertson_jac_sparse") return sundialr_xptr_jac_sparse(robertson_jac_sparse);
+  if (name == "robertson_rhs_ensemble") return sundialr_xptr_rhs_ensemble(robertson_rhs_ensemble);
+  if (name == "robertson_jac_ensemble") return sundialr_xptr_jac_ensemble(robertson_jac_ensemble);
+  if (name == "robertson_or_fail_rhs") return sundialr_xptr_rhs(robertson_or_fail_rhs);
+  if (name == "robertson_sens")  return sundialr_xptr_sens_rhs(robertson_sens);
+  if (name == "robertson_sens1") return sundialr_xptr_sens_rhs1(robertson_sens1);
+  if (name == "chain_dae_res") return sundialr_xptr_res(chain_dae_res);
+  if (name == "chain_dae_jac") return sundialr_xptr_jac_ida(chain_dae_jac);
+  if (name == "chain_dae_jac_band") return sundialr_xptr_jac_ida_band(chain_dae_jac_band);
+  if (name == "chain_dae_jac_sparse") return sundialr_xptr_jac_ida_sparse(chain_dae_jac_sparse);
+  if (name == "robertson_jtimes") return sundialr_xptr_jtimes(robertson_jtimes);
+  if (name == "robertson_psetup") return sundialr_xptr_psetup(robertson_psetup);
+  if (name == "robertson_psolve") return sundialr_xptr_psolve(robertson_psolve);
+  if (name == "chain_dae_jtimes") return sundialr_xptr_jtimes_ida(chain_dae_jtimes);
+  if (name == "chain_dae_psolve") return sundialr_xptr_psolve_ida(chain_dae_psolve);
+  if (name == "failing_rhs")   return sundialr_xptr_rhs(failing_rhs);
+  if (name == "robertson_outputs") return sundialr_xptr_outputs(robertson_outputs, 2);
+  stop("unknown test model '%s'", name);
+  return R_NilValue;
+}
+
+// Solve A x = b with the linear solver specialised to the size of A and with
+// SUNDIALS' dense one, which should agree to the last bit. Returns each one's
+// solution and the code of its setup(), nonzero for a singular A.
+// [[Rcpp::export(".small_dense_test")]]
+List small_dense_test(NumericMatrix A, NumericVector b) {
+  int n = A.nrow();
+  if (A.ncol() != n || b.size() != n || n > SMALL_DENSE_MAX) stop("A must be square, at most %d", SMALL_DENSE_MAX);
+
+  SUNContext sunctx;
+  if (SUNContext_Create(SUN_COMM_NULL, &sunctx) < 0) stop("SUNContext_Create failed");
+  List out;
+  for (int small = 1; small >= 0; small--) {
+    N_Vector x = N_VNew_Serial(n, sunctx), rhs = N_VNew_Serial(n, sunctx);
+    SUNMatrix M = SUNDenseMatrix(n, n, sunctx);
+    SUNLinearSolver LS = small ? SUNLinSol_SmallDense(x, M, sunctx) : SUNLinSol_Dense(x, M, sunctx);
+    for (int k = 0; k < n * n; k++) SM_DATA_D(M)[k] = A[k];
+    for (int i = 0; i < n; i++) NV_Ith_S(rhs, i) = b[i];
+    SUNLinSolInitialize(LS);
+    int flag = SUNLinSolSetup(LS, M);
+    NumericVector sol(n, NA_REAL);
+    if (flag == 0) {
+      SUNLinSolSolve(LS, M, x, rhs, 0.0);
+      for (int i = 0; i < n; i++) sol[i] = NV_Ith_S(x, i);
+    }
+    out[small ? "small" : "dense"] = List::create(_["x"] = sol, _["flag"] = flag);
+    SUNLinSolFree(LS);
+    SUNMatDestroy(M);
+    N_VDestroy(x);
+    N_VDestroy(rhs);
+  }
+  SUNContext_Free(&sunctx);
+  return out;
+}
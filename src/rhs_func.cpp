@@ -29,14 +29,58 @@
 //   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <Rcpp.h>
+#include <cvode/cvode.h>               /* CVRhsFn */
+#include <cvode/cvode_ls.h>            /* CVLsJacTimesVecFn etc. */
 #include <nvector/nvector_serial.h>    /* serial N_Vector types, fcts., macros */
 #include <sundials/sundials_types.h>   /* definition of type realtype */
 
 #include <rhs_func.h>
+#include <sundialr_xptr.h>
+
+#include <algorithm>
 
 using namespace Rcpp;
 
-#define Ith(v,i)    NV_Ith_S(v,i-1)         /* i-th vector component i=1..NEQ */
+// Sort the RHS and Jacobian into R functions and compiled functions. A compiled
+// function is called through the pointer without any further check, so the tag
+// naming its signature is verified here, before the solve starts.
+rhs_func::rhs_func(SEXP rhs_eqn, NumericVector params_, SEXP jac_eqn_,
+                   sundials_err_record *err_, int y_len)
+  : params(params_), jac_eqn(jac_eqn_), err(err_),
+    rhs_native(NULL), jac_native(NULL), jac_band(NULL), jac_sparse(NULL), pattern(NULL), model(NULL), model_jac(false),
+    clock(NULL) {
+
+  if ((model = expr_model_get(rhs_eqn)) != NULL) {
+    expr_model_check(model, y_len, params.length());
+    model->rhs.init_scratch(model_regs);
+    if (model->has_jac && jac_eqn == R_NilValue) {
+      model_jac = true;
+      model->jac.init_scratch(jac_regs);
+      jac_vals.resize(model->jac_rows.size());
+    }
+  } else if (TYPEOF(rhs_eqn) == EXTPTRSXP) {
+    rhs_native = (sundialr_rhs) sundialr_xptr_get(rhs_eqn, "sundialr_rhs");
+    if (!rhs_native) {
+      stop("The input function is an external pointer but not a valid compiled RHS: make it with sundialr_xptr_rhs() from sundialr_xptr.h");
+    }
+  } else {
+    Function rhs_fun(rhs_eqn);
+    t_arg = r_arg_buffer(1);
+    y_arg = r_arg_buffer(y_len);
+    rhs_call = Language(rhs_fun, t_arg, y_arg, params);
+  }
+
+  if (TYPEOF(jac_eqn) == EXTPTRSXP) {
+    jac_native = (sundialr_jac) sundialr_xptr_get(jac_eqn, "sundialr_jac");
+    jac_band = (sundialr_jac_band) sundialr_xptr_get(jac_eqn, "sundialr_jac_band");
+    jac_sparse = (sundialr_jac_sparse) sundialr_xptr_get(jac_eqn, "sundialr_jac_sparse");
+    if (!jac_native && !jac_band && !jac_sparse) {
+      stop("The Jacobian is an external pointer but not a valid compiled Jacobian: make it with sundialr_xptr_jac(), sundialr_xptr_jac_band() or sundialr_xptr_jac_sparse() from sundialr_xptr.h");
+    }
+  } else if (jac_eqn != R_NilValue && !Rf_isFunction(jac_eqn)) {
+    stop("The Jacobian must be an R or Rcpp function, or a compiled Jacobian made with sundialr_xptr_jac(), sundialr_xptr_jac_band() or sundialr_xptr_jac_sparse()");
+  }
+}
 
 // function called by CVodeInit if user inputs R function
 //
@@ -51,45 +95,161 @@ int rhs_function(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data){
 
   // nothing to record against, so just report the failure to SUNDIALS
   if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock);
 
   return sundials_callback_guard(my_rhs_fun->err, [&]() -> int {
 
-    // convert y to NumericVector y1
     int y_len = NV_LENGTH_S(y);
 
-    NumericVector y1(y_len);    // filled with zeros
+    // copy t and y into the argument buffers the prebuilt call refers to
+    REAL(my_rhs_fun->t_arg)[0] = t;
+    sunrealtype *y_ptr = N_VGetArrayPointer(y);
+    double *y_arg = REAL(my_rhs_fun->y_arg);
     for (int i = 0; i < y_len; i++){
-      y1[i] = Ith(y,i+1);
+      y_arg[i] = y_ptr[i];
     }
 
-    NumericVector ydot1(y_len);    // filled with zeros
+    // use the function to calculate value of RHS, straight into ydot ----
+    r_call_into(my_rhs_fun->rhs_call, N_VGetArrayPointer(ydot), y_len, "RHS",
+                my_rhs_fun->clock);
 
-    Function rhs_fun = (*my_rhs_fun).rhs_eqn;           // function
-    NumericVector p_values = (*my_rhs_fun).params;      // rate parameters
+    // everything went smoothly
+    return(0);
+  });
+}
+//---RHS function definition ends ----------------------------------------------
 
-    if (!rhs_fun || (TYPEOF(rhs_fun) != CLOSXP)){
-      stop("The RHS function is not an R or Rcpp function, stopping!");
-    }
 
-    // use the function to calculate value of RHS ----
-    ydot1 = rhs_fun(t, y1, p_values);
+// function called by CVodeInit if user inputs a compiled RHS
+//
+// No R is involved, so there is nothing to guard: the compiled function does
+// not throw, and its return value goes straight back to SUNDIALS, which treats
+// a positive value as recoverable and a negative one as fatal.
+int rhs_function_native(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data){
 
-    // The values below are copied out element by element, so a short return
-    // would read past the end of ydot1 instead of being reported.
-    if (ydot1.length() != y_len){
-      stop("The RHS function must return a vector of the same length as the state vector: expected %d, got %d",
-           y_len, ydot1.length());
-    }
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock);
+  user_section user(my_rhs_fun->clock);
 
-    // convert NumericVector ydot1 to N_Vector ydot
-    sunrealtype *ydot_ptr = N_VGetArrayPointer(ydot);
-    for (int i = 0; i<  y_len; i++){
-      ydot_ptr[i] = ydot1[i];
-    }
+  return my_rhs_fun->rhs_native(t, N_VGetArrayPointer(y), N_VGetArrayPointer(ydot),
+                                my_rhs_fun->params.begin());
+}
+//---compiled RHS function definition ends -------------------------------------
 
-    // everything went smoothly
-    return(0);
-  });
+
+// function called by CVodeInit if user inputs a model built by ode_model()
+//
+// The bytecode interpreter neither calls R nor throws, so like a compiled RHS
+// this needs no guard.
+int rhs_function_model(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data){
+
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock);
+  user_section user(my_rhs_fun->clock);
+
+  my_rhs_fun->model->rhs.eval(t, N_VGetArrayPointer(y), my_rhs_fun->params.begin(),
+                              my_rhs_fun->model_regs.data(), N_VGetArrayPointer(ydot));
+  return(0);
 }
-//---RHS function definition ends ----------------------------------------------
+//---model RHS function definition ends ----------------------------------------
+
+CVRhsFn rhs_func::rhs_callback() const {
+  if (model) return rhs_function_model;
+  if (rhs_native) return rhs_function_native;
+  return rhs_function;
+}
+
 
+CVLsJacTimesSetupFn rhs_func::jtsetup_callback() const {
+  if (krylov.has_jtimes()) return NULL;
+  if (model_jac) return rhs_jtsetup_model;
+  return NULL;
+}
+
+CVLsJacTimesVecFn rhs_func::jtimes_callback() const {
+  if (krylov.has_jtimes()) return rhs_jtimes;
+  if (model_jac) return rhs_jtimes_model;
+  return NULL;
+}
+
+// Jacobian-times-vector and preconditioner for a Krylov linear solver; the R
+// or compiled function behind each is called by krylov_func (see krylov_func.h)
+int rhs_jtimes(N_Vector v, N_Vector Jv, sunrealtype t, N_Vector y, N_Vector fy,
+               void *user_data, N_Vector tmp) {
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock, CB_JTIMES);
+  return my_rhs_fun->krylov.jtimes_eval(t, y, v, Jv);
+}
+
+int rhs_psetup(sunrealtype t, N_Vector y, N_Vector fy, sunbooleantype jok,
+               sunbooleantype *jcurPtr, sunrealtype gamma, void *user_data) {
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock, CB_PSETUP);
+  int jcur = 1;
+  int flag = my_rhs_fun->krylov.psetup_eval(t, y, jok ? 1 : 0, &jcur, gamma);
+  *jcurPtr = jcur ? SUNTRUE : SUNFALSE;
+  return flag;
+}
+
+int rhs_psolve(sunrealtype t, N_Vector y, N_Vector fy, N_Vector r, N_Vector z,
+               sunrealtype gamma, sunrealtype delta, int lr, void *user_data) {
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock, CB_PSOLVE);
+  return my_rhs_fun->krylov.psolve_eval(t, y, r, z, gamma);
+}
+//---Krylov function definitions end -------------------------------------------
+
+
+// A model's symbolic Jacobian as a product with a vector. SUNDIALS calls the
+// setup at the state of each linear solve before the products at that state.
+int rhs_jtsetup_model(sunrealtype t, N_Vector y, N_Vector fy, void *user_data) {
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock, CB_JTIMES);
+  user_section user(my_rhs_fun->clock);
+  my_rhs_fun->model->jac.eval(t, N_VGetArrayPointer(y), my_rhs_fun->params.begin(),
+                              my_rhs_fun->jac_regs.data(), my_rhs_fun->jac_vals.data());
+  return(0);
+}
+
+int rhs_jtimes_model(N_Vector v, N_Vector Jv, sunrealtype t, N_Vector y,
+                     N_Vector fy, void *user_data, N_Vector tmp) {
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock, CB_JTIMES);
+  const expr_model *model = my_rhs_fun->model;
+  const double *vals = my_rhs_fun->jac_vals.data();
+  const sunrealtype *v_ptr = N_VGetArrayPointer(v);
+  sunrealtype *Jv_ptr = N_VGetArrayPointer(Jv);
+  std::fill(Jv_ptr, Jv_ptr + NV_LENGTH_S(Jv), 0.0);
+  for (size_t e = 0; e < model->jac_rows.size(); e++) {
+    Jv_ptr[model->jac_rows[e]] += vals[e] * v_ptr[model->jac_cols[e]];
+  }
+  return(0);
+}
+//---model Jacobian-times-vector definitions end -------------------------------
+
+
+// The right-hand side is whichever rhs_callback() gives, so an R function is
+// guarded call by call as usual, and its first failure is returned to CVODE.
+// The increments need CVODE's current error weights and step.
+int rhs_jac_fd(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix JAC,
+               void *user_data, N_Vector tmp1, N_Vector tmp2) {
+  struct rhs_func *my_rhs_fun = (struct rhs_func*)user_data;
+  if(!my_rhs_fun){ return(-1); }
+  callback_timer timer(my_rhs_fun->clock, CB_JAC);
+  fd_jacobian &fd = my_rhs_fun->fd;
+  sunrealtype h;
+  if (CVodeGetErrWeights(fd.mem, fd.ewt) != CV_SUCCESS ||
+      CVodeGetCurrentStep(fd.mem, &h) != CV_SUCCESS) {
+    return(-1);
+  }
+  return fd_jac_ode(my_rhs_fun->rhs_callback(), user_data, t, y, fy, h, JAC, fd,
+                    tmp1, tmp2);
+}
+//---coloured finite-difference Jacobian definition ends -----------------------
@@ -161,13 +161,17 @@ done
 ## ---- verification guard -----------------------------------------------------
 # Fail loudly if any CRAN-flagged call survives in sources compiled into the
 # libraries linked by sundialr (core, cvodes, idas, nvecserial,
-# sunlinsoldense, sunmatrixdense) plus the patched cvode/ida sources.
+# sunlinsoldense, sunlinsolband, sunmatrixdense, sunmatrixband,
+# sunmatrixsparse) plus the patched cvode/ida sources.
 # Excluded: fmod_* dirs (Fortran interfaces, not compiled) and
 # sundials_profiler.c (its printf is inside #if SUNDIALS_MPI_ENABLED, off).
 
 GUARD_DIRS="${SRC}/src/sundials ${SRC}/src/cvode ${SRC}/src/cvodes \
 ${SRC}/src/ida ${SRC}/src/idas ${SRC}/src/nvector/serial \
-${SRC}/src/sunlinsol/dense ${SRC}/src/sunmatrix/dense"
+${SRC}/src/sunlinsol/dense ${SRC}/src/sunlinsol/band \
+${SRC}/src/sunlinsol/spgmr ${SRC}/src/sunlinsol/spfgmr ${SRC}/src/sunlinsol/spbcgs \
+${SRC}/src/sunlinsol/sptfqmr ${SRC}/src/sunlinsol/pcg \
+${SRC}/src/sunmatrix/dense ${SRC}/src/sunmatrix/band ${SRC}/src/sunmatrix/sparse"
 
 guard_fail=0
 for pat in \
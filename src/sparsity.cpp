@@ -0,0 +1,256 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <Rcpp.h>
+
+#include <cvode/cvode.h>             /* CVRhsFn */
+#include <nvector/nvector_serial.h>  /* serial N_Vector types, fcts., macros */
+#include <sundials/sundials_types.h> /* definition of type realtype */
+
+#include <rhs_func.h>
+#include <r_callback.h>
+#include <sundialr_xptr.h>
+#include <sundials_scope_guard.h>
+#include <sundials_err_handler.h>
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+using namespace Rcpp;
+
+// Probing the Jacobian's structure.
+//
+// Each state is perturbed in turn, at a few points scattered at random around
+// the initial conditions, and every output that changes marks an entry of the
+// Jacobian. An output that does not depend on a state is computed from exactly
+// the same numbers either way, so the comparison is exact rather than against
+// a tolerance. A derivative that happens to vanish at one point (a rate
+// proportional to a state that is zero there) is caught at another, which is
+// why the points are random and the states at them kept away from zero. A
+// model built by ode_model() needs no probing: its symbolic Jacobian already
+// lists the entries that are not structurally zero.
+
+// the values differ, counting two NaNs as equal
+static inline bool probe_changed(double a, double b) {
+  return a != b && !(ISNAN(a) && ISNAN(b));
+}
+
+// x scattered at random around centre, away from zero in the direction of its
+// sign, with scale the size of the largest value (1 when they are all zero)
+static void probe_point(const NumericVector &centre, double *x) {
+  double scale = 0;
+  for (int i = 0; i < centre.length(); i++) scale = std::max(scale, std::fabs(centre[i]));
+  if (scale == 0) scale = 1;
+  for (int i = 0; i < centre.length(); i++) {
+    double c = centre[i];
+    x[i] = c * (1 + 0.5 * unif_rand()) + (c < 0 ? -0.1 : 0.1) * scale * (0.5 + unif_rand());
+  }
+}
+
+// Perturb x[j] by a random relative amount; returns the old value
+static inline double probe_perturb(double *x, int j) {
+  double old = x[j];
+  x[j] += 1e-3 * (std::fabs(old) + 1) * (1 + unif_rand());
+  return old;
+}
+
+//'detect_sparsity
+//'
+//' Find the sparsity pattern of the Jacobian of a system automatically, by
+//' probing its right-hand side (or residual), for use as the \code{sparsity}
+//' argument of \code{cvode()}, \code{cvsolve()} and \code{ida()}.
+//'
+//' At each of \code{samples} points scattered at random around the initial
+//' conditions, every state is perturbed in turn and each output that changes
+//' marks an entry of the Jacobian; the pattern is the union over the points.
+//' This costs \code{samples * (n + 1)} evaluations (twice as many for a
+//' residual), once, which the solves that reuse the pattern soon recover. An
+//' entry whose derivative is zero at every probe point, such as one behind a
+//' branch the points never take, is missed, so the points should lie where the
+//' system will be solved. For a model built by \code{\link{ode_model}}, the
+//' symbolic Jacobian gives the pattern exactly, and nothing is probed.
+//'@param IC Initial Conditions, around which the system is probed
+//'@param input_function Right Hand Side function of ODEs, an R or Rcpp function, a compiled function or a model built by \code{\link{ode_model}}, as in \code{\link{cvode}}; or when \code{IRes} is given, the residual function of a DAE as in \code{\link{ida}}, an R function with signature \code{function(t, y, ydot, p)} or a compiled residual made with \code{sundialr_xptr_res()}
+//'@param Parameters Parameters input to the system
+//'@param IRes (Optional) Initial values of the derivatives, for a DAE residual. The pattern is then that of dF/dy + cj * dF/dydot, the Newton matrix IDA factors. Default NULL, for an ODE
+//'@param samples Number of random points at which the states are perturbed (default 3)
+//'@param time The time at which the system is evaluated (default 0)
+//'@returns A list of class \code{sundialr_sparsity} to be passed as \code{sparsity} to a solver, as many times as needed. Its elements \code{i}, \code{p} and \code{Dim} are the slots of a \code{dgCMatrix} of the pattern, with the diagonal included, so \code{Matrix::sparseMatrix(i = x$i, p = x$p, dims = x$Dim, index1 = FALSE)} rebuilds it; \code{nnz} is the number of nonzeros and \code{mupper} and \code{mlower} the half-bandwidths. \code{storage} is \code{"band"} when the band holds at most twice the nonzeros, and the solvers then use a band matrix and band solver, and \code{"sparse"} otherwise, for a sparse matrix and the finite-difference Jacobian by groups of columns; it may be changed before the pattern is used.
+//'@example /inst/examples/detect_sparsity.r
+// [[Rcpp::export]]
+List detect_sparsity(NumericVector IC, SEXP input_function, NumericVector Parameters,
+                     SEXP IRes = R_NilValue, int samples = 3, double time = 0){
+
+  int n = IC.length();
+  bool dae = IRes != R_NilValue;
+  if (n < 1) { stop("IC must have at least one value"); }
+  if (samples < 1) { stop("samples must be at least 1"); }
+  for (int i = 0; i < n; i++) {
+    if (!R_finite(IC[i])) { stop("IC must be finite"); }
+  }
+
+  // the entries found, column by column
+  std::vector<std::vector<int> > cols(n);
+
+  SUNContext sunctx = NULL;
+  N_Vector y = NULL, f0 = NULL, f1 = NULL;
+  sundials_err_record sun_err;
+
+  auto sundials_cleanup = make_scope_guard([&]{
+    if (f1)     N_VDestroy(f1);
+    if (f0)     N_VDestroy(f0);
+    if (y)      N_VDestroy(y);
+    if (sunctx) SUNContext_Free(&sunctx);
+  });
+
+  if (dae) {
+    NumericVector yp0(IRes);
+    if (yp0.length() != n) { stop("IRes must have one value per state, like IC"); }
+    if (expr_model_get(input_function)) {
+      stop("A model built by ode_model() is a right-hand side, not a residual: leave IRes NULL");
+    }
+
+    // the residual, compiled or in R
+    sundialr_res res_native = NULL;
+    RObject res_call;
+    NumericVector t_arg, y_arg, yp_arg;
+    if (TYPEOF(input_function) == EXTPTRSXP) {
+      res_native = (sundialr_res) sundialr_xptr_get(input_function, "sundialr_res");
+      if (!res_native) {
+        stop("The input function is an external pointer but not a valid compiled residual: make it with sundialr_xptr_res() from sundialr_xptr.h");
+      }
+    } else if (Rf_isFunction(input_function)) {
+      t_arg = r_arg_buffer(1);
+      y_arg = r_arg_buffer(n);
+      yp_arg = r_arg_buffer(n);
+      res_call = Language(Function(input_function), t_arg, y_arg, yp_arg, Parameters);
+      REAL(t_arg)[0] = time;
+    } else {
+      stop("Incorrect input function type - input function can be an R or Rcpp function, or a compiled function made with sundialr_xptr_res()");
+    }
+
+    std::vector<double> yy(n), yp(n), r0(n), r1(n);
+    auto residual = [&](std::vector<double> &r) {
+      if (res_native) {
+        int flag = res_native(time, yy.data(), yp.data(), r.data(), Parameters.begin());
+        if (flag != 0) { stop("The residual failed at a probe point, returning %d", flag); }
+        return;
+      }
+      std::copy(yy.begin(), yy.end(), REAL(y_arg));
+      std::copy(yp.begin(), yp.end(), REAL(yp_arg));
+      r_call_into(res_call, r.data(), n, "residual");
+    };
+
+    for (int s = 0; s < samples; s++) {
+      probe_point(IC, yy.data());
+      probe_point(yp0, yp.data());
+      residual(r0);
+      for (int j = 0; j < n; j++) {
+        for (double *x : { yy.data(), yp.data() }) {
+          double old = probe_perturb(x, j);
+          residual(r1);
+          x[j] = old;
+          for (int i = 0; i < n; i++) {
+            if (probe_changed(r1[i], r0[i])) cols[j].push_back(i);
+          }
+        }
+      }
+    }
+  } else {
+    if(TYPEOF(input_function) != CLOSXP && TYPEOF(input_function) != EXTPTRSXP) {
+      stop("Incorrect input function type - input function can be an R or Rcpp function, a compiled function made with sundialr_xptr_rhs(), or a model built by ode_model()");
+    }
+    struct rhs_func my_rhs_function(input_function, Parameters, R_NilValue, &sun_err, n);
+
+    if (my_rhs_function.model_jac) {
+      const expr_model *model = my_rhs_function.model;
+      for (size_t e = 0; e < model->jac_rows.size(); e++) {
+        cols[model->jac_cols[e]].push_back(model->jac_rows[e]);
+      }
+    } else {
+      SUNContext_Create(SUN_COMM_NULL, &sunctx);
+      SUNContext_PushErrHandler(sunctx, sundials_r_err_handler, &sun_err);
+      y = N_VNew_Serial(n, sunctx);
+      f0 = N_VNew_Serial(n, sunctx);
+      f1 = N_VNew_Serial(n, sunctx);
+      sundials_check(sun_err);
+
+      CVRhsFn f = my_rhs_function.rhs_callback();
+      auto rhs = [&](N_Vector out) {
+        int flag = f(time, y, out, &my_rhs_function);
+        if (flag != 0) { sundials_stop(sun_err, "detect_sparsity", "the right-hand side failed at a probe point"); }
+      };
+
+      double *y_ptr = N_VGetArrayPointer(y);
+      const double *f0_ptr = N_VGetArrayPointer(f0), *f1_ptr = N_VGetArrayPointer(f1);
+      for (int s = 0; s < samples; s++) {
+        probe_point(IC, y_ptr);
+        rhs(f0);
+        for (int j = 0; j < n; j++) {
+          double old = probe_perturb(y_ptr, j);
+          rhs(f1);
+          y_ptr[j] = old;
+          for (int i = 0; i < n; i++) {
+            if (probe_changed(f1_ptr[i], f0_ptr[i])) cols[j].push_back(i);
+          }
+        }
+      }
+    }
+  }
+
+  // the pattern in compressed-column form, with the diagonal, and its band
+  IntegerVector p(n + 1);
+  std::vector<int> rows;
+  int mupper = 0, mlower = 0;
+  for (int j = 0; j < n; j++) {
+    std::vector<int> &c = cols[j];
+    c.push_back(j);
+    std::sort(c.begin(), c.end());
+    c.erase(std::unique(c.begin(), c.end()), c.end());
+    mupper = std::max(mupper, j - c.front());
+    mlower = std::max(mlower, c.back() - j);
+    rows.insert(rows.end(), c.begin(), c.end());
+    p[j + 1] = (int) rows.size();
+  }
+  int nnz = (int) rows.size();
+  bool band = (double) (mupper + mlower + 1) * n <= 2.0 * nnz && mupper + mlower + 1 < n;
+
+  List pattern = List::create(_["i"] = IntegerVector(rows.begin(), rows.end()),
+                              _["p"] = p,
+                              _["Dim"] = IntegerVector::create(n, n),
+                              _["nnz"] = nnz,
+                              _["mupper"] = mupper,
+                              _["mlower"] = mlower,
+                              _["storage"] = band ? "band" : "sparse");
+  pattern.attr("class") = "sundialr_sparsity";
+  return pattern;
+}
@@ -39,7 +39,10 @@
 // sundials_err_handler.h - and is just as easy to reintroduce by copying a
 // solver body that uses stop(), so keep every body inside CAPI_GUARD.
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -56,6 +59,9 @@
 #include <sundials_err_handler.h>
 
 #include <sundialr_capi.h>
+#include <batch_pool.h>
+#include <ensemble_solver.h>
+#include <sunlinsol_small_dense.h>
 
 // The C API speaks `double`; N_VGetArrayPointer hands back sunrealtype*. The
 // package builds SUNDIALS at its default double precision, so the two coincide
@@ -75,10 +81,14 @@ struct sundialr_cvode_handle {
   SUNLinearSolver LS        = NULL;
 
   int   neq   = 0;
+  int   K     = 0;                  // subjects of an ensemble handle, 0 if not one
   void* udata = NULL;
 
   sundialr_rhs rhs = NULL;
   sundialr_jac jac = NULL;
+  sundialr_rhs_ensemble rhs_ens = NULL;
+  sundialr_jac_ensemble jac_ens = NULL;
+  std::vector<double> fd_work;        // the difference Jacobian of an ensemble
 
   bool initialized = false;           // has CVodeInit run yet?
 
@@ -99,12 +109,21 @@ struct sundialr_cvode_handle {
 
   sundials_err_record err;            // filled by the recording handler
   std::string last_err_msg;           // returned by last_err()
+
+  // Clones of this handle, one per thread of sundialr_cvode_solve_batch(),
+  // made by its first call and reused by later ones; freed with the handle
+  std::vector<sundialr_cvode_handle*> pool;
 };
 
 // ---------------------------------------------------------------------------
 // Helpers
 // ---------------------------------------------------------------------------
 
+// The length of the state: neq, or neq*K for an ensemble
+static size_t capi_length(const sundialr_cvode_handle* h) {
+  return (size_t) h->neq * (h->K > 0 ? h->K : 1);
+}
+
 // Copy the current failure into last_err_msg: the SUNDIALS-recorded message if
 // there is one, otherwise a description naming the numeric code.
 static void capi_capture_err(sundialr_cvode_handle* h, int flag) {
@@ -152,8 +171,105 @@ static int capi_ewt_thunk(N_Vector y, N_Vector w, void* user_data) {
   return 0;
 }
 
+// --- The same for an ensemble handle (see ensemble_solver.h) ---------------
+
+static int capi_rhs_ens_thunk(sunrealtype t, N_Vector y, N_Vector ydot, void* user_data) {
+  sundialr_cvode_handle* h = (sundialr_cvode_handle*) user_data;
+  return h->rhs_ens(h->K, (double) t, N_VGetArrayPointer(y), N_VGetArrayPointer(ydot),
+                    h->udata);
+}
+
+// Without the consumer's Jacobian, column j of every block is approximated at
+// once: state j of every subject is moved by its own increment, and one
+// evaluation of the right-hand side gives the column for all of them. The
+// increments are those of CVODE's dense difference quotients, subject by
+// subject. t1 receives the error weights; t2 and t3 are the moved state and
+// its derivative.
+static int capi_jac_ens_thunk(sunrealtype t, N_Vector y, N_Vector fy, SUNMatrix J,
+                              void* user_data, N_Vector t1, N_Vector t2, N_Vector t3) {
+  sundialr_cvode_handle* h = (sundialr_cvode_handle*) user_data;
+  double* Jdata = SUNEnsembleMatrix_Data(J);
+  if (h->jac_ens) return h->jac_ens(h->K, (double) t, N_VGetArrayPointer(y), Jdata, h->udata);
+
+  const int n = h->neq, K = h->K;
+  int flag = CVodeGetErrWeights(h->cvode_mem, t1);
+  if (flag < 0) return -1;
+  sunrealtype hcur = 0.0;
+  flag = CVodeGetCurrentStep(h->cvode_mem, &hcur);
+  if (flag < 0) return -1;
+
+  const double* yd = N_VGetArrayPointer(y);
+  const double* fd = N_VGetArrayPointer(fy);
+  const double* ewt = N_VGetArrayPointer(t1);
+  double* yt = N_VGetArrayPointer(t2);
+  double* ft = N_VGetArrayPointer(t3);
+  double* min_inc = h->fd_work.data();
+  double* inc = min_inc + K;
+
+  const double srur = std::sqrt(SUN_UNIT_ROUNDOFF);
+  for (int k = 0; k < K; k++) min_inc[k] = 0.0;
+  for (int i = 0; i < n; i++) {
+    for (int k = 0; k < K; k++) {
+      double v = fd[i * K + k] * ewt[i * K + k];
+      min_inc[k] += v * v;
+    }
+  }
+  for (int k = 0; k < K; k++) {
+    double fnorm = std::sqrt(min_inc[k] / n);
+    min_inc[k] = fnorm != 0.0 ? 1000.0 * std::fabs(hcur) * SUN_UNIT_ROUNDOFF * n * fnorm : 1.0;
+  }
+
+  N_VScale(1.0, y, t2);
+  for (int j = 0; j < n; j++) {
+    double* ytj = yt + (size_t) j * K;
+    const double* yj = yd + (size_t) j * K;
+    const double* ewtj = ewt + (size_t) j * K;
+    for (int k = 0; k < K; k++) {
+      ytj[k] = yj[k] + std::max(srur * std::fabs(yj[k]), min_inc[k] / ewtj[k]);
+      inc[k] = 1.0 / (ytj[k] - yj[k]);
+    }
+    flag = h->rhs_ens(K, (double) t, yt, ft, h->udata);
+    if (flag != 0) return flag;
+    for (int i = 0; i < n; i++) {
+      double* Jij = Jdata + (size_t) (i + j * n) * K;
+      const double* fti = ft + (size_t) i * K;
+      const double* fdi = fd + (size_t) i * K;
+      for (int k = 0; k < K; k++) Jij[k] = (fti[k] - fdi[k]) * inc[k];
+    }
+    for (int k = 0; k < K; k++) ytj[k] = yj[k];
+  }
+  return 0;
+}
+
+// The error weights of an ensemble: every subject's from the tolerances of the
+// neq states, scalar or per state
+static int capi_ewt_ens_thunk(N_Vector y, N_Vector w, void* user_data) {
+  sundialr_cvode_handle* h = (sundialr_cvode_handle*) user_data;
+  const int n = h->neq, K = h->K;
+  const double* yp = N_VGetArrayPointer(y);
+  double* wp = N_VGetArrayPointer(w);
+  for (int i = 0; i < n; i++) {
+    double rtol = h->tol_mode == 2 ? h->rtol_v[i] : h->rtol_s;
+    double atol = h->tol_mode == 2 ? h->atol_v[i] : h->atol_s;
+    for (int k = 0; k < K; k++) {
+      double ww = rtol * std::fabs(yp[i * K + k]) + atol;
+      if (ww <= 0.0) return -1;
+      wp[i * K + k] = 1.0 / ww;
+    }
+  }
+  return 0;
+}
+
+// The Jacobian function to give CVODE: an ensemble always has one, its own or
+// the difference approximation
+static CVLsJacFn capi_jac_fn(const sundialr_cvode_handle* h) {
+  if (h->K > 0) return capi_jac_ens_thunk;
+  return h->jac ? capi_jac_thunk : NULL;
+}
+
 // Apply the stored tolerance configuration to an initialized handle.
 static int capi_apply_tol(sundialr_cvode_handle* h) {
+  if (h->K > 0) return CVodeWFtolerances(h->cvode_mem, capi_ewt_ens_thunk);
   if (h->tol_mode == 2) return CVodeWFtolerances(h->cvode_mem, capi_ewt_thunk);
   if (h->tol_mode == 1) return CVodeSStolerances(h->cvode_mem, h->rtol_s, h->atol_s);
   return CVodeSStolerances(h->cvode_mem, h->rtol_s, h->atol_s);  // defaults
@@ -168,6 +284,29 @@ static int capi_apply_steps(sundialr_cvode_handle* h) {
   return 0;
 }
 
+// Copy the configuration of h - everything but the state, the udata and the
+// pool - into its clone c, and apply it at once if c is already initialized.
+static int capi_copy_config(sundialr_cvode_handle* c, const sundialr_cvode_handle* h) {
+  c->rhs = h->rhs;
+  c->jac = h->jac;
+  c->rhs_ens = h->rhs_ens;
+  c->jac_ens = h->jac_ens;
+  c->tol_mode = h->tol_mode;
+  c->rtol_s = h->rtol_s;
+  c->atol_s = h->atol_s;
+  c->rtol_v = h->rtol_v;
+  c->atol_v = h->atol_v;
+  c->has_maxsteps = h->has_maxsteps; c->maxsteps = h->maxsteps;
+  c->has_hmax     = h->has_hmax;     c->hmax     = h->hmax;
+  c->has_hmin     = h->has_hmin;     c->hmin     = h->hmin;
+  if (!c->initialized) return SUNDIALR_CV_SUCCESS;
+  int flag = CVodeSetJacFn(c->cvode_mem, capi_jac_fn(c));
+  if (flag < 0) return flag;
+  flag = capi_apply_tol(c);
+  if (flag < 0) return flag;
+  return capi_apply_steps(c);
+}
+
 // Wrap every entry-point body so no C++ exception can escape to the caller (the
 // whole reason this file exists). A thrown std::exception is recorded and turned
 // into an error code; anything else becomes a generic memory error.
@@ -182,17 +321,14 @@ static int capi_apply_steps(sundialr_cvode_handle* h) {
     return failcode;                                                           \
   }
 
-extern "C" {
-
-// ---------------------------------------------------------------------------
-// Lifecycle
-// ---------------------------------------------------------------------------
-void* sundialr_cvode_create(int neq, void* udata) {
-  if (neq <= 0) return NULL;
+// A handle for neq equations, of K subjects if K > 0 (then with the ensemble
+// vector, matrix and solver), otherwise of one system
+static sundialr_cvode_handle* capi_create(int neq, int K, void* udata) {
   sundialr_cvode_handle* h = NULL;
   try {
     h = new sundialr_cvode_handle();
     h->neq   = neq;
+    h->K     = K;
     h->udata = udata;
 
     if (SUNContext_Create(SUN_COMM_NULL, &h->sunctx) < 0) { sundialr_cvode_free(h); return NULL; }
@@ -203,14 +339,23 @@ void* sundialr_cvode_create(int neq, void* udata) {
     h->cvode_mem = CVodeCreate(CV_BDF, h->sunctx);
     if (!h->cvode_mem) { sundialr_cvode_free(h); return NULL; }
 
-    h->y = N_VNew_Serial(neq, h->sunctx);
-    if (!h->y) { sundialr_cvode_free(h); return NULL; }
-
-    h->SM = SUNDenseMatrix(neq, neq, h->sunctx);
-    if (!h->SM) { sundialr_cvode_free(h); return NULL; }
-
-    h->LS = SUNLinSol_Dense(h->y, h->SM, h->sunctx);
-    if (!h->LS) { sundialr_cvode_free(h); return NULL; }
+    if (K > 0) {
+      h->y  = N_VNew_Ensemble(neq, K, h->sunctx);
+      if (!h->y) { sundialr_cvode_free(h); return NULL; }
+      h->SM = SUNEnsembleMatrix(neq, K, h->sunctx);
+      if (!h->SM) { sundialr_cvode_free(h); return NULL; }
+      h->LS = SUNLinSol_Ensemble(h->y, h->SM, h->sunctx);
+      if (!h->LS) { sundialr_cvode_free(h); return NULL; }
+      h->fd_work.resize(2 * (size_t) K);
+    } else {
+      h->y  = N_VNew_Serial(neq, h->sunctx);
+      if (!h->y) { sundialr_cvode_free(h); return NULL; }
+      h->SM = SUNDenseMatrix(neq, neq, h->sunctx);
+      if (!h->SM) { sundialr_cvode_free(h); return NULL; }
+      h->LS = neq <= SMALL_DENSE_MAX ? SUNLinSol_SmallDense(h->y, h->SM, h->sunctx)
+                                     : SUNLinSol_Dense(h->y, h->SM, h->sunctx);
+      if (!h->LS) { sundialr_cvode_free(h); return NULL; }
+    }
   }
   catch (...) {
     if (h) sundialr_cvode_free(h);
@@ -219,9 +364,25 @@ void* sundialr_cvode_create(int neq, void* udata) {
   return h;
 }
 
+extern "C" {
+
+// ---------------------------------------------------------------------------
+// Lifecycle
+// ---------------------------------------------------------------------------
+void* sundialr_cvode_create(int neq, void* udata) {
+  if (neq <= 0) return NULL;
+  return capi_create(neq, 0, udata);
+}
+
+void* sundialr_cvode_create_ensemble(int neq, int K, void* udata) {
+  if (neq <= 0 || K <= 0) return NULL;
+  return capi_create(neq, K, udata);
+}
+
 void sundialr_cvode_free(void* m) {
   sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
   if (!h) return;
+  for (sundialr_cvode_handle* c : h->pool) sundialr_cvode_free(c);
   // Same order as the R solvers' cleanup: dependents first, context last.
   if (h->y)         N_VDestroy(h->y);
   if (h->LS)        SUNLinSolFree(h->LS);
@@ -237,14 +398,24 @@ void sundialr_cvode_free(void* m) {
 int sundialr_cvode_set_rhs(void* m, sundialr_rhs f) {
   sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
   if (!h) return SUNDIALR_CV_MEM_NULL;
-  h->rhs = f;
-  return SUNDIALR_CV_SUCCESS;
+  CAPI_GUARD(h, SUNDIALR_CV_MEM_FAIL, {
+    if (h->K > 0) {
+      h->last_err_msg = "an ensemble handle takes its RHS from sundialr_cvode_set_rhs_ensemble";
+      return SUNDIALR_CV_ILL_INPUT;
+    }
+    h->rhs = f;
+    return SUNDIALR_CV_SUCCESS;
+  })
 }
 
 int sundialr_cvode_set_jac(void* m, sundialr_jac J) {
   sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
   if (!h) return SUNDIALR_CV_MEM_NULL;
   CAPI_GUARD(h, SUNDIALR_CV_MEM_FAIL, {
+    if (h->K > 0) {
+      h->last_err_msg = "an ensemble handle takes its Jacobian from sundialr_cvode_set_jac_ensemble";
+      return SUNDIALR_CV_ILL_INPUT;
+    }
     h->jac = J;
     if (h->initialized) {
       int flag = J ? CVodeSetJacFn(h->cvode_mem, capi_jac_thunk)
@@ -255,6 +426,34 @@ int sundialr_cvode_set_jac(void* m, sundialr_jac J) {
   })
 }
 
+int sundialr_cvode_set_rhs_ensemble(void* m, sundialr_rhs_ensemble f) {
+  sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
+  if (!h) return SUNDIALR_CV_MEM_NULL;
+  CAPI_GUARD(h, SUNDIALR_CV_MEM_FAIL, {
+    if (h->K == 0) {
+      h->last_err_msg = "sundialr_cvode_set_rhs_ensemble needs a handle made by sundialr_cvode_create_ensemble";
+      return SUNDIALR_CV_ILL_INPUT;
+    }
+    h->rhs_ens = f;
+    return SUNDIALR_CV_SUCCESS;
+  })
+}
+
+// The ensemble's Jacobian function is given to CVODE once, and calls this one
+// or makes the difference approximation, so nothing is reapplied here
+int sundialr_cvode_set_jac_ensemble(void* m, sundialr_jac_ensemble J) {
+  sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
+  if (!h) return SUNDIALR_CV_MEM_NULL;
+  CAPI_GUARD(h, SUNDIALR_CV_MEM_FAIL, {
+    if (h->K == 0) {
+      h->last_err_msg = "sundialr_cvode_set_jac_ensemble needs a handle made by sundialr_cvode_create_ensemble";
+      return SUNDIALR_CV_ILL_INPUT;
+    }
+    h->jac_ens = J;
+    return SUNDIALR_CV_SUCCESS;
+  })
+}
+
 int sundialr_cvode_set_tol_scalar(void* m, double rtol, double atol) {
   sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
   if (!h) return SUNDIALR_CV_MEM_NULL;
@@ -263,7 +462,7 @@ int sundialr_cvode_set_tol_scalar(void* m, double rtol, double atol) {
     h->rtol_s = rtol;
     h->atol_s = atol;
     if (h->initialized) {
-      int flag = CVodeSStolerances(h->cvode_mem, rtol, atol);
+      int flag = capi_apply_tol(h);
       if (flag < 0) { capi_capture_err(h, flag); return flag; }
     }
     return SUNDIALR_CV_SUCCESS;
@@ -279,7 +478,7 @@ int sundialr_cvode_set_tol_vector(void* m, const double* rtol, const double* ato
     h->rtol_v.assign(rtol, rtol + h->neq);
     h->atol_v.assign(atol, atol + h->neq);
     if (h->initialized) {
-      int flag = CVodeWFtolerances(h->cvode_mem, capi_ewt_thunk);
+      int flag = capi_apply_tol(h);
       if (flag < 0) { capi_capture_err(h, flag); return flag; }
     }
     return SUNDIALR_CV_SUCCESS;
@@ -337,24 +536,25 @@ int sundialr_cvode_reinit(void* m, double t0, const double* y0) {
   CAPI_GUARD(h, SUNDIALR_CV_MEM_FAIL, {
     capi_clear_err(h);
     double* yp = N_VGetArrayPointer(h->y);
-    for (int i = 0; i < h->neq; i++) yp[i] = y0[i];
+    std::copy(y0, y0 + capi_length(h), yp);
 
     int flag;
     if (!h->initialized) {
-      if (!h->rhs) {
-        h->last_err_msg = "RHS function not set (call sundialr_cvode_set_rhs before reinit)";
+      if (h->K > 0 ? !h->rhs_ens : !h->rhs) {
+        h->last_err_msg = h->K > 0 ? "RHS function not set (call sundialr_cvode_set_rhs_ensemble before reinit)"
+                                   : "RHS function not set (call sundialr_cvode_set_rhs before reinit)";
         return SUNDIALR_CV_ILL_INPUT;
       }
       // One-time setup. CVodeReInit does not reset any of these, so later
       // reinits keep the linear solver, tolerances, Jacobian and step limits.
-      flag = CVodeInit(h->cvode_mem, capi_rhs_thunk, t0, h->y);
+      flag = CVodeInit(h->cvode_mem, h->K > 0 ? capi_rhs_ens_thunk : capi_rhs_thunk, t0, h->y);
       if (flag < 0) { capi_capture_err(h, flag); return flag; }
       flag = CVodeSetUserData(h->cvode_mem, h);
       if (flag < 0) { capi_capture_err(h, flag); return flag; }
       flag = CVodeSetLinearSolver(h->cvode_mem, h->LS, h->SM);
       if (flag < 0) { capi_capture_err(h, flag); return flag; }
-      if (h->jac) {
-        flag = CVodeSetJacFn(h->cvode_mem, capi_jac_thunk);   // must follow SetLinearSolver
+      if (capi_jac_fn(h)) {
+        flag = CVodeSetJacFn(h->cvode_mem, capi_jac_fn(h));   // must follow SetLinearSolver
         if (flag < 0) { capi_capture_err(h, flag); return flag; }
       }
       flag = capi_apply_tol(h);
@@ -383,7 +583,7 @@ int sundialr_cvode_solve(void* m, double tout, double* y, double* treached) {
     int flag = CVode(h->cvode_mem, tout, h->y, &treal, CV_NORMAL);
 
     double* yp = N_VGetArrayPointer(h->y);
-    for (int i = 0; i < h->neq; i++) y[i] = yp[i];
+    std::copy(yp, yp + capi_length(h), y);
     if (treached) *treached = (double) treal;
 
     if (flag < 0) capi_capture_err(h, flag);
@@ -391,6 +591,75 @@ int sundialr_cvode_solve(void* m, double tout, double* y, double* treached) {
   })
 }
 
+int sundialr_cvode_solve_batch(void* m, int n_items, double t0, const double* y0,
+                               void* const* udata, int n_times, const double* times,
+                               double* y, int* status, int n_threads) {
+  sundialr_cvode_handle* h = (sundialr_cvode_handle*) m;
+  if (!h) return SUNDIALR_CV_MEM_NULL;
+  if (n_items < 0 || n_times < 0 || (n_items > 0 && (!y0 || !y)) ||
+      (n_times > 0 && !times)) return SUNDIALR_CV_ILL_INPUT;
+  CAPI_GUARD(h, SUNDIALR_CV_MEM_FAIL, {
+    capi_clear_err(h);
+    h->last_err_msg.clear();
+    if (h->K > 0 ? !h->rhs_ens : !h->rhs) {
+      h->last_err_msg = h->K > 0 ? "RHS function not set (call sundialr_cvode_set_rhs_ensemble before solve_batch)"
+                                 : "RHS function not set (call sundialr_cvode_set_rhs before solve_batch)";
+      return SUNDIALR_CV_ILL_INPUT;
+    }
+    if (n_items == 0) return SUNDIALR_CV_SUCCESS;
+
+    // one clone per thread, made once and brought up to date with h
+    int n_workers = batch_workers(n_threads, n_items);
+    while ((int) h->pool.size() < n_workers) {
+      sundialr_cvode_handle* c = capi_create(h->neq, h->K, h->udata);
+      if (!c) {
+        h->last_err_msg = "cannot allocate a handle for a thread of sundialr_cvode_solve_batch";
+        return SUNDIALR_CV_MEM_FAIL;
+      }
+      h->pool.push_back(c);
+    }
+    for (int w = 0; w < n_workers; w++) {
+      int flag = capi_copy_config(h->pool[w], h);
+      if (flag < 0) { capi_capture_err(h->pool[w], flag); h->last_err_msg = h->pool[w]->last_err_msg; return flag; }
+    }
+
+    const size_t neq = capi_length(h);
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    std::mutex fail_mutex;
+    int fail_item = -1;
+    int fail_flag = 0;
+    std::string fail_msg;
+
+    auto solve_item = [&](int worker, int k) {
+      sundialr_cvode_handle* c = h->pool[worker];
+      c->udata = udata ? udata[k] : h->udata;
+      double* yk = y + (size_t) k * n_times * neq;
+      int flag = sundialr_cvode_reinit(c, t0, y0 + (size_t) k * neq);
+      int i = 0;
+      for (; flag >= 0 && i < n_times; i++) {
+        flag = sundialr_cvode_solve(c, times[i], yk + (size_t) i * neq, NULL);
+        if (flag < 0) break;
+      }
+      if (status) status[k] = flag < 0 ? flag : SUNDIALR_CV_SUCCESS;
+      if (flag >= 0) return;
+      std::fill(yk + (size_t) i * neq, yk + (size_t) n_times * neq, nan);
+      std::lock_guard<std::mutex> lock(fail_mutex);
+      if (fail_item < 0 || k < fail_item) {
+        fail_item = k;
+        fail_flag = flag;
+        fail_msg = c->last_err_msg;
+      }
+    };
+    batch_run(n_workers, n_items, solve_item, [] { return true; });
+
+    if (fail_item >= 0) {
+      h->last_err_msg = "item " + std::to_string(fail_item) + ": " + fail_msg;
+      return fail_flag;
+    }
+    return SUNDIALR_CV_SUCCESS;
+  })
+}
+
 // ---------------------------------------------------------------------------
 // Introspection
 // ---------------------------------------------------------------------------
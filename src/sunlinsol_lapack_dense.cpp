@@ -0,0 +1,168 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <nvector/nvector_serial.h>     /* serial N_Vector types, fcts., macros */
+#include <sunmatrix/sunmatrix_dense.h>  /* access to dense SUNMatrix            */
+
+#include <sunlinsol_lapack_dense.h>
+
+#include <climits>
+#include <new>
+#include <vector>
+
+#ifdef SUNDIALR_HAVE_LAPACK
+
+// the character arguments of dgetrs carry their hidden lengths (R-exts 6.6.1)
+#define USE_FC_LEN_T
+#include <Rconfig.h>
+#include <R_ext/Lapack.h>
+#ifndef FCONE
+# define FCONE
+#endif
+
+struct lapack_dense {
+  int n;
+  std::vector<int> ipiv;        // row pivots of the last factorisation
+  sunindextype last_flag;
+};
+
+#define LPD(S) ((lapack_dense*)(S)->content)
+
+//------------------------------------------------------------------------------
+// SUNLinearSolver operations
+
+static SUNLinearSolver_Type lapack_dense_gettype(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_DIRECT;
+}
+
+static SUNLinearSolver_ID lapack_dense_getid(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_CUSTOM;
+}
+
+static SUNErrCode lapack_dense_initialize(SUNLinearSolver S) {
+  LPD(S)->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+// A is factored in place, as SUNDIALS' dense solvers do; solve() then reads
+// the factors from it
+static int lapack_dense_setup(SUNLinearSolver S, SUNMatrix A) {
+  lapack_dense *ld = LPD(S);
+  int n = ld->n, lda = (int) SM_ROWS_D(A), info = 0;
+  F77_CALL(dgetrf)(&n, &n, SM_DATA_D(A), &lda, ld->ipiv.data(), &info);
+  ld->last_flag = info;
+  if (info > 0) return SUNLS_LUFACT_FAIL;
+  if (info < 0) return SUN_ERR_EXT_FAIL;
+  return SUN_SUCCESS;
+}
+
+static int lapack_dense_solve(SUNLinearSolver S, SUNMatrix A, N_Vector x,
+                              N_Vector b, sunrealtype tol) {
+  lapack_dense *ld = LPD(S);
+  int n = ld->n, lda = (int) SM_ROWS_D(A), one = 1, info = 0;
+  N_VScale(1.0, b, x);
+  F77_CALL(dgetrs)("N", &n, &one, SM_DATA_D(A), &lda, ld->ipiv.data(),
+                   N_VGetArrayPointer(x), &n, &info FCONE);
+  ld->last_flag = info;
+  return info < 0 ? SUN_ERR_EXT_FAIL : SUN_SUCCESS;
+}
+
+static sunindextype lapack_dense_lastflag(SUNLinearSolver S) {
+  return LPD(S)->last_flag;
+}
+
+static SUNErrCode lapack_dense_free(SUNLinearSolver S) {
+  if (S == NULL) return SUN_SUCCESS;
+  delete LPD(S);
+  S->content = NULL;
+  SUNLinSolFreeEmpty(S);
+  return SUN_SUCCESS;
+}
+
+SUNLinearSolver SUNLinSol_RLapackDense(N_Vector y, SUNMatrix A, SUNContext sunctx) {
+  // LAPACK takes the dimensions as int
+  if (SUNMatGetID(A) != SUNMATRIX_DENSE || SM_ROWS_D(A) != SM_COLUMNS_D(A) ||
+      SM_ROWS_D(A) != NV_LENGTH_S(y) || SM_ROWS_D(A) > INT_MAX) {
+    return NULL;
+  }
+
+  SUNLinearSolver S = SUNLinSolNewEmpty(sunctx);
+  if (S == NULL) return NULL;
+
+  S->ops->gettype    = lapack_dense_gettype;
+  S->ops->getid      = lapack_dense_getid;
+  S->ops->initialize = lapack_dense_initialize;
+  S->ops->setup      = lapack_dense_setup;
+  S->ops->solve      = lapack_dense_solve;
+  S->ops->lastflag   = lapack_dense_lastflag;
+  S->ops->free       = lapack_dense_free;
+
+  lapack_dense *ld = new (std::nothrow) lapack_dense();
+  if (ld == NULL) {
+    SUNLinSolFreeEmpty(S);
+    return NULL;
+  }
+  S->content = ld;
+
+  try {
+    ld->n = (int) SM_ROWS_D(A);
+    ld->ipiv.resize(ld->n);
+    ld->last_flag = SUN_SUCCESS;
+  } catch (std::bad_alloc &) {
+    lapack_dense_free(S);
+    return NULL;
+  }
+  return S;
+}
+
+#else  /* no LAPACK */
+
+SUNLinearSolver SUNLinSol_RLapackDense(N_Vector y, SUNMatrix A, SUNContext sunctx) {
+  return NULL;
+}
+
+#endif /* SUNDIALR_HAVE_LAPACK */
+
+//'sundialr_has_lapack
+//'
+//' Whether \code{linear_solver = "lapack_dense"} is available in
+//' \code{\link{cvode}}, \code{\link{cvsolve}} and \code{\link{ida}}. The
+//' package's configure script offers it when a program calling LAPACK's
+//' \code{dgetrf} links against R's LAPACK as the package was installed.
+//'@returns TRUE when the package was built with R's LAPACK, FALSE otherwise
+// [[Rcpp::export]]
+bool sundialr_has_lapack() {
+#ifdef SUNDIALR_HAVE_LAPACK
+  return true;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,219 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <nvector/nvector_serial.h>     /* serial N_Vector types, fcts., macros */
+#include <sunmatrix/sunmatrix_dense.h>  /* access to dense SUNMatrix            */
+
+#include <sunlinsol_small_dense.h>
+
+#include <cmath>
+#include <new>
+#include <utility>
+
+// Every loop below has a bound known at compile time, but at -O2, R's default,
+// GCC unrolls only the smallest; ask it, and clang, to unroll them all
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 8)
+# define SMALL_DENSE_UNROLL _Pragma("GCC unroll 16")
+#else
+# define SMALL_DENSE_UNROLL
+#endif
+
+// The row swapped with row k at step k of the elimination
+template <int N>
+struct small_dense {
+  int pivot[N];
+  sunindextype last_flag;
+};
+
+//------------------------------------------------------------------------------
+// SUNLinearSolver operations
+
+static SUNLinearSolver_Type small_dense_gettype(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_DIRECT;
+}
+
+static SUNLinearSolver_ID small_dense_getid(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_CUSTOM;
+}
+
+template <int N>
+static SUNErrCode small_dense_initialize(SUNLinearSolver S) {
+  ((small_dense<N>*) S->content)->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+// Step K of the LU factorisation of the N x N matrix a in place, and then the
+// steps after it, by the steps of denseGETRF: pick the largest pivot of column
+// K, swap whole rows, scale the column below it by its reciprocal and update
+// the columns to its right. Recursing on K makes the step a constant, so the
+// whole factorisation is unrolled.
+template <int N, int K>
+struct small_dense_lu {
+  static inline bool run(sunrealtype *a, int *pivot, sunindextype *last_flag) {
+    sunrealtype *col_k = a + K * N;
+    int l = K;
+    SMALL_DENSE_UNROLL
+    for (int i = K + 1; i < N; i++) {
+      if (std::fabs(col_k[i]) > std::fabs(col_k[l])) l = i;
+    }
+    pivot[K] = l;
+    if (col_k[l] == 0.0) {
+      *last_flag = K + 1;
+      return false;
+    }
+    if (l != K) {
+      SMALL_DENSE_UNROLL
+      for (int j = 0; j < N; j++) std::swap(a[l + j * N], a[K + j * N]);
+    }
+    sunrealtype mult = 1.0 / col_k[K];
+    SMALL_DENSE_UNROLL
+    for (int i = K + 1; i < N; i++) col_k[i] *= mult;
+    for (int j = K + 1; j < N; j++) {
+      sunrealtype *col_j = a + j * N;
+      sunrealtype a_kj = col_j[K];
+      SMALL_DENSE_UNROLL
+      for (int i = K + 1; i < N; i++) col_j[i] -= a_kj * col_k[i];
+    }
+    return small_dense_lu<N, K + 1>::run(a, pivot, last_flag);
+  }
+};
+
+template <int N>
+struct small_dense_lu<N, N> {
+  static inline bool run(sunrealtype *a, int *pivot, sunindextype *last_flag) {
+    return true;
+  }
+};
+
+// A is factored in place, as SUNDIALS' dense solvers do
+template <int N>
+static int small_dense_setup(SUNLinearSolver S, SUNMatrix A) {
+  small_dense<N> *sd = (small_dense<N>*) S->content;
+  if (!small_dense_lu<N, 0>::run(SM_DATA_D(A), sd->pivot, &sd->last_flag)) {
+    return SUNLS_LUFACT_FAIL;
+  }
+  sd->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+// The steps of denseGETRS, on a copy of b on the stack: the row swaps, then L
+// and U by columns
+template <int N>
+static int small_dense_solve(SUNLinearSolver S, SUNMatrix A, N_Vector x,
+                             N_Vector b, sunrealtype tol) {
+  const small_dense<N> *sd = (const small_dense<N>*) S->content;
+  const sunrealtype *lu = SM_DATA_D(A);
+  sunrealtype v[N];
+  const sunrealtype *bd = N_VGetArrayPointer(b);
+  SMALL_DENSE_UNROLL
+  for (int i = 0; i < N; i++) v[i] = bd[i];
+
+  // the last row has no other to swap with
+  SMALL_DENSE_UNROLL
+  for (int k = 0; k < N - 1; k++) {
+    int p = sd->pivot[k];
+    if (p != k) std::swap(v[k], v[p]);
+  }
+  SMALL_DENSE_UNROLL
+  for (int k = 0; k < N - 1; k++) {
+    const sunrealtype *col_k = lu + k * N;
+    SMALL_DENSE_UNROLL
+    for (int i = k + 1; i < N; i++) v[i] -= col_k[i] * v[k];
+  }
+  SMALL_DENSE_UNROLL
+  for (int k = N - 1; k > 0; k--) {
+    const sunrealtype *col_k = lu + k * N;
+    v[k] /= col_k[k];
+    SMALL_DENSE_UNROLL
+    for (int i = 0; i < k; i++) v[i] -= col_k[i] * v[k];
+  }
+  v[0] /= lu[0];
+
+  sunrealtype *xd = N_VGetArrayPointer(x);
+  SMALL_DENSE_UNROLL
+  for (int i = 0; i < N; i++) xd[i] = v[i];
+  return SUN_SUCCESS;
+}
+
+template <int N>
+static sunindextype small_dense_lastflag(SUNLinearSolver S) {
+  return ((small_dense<N>*) S->content)->last_flag;
+}
+
+template <int N>
+static SUNErrCode small_dense_free(SUNLinearSolver S) {
+  if (S == NULL) return SUN_SUCCESS;
+  delete (small_dense<N>*) S->content;
+  S->content = NULL;
+  SUNLinSolFreeEmpty(S);
+  return SUN_SUCCESS;
+}
+
+template <int N>
+static SUNLinearSolver small_dense_new(SUNContext sunctx) {
+  SUNLinearSolver S = SUNLinSolNewEmpty(sunctx);
+  if (S == NULL) return NULL;
+
+  S->ops->gettype    = small_dense_gettype;
+  S->ops->getid      = small_dense_getid;
+  S->ops->initialize = small_dense_initialize<N>;
+  S->ops->setup      = small_dense_setup<N>;
+  S->ops->solve      = small_dense_solve<N>;
+  S->ops->lastflag   = small_dense_lastflag<N>;
+  S->ops->free       = small_dense_free<N>;
+
+  small_dense<N> *sd = new (std::nothrow) small_dense<N>();
+  if (sd == NULL) {
+    SUNLinSolFreeEmpty(S);
+    return NULL;
+  }
+  sd->last_flag = SUN_SUCCESS;
+  S->content = sd;
+  return S;
+}
+
+// The constructor of every size, indexed by the size less one
+typedef SUNLinearSolver (*small_dense_ctor)(SUNContext);
+
+static const small_dense_ctor small_dense_ctors[SMALL_DENSE_MAX] = {
+  small_dense_new<1>,  small_dense_new<2>,  small_dense_new<3>,  small_dense_new<4>,
+  small_dense_new<5>,  small_dense_new<6>,  small_dense_new<7>,  small_dense_new<8>,
+  small_dense_new<9>,  small_dense_new<10>, small_dense_new<11>, small_dense_new<12>,
+  small_dense_new<13>, small_dense_new<14>, small_dense_new<15>, small_dense_new<16>
+};
+
+SUNLinearSolver SUNLinSol_SmallDense(N_Vector y, SUNMatrix A, SUNContext sunctx) {
+  if (SUNMatGetID(A) != SUNMATRIX_DENSE || SM_ROWS_D(A) != SM_COLUMNS_D(A) ||
+      SM_ROWS_D(A) != NV_LENGTH_S(y) || SM_ROWS_D(A) < 1 ||
+      SM_ROWS_D(A) > SMALL_DENSE_MAX) {
+    return NULL;
+  }
+  return small_dense_ctors[SM_ROWS_D(A) - 1](sunctx);
+}
@@ -0,0 +1,356 @@
+//   Copyright (c) 2016-2026, Satyaprakash Nayak
+//
+//   Redistribution and use in source and binary forms, with or without
+//   modification, are permitted provided that the following conditions are
+//   met:
+//
+//   Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+//   Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in
+//   the documentation and/or other materials provided with the
+//   distribution.
+//
+//   Neither sundialr nor the names of its
+//   contributors may be used to endorse or promote products derived
+//   from this software without specific prior written permission.
+//
+//   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+//   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+//   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+//   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+//   HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+//   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+//   LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//   DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//   THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//   (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+//   OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <nvector/nvector_serial.h>     /* serial N_Vector types, fcts., macros */
+#include <sunmatrix/sunmatrix_sparse.h> /* access to sparse SUNMatrix           */
+
+#include <sunlinsol_sparse_lu.h>
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <set>
+#include <utility>
+#include <vector>
+
+typedef std::vector<sunindextype> index_vec;
+
+struct sparse_lu {
+  sunindextype n;
+
+  // pattern of the matrix the ordering q was computed for
+  index_vec Ap, Ai;
+  index_vec q;                  // column k of the factors is column q[k] of A
+
+  // the factors; L is unit lower triangular with its diagonal stored first in
+  // each column, U upper triangular with its diagonal stored last
+  index_vec Lp, Li, Up, Ui;
+  std::vector<sunrealtype> Lx, Ux;
+  index_vec pinv;               // row i of A is row pinv[i] of L and U
+
+  // workspace of the factorisation and the solve
+  std::vector<sunrealtype> x;
+  index_vec xi, mark;
+
+  sunindextype last_flag;
+};
+
+#define SLU(S) ((sparse_lu*)(S)->content)
+
+//------------------------------------------------------------------------------
+// Minimum-degree ordering of the pattern of A + A': repeatedly eliminate the
+// node of least degree and join its neighbours into a clique, which is the
+// fill its elimination causes
+static void sparse_lu_order(sparse_lu *lu) {
+  sunindextype n = lu->n;
+  std::vector<index_vec> adj(n);
+  for (sunindextype j = 0; j < n; j++) {
+    for (sunindextype p = lu->Ap[j]; p < lu->Ap[j + 1]; p++) {
+      sunindextype i = lu->Ai[p];
+      if (i == j) continue;
+      adj[i].push_back(j);
+      adj[j].push_back(i);
+    }
+  }
+  std::set<std::pair<sunindextype, sunindextype> > by_degree;
+  for (sunindextype j = 0; j < n; j++) {
+    std::sort(adj[j].begin(), adj[j].end());
+    adj[j].erase(std::unique(adj[j].begin(), adj[j].end()), adj[j].end());
+    by_degree.insert(std::make_pair((sunindextype) adj[j].size(), j));
+  }
+
+  index_vec merged;
+  for (sunindextype k = 0; k < n; k++) {
+    sunindextype v = by_degree.begin()->second;
+    by_degree.erase(by_degree.begin());
+    lu->q[k] = v;
+
+    const index_vec &nbrs = adj[v];
+    for (size_t a = 0; a < nbrs.size(); a++) {
+      sunindextype u = nbrs[a];
+      index_vec &au = adj[u];
+      by_degree.erase(std::make_pair((sunindextype) au.size(), u));
+      merged.clear();
+      std::set_union(au.begin(), au.end(), nbrs.begin(), nbrs.end(),
+                     std::back_inserter(merged));
+      au.clear();
+      for (size_t b = 0; b < merged.size(); b++) {
+        if (merged[b] != u && merged[b] != v) au.push_back(merged[b]);
+      }
+      by_degree.insert(std::make_pair((sunindextype) au.size(), u));
+    }
+    index_vec().swap(adj[v]);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Nonzero pattern of L \ A(:, col): the rows reachable from the nonzeros of
+// A(:, col) in the graph of the columns of L computed so far, left in
+// xi[top..n-1] in topological order. xi[0..n-1] is also the stack of the
+// search and xi[n..2n-1] the position reached in each column on it.
+static sunindextype sparse_lu_reach(sparse_lu *lu, const sunindextype *Ap,
+                                    const sunindextype *Ai, sunindextype col,
+                                    sunindextype stamp) {
+  sunindextype n = lu->n, top = n;
+  sunindextype *xi = lu->xi.data(), *pstack = xi + n;
+  sunindextype *mark = lu->mark.data();
+  const sunindextype *pinv = lu->pinv.data();
+  const sunindextype *Lp = lu->Lp.data(), *Li = lu->Li.data();
+
+  for (sunindextype p = Ap[col]; p < Ap[col + 1]; p++) {
+    if (mark[Ai[p]] == stamp) continue;
+    sunindextype head = 0;
+    xi[0] = Ai[p];
+    while (head >= 0) {
+      sunindextype j = xi[head], jcol = pinv[j];
+      if (mark[j] != stamp) {
+        mark[j] = stamp;
+        pstack[head] = jcol < 0 ? 0 : Lp[jcol] + 1;
+      }
+      bool done = true;
+      sunindextype pend = jcol < 0 ? 0 : Lp[jcol + 1];
+      for (sunindextype q = pstack[head]; q < pend; q++) {
+        sunindextype i = Li[q];
+        if (mark[i] == stamp) continue;
+        pstack[head] = q + 1;
+        xi[++head] = i;
+        done = false;
+        break;
+      }
+      if (done) {
+        head--;
+        xi[--top] = j;
+      }
+    }
+  }
+  return top;
+}
+
+//------------------------------------------------------------------------------
+// P A Q = L U. Returns 0, or k + 1 when column k has no nonzero pivot.
+static sunindextype sparse_lu_factor(sparse_lu *lu, const sunindextype *Ap,
+                                     const sunindextype *Ai, const sunrealtype *Ax) {
+  sunindextype n = lu->n;
+  sunrealtype *x = lu->x.data();
+  const sunindextype *xi = lu->xi.data();
+
+  std::fill(lu->pinv.begin(), lu->pinv.end(), -1);
+  std::fill(lu->mark.begin(), lu->mark.end(), -1);
+  sunindextype lnz = 0, unz = 0;
+
+  for (sunindextype k = 0; k < n; k++) {
+    lu->Lp[k] = lnz;
+    lu->Up[k] = unz;
+    // column k adds at most n entries to each factor
+    if ((sunindextype) lu->Li.size() < lnz + n) {
+      lu->Li.resize(2 * lu->Li.size() + n);
+      lu->Lx.resize(lu->Li.size());
+    }
+    if ((sunindextype) lu->Ui.size() < unz + n) {
+      lu->Ui.resize(2 * lu->Ui.size() + n);
+      lu->Ux.resize(lu->Ui.size());
+    }
+    sunindextype *pinv = lu->pinv.data();
+    const sunindextype *Lp = lu->Lp.data(), *Li = lu->Li.data();
+    const sunrealtype *Lx = lu->Lx.data();
+
+    // x = L \ A(:, col), sparse
+    sunindextype col = lu->q[k];
+    sunindextype top = sparse_lu_reach(lu, Ap, Ai, col, k);
+    for (sunindextype p = top; p < n; p++) x[xi[p]] = 0.0;
+    for (sunindextype p = Ap[col]; p < Ap[col + 1]; p++) x[Ai[p]] = Ax[p];
+    for (sunindextype p = top; p < n; p++) {
+      sunindextype j = xi[p], jcol = pinv[j];
+      if (jcol < 0) continue;
+      for (sunindextype r = Lp[jcol] + 1; r < Lp[jcol + 1]; r++) {
+        x[Li[r]] -= Lx[r] * x[j];
+      }
+    }
+
+    // rows already pivotal go to U; the pivot is the largest of the others,
+    // or the diagonal when it is not much smaller
+    sunindextype ipiv = -1;
+    sunrealtype amax = -1.0;
+    for (sunindextype p = top; p < n; p++) {
+      sunindextype i = xi[p];
+      if (pinv[i] < 0) {
+        sunrealtype a = std::fabs(x[i]);
+        if (a > amax) { amax = a; ipiv = i; }
+      } else {
+        lu->Ui[unz] = pinv[i];
+        lu->Ux[unz++] = x[i];
+      }
+    }
+    if (ipiv < 0 || !(amax > 0.0)) return k + 1;
+    if (pinv[col] < 0 && lu->mark[col] == k &&
+        std::fabs(x[col]) >= SPARSE_LU_PIVOT_TOL * amax) {
+      ipiv = col;
+    }
+
+    sunrealtype pivot = x[ipiv];
+    lu->Ui[unz] = k;
+    lu->Ux[unz++] = pivot;
+    pinv[ipiv] = k;
+    lu->Li[lnz] = ipiv;
+    lu->Lx[lnz++] = 1.0;
+    for (sunindextype p = top; p < n; p++) {
+      sunindextype i = xi[p];
+      if (pinv[i] < 0) {
+        lu->Li[lnz] = i;
+        lu->Lx[lnz++] = x[i] / pivot;
+      }
+      x[i] = 0.0;
+    }
+  }
+  lu->Lp[n] = lnz;
+  lu->Up[n] = unz;
+
+  // number the rows of L by pivot order, as U's already are
+  for (sunindextype p = 0; p < lnz; p++) lu->Li[p] = lu->pinv[lu->Li[p]];
+  return 0;
+}
+
+//------------------------------------------------------------------------------
+// SUNLinearSolver operations
+
+static SUNLinearSolver_Type sparse_lu_gettype(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_DIRECT;
+}
+
+static SUNLinearSolver_ID sparse_lu_getid(SUNLinearSolver S) {
+  return SUNLINEARSOLVER_CUSTOM;
+}
+
+static SUNErrCode sparse_lu_initialize(SUNLinearSolver S) {
+  SLU(S)->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+static int sparse_lu_setup(SUNLinearSolver S, SUNMatrix A) {
+  sparse_lu *lu = SLU(S);
+  const sunindextype *Ap = SM_INDEXPTRS_S(A), *Ai = SM_INDEXVALS_S(A);
+  sunindextype n = lu->n, nnz = Ap[n];
+
+  try {
+    // the ordering depends on the pattern alone, which stays the same from
+    // one Jacobian to the next
+    if ((sunindextype) lu->Ap.size() != n + 1 || (sunindextype) lu->Ai.size() != nnz ||
+        !std::equal(Ap, Ap + n + 1, lu->Ap.begin()) ||
+        !std::equal(Ai, Ai + nnz, lu->Ai.begin())) {
+      lu->Ap.assign(Ap, Ap + n + 1);
+      lu->Ai.assign(Ai, Ai + nnz);
+      sparse_lu_order(lu);
+    }
+    lu->last_flag = sparse_lu_factor(lu, Ap, Ai, SM_DATA_S(A));
+  } catch (std::bad_alloc &) {
+    lu->last_flag = SUN_ERR_MALLOC_FAIL;
+    return SUN_ERR_MALLOC_FAIL;
+  }
+  return lu->last_flag > 0 ? SUNLS_LUFACT_FAIL : SUN_SUCCESS;
+}
+
+static int sparse_lu_solve(SUNLinearSolver S, SUNMatrix A, N_Vector x,
+                           N_Vector b, sunrealtype tol) {
+  sparse_lu *lu = SLU(S);
+  sunindextype n = lu->n;
+  const sunrealtype *bd = N_VGetArrayPointer(b);
+  sunrealtype *xd = N_VGetArrayPointer(x);
+  sunrealtype *w = lu->x.data();
+  const sunindextype *Lp = lu->Lp.data(), *Li = lu->Li.data();
+  const sunindextype *Up = lu->Up.data(), *Ui = lu->Ui.data();
+  const sunrealtype *Lx = lu->Lx.data(), *Ux = lu->Ux.data();
+
+  for (sunindextype i = 0; i < n; i++) w[lu->pinv[i]] = bd[i];
+  for (sunindextype j = 0; j < n; j++) {
+    for (sunindextype p = Lp[j] + 1; p < Lp[j + 1]; p++) w[Li[p]] -= Lx[p] * w[j];
+  }
+  for (sunindextype j = n - 1; j >= 0; j--) {
+    w[j] /= Ux[Up[j + 1] - 1];
+    for (sunindextype p = Up[j]; p < Up[j + 1] - 1; p++) w[Ui[p]] -= Ux[p] * w[j];
+  }
+  for (sunindextype k = 0; k < n; k++) xd[lu->q[k]] = w[k];
+
+  lu->last_flag = SUN_SUCCESS;
+  return SUN_SUCCESS;
+}
+
+static sunindextype sparse_lu_lastflag(SUNLinearSolver S) {
+  return SLU(S)->last_flag;
+}
+
+static SUNErrCode sparse_lu_free(SUNLinearSolver S) {
+  if (S == NULL) return SUN_SUCCESS;
+  delete SLU(S);
+  S->content = NULL;
+  SUNLinSolFreeEmpty(S);
+  return SUN_SUCCESS;
+}
+
+SUNLinearSolver SUNLinSol_SparseLU(N_Vector y, SUNMatrix A, SUNContext sunctx) {
+  if (SUNMatGetID(A) != SUNMATRIX_SPARSE || SM_SPARSETYPE_S(A) != CSC_MAT ||
+      SM_ROWS_S(A) != SM_COLUMNS_S(A) || SM_ROWS_S(A) != NV_LENGTH_S(y)) {
+    return NULL;
+  }
+
+  SUNLinearSolver S = SUNLinSolNewEmpty(sunctx);
+  if (S == NULL) return NULL;
+
+  S->ops->gettype    = sparse_lu_gettype;
+  S->ops->getid      = sparse_lu_getid;
+  S->ops->initialize = sparse_lu_initialize;
+  S->ops->setup      = sparse_lu_setup;
+  S->ops->solve      = sparse_lu_solve;
+  S->ops->lastflag   = sparse_lu_lastflag;
+  S->ops->free       = sparse_lu_free;
+
+  sparse_lu *lu = new (std::nothrow) sparse_lu();
+  if (lu == NULL) {
+    SUNLinSolFreeEmpty(S);
+    return NULL;
+  }
+  S->content = lu;
+
+  sunindextype n = SM_ROWS_S(A);
+  try {
+    lu->n = n;
+    lu->q.resize(n);
+    lu->Lp.resize(n + 1);
+    lu->Up.resize(n + 1);
+    lu->pinv.resize(n);
+    lu->x.assign(n, 0.0);
+    lu->xi.resize(2 * n);
+    lu->mark.resize(n);
+    lu->last_flag = SUN_SUCCESS;
+  } catch (std::bad_alloc &) {
+    sparse_lu_free(S);
+    return NULL;
+  }
+  return S;
+}
@@ -0,0 +1,28 @@
+## The performance regression gate of test-perf.r; the cases, their counts and
+## tolerances are in inst/benchmarks/perf_gate.R
+
+perf_file <- function(name) system.file("benchmarks", name, package = "sundialr")
+source(perf_file("stiff_problems.R"), local = TRUE)
+source(perf_file("perf_gate.R"), local = TRUE)
+
+perf_baselines <- function() {
+  read.csv(perf_file("baselines.csv"), stringsAsFactors = FALSE)
+}
+
+## Times are compared only when SUNDIALR_PERF_TIMING is "true": on a shared or
+## busy machine they vary too much to fail a check on, where the counts do not
+perf_timing <- function() identical(Sys.getenv("SUNDIALR_PERF_TIMING"), "true")
+
+## Solves the case of one row of the baselines and fails if its steps or
+## evaluations, or with timing on its normalised time, rose beyond the
+## baseline's tolerance
+expect_no_perf_regression <- function(baseline, problems = stiff_problems(),
+                                      timing = perf_timing(),
+                                      unit = if (timing) perf_unit() else NA) {
+  pr <- problems[[baseline$problem]]
+  counts <- perf_counts(pr, baseline$solver)
+  time_norm <- if (timing) perf_time_norm(pr, baseline$solver, unit) else NA
+  msgs <- perf_check(baseline, counts, time_norm)
+  expect(length(msgs) == 0, paste(msgs, collapse = "\n"))
+  invisible(counts)
+}
@@ -0,0 +1,124 @@
+context("Band matrix and band linear solver")
+
+## A reaction-diffusion chain, the method of lines on a line of n cells:
+##   y_i' = D * (y_{i-1} - 2 y_i + y_{i+1}) - k * y_i^2,   y_0 = y_{n+1} = 0
+## Each state involves only its neighbours, so the Jacobian is tridiagonal
+## (mupper = mlower = 1).
+n <- 30
+CHAIN_R <- function(t, y, p) {
+  up   <- c(y[-1], 0)
+  down <- c(0, y[-length(y)])
+  p[1] * (down - 2 * y + up) - p[2] * y^2
+}
+CHAIN_JAC <- function(t, y, p) {
+  J <- diag(-2 * p[1] - 2 * p[2] * y)
+  J[cbind(2:n, 1:(n - 1))] <- p[1]
+  J[cbind(1:(n - 1), 2:n)] <- p[1]
+  J
+}
+
+tv     <- seq(0, 1, by = 0.1)
+y0     <- sin(pi * seq_len(n) / (n + 1))
+params <- c(50, 0.5)
+
+test_that("cvode gives the dense solution with a band linear solver", {
+
+  dense   <- cvode(tv, y0, CHAIN_R, params, 1e-8, 1e-10)
+  band    <- cvode(tv, y0, CHAIN_R, params, 1e-8, 1e-10, mupper = 1, mlower = 1)
+  band_j  <- cvode(tv, y0, CHAIN_R, params, 1e-8, 1e-10, jacobian = CHAIN_JAC,
+                   mupper = 1, mlower = 1)
+  # a wider band than needed only stores more zeros
+  wide    <- cvode(tv, y0, CHAIN_R, params, 1e-8, 1e-10, mupper = 3, mlower = 2)
+
+  expect_equal(band, dense, tolerance = 1e-6)
+  expect_equal(band_j, dense, tolerance = 1e-6)
+  expect_equal(wide, dense, tolerance = 1e-6)
+})
+
+test_that("a model's symbolic Jacobian and a compiled Jacobian fill the band", {
+
+  eqs <- lapply(seq_len(n), function(i) {
+    down <- if (i > 1) sprintf("y[%d]", i - 1) else "0"
+    up   <- if (i < n) sprintf("y[%d]", i + 1) else "0"
+    str2lang(sprintf("D * (%s - 2 * y[%d] + %s) - k * y[%d]^2", down, i, up, i))
+  })
+  chain <- ode_model(eqs, parameters = c("D", "k"))
+
+  dense <- cvode(tv, y0, CHAIN_R, params, 1e-8, 1e-10)
+  expect_equal(cvode(tv, y0, chain, params, 1e-8, 1e-10, mupper = 1, mlower = 1),
+               dense, tolerance = 1e-6)
+  expect_equal(cvsolve(tv, y0, chain, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10, mupper = 1, mlower = 1),
+               cvsolve(tv, y0, CHAIN_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10),
+               tolerance = 1e-6)
+
+  # the compiled Robertson Jacobian is full, so a full band reproduces it
+  native <- sundialr:::.native_test_xptr
+  rob_tv <- c(0, 0.4, 4, 40, 400)
+  rob_p  <- c(0.04, 10000, 30000000)
+  rob_at <- c(1e-8, 1e-14, 1e-6)
+  expect_equal(cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p, 1e-4, rob_at,
+                     jacobian = native("robertson_jac"), mupper = 2, mlower = 2),
+               cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p, 1e-4, rob_at,
+                     jacobian = native("robertson_jac")))
+})
+
+test_that("a compiled band Jacobian writes the band matrix's own storage", {
+
+  native <- sundialr:::.native_test_xptr
+  rob_tv <- c(0, 0.4, 4, 40, 400)
+  rob_p  <- c(0.04, 10000, 30000000)
+  rob_at <- c(1e-8, 1e-14, 1e-6)
+  rob    <- function(...) cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p,
+                                1e-4, rob_at, ...)
+
+  # a band form and an n-by-n one store the same band
+  for (bw in 1:2) {
+    expect_identical(rob(jacobian = native("robertson_jac_band"), mupper = bw, mlower = bw),
+                     rob(jacobian = native("robertson_jac"), mupper = bw, mlower = bw),
+                     info = bw)
+  }
+  expect_equal(rob(jacobian = native("robertson_jac_band"), mupper = 2, mlower = 2),
+               rob(jacobian = native("robertson_jac")))
+
+  k   <- c(0.5, 0.2)
+  dae <- function(...) ida(seq(0, 20, by = 2), c(1, 0, 1), c(-0.5, 0.5, 0),
+                           native("chain_dae_res"), k, 1e-8, rep(1e-10, 3), ...)
+  expect_identical(dae(jacobian = native("chain_dae_jac_band"), mupper = 2, mlower = 2),
+                   dae(jacobian = native("chain_dae_jac"), mupper = 2, mlower = 2))
+
+  expect_error(rob(jacobian = native("robertson_jac_band")),
+               "A compiled band Jacobian needs a band matrix")
+  expect_error(dae(jacobian = native("chain_dae_jac_band")),
+               "A compiled band Jacobian needs a band matrix")
+})
+
+test_that("ida gives the dense solution with a band linear solver", {
+
+  CHAIN_DAE <- function(t, y, ydot, p) CHAIN_R(t, y, p) - ydot
+  CHAIN_DAE_JAC <- function(t, y, ydot, cj, p) CHAIN_JAC(t, y, p) - cj * diag(n)
+  yp0 <- CHAIN_R(0, y0, params)
+
+  dense  <- ida(tv, y0, yp0, CHAIN_DAE, params, 1e-8, 1e-10)
+  band   <- ida(tv, y0, yp0, CHAIN_DAE, params, 1e-8, 1e-10, mupper = 1, mlower = 1)
+  band_j <- ida(tv, y0, yp0, CHAIN_DAE, params, 1e-8, 1e-10,
+                jacobian = CHAIN_DAE_JAC, mupper = 1, mlower = 1)
+
+  expect_equal(band, dense, tolerance = 1e-6)
+  expect_equal(band_j, dense, tolerance = 1e-6)
+})
+
+test_that("invalid bandwidths are rejected before the solve", {
+
+  expect_error(cvode(tv, y0, CHAIN_R, params, mupper = 1),
+               "mupper and mlower must be given together")
+  expect_error(cvode(tv, y0, CHAIN_R, params, mupper = -1, mlower = 1),
+               "mupper must be a whole number between 0 and 29")
+  expect_error(cvsolve(tv, y0, CHAIN_R, params, mupper = 1, mlower = n),
+               "mlower must be a whole number")
+  expect_error(ida(tv, y0, y0, CHAIN_R, params, mupper = 1.5, mlower = 1),
+               "mupper must be a whole number")
+  expect_error(cvode(tv, y0, CHAIN_R, params, mupper = c(1, 1), mlower = 1),
+               "mupper must be a single whole number")
+})
@@ -0,0 +1,133 @@
+context("Batch solves over many parameter sets")
+
+native <- sundialr:::.native_test_xptr
+
+robertson <- ode_model(
+  list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+       y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+       y3 = quote( k3 * y2^2)),
+  parameters = c("k1", "k2", "k3"))
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3, 4E4)
+IC       <- c(1, 0, 0)
+reltol   <- 1e-04
+abstol   <- c(1e-8, 1e-14, 1e-6)
+params   <- cbind(seq(0.01, 0.1, length.out = 12), 10000, 30000000)
+
+test_that("every set gives the solution of cvode()", {
+
+  for (rhs in list(robertson, native("robertson_rhs"))) {
+    out <- cvode_batch(time_vec, IC, rhs, params, reltol, abstol, threads = 2)
+    expect_equal(dim(out), c(length(time_vec), 4, nrow(params)))
+    expect_equal(attr(out, "status"), integer(nrow(params)))
+    for (k in seq_len(nrow(params))) {
+      expect_equal(out[, , k], cvode(time_vec, IC, rhs, params[k, ], reltol, abstol),
+                   tolerance = 1e-6, info = k)
+    }
+  }
+})
+
+test_that("the result does not depend on the number of threads", {
+
+  jac <- native("robertson_jac")
+  one <- cvode_batch(time_vec, IC, native("robertson_rhs"), params, reltol, abstol,
+                     jacobian = jac, threads = 1)
+  two <- cvode_batch(time_vec, IC, native("robertson_rhs"), params, reltol, abstol,
+                     jacobian = jac, threads = 2)
+  expect_identical(two, one)
+})
+
+test_that("the steps of every set are reported, and may be fed back as costs", {
+
+  rhs <- native("robertson_rhs")
+  out <- cvode_batch(time_vec, IC, rhs, params, reltol, abstol, threads = 2)
+  steps <- attr(out, "steps")
+  for (k in seq_len(nrow(params))) {
+    st <- attr(cvode(time_vec, IC, rhs, params[k, ], reltol, abstol, stats = TRUE), "stats")
+    expect_equal(steps[k], st$steps, info = k)
+  }
+  expect_true(all(attr(out, "thread") %in% 1:2))
+
+  # queued by cost, the sets are solved in another order but to the same result
+  again <- cvode_batch(time_vec, IC, rhs, params, reltol, abstol, threads = 2,
+                       cost = steps)
+  expect_identical(c(again), c(out))
+  expect_identical(attr(again, "steps"), steps)
+
+  expect_error(cvode_batch(time_vec, IC, rhs, params, cost = 1:2), "12 sets")
+  expect_error(cvode_batch(time_vec, IC, rhs, params, cost = c(NA, steps[-1])), "finite")
+})
+
+test_that("initial conditions may vary by set, and a vector is shared", {
+
+  y0 <- rbind(c(1, 0, 0), c(0.5, 0, 0.5), c(0.2, 0, 0.8))
+  out <- cvode_batch(time_vec, y0, robertson, params[1, ], reltol, abstol, threads = 2)
+  expect_equal(dim(out)[3], 3)
+  for (k in 1:3) {
+    expect_equal(out[, , k], cvode(time_vec, y0[k, ], robertson, params[1, ], reltol, abstol),
+                 tolerance = 1e-6, info = k)
+  }
+  expect_error(cvode_batch(time_vec, y0, robertson, params), "same number")
+})
+
+test_that("a set that fails is NA from there on and does not stop the others", {
+
+  out <- expect_warning(
+    cvode_batch(time_vec, IC, native("failing_rhs"), params[1:3, ], threads = 2),
+    "3 of 3 sets")
+  expect_true(all(attr(out, "status") < 0))
+  expect_true(all(is.na(out[-1, -1, ])))
+  expect_equal(out[, 1, 1], time_vec)
+})
+
+test_that("R functions are rejected", {
+
+  expect_error(cvode_batch(time_vec, IC, function(t, y, p) -y, params),
+               "cannot call R")
+  expect_error(cvode_batch(time_vec, IC, robertson, params, jacobian = function(t, y, p) diag(3)),
+               "cannot call R")
+})
+
+test_that("sets solved in lockstep groups give the solution of cvode()", {
+
+  rhss <- list(robertson, native("robertson_rhs"), native("robertson_rhs_ensemble"),
+               native("robertson_rhs_ensemble"))
+  jacs <- list(NULL, native("robertson_jac"), NULL, native("robertson_jac_ensemble"))
+  for (i in seq_along(rhss)) {
+    out <- cvode_batch(time_vec, IC, rhss[[i]], params, reltol, abstol,
+                       jacobian = jacs[[i]], threads = 2, ensemble = 5)
+    expect_equal(attr(out, "status"), integer(nrow(params)), info = i)
+    for (k in seq_len(nrow(params))) {
+      expect_equal(out[, , k], cvode(time_vec, IC, robertson, params[k, ], reltol, abstol),
+                   tolerance = 1e-3, info = paste(i, k))
+    }
+    # twelve sets in groups of five: the sets of a group share its steps
+    steps <- attr(out, "steps")
+    expect_true(all(steps[1:5] == steps[1]) && all(steps[6:10] == steps[6]) &&
+                all(steps[11:12] == steps[11]), info = i)
+  }
+
+  one <- cvode_batch(time_vec, IC, robertson, params, reltol, abstol, threads = 1,
+                     ensemble = 4)
+  three <- cvode_batch(time_vec, IC, robertson, params, reltol, abstol, threads = 3,
+                       ensemble = 4)
+  expect_identical(c(three), c(one))
+
+  expect_error(cvode_batch(time_vec, IC, robertson, params, ensemble = 0), "at least 1")
+})
+
+test_that("a group with a set that fails is solved again set by set", {
+
+  bad <- params
+  bad[3, 1] <- -1
+  out <- expect_warning(
+    cvode_batch(time_vec, IC, native("robertson_or_fail_rhs"), bad, reltol, abstol,
+                threads = 2, ensemble = 4),
+    "1 of 12 sets")
+  expect_true(attr(out, "status")[3] < 0)
+  expect_equal(attr(out, "status")[-3], integer(11))
+  for (k in c(1, 2, 4)) {
+    expect_equal(out[, , k], cvode(time_vec, IC, robertson, params[k, ], reltol, abstol),
+                 tolerance = 1e-6, info = k)
+  }
+})
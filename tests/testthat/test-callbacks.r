@@ -98,3 +98,40 @@ test_that("A solver still works normally after callbacks have failed", {
   expect_lt(abs(df[3, 2] - exp(-params[1] * 2)), 1e-6)
 
 })
+
+test_that("An R function that modifies its arguments does not affect the solve", {
+
+  ## the arguments are reused from one call to the next, so an assignment into
+  ## one must go to a copy rather than into the solver's buffer
+  decay_R <- function(t, y, p) {
+    ydot <- -p[1] * y
+    y[] <- NaN
+    p[] <- NaN
+    ydot
+  }
+  decay_DAE <- function(t, y, ydot, p) {
+    res <- -p[1] * y - ydot
+    y[] <- NaN
+    ydot[] <- NaN
+    res
+  }
+
+  t_out <- c(0, 1, 2)
+  exact <- exp(-params[1] * t_out)
+
+  expect_lt(max(abs(cvode(t_out, 1, decay_R, params, 1e-8, 1e-10)[, 2] - exact)), 1e-6)
+  expect_lt(max(abs(cvsolve(t_out, 1, decay_R, params, NULL, 1e-8, 1e-10)[, 2] - exact)), 1e-6)
+  expect_lt(max(abs(ida(t_out, 1, -params[1], decay_DAE, params, 1e-8, 1e-10)[, 2] - exact)), 1e-6)
+  expect_equal(params, c(0.5))
+
+})
+
+test_that("An R function returning integers is accepted", {
+
+  ## a non-double result is coerced, as it was before the buffers were reused
+  zero_R <- function(t, y, p) c(0L, 0L, 0L)
+
+  df <- cvode(time_vec, IC, zero_R, params)
+  expect_equal(unname(df[3, -1]), IC)
+
+})
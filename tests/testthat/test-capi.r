@@ -7,6 +7,9 @@ forceerr   <- sundialr:::.capi_test_force_error
 numsteps   <- sundialr:::.capi_test_num_steps
 cleanerr   <- sundialr:::.capi_test_clean_err
 abi        <- sundialr:::.capi_test_abi
+threads    <- sundialr:::.capi_test_threads
+batch      <- sundialr:::.capi_test_batch
+ensemble   <- sundialr:::.capi_test_ensemble
 
 test_that("scalar-tolerance decay matches the closed form", {
   # y' = -k y  ->  y(t) = y0 exp(-k t)
@@ -75,3 +78,65 @@ test_that("introspection: ABI version and step count", {
   expect_equal(abi(), 1L)
   expect_true(numsteps(8.0, 3.0, 0.6) > 0)
 })
+
+test_that("handles on different threads do not interfere", {
+  # each thread solves on its own handle, at the same time as the others; the
+  # results must be those of the same solves run one after another
+  expect_identical(threads(4L, 20L), 0)
+})
+
+test_that("a batch solves every item with its own udata and initial state", {
+  times <- seq(0, 10, by = 0.5)
+  A <- c(10, 5, 1, 20); k1 <- c(1.0, 0.5, 2.0, 0.1); k2 <- 0.3
+  res <- batch(times, A, k1, k2, use_jac = TRUE, n_threads = 2L)
+  expect_equal(res$flag, 0L)
+  expect_equal(res$status, integer(4))
+  expect_equal(dim(res$y), c(2, length(times) - 1, 4))
+  for (k in 1:4) {
+    # the output times after t0, as the single-handle solve gives them
+    single <- twocmt(times, A[k], k1[k], k2, use_jac = TRUE)[-1, ]
+    expect_equal(t(res$y[, , k]), single, tolerance = 1e-8, info = k)
+  }
+  # and the same without the Jacobian, on a different number of threads
+  fd <- batch(times, A, k1, k2, use_jac = FALSE, n_threads = 3L)
+  expect_equal(fd$y, res$y, tolerance = 1e-6)
+})
+
+test_that("a failed item of a batch is reported and leaves the others alone", {
+  times <- seq(0, 10, by = 0.5)
+  k1 <- c(1.0, -1, 2.0, -1, 0.1)
+  res <- batch(times, rep(10, 5), k1, 0.3, use_jac = TRUE, n_threads = 2L)
+  expect_true(res$flag < 0)
+  expect_true(all(res$status[c(2, 4)] < 0))
+  expect_equal(res$status[c(1, 3, 5)], integer(3))
+  expect_match(res$err, "^item 1: ")
+  expect_true(all(is.nan(res$y[, , c(2, 4)])))
+  expect_false(any(is.nan(res$y[, , c(1, 3, 5)])))
+})
+
+test_that("an ensemble solves each subject to its own tolerance", {
+  times <- seq(0, 10, by = 0.5)
+  A <- c(10, 5, 1, 20, 2); k1 <- c(1.0, 0.5, 2.0, 0.1, 0.7); k2 <- 0.3
+  res <- ensemble(times, A, k1, k2, use_jac = TRUE)
+  expect_equal(dim(res$y), c(2, length(times), 5))
+  for (k in 1:5) {
+    y1 <- A[k] * exp(-k1[k] * times)
+    y2 <- A[k] * k1[k] / (k2 - k1[k]) * (exp(-k1[k] * times) - exp(-k2 * times))
+    expect_equal(res$y[1, , k], y1, tolerance = 1e-6, info = k)
+    expect_equal(res$y[2, , k], y2, tolerance = 1e-6, info = k)
+  }
+  # the differences Jacobian of the whole ensemble does as well
+  fd <- ensemble(times, A, k1, k2, use_jac = FALSE)
+  expect_equal(fd$y, res$y, tolerance = 1e-6)
+  # sundialr_cvode_set_rhs() is refused on an ensemble handle (CV_ILL_INPUT)
+  expect_equal(res$rhs_flag, -22L)
+})
+
+test_that("an ensemble of one subject steps as a single handle does", {
+  times <- seq(0, 10, by = 0.5)
+  for (use_jac in c(TRUE, FALSE)) {
+    one <- ensemble(times, 10, 1.0, 0.3, use_jac = use_jac)
+    single <- twocmt(times, 10, 1.0, 0.3, use_jac = use_jac)
+    expect_equal(t(one$y[, , 1]), single, tolerance = 1e-12, info = use_jac)
+  }
+})
@@ -0,0 +1,94 @@
+context("Continuous solution of cvode() by dense output")
+
+ODE_R <- function(t, y, p) {
+  c(-p[1] * y[1] + p[2] * y[2] * y[3],
+     p[1] * y[1] - p[2] * y[2] * y[3] - p[3] * y[2]^2,
+     p[3] * y[2]^2)
+}
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3, 4E4)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+reltol   <- 1e-04
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+test_that("keeping the dense output does not change the solve", {
+
+  plain <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, stats = TRUE)
+  dense <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, stats = TRUE,
+                 dense_output = TRUE)
+  expect_identical(c(dense), c(plain))
+  expect_identical(attr(dense, "stats")$steps, attr(plain, "stats")$steps)
+
+  rec <- attr(dense, "dense_output")
+  expect_true(inherits(rec, "sundialr_dense_output"))
+  expect_equal(length(rec$order), attr(plain, "stats")$steps)
+  expect_true(all(rec$order >= 1 & rec$order <= 5))
+  expect_true(rec$time[length(rec$time)] >= 4E4)
+})
+
+test_that("it gives back the output times and interpolates between them", {
+
+  dense <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, dense_output = TRUE)
+  expect_equal(dense_eval(dense, time_vec), dense[, 1:4], tolerance = 1e-12)
+
+  # the attribute alone will do, and the times may come in any order
+  t_mid <- c(2, 0.1, 1000, 20)
+  expect_identical(dense_eval(attr(dense, "dense_output"), t_mid), dense_eval(dense, t_mid))
+
+  # against a solve that lands on those times itself
+  direct <- cvode(c(0, sort(t_mid)), IC, ODE_R, params, reltol, abstol)
+  expect_equal(dense_eval(dense, sort(t_mid)), direct[-1, ], tolerance = 1e-3)
+})
+
+test_that("it evaluates the solution and its derivatives to the tolerance", {
+
+  ## y' = -k y: y = y0 e^(-k t), y' = -k y
+  k <- 0.7
+  dense <- cvode(c(0, 10), 2, function(t, y, p) -p * y, k, 1e-10, 1e-12,
+                 dense_output = TRUE)
+  tt <- seq(0, 10, length.out = 101)
+  expect_equal(dense_eval(dense, tt)[, 2], 2 * exp(-k * tt), tolerance = 1e-7)
+  expect_equal(dense_eval(dense, tt, deriv = 1)[, 2], -k * 2 * exp(-k * tt),
+               tolerance = 1e-5)
+  expect_equal(dense_eval(dense, tt, deriv = 6)[, 2], numeric(101))
+})
+
+test_that("times outside the solve and solutions without dense output are refused", {
+
+  dense <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, dense_output = TRUE)
+  expect_error(dense_eval(dense, -1), "outside the interval")
+  expect_error(dense_eval(dense, 1e6), "outside the interval")
+  expect_error(dense_eval(dense, 1, deriv = -1), "0 or more")
+  expect_error(dense_eval(cvode(time_vec, IC, ODE_R, params, reltol, abstol), 1),
+               "no dense output")
+})
+
+test_that("a dense output changed in R is refused rather than read out of bounds", {
+
+  rec <- attr(cvode(time_vec, IC, ODE_R, params, reltol, abstol, dense_output = TRUE),
+              "dense_output")
+  last <- length(rec$order)
+
+  bad <- rec; bad$order[1] <- 9L
+  expect_error(dense_eval(bad, 1), "malformed")
+  bad <- rec; bad$order[last] <- 0L
+  expect_error(dense_eval(bad, 1), "malformed")
+  bad <- rec; bad$start[last] <- length(rec$deriv)
+  expect_error(dense_eval(bad, 1), "derivatives of step")
+  bad <- rec; bad$start[1] <- -3
+  expect_error(dense_eval(bad, 1), "derivatives of step 1")
+  bad <- rec; bad$deriv <- rec$deriv[-length(rec$deriv)]
+  expect_error(dense_eval(bad, 1), "malformed")
+  bad <- rec; bad$states <- 0L
+  expect_error(dense_eval(bad, 1), "malformed")
+})
+
+test_that("a solve that takes too many steps fails with dense output too", {
+
+  ## y'' = -10^4 y over 1600 periods: more than 500 steps to the one output time
+  OSC_R <- function(t, y, p) c(y[2], -1e4 * y[1])
+  expect_error(cvode(c(0, 100), c(1, 0), OSC_R, 0, 1e-6, 1e-8),
+               "mxstep steps taken before reaching tout")
+  expect_error(cvode(c(0, 100), c(1, 0), OSC_R, 0, 1e-6, 1e-8, dense_output = TRUE),
+               "mxstep steps taken before reaching tout")
+})
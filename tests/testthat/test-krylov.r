@@ -0,0 +1,148 @@
+context("Krylov linear solvers and preconditioners")
+
+## Diffusion with a quadratic sink on an m-by-m grid, the method of lines with
+## zero boundaries:
+##   y' = D * (discrete Laplacian of y) - k * y^2
+m  <- 8
+n  <- m * m
+LAP <- function(y) {
+  u <- matrix(y, m, m)
+  up    <- rbind(u[-1, ], 0)
+  down  <- rbind(0, u[-m, ])
+  right <- cbind(u[, -1], 0)
+  left  <- cbind(0, u[, -m])
+  as.vector(up + down + left + right - 4 * u)
+}
+GRID_R <- function(t, y, p) p[1] * LAP(y) - p[2] * y^2
+GRID_JTIMES <- function(t, y, v, p) p[1] * LAP(v) - 2 * p[2] * y * v
+
+tv     <- seq(0, 0.5, by = 0.1)
+y0     <- as.vector(outer(sin(pi * seq_len(m) / (m + 1)), sin(pi * seq_len(m) / (m + 1))))
+params <- c(20, 1)
+
+test_that("every Krylov solver gives the dense solution", {
+
+  dense <- cvode(tv, y0, GRID_R, params, 1e-8, 1e-10)
+  for (ls in c("spgmr", "spfgmr", "spbcgs", "sptfqmr", "pcg")) {
+    expect_equal(cvode(tv, y0, GRID_R, params, 1e-8, 1e-10, linear_solver = ls),
+                 dense, tolerance = 1e-6, info = ls)
+  }
+  expect_equal(cvode(tv, y0, GRID_R, params, 1e-8, 1e-10, linear_solver = "dense"),
+               dense)
+  expect_equal(cvsolve(tv, y0, GRID_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10, linear_solver = "spgmr"),
+               cvsolve(tv, y0, GRID_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10),
+               tolerance = 1e-6)
+})
+
+test_that("jtimes and an R preconditioner are used", {
+
+  dense <- cvode(tv, y0, GRID_R, params, 1e-8, 1e-10)
+
+  # the diagonal of I - gamma * J, prepared by psetup for psolve
+  jacobi <- function() {
+    d <- NULL
+    calls <- 0
+    list(
+      psetup = function(t, y, jok, gamma, p) {
+        d <<- 1 - gamma * (-4 * p[1] - 2 * p[2] * y)
+        calls <<- calls + 1
+        TRUE
+      },
+      psolve = function(t, y, r, gamma, p) r / d,
+      calls  = function() calls
+    )
+  }
+  pc <- jacobi()
+  expect_equal(cvode(tv, y0, GRID_R, params, 1e-8, 1e-10, linear_solver = "spgmr",
+                     jtimes = GRID_JTIMES, psetup = pc$psetup, psolve = pc$psolve),
+               dense, tolerance = 1e-6)
+  expect_gt(pc$calls(), 0)
+
+  expect_equal(cvode(tv, y0, GRID_R, params, 1e-8, 1e-10, linear_solver = "pcg",
+                     jtimes = GRID_JTIMES),
+               dense, tolerance = 1e-6)
+
+  # psolve alone, with nothing to prepare
+  expect_equal(cvode(tv, y0, GRID_R, params, 1e-8, 1e-10, linear_solver = "spbcgs",
+                     psolve = function(t, y, r, gamma, p) r / (1 + 4 * gamma * p[1])),
+               dense, tolerance = 1e-6)
+})
+
+test_that("a model's symbolic Jacobian gives the products", {
+
+  eqs <- lapply(seq_len(n), function(i) {
+    a <- (i - 1) %% m; b <- (i - 1) %/% m
+    nb <- c(if (a > 0) i - 1, if (a < m - 1) i + 1, if (b > 0) i - m, if (b < m - 1) i + m)
+    str2lang(sprintf("D * (%s - 4 * y[%d]) - k * y[%d]^2",
+                     paste(sprintf("y[%d]", nb), collapse = " + "), i, i))
+  })
+  grid <- ode_model(eqs, parameters = c("D", "k"))
+
+  expect_equal(cvode(tv, y0, grid, params, 1e-8, 1e-10, linear_solver = "spgmr"),
+               cvode(tv, y0, GRID_R, params, 1e-8, 1e-10),
+               tolerance = 1e-6)
+})
+
+test_that("compiled Krylov functions are accepted", {
+
+  native <- sundialr:::.native_test_xptr
+  rob_tv <- c(0, 0.4, 4, 40, 400)
+  rob_p  <- c(0.04, 10000, 30000000)
+  rob_at <- c(1e-8, 1e-14, 1e-6)
+  dense  <- cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p, 1e-4, rob_at,
+                  jacobian = native("robertson_jac"))
+
+  expect_equal(cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p, 1e-4, rob_at,
+                     linear_solver = "spgmr", jtimes = native("robertson_jtimes"),
+                     psetup = native("robertson_psetup"),
+                     psolve = native("robertson_psolve")),
+               dense, tolerance = 1e-4)
+
+  # the chain DAE of test-native.r
+  DAE_R <- function(t, y, ydot, p) {
+    c(-p[1] * y[1] - ydot[1], p[1] * y[1] - p[2] * y[2] - ydot[2], y[3] - y[1] - y[2])
+  }
+  tv  <- seq(0, 20, by = 2)
+  y0  <- c(1, 0, 1)
+  yp0 <- c(-0.5, 0.5, 0)
+  k   <- c(0.5, 0.2)
+  dae <- ida(tv, y0, yp0, DAE_R, k, 1e-8, 1e-10)
+  expect_equal(ida(tv, y0, yp0, native("chain_dae_res"), k, 1e-8, 1e-10,
+                   linear_solver = "spgmr", jtimes = native("chain_dae_jtimes"),
+                   psolve = native("chain_dae_psolve")),
+               dae, tolerance = 1e-6)
+  # and in R, the exact Newton matrix as the preconditioner
+  M <- function(cj, p) matrix(c(-p[1] - cj, p[1], -1, 0, -p[2] - cj, -1, 0, 0, 1), 3, 3)
+  expect_equal(ida(tv, y0, yp0, DAE_R, k, 1e-8, 1e-10, linear_solver = "sptfqmr",
+                   jtimes = function(t, y, ydot, v, cj, p) as.vector(M(cj, p) %*% v),
+                   psolve = function(t, y, ydot, r, cj, p) solve(M(cj, p), r)),
+               dae, tolerance = 1e-6)
+
+  # a CVODE function is not an IDA one
+  expect_error(ida(tv, y0, yp0, DAE_R, k, linear_solver = "spgmr",
+                   jtimes = native("robertson_jtimes")),
+               "not a valid compiled function of type sundialr_jtimes_ida")
+})
+
+test_that("invalid Krylov arguments are rejected before the solve", {
+
+  expect_error(cvode(tv, y0, GRID_R, params, linear_solver = "gmres"),
+               "Unknown linear_solver \"gmres\"")
+  expect_error(cvode(tv, y0, GRID_R, params, linear_solver = c("spgmr", "pcg")),
+               "linear_solver must be a single string")
+  expect_error(cvode(tv, y0, GRID_R, params, linear_solver = "spgmr", mupper = 1, mlower = 1),
+               "cannot be combined with linear_solver = \"spgmr\"")
+  expect_error(cvode(tv, y0, GRID_R, params, linear_solver = "spgmr",
+                     jacobian = function(t, y, p) diag(n)),
+               "A Krylov linear_solver uses no Jacobian matrix")
+  expect_error(cvode(tv, y0, GRID_R, params, jtimes = GRID_JTIMES),
+               "used only with a Krylov linear_solver")
+  expect_error(cvode(tv, y0, GRID_R, params, linear_solver = "spgmr",
+                     psetup = function(t, y, jok, gamma, p) TRUE),
+               "psolve, which must be given too")
+  expect_error(cvode(tv, y0, GRID_R, params, linear_solver = "spgmr",
+                     jtimes = function(t, y, v, p) v[-1]),
+               "The jtimes function must return a vector of the same length")
+})
@@ -0,0 +1,52 @@
+context("Dense linear solver using R's LAPACK")
+
+## A stiff, fully coupled linear system plus a quadratic sink:
+##   y' = A y - k * y^2, A a random matrix shifted to be stable
+n <- 40
+set.seed(7)
+A <- matrix(rnorm(n * n), n, n) / sqrt(n) - 5 * diag(n)
+LIN_R   <- function(t, y, p) as.vector(A %*% y) - p[1] * y^2
+LIN_JAC <- function(t, y, p) A - diag(2 * p[1] * y)
+
+tv <- seq(0, 2, by = 0.25)
+y0 <- seq(0.5, 1.5, length.out = n)
+
+test_that("lapack_dense gives the dense solution", {
+
+  skip_if_not(sundialr_has_lapack(), "no LAPACK was linked")
+
+  dense <- cvode(tv, y0, LIN_R, 0.3, 1e-8, 1e-10)
+  expect_equal(cvode(tv, y0, LIN_R, 0.3, 1e-8, 1e-10, linear_solver = "lapack_dense"),
+               dense, tolerance = 1e-6)
+  expect_equal(cvode(tv, y0, LIN_R, 0.3, 1e-8, 1e-10, jacobian = LIN_JAC,
+                     linear_solver = "lapack_dense"),
+               dense, tolerance = 1e-6)
+  expect_equal(cvsolve(tv, y0, LIN_R, 0.3, reltolerance = 1e-8, abstolerance = 1e-10,
+                       linear_solver = "lapack_dense"),
+               cvsolve(tv, y0, LIN_R, 0.3, reltolerance = 1e-8, abstolerance = 1e-10),
+               tolerance = 1e-6)
+
+  LIN_DAE <- function(t, y, ydot, p) LIN_R(t, y, p) - ydot
+  yp0 <- LIN_R(0, y0, 0.3)
+  expect_equal(ida(tv, y0, yp0, LIN_DAE, 0.3, 1e-8, 1e-10, linear_solver = "lapack_dense"),
+               ida(tv, y0, yp0, LIN_DAE, 0.3, 1e-8, 1e-10),
+               tolerance = 1e-6)
+})
+
+test_that("lapack_dense is a dense solver only", {
+
+  skip_if_not(sundialr_has_lapack(), "no LAPACK was linked")
+
+  expect_error(cvode(tv, y0, LIN_R, 0.3, linear_solver = "lapack_dense",
+                     mupper = 1, mlower = 1),
+               "cannot be combined with linear_solver = \"lapack_dense\"")
+})
+
+test_that("lapack_dense says so when no LAPACK was linked", {
+
+  # configure leaves "lapack_dense" out when no LAPACK could be linked
+  skip_if(sundialr_has_lapack(), "LAPACK was linked")
+
+  expect_error(cvode(tv, y0, LIN_R, 0.3, linear_solver = "lapack_dense"),
+               "is not available: no LAPACK could be linked")
+})
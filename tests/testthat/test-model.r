@@ -0,0 +1,167 @@
+context("Models compiled from R expressions with ode_model()")
+
+ODE_R <- function(t, y, p){
+  ydot = vector(mode = "numeric", length = length(y))
+  ydot[1] = -p[1]*y[1] + p[2]*y[2]*y[3]
+  ydot[2] = p[1]*y[1] - p[2]*y[2]*y[3] - p[3]*y[2]*y[2]
+  ydot[3] = p[3]*y[2]*y[2]
+  ydot
+}
+
+robertson <- ode_model(
+  list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+       y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+       y3 = quote( k3 * y2^2)),
+  parameters = c("k1", "k2", "k3"))
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3, 4E4, 4E5, 4E6, 4E7, 4E8, 4E9, 4E10)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+reltol   <- 1e-04
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+test_that("a model gives the same solution as the R function", {
+
+  df_r <- cvode(time_vec, IC, ODE_R, params, reltol, abstol)
+  df_m <- cvode(time_vec, IC, robertson, params, reltol, abstol)
+
+  expect_equal(df_m, df_r, tolerance = 1e-6)
+  expect_equal(attr(robertson, "states"), c("y1", "y2", "y3"))
+  expect_equal(attr(robertson, "parameters"), c("k1", "k2", "k3"))
+})
+
+test_that("y[i], p[i], formulas and expression() are accepted", {
+
+  indexed <- ode_model(
+    list(~ -p[1]*y[1] + p[2]*y[2]*y[3],
+         expression(p[1]*y[1] - p[2]*y[2]*y[3] - p[3]*y[2]*y[2]),
+         quote(p[3]*y[2]*y[2])),
+    parameters = c("k1", "k2", "k3"))
+
+  expect_equal(cvode(time_vec, IC, indexed, params, reltol, abstol),
+               cvode(time_vec, IC, robertson, params, reltol, abstol),
+               tolerance = 1e-6)
+})
+
+test_that("functions, comparisons and ifelse evaluate as in R", {
+
+  # each state integrates a constant-in-y expression, so y(1) is its value at
+  # t = 0 when the expression does not depend on t
+  exprs <- list(a = quote(exp(k) + log(k) + sqrt(k) + log10(k) + log(k, 2)),
+                b = quote(sin(k) * cos(k) / tan(k) + atan(k) + tanh(k) + abs(-k)),
+                c = quote(max(k, 2, 0.5) - min(k, 2) + k^3 + k^-2 + k^1.5),
+                d = quote(ifelse(k > 1 & k <= 3, 10, 20) + (k == 2) + !(k != 2)),
+                e = quote(if (t < 0.5) 1 else 3))
+  m <- ode_model(exprs, parameters = "k")
+  k <- 2
+  expect_r <- c(exp(k) + log(k) + sqrt(k) + log10(k) + log(k, 2),
+                sin(k) * cos(k) / tan(k) + atan(k) + tanh(k) + abs(-k),
+                max(k, 2, 0.5) - min(k, 2) + k^3 + k^-2 + k^1.5,
+                ifelse(k > 1 & k <= 3, 10, 20) + (k == 2) + !(k != 2),
+                2)   # 1 for half the interval, 3 for the other half
+  sol <- cvode(c(0, 1), rep(0, 5), m, k, 1e-10, 1e-10)
+  expect_equal(unname(sol[2, -1]), expect_r, tolerance = 1e-4)
+})
+
+test_that("infinite and NaN values give the same results as in R", {
+
+  # 0*k, k - k and 0/k are NaN for an infinite or NaN k, so none of them may be
+  # simplified to 0; nor may k/3 become k*(1/3), or k^0.5 become sqrt(k); and
+  # k + 0 and 0 - k are +0 for k = -0 and k = 0, which 1/ tells from -0
+  m <- ode_model(list(A = quote(-A)), parameters = "k")
+  obs <- list(a = quote(0 * k), b = quote(k - k), c = quote(0 / k),
+              d = quote(k / 3), e = quote(k^0.5), f = quote(k * 1 + 0),
+              g = quote(1 / (k + 0)), h = quote(1 / (0 - k)))
+  for (k in c(Inf, -Inf, NaN, 0, -0, 3)) {
+    out <- cvode(c(0, 1), 1, m, k, outputs = obs)
+    expect_identical(unname(out[1, -1]),
+                     c(0 * k, k - k, 0 / k, k / 3, k^0.5, k * 1 + 0,
+                       1 / (k + 0), 1 / (0 - k)))
+  }
+
+  # constant integer powers are R's own, not repeated multiplication, which
+  # overflows in 1/k^2 for k = 1e160 and gathers rounding errors in k^63
+  powers <- list(a = quote(k^-2), b = quote(k^63), c = quote(k^3),
+                 d = quote(k^-1), e = quote(k^2))
+  for (k in c(1e160, 1.1, -1.7, 0.3, -0, Inf, -Inf, NaN)) {
+    out <- cvode(c(0, 1), 1, m, k, outputs = powers)
+    expect_identical(unname(out[1, -1]), c(k^-2, k^63, k^3, k^-1, k^2))
+  }
+})
+
+test_that("cvsolve and cvodes accept a model", {
+
+  TSAMP  <- seq(from = 0, to = 10, by = 0.5)
+  Events <- data.frame(ID = 1, TIMES = c(2, 6), VAL = c(0.5, 0.5))
+  expect_equal(cvsolve(TSAMP, IC, robertson, params, Events, reltol, abstol),
+               cvsolve(TSAMP, IC, ODE_R, params, Events, reltol, abstol),
+               tolerance = 1e-6)
+
+  tv <- time_vec[1:7]
+  expect_equal(cvodes(tv, IC, robertson, params, 1e-6, abstol, "STG", FALSE),
+               cvodes(tv, IC, ODE_R, params, 1e-6, abstol, "STG", FALSE),
+               tolerance = 1e-4)
+})
+
+test_that("invalid models and mismatched inputs are reported", {
+
+  expect_error(ode_model(list(a = quote(-k * a))), "unknown name 'k'")
+  expect_error(ode_model(list(a = quote(foo(a)))), "unsupported function foo")
+  expect_error(ode_model(list(a = quote(-y[2])), "index y\\[2\\] is out of range")
+  expect_error(ode_model(list(a = quote(-a), a = quote(a))), "state names must be unique")
+  expect_error(ode_model(list()), "at least one equation")
+
+  expect_error(cvode(time_vec, c(1, 0), robertson, params),
+               "model has 3 states but the initial conditions have 2")
+  expect_error(cvode(time_vec, IC, robertson, params[1:2]),
+               "model has 3 parameters but Parameters has 2")
+})
+
+test_that("the symbolic Jacobian keeps only the structural nonzeros", {
+
+  # of the 9 entries, d(y3')/d(y1) and d(y3')/d(y3) are structurally zero
+  expect_equal(attr(robertson, "jacobian_nonzeros"), 7L)
+
+  no_jac <- ode_model(
+    list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+         y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+         y3 = quote( k3 * y2^2)),
+    parameters = c("k1", "k2", "k3"), jacobian = FALSE)
+  expect_null(attr(no_jac, "jacobian_nonzeros"))
+
+  JAC_R <- function(t, y, p){
+    matrix(c(
+      -p[1],                              p[1],                   0,
+       p[2]*y[3],   -p[2]*y[3] - 2*p[3]*y[2],   2*p[3]*y[2],
+       p[2]*y[2],               -p[2]*y[2],                   0
+    ), nrow = 3, ncol = 3)
+  }
+
+  df_ref <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, jacobian = JAC_R)
+  df_sym <- cvode(time_vec, IC, robertson, params, reltol, abstol)
+  df_fd  <- cvode(time_vec, IC, no_jac, params, reltol, abstol)
+  df_usr <- cvode(time_vec, IC, robertson, params, reltol, abstol, jacobian = JAC_R)
+
+  # the symbolic Jacobian is the analytic one, up to rounding
+  expect_equal(df_sym, df_ref)
+  expect_equal(df_usr, df_ref)
+  expect_equal(df_fd, df_ref, tolerance = 1e-6)
+})
+
+test_that("symbolic derivatives of functions match finite differences", {
+
+  # y' = f(y) with f built from every differentiable function; a solve with
+  # the symbolic Jacobian must match one with the finite-difference Jacobian
+  exprs <- list(
+    u = quote(-0.1 * u + 0.01 * sin(v) * exp(-u) + log(1 + u^2) / (2 + v)),
+    v = quote(-0.2 * v + 0.05 * atan(u * v) + sqrt(1 + v^2) * tanh(u) / 10),
+    w = quote(-w + ifelse(u > v, cosh(u) / 10, abs(v - u)) + max(u, w)^2 / 100))
+  sym <- ode_model(exprs)
+  fd  <- ode_model(exprs, jacobian = FALSE)
+  tv  <- seq(0, 20, by = 2)
+  y0  <- c(1, 0.5, 0.2)
+
+  expect_equal(cvode(tv, y0, sym, numeric(0), 1e-8, 1e-10),
+               cvode(tv, y0, fd, numeric(0), 1e-8, 1e-10),
+               tolerance = 1e-6)
+})
@@ -0,0 +1,157 @@
+context("Compiled right-hand sides and Jacobians passed as external pointers")
+
+# The test models are compiled into the package (src/native_test.cpp) and
+# handed out through an unexported driver, exactly as a consumer's own
+# sundialr_xptr_*() wrappers would hand out theirs.
+native <- sundialr:::.native_test_xptr
+
+ODE_R <- function(t, y, p){
+  ydot = vector(mode = "numeric", length = length(y))
+  ydot[1] = -p[1]*y[1] + p[2]*y[2]*y[3]
+  ydot[2] = p[1]*y[1] - p[2]*y[2]*y[3] - p[3]*y[2]*y[2]
+  ydot[3] = p[3]*y[2]*y[2]
+  ydot
+}
+
+JAC_R <- function(t, y, p){
+  matrix(c(
+    -p[1],                              p[1],                   0,
+     p[2]*y[3],   -p[2]*y[3] - 2*p[3]*y[2],   2*p[3]*y[2],
+     p[2]*y[2],               -p[2]*y[2],                   0
+  ), nrow = 3, ncol = 3)
+}
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3, 4E4, 4E5, 4E6, 4E7, 4E8, 4E9, 4E10)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+reltol   <- 1e-04
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+test_that("a compiled RHS gives the same solution as the R function", {
+
+  df_r   <- cvode(time_vec, IC, ODE_R, params, reltol, abstol)
+  df_nat <- cvode(time_vec, IC, native("robertson_rhs"), params, reltol, abstol)
+
+  # the same arithmetic in the same order, so the solver takes the same steps
+  expect_equal(df_nat, df_r)
+})
+
+test_that("compiled and R Jacobians can be combined with either form of RHS", {
+
+  df_ref <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, jacobian = JAC_R)
+
+  nat_nat <- cvode(time_vec, IC, native("robertson_rhs"), params, reltol, abstol,
+                   jacobian = native("robertson_jac"))
+  r_nat   <- cvode(time_vec, IC, ODE_R, params, reltol, abstol,
+                   jacobian = native("robertson_jac"))
+  nat_r   <- cvode(time_vec, IC, native("robertson_rhs"), params, reltol, abstol,
+                   jacobian = JAC_R)
+
+  expect_equal(nat_nat, df_ref)
+  expect_equal(r_nat, df_ref)
+  expect_equal(nat_r, df_ref)
+})
+
+test_that("cvsolve accepts a compiled RHS and Jacobian", {
+
+  TSAMP  <- seq(from = 0, to = 10, by = 0.5)
+  Events <- data.frame(ID = 1, TIMES = c(2, 6), VAL = c(0.5, 0.5))
+
+  df_r   <- cvsolve(TSAMP, IC, ODE_R, params, Events, reltol, abstol,
+                    jacobian = JAC_R)
+  df_nat <- cvsolve(TSAMP, IC, native("robertson_rhs"), params, Events,
+                    reltol, abstol, jacobian = native("robertson_jac"))
+
+  expect_equal(df_nat, df_r)
+})
+
+test_that("a pointer of the wrong type is rejected before the solve", {
+
+  expect_error(cvode(time_vec, IC, native("robertson_jac"), params, reltol, abstol),
+               "not a valid compiled RHS")
+  expect_error(cvode(time_vec, IC, ODE_R, params, reltol, abstol,
+                     jacobian = native("robertson_rhs")),
+               "not a valid compiled Jacobian")
+  expect_error(cvode(time_vec, IC, ODE_R, params, reltol, abstol, jacobian = 1),
+               "Jacobian must be an R or Rcpp function")
+})
+
+test_that("a failure code returned by a compiled RHS stops the solve", {
+
+  expect_error(cvode(time_vec, IC, native("failing_rhs"), params, reltol, abstol))
+  expect_error(cvsolve(time_vec, IC, native("failing_rhs"), params))
+})
+
+test_that("ida accepts a compiled residual and Jacobian", {
+
+  # the closed-form DAE of test-ida.r
+  DAE_R <- function(t, y, ydot, p) {
+    c(
+      -p[1] * y[1] - ydot[1],
+       p[1] * y[1] - p[2] * y[2] - ydot[2],
+       y[3] - y[1] - y[2]
+    )
+  }
+  JAC_IDA <- function(t, y, ydot, cj, p) {
+    matrix(c(
+      -p[1] - cj,   p[1],         -1,
+       0,          -p[2] - cj,    -1,
+       0,           0,             1
+    ), nrow = 3, ncol = 3)
+  }
+  tv    <- seq(0, 20, by = 2)
+  y0    <- c(1, 0, 1)
+  yp0   <- c(-0.5, 0.5, 0)
+  k     <- c(0.5, 0.2)
+  atol  <- rep(1e-10, 3)
+
+  df_r   <- ida(tv, y0, yp0, DAE_R, k, 1e-8, atol, jacobian = JAC_IDA)
+  df_nat <- ida(tv, y0, yp0, native("chain_dae_res"), k, 1e-8, atol,
+                jacobian = native("chain_dae_jac"))
+  r_nat  <- ida(tv, y0, yp0, DAE_R, k, 1e-8, atol,
+                jacobian = native("chain_dae_jac"))
+  nat_fd <- ida(tv, y0, yp0, native("chain_dae_res"), k, 1e-8, atol)
+
+  expect_equal(df_nat, df_r)
+  expect_equal(r_nat, df_r)
+  expect_equal(nat_fd, df_r, tolerance = 1e-6)
+
+  # an ODE right-hand side or a CVODE Jacobian is not a residual or IDA Jacobian
+  expect_error(ida(tv, y0, yp0, native("robertson_rhs"), k, 1e-8, atol),
+               "not a valid compiled residual")
+  expect_error(ida(tv, y0, yp0, DAE_R, k, 1e-8, atol,
+                   jacobian = native("robertson_jac")),
+               "not a valid compiled IDA Jacobian")
+})
+
+test_that("cvodes accepts compiled sensitivity right-hand sides in both forms", {
+
+  SENS_R <- function(t, y, ydot, iS, yS, p) {
+    J <- JAC_R(t, y, p)
+    dfdp <- switch(iS,
+                   c(-y[1],      y[1],       0),
+                   c( y[2]*y[3], -y[2]*y[3], 0),
+                   c( 0,        -y[2]^2,     y[2]^2))
+    as.numeric(J %*% yS + dfdp)
+  }
+  tv <- time_vec[1:7]
+
+  ana_r  <- cvodes(tv, IC, ODE_R, params, 1e-6, abstol, "STG", FALSE,
+                   sensitivity = SENS_R)
+  all_at <- cvodes(tv, IC, native("robertson_rhs"), params, 1e-6, abstol,
+                   "STG", FALSE, jacobian = native("robertson_jac"),
+                   sensitivity = native("robertson_sens"))
+  per_p  <- cvodes(tv, IC, native("robertson_rhs"), params, 1e-6, abstol,
+                   "SIM", FALSE, sensitivity = native("robertson_sens1"))
+  fd_nat <- cvodes(tv, IC, native("robertson_rhs"), params, 1e-6, abstol,
+                   "STG", FALSE)
+
+  expect_equal(all_at, ana_r, tolerance = 1e-3)
+  expect_equal(per_p, ana_r, tolerance = 1e-3)
+  # finite differences perturb the parameters the compiled RHS reads via udata
+  expect_equal(fd_nat, ana_r, tolerance = 1e-3)
+
+  expect_error(cvodes(tv, IC, ODE_R, params, 1e-6, abstol, "STG", FALSE,
+                      sensitivity = native("robertson_rhs")),
+               "not a valid compiled sensitivity RHS")
+})
@@ -0,0 +1,101 @@
+context("Storing only some states or observables with outputs")
+
+native <- sundialr:::.native_test_xptr
+
+robertson <- ode_model(
+  list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+       y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+       y3 = quote( k3 * y2^2)),
+  parameters = c("k1", "k2", "k3"))
+
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+reltol   <- 1e-04
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+test_that("states chosen by index or name are the columns of the full solution", {
+
+  full <- cvode(time_vec, IC, robertson, params, reltol, abstol)
+  expect_identical(cvode(time_vec, IC, robertson, params, reltol, abstol,
+                         outputs = c(3, 1)), full[, c(1, 4, 2)])
+  expect_identical(cvode(time_vec, IC, robertson, params, reltol, abstol,
+                         outputs = c("y3", "y1")), full[, c(1, 4, 2)])
+  expect_identical(cvode(time_vec, IC, robertson, params, reltol, abstol,
+                         outputs = 1:3), full)
+
+  steps <- cvode(time_vec, IC, robertson, params, reltol, abstol, output = "steps")
+  expect_identical(cvode(time_vec, IC, robertson, params, reltol, abstol,
+                         output = "steps", outputs = 2), steps[, c(1, 3)])
+})
+
+test_that("observables are computed from the states at each output time", {
+
+  full <- cvode(time_vec, IC, robertson, params, reltol, abstol)
+  obs <- list(total = quote(y1 + y2 + y3), rate = ~ k1 * y1, late = quote(t * y[3]))
+  out <- cvode(time_vec, IC, robertson, params, reltol, abstol, outputs = obs)
+  expect_equal(dim(out), c(length(time_vec), 4))
+  expect_equal(out[, 2], rowSums(full[, 2:4]))
+  expect_equal(out[, 3], params[1] * full[, 2])
+  expect_equal(out[, 4], full[, 1] * full[, 4])
+
+  # an R function has no names, but y[i] and p[i] work with it too
+  rhs <- function(t, y, p) c(-p[1]*y[1] + p[2]*y[2]*y[3],
+                             p[1]*y[1] - p[2]*y[2]*y[3] - p[3]*y[2]^2,
+                             p[3]*y[2]^2)
+  out <- cvode(time_vec, IC, rhs, params, reltol, abstol,
+               outputs = expression(y[1] + y[2] + y[3]))
+  expect_equal(out[, 2], rep(1, length(time_vec)), tolerance = 1e-6)
+
+  # the compiled observables, total and rate, fail after t = 100
+  nat <- cvode(time_vec[1:4], IC, native("robertson_rhs"), params, reltol, abstol,
+               outputs = native("robertson_outputs"))
+  expect_equal(nat, cvode(time_vec[1:4], IC, robertson, params, reltol, abstol,
+                          outputs = obs[1:2]), tolerance = 1e-6)
+  expect_error(cvode(time_vec, IC, native("robertson_rhs"), params, reltol, abstol,
+                     outputs = native("robertson_outputs")),
+               "the outputs function failed at t = 400")
+})
+
+test_that("a bad outputs argument is an error", {
+
+  rhs <- native("robertson_rhs")
+  expect_error(cvode(time_vec, IC, robertson, params, outputs = 4),
+               "outputs must be whole numbers between 1 and 3")
+  expect_error(cvode(time_vec, IC, robertson, params, outputs = "y4"),
+               "the model has no state named 'y4'")
+  expect_error(cvode(time_vec, IC, rhs, params, outputs = "y1"),
+               "only a model built by ode_model\\(\\) has")
+  expect_error(cvode(time_vec, IC, rhs, params, outputs = list(quote(y1))),
+               "outputs: unknown name 'y1' in output 1")
+  expect_error(cvode(time_vec, IC, rhs, params, outputs = list()),
+               "outputs must not be empty")
+  expect_error(cvode(time_vec, IC, rhs, params, outputs = TRUE),
+               "outputs must be NULL")
+})
+
+test_that("cvode_batch() allocates only the outputs of every set", {
+
+  sets <- cbind(seq(0.01, 0.1, length.out = 6), 10000, 30000000)
+  obs <- list(total = quote(y1 + y2 + y3), rate = quote(k1 * y1))
+  for (ensemble in c(1, 4)) {
+    out <- cvode_batch(time_vec, IC, robertson, sets, reltol, abstol, threads = 2,
+                       ensemble = ensemble, outputs = obs)
+    full <- cvode_batch(time_vec, IC, robertson, sets, reltol, abstol, threads = 2,
+                        ensemble = ensemble)
+    expect_equal(dim(out), c(length(time_vec), 3, nrow(sets)))
+    for (k in seq_len(nrow(sets))) {
+      expect_equal(out[, 2, k], rowSums(full[, 2:4, k]), info = k)
+      expect_equal(out[, 3, k], sets[k, 1] * full[, 2, k], info = k)
+    }
+    expect_identical(cvode_batch(time_vec, IC, robertson, sets, reltol, abstol,
+                                 ensemble = ensemble, outputs = "y2"),
+                     full[, c(1, 3), , drop = FALSE])
+  }
+
+  # a compiled outputs function that fails gives NA for those times
+  out <- cvode_batch(time_vec, IC, native("robertson_rhs"), sets, reltol, abstol,
+                     outputs = native("robertson_outputs"))
+  expect_true(all(is.na(out[5:6, 2:3, ])))
+  expect_false(anyNA(out[1:4, , ]))
+})
@@ -0,0 +1,44 @@
+context("Performance baselines")
+
+problems  <- stiff_problems()
+baselines <- perf_baselines()
+
+test_that("the baselines name every case of the gate", {
+
+  expect_equal(names(baselines), c("problem", "solver", "steps", "rhs_evals",
+                                   "jac_evals", "count_tol", "time_norm"))
+  cases <- perf_cases(problems)
+  expect_setequal(paste(baselines$problem, baselines$solver),
+                  paste(cases$problem, cases$solver))
+  expect_true(all(baselines$count_tol >= 0.02))
+})
+
+test_that("no solve takes more steps or evaluations than its baseline allows", {
+
+  # the counts may move beyond a tight tolerance with another platform's
+  # compiler or maths library
+  skip_on_cran()
+  timing <- perf_timing()
+  unit <- if (timing) perf_unit() else NA
+  for (i in seq_len(nrow(baselines))) {
+    expect_no_perf_regression(baselines[i, ], problems, timing, unit)
+  }
+})
+
+test_that("an increase beyond the tolerance is reported, and only that", {
+
+  baseline <- data.frame(problem = "brusselator", solver = "cvode", steps = 200,
+                         rhs_evals = 300, jac_evals = 4, count_tol = 0.05,
+                         time_norm = 2, stringsAsFactors = FALSE)
+  within <- c(steps = 210, rhs_evals = 315, jac_evals = 4)
+  expect_length(perf_check(baseline, within), 0)
+
+  msgs <- perf_check(baseline, c(steps = 211, rhs_evals = 300, jac_evals = 4))
+  expect_length(msgs, 1)
+  expect_match(msgs, "brusselator cvode: steps rose from 200 to 211")
+
+  expect_length(perf_check(baseline, within, time_norm = 2.9), 0)
+  expect_match(perf_check(baseline, within, time_norm = 3.1), "normalised time")
+  baseline$time_norm <- NA
+  expect_length(perf_check(baseline, within, time_norm = 100), 0)
+})
@@ -0,0 +1,97 @@
+context("Callback profile")
+
+## The Robertson problem of test-cvode.r
+ODE_R <- function(t, y, p){
+  r = rep(NA, length(y))
+  r[1] <- -p[1]*y[1] + p[2]*y[2]*y[3]
+  r[3] <- p[3]*y[2]*y[2]
+  r[2] <- -r[1] - r[3]
+  return(r)
+}
+JAC_R <- function(t, y, p) {
+  matrix(c(-p[1], p[1], 0,
+           p[2]*y[3], -p[2]*y[3] - 2*p[3]*y[2], 2*p[3]*y[2],
+           p[2]*y[2], -p[2]*y[2], 0), 3, 3)
+}
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+columns <- c("callback", "calls", "total_ns", "mean_ns", "marshal_ns", "user_ns")
+
+test_that("the profile is attached only when asked for, leaving the solution as it was", {
+
+  plain <- cvode(time_vec, IC, ODE_R, params, 1e-04, abstol, jacobian = JAC_R)
+  expect_null(attr(plain, "profile"))
+
+  df <- cvode(time_vec, IC, ODE_R, params, 1e-04, abstol, jacobian = JAC_R,
+              profile = TRUE)
+  pr <- attr(df, "profile")
+  attr(df, "profile") <- NULL
+  expect_equal(df, plain)
+
+  expect_true(is.data.frame(pr))
+  expect_equal(names(pr), columns)
+  expect_equal(pr$callback, c("rhs", "jacobian"))
+  expect_true(all(pr$calls > 0))
+  expect_equal(pr$marshal_ns + pr$user_ns, pr$total_ns)
+  expect_equal(pr$mean_ns, pr$total_ns / pr$calls)
+  expect_true(all(pr$user_ns >= 0 & pr$user_ns <= pr$total_ns))
+})
+
+test_that("the calls agree with the integrator's counters", {
+
+  df <- cvode(time_vec, IC, ODE_R, params, 1e-04, abstol, jacobian = JAC_R,
+              stats = TRUE, profile = TRUE)
+  st <- attr(df, "stats")
+  pr <- attr(df, "profile")
+  expect_equal(pr$calls[pr$callback == "rhs"], st$rhs_evals + st$rhs_evals_lin)
+  expect_equal(pr$calls[pr$callback == "jacobian"], st$jac_evals)
+  expect_lte(sum(pr$total_ns) / 1e9, st$time_total)
+})
+
+test_that("a slow R function shows as user time, not marshalling", {
+
+  SLOW_R <- function(t, y, p) {
+    Sys.sleep(0.001)
+    ODE_R(t, y, p)
+  }
+  pr <- attr(cvode(c(0, 0.4), IC, SLOW_R, params, 1e-04, abstol, jacobian = JAC_R,
+                   profile = TRUE), "profile")
+  rhs <- pr[pr$callback == "rhs", ]
+  expect_gte(rhs$mean_ns, 1e6)
+  expect_gt(rhs$user_ns, rhs$marshal_ns)
+})
+
+test_that("every solver names its callbacks", {
+
+  # a sparse solve without a Jacobian evaluates the right-hand side inside it
+  pr <- attr(cvsolve(time_vec, IC, ODE_R, params, reltolerance = 1e-04,
+                     abstolerance = abstol, sparsity = matrix(TRUE, 3, 3),
+                     profile = TRUE), "profile")
+  expect_setequal(pr$callback, c("rhs", "jacobian"))
+  jac <- pr[pr$callback == "jacobian", ]
+  expect_gt(jac$user_ns, 0)
+
+  pr <- attr(cvodes(time_vec, IC, ODE_R, params, 1e-04, abstol, "STG", FALSE,
+                    profile = TRUE), "profile")
+  expect_true(all(c("rhs", "ewt") %in% pr$callback))
+  expect_equal(pr$user_ns[pr$callback == "ewt"], 0)
+
+  DAE_R <- function(t, y, ydot, p) {
+    c(-p[1] * y[1] - ydot[1], p[1] * y[1] - p[2] * y[2] - ydot[2], y[3] - y[1] - y[2])
+  }
+  pr <- attr(ida(seq(0, 20, by = 2), c(1, 0, 1), c(-0.5, 0.5, 0), DAE_R, c(0.5, 0.2),
+                 1e-8, 1e-10, profile = TRUE), "profile")
+  expect_true("residual" %in% pr$callback)
+  expect_false("rhs" %in% pr$callback)
+
+  # compiled Krylov functions are profiled like R ones
+  native <- sundialr:::.native_test_xptr
+  pr <- attr(cvode(time_vec, IC, native("robertson_rhs"), params, 1e-04, abstol,
+                   linear_solver = "spgmr", jtimes = native("robertson_jtimes"),
+                   psetup = native("robertson_psetup"),
+                   psolve = native("robertson_psolve"), profile = TRUE), "profile")
+  expect_true(all(c("rhs", "jtimes", "psolve") %in% pr$callback))
+})
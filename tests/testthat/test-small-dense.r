@@ -0,0 +1,42 @@
+context("Dense linear solver specialised to small systems")
+
+small_dense <- sundialr:::.small_dense_test
+
+test_that("it solves as SUNDIALS' dense solver does, to the last bit", {
+
+  set.seed(11)
+  for (n in 1:16) {
+    A <- matrix(rnorm(n * n), n, n)
+    b <- rnorm(n)
+    res <- small_dense(A, b)
+    expect_identical(res$small, res$dense, info = n)
+    expect_equal(res$small$x, solve(A, b), tolerance = 1e-8, info = n)
+  }
+})
+
+test_that("a singular matrix fails at the same column", {
+
+  A <- matrix(c(1, 2, 3, 2, 4, 6, 0, 1, 5), 3, 3)
+  res <- small_dense(A, c(1, 1, 1))
+  expect_identical(res$small, res$dense)
+  expect_true(res$small$flag > 0)
+})
+
+test_that("cvode() solves a coupled linear system of 16 states exactly", {
+
+  ## y' = M y, M stable with distinct real eigenvalues: y(t) = V e^(L t) V^-1 y0
+  n <- 16
+  set.seed(3)
+  V <- diag(n) + matrix(runif(n * n, -0.2, 0.2), n, n)
+  L <- -seq(0.5, 200, length.out = n)
+  M <- V %*% diag(L) %*% solve(V)
+  y0 <- seq(1, 2, length.out = n)
+  tv <- c(0, 0.1, 0.5, 1, 2)
+  exact <- t(sapply(tv, function(t) V %*% (exp(L * t) * solve(V, y0))))
+
+  rhs <- function(t, y, p) as.vector(M %*% y)
+  out <- cvode(tv, y0, rhs, 0, 1e-10, 1e-12)
+  expect_equal(out[, -1], exact, tolerance = 1e-6)
+  out <- cvode(tv, y0, rhs, 0, 1e-10, 1e-12, jacobian = function(t, y, p) M)
+  expect_equal(out[, -1], exact, tolerance = 1e-6)
+})
@@ -0,0 +1,111 @@
+context("Persistent solver objects")
+
+## The Robertson problem of test-cvode.r
+ODE_R <- function(t, y, p){
+  r = rep(NA, length(y))
+  r[1] <- -p[1]*y[1] + p[2]*y[2]*y[3]
+  r[3] <- p[3]*y[2]*y[2]
+  r[2] <- -r[1] - r[3]
+  return(r)
+}
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+test_that("a solver gives the result of cvode()", {
+
+  solver <- cvode_solver(0, IC, ODE_R, params, 1e-04, abstol)
+  expect_is(solver, "sundialr_solver")
+  expect_equal(solver_solve(solver, time_vec),
+               cvode(time_vec, IC, ODE_R, params, 1e-04, abstol))
+})
+
+test_that("solver_reinit() restarts with new states and parameters", {
+
+  solver <- cvode_solver(0, IC, ODE_R, params, 1e-04, abstol)
+  solver_solve(solver, time_vec)
+
+  for (k1 in c(0.02, 0.08)) {
+    p <- c(k1, 10000, 30000000)
+    expect_identical(solver_reinit(solver, 0, IC, p), solver)
+    expect_equal(solver_solve(solver, time_vec),
+                 cvode(time_vec, IC, ODE_R, p, 1e-04, abstol), info = k1)
+  }
+
+  # the parameters are kept when none are given
+  y0 <- c(0.5, 0, 0.5)
+  solver_reinit(solver, 0, y0)
+  expect_equal(solver_solve(solver, time_vec),
+               cvode(time_vec, y0, ODE_R, c(0.08, 10000, 30000000), 1e-04, abstol))
+
+  # the caller's vector is copied, not changed
+  expect_equal(params, c(0.04, 10000, 30000000))
+})
+
+test_that("a further solve continues from the last output time", {
+
+  solver <- cvode_solver(0, IC, ODE_R, params, 1e-04, abstol)
+  first  <- solver_solve(solver, time_vec[1:4])
+  rest   <- solver_solve(solver, time_vec[4:6])
+  expect_equal(rest[1, ], first[4, ])
+  expect_equal(rbind(first, rest[-1, ]),
+               cvode(time_vec, IC, ODE_R, params, 1e-04, abstol),
+               tolerance = 1e-4)
+})
+
+test_that("compiled functions and sparse solves are accepted", {
+
+  native <- sundialr:::.native_test_xptr
+  solver <- cvode_solver(0, IC, native("robertson_rhs"), params, 1e-04, abstol,
+                         jacobian = native("robertson_jac"))
+  expect_equal(solver_solve(solver, time_vec),
+               cvode(time_vec, IC, ODE_R, params, 1e-04, abstol),
+               tolerance = 1e-4)
+
+  solver <- cvode_solver(0, IC, ODE_R, params, 1e-04, abstol,
+                         sparsity = matrix(TRUE, 3, 3))
+  for (k1 in c(0.04, 0.02)) {
+    p <- c(k1, 10000, 30000000)
+    solver_reinit(solver, 0, IC, p)
+    expect_equal(solver_solve(solver, time_vec),
+                 cvode(time_vec, IC, ODE_R, p, 1e-04, abstol),
+                 tolerance = 1e-4, info = k1)
+  }
+})
+
+test_that("invalid solvers and arguments are rejected", {
+
+  solver <- cvode_solver(0, IC, ODE_R, params, 1e-04, abstol)
+  expect_error(solver_solve(list(), time_vec),
+               "solver must be a solver made by cvode_solver()", fixed = TRUE)
+  expect_error(solver_solve(sundialr:::.native_test_xptr("robertson_rhs"), time_vec),
+               "solver must be a solver made by cvode_solver()", fixed = TRUE)
+  expect_error(solver_reinit(solver, 0, c(1, 0)),
+               "IC must have 3 values")
+  expect_error(solver_reinit(solver, 0, IC, c(0.04, 10000)),
+               "Parameters must have 3 values")
+  expect_error(solver_solve(solver, c(4, 0.4)),
+               "time_vector must be increasing")
+  solver_solve(solver, c(0, 40))
+  expect_error(solver_solve(solver, c(4, 400)),
+               "start no earlier than the solver's current time")
+})
+
+test_that("a model and Jacobian made inline survive garbage collection", {
+
+  solver <- cvode_solver(0, IC, ode_model(
+    list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+         y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+         y3 = quote( k3 * y2^2)),
+    parameters = c("k1", "k2", "k3")), params, 1e-04, abstol,
+    jacobian = function(t, y, p) {
+      matrix(c(-p[1], p[1], 0,
+               p[2]*y[3], -p[2]*y[3] - 2*p[3]*y[2], 2*p[3]*y[2],
+               p[2]*y[2], -p[2]*y[2], 0), 3, 3)
+    })
+  gc()
+  expect_equal(solver_solve(solver, time_vec),
+               cvode(time_vec, IC, ODE_R, params, 1e-04, abstol),
+               tolerance = 1e-4)
+})
@@ -0,0 +1,181 @@
+context("Sparse matrix and sparse direct solver")
+
+## A reaction network of n species, each decaying and feeding one other species
+## far from it in the state vector, so the Jacobian has two nonzeros per column
+## and no band:
+##   y_i' = -k1 * y_i - k2 * y_i^2 + k1 * y_{s(i)},   s(target[i]) = i
+n      <- 40
+idx    <- seq_len(n)
+target <- (idx * 7) %% n + 1
+NET_R <- function(t, y, p) {
+  ydot <- -p[1] * y - p[2] * y^2
+  ydot[target] <- ydot[target] + p[1] * y
+  ydot
+}
+NET_JAC <- function(t, y, p) {
+  J <- diag(-p[1] - 2 * p[2] * y)
+  J[cbind(target, idx)] <- p[1]
+  J
+}
+pattern <- diag(n) != 0
+pattern[cbind(target, idx)] <- TRUE
+
+tv     <- seq(0, 5, by = 0.5)
+y0     <- 1 + sin(idx)
+params <- c(2, 0.3)
+
+test_that("cvode gives the dense solution with a sparse linear solver", {
+
+  dense  <- cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC)
+  sparse <- cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC,
+                  sparsity = pattern)
+  expect_equal(sparse, dense, tolerance = 1e-6)
+
+  # the nonzero values alone, column by column in the order of the pattern
+  # with its diagonal
+  NET_JAC_VALUES <- function(t, y, p) {
+    d <- -p[1] - 2 * p[2] * y
+    as.vector(rbind(ifelse(target > idx, d, p[1]), ifelse(target > idx, p[1], d)))
+  }
+  expect_equal(cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC_VALUES,
+                     sparsity = pattern),
+               dense, tolerance = 1e-6)
+
+  expect_equal(cvsolve(tv, y0, NET_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10, jacobian = NET_JAC, sparsity = pattern),
+               cvsolve(tv, y0, NET_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10, jacobian = NET_JAC),
+               tolerance = 1e-6)
+})
+
+test_that("sparse matrices from the Matrix package are read without densifying", {
+
+  skip_if_not_installed("Matrix")
+
+  NET_JAC_C <- function(t, y, p) {
+    Matrix::sparseMatrix(i = c(idx, target), j = c(idx, idx),
+                         x = c(-p[1] - 2 * p[2] * y, rep(p[1], n)), dims = c(n, n))
+  }
+  NET_JAC_T <- function(t, y, p) {
+    # the diagonal in two halves, which a dgTMatrix sums
+    Matrix::sparseMatrix(i = c(idx, idx, target), j = c(idx, idx, idx),
+                         x = c(-p[1] - p[2] * y, -p[2] * y, rep(p[1], n)),
+                         dims = c(n, n), repr = "T")
+  }
+  sparse_pattern <- Matrix::sparseMatrix(i = target, j = idx, dims = c(n, n))
+
+  dense <- cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC)
+  expect_equal(cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC_C,
+                     sparsity = sparse_pattern),
+               dense, tolerance = 1e-6)
+  expect_equal(cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC_T,
+                     sparsity = pattern),
+               dense, tolerance = 1e-6)
+})
+
+test_that("a model's symbolic Jacobian fills the sparse matrix", {
+
+  eqs <- lapply(idx, function(i) {
+    src <- which(target == i)
+    str2lang(sprintf("-k1 * y[%d] - k2 * y[%d]^2 + k1 * y[%d]", i, i, src))
+  })
+  net <- ode_model(eqs, parameters = c("k1", "k2"))
+
+  expect_equal(cvode(tv, y0, net, params, 1e-8, 1e-10, sparsity = pattern),
+               cvode(tv, y0, NET_R, params, 1e-8, 1e-10, jacobian = NET_JAC),
+               tolerance = 1e-6)
+})
+
+test_that("a compiled sparse Jacobian writes the values of the pattern in place", {
+
+  native <- sundialr:::.native_test_xptr
+  rob_pattern <- matrix(TRUE, 3, 3)
+  rob_pattern[3, 1] <- FALSE
+  rob <- function(...) cvode(c(0, 0.4, 4, 40, 400), c(1, 0, 0), native("robertson_rhs"),
+                             c(0.04, 10000, 30000000), 1e-4, c(1e-8, 1e-14, 1e-6), ...)
+  expect_identical(rob(jacobian = native("robertson_jac_sparse"), sparsity = rob_pattern),
+                   rob(jacobian = native("robertson_jac"), sparsity = rob_pattern))
+  expect_equal(rob(jacobian = native("robertson_jac_sparse"), sparsity = rob_pattern),
+               rob(jacobian = native("robertson_jac")), tolerance = 1e-6)
+
+  dae <- function(...) ida(seq(0, 20, by = 2), c(1, 0, 1), c(-0.5, 0.5, 0),
+                           native("chain_dae_res"), c(0.5, 0.2), 1e-8, rep(1e-10, 3), ...)
+  dae_pattern <- lower.tri(diag(3), diag = TRUE)
+  expect_identical(dae(jacobian = native("chain_dae_jac_sparse"), sparsity = dae_pattern),
+                   dae(jacobian = native("chain_dae_jac"), sparsity = dae_pattern))
+
+  expect_error(rob(jacobian = native("robertson_jac_sparse")),
+               "A compiled sparse Jacobian needs a sparse matrix")
+  expect_error(dae(jacobian = native("chain_dae_jac_sparse"), mupper = 1, mlower = 1),
+               "A compiled sparse Jacobian needs a sparse matrix")
+  # a pattern other than the one the function was written for fails the solve
+  expect_error(rob(jacobian = native("robertson_jac_sparse"), sparsity = matrix(TRUE, 3, 3)))
+})
+
+test_that("ida gives the dense solution with a sparse linear solver", {
+
+  NET_DAE <- function(t, y, ydot, p) NET_R(t, y, p) - ydot
+  NET_DAE_JAC <- function(t, y, ydot, cj, p) NET_JAC(t, y, p) - cj * diag(n)
+  yp0 <- NET_R(0, y0, params)
+
+  dense  <- ida(tv, y0, yp0, NET_DAE, params, 1e-8, 1e-10, jacobian = NET_DAE_JAC)
+  sparse <- ida(tv, y0, yp0, NET_DAE, params, 1e-8, 1e-10, jacobian = NET_DAE_JAC,
+                sparsity = pattern)
+  expect_equal(sparse, dense, tolerance = 1e-6)
+})
+
+test_that("without a Jacobian the sparse one is approximated by coloured differences", {
+
+  dense <- cvode(tv, y0, NET_R, params, 1e-8, 1e-10)
+  expect_equal(cvode(tv, y0, NET_R, params, 1e-8, 1e-10, sparsity = pattern),
+               dense, tolerance = 1e-6)
+
+  # two nonzeros per column: a handful of groups instead of one column per
+  # evaluation of the right-hand side
+  counter <- function() {
+    calls <- 0
+    list(f = function(t, y, p) { calls <<- calls + 1; NET_R(t, y, p) },
+         calls = function() calls)
+  }
+  d <- counter(); s <- counter()
+  cvode(tv, y0, d$f, params, 1e-8, 1e-10)
+  cvode(tv, y0, s$f, params, 1e-8, 1e-10, sparsity = pattern)
+  expect_lt(s$calls(), d$calls())
+
+  expect_equal(cvsolve(tv, y0, NET_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10, sparsity = pattern),
+               cvsolve(tv, y0, NET_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10),
+               tolerance = 1e-6)
+
+  NET_DAE <- function(t, y, ydot, p) NET_R(t, y, p) - ydot
+  yp0 <- NET_R(0, y0, params)
+  expect_equal(ida(tv, y0, yp0, NET_DAE, params, 1e-8, 1e-10, sparsity = pattern),
+               ida(tv, y0, yp0, NET_DAE, params, 1e-8, 1e-10),
+               tolerance = 1e-6)
+
+  # a compiled right-hand side is differenced the same way
+  native <- sundialr:::.native_test_xptr
+  rob_tv <- c(0, 0.4, 4, 40)
+  rob_p  <- c(0.04, 10000, 30000000)
+  rob_at <- c(1e-8, 1e-14, 1e-6)
+  expect_equal(cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p, 1e-6, rob_at,
+                     sparsity = matrix(TRUE, 3, 3)),
+               cvode(rob_tv, c(1, 0, 0), native("robertson_rhs"), rob_p, 1e-6, rob_at),
+               tolerance = 1e-4)
+})
+
+test_that("invalid sparse arguments are rejected before the solve", {
+
+  expect_error(cvode(tv, y0, NET_R, params, jacobian = NET_JAC, sparsity = pattern,
+                     mupper = 1, mlower = 1),
+               "sparsity cannot be combined with mupper and mlower")
+  expect_error(cvode(tv, y0, NET_R, params, jacobian = NET_JAC,
+                     sparsity = pattern[-1, ]),
+               "sparsity must be 40-by-40")
+  expect_error(cvode(tv, y0, NET_R, params, jacobian = NET_JAC, sparsity = "all"),
+               "sparsity must be a matrix")
+  expect_error(cvode(tv, y0, NET_R, params, jacobian = function(t, y, p) 1:3 + 0.5,
+                     sparsity = pattern),
+               "the sparsity pattern has 80 nonzeros")
+})
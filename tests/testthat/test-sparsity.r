@@ -0,0 +1,122 @@
+context("Sparsity detection")
+
+## The reaction network of test-sparse.r: each species decays and feeds one
+## other far from it in the state vector
+n      <- 40
+idx    <- seq_len(n)
+target <- (idx * 7) %% n + 1
+NET_R <- function(t, y, p) {
+  ydot <- -p[1] * y - p[2] * y^2
+  ydot[target] <- ydot[target] + p[1] * y
+  ydot
+}
+pattern <- diag(n) != 0
+pattern[cbind(target, idx)] <- TRUE
+
+tv     <- seq(0, 5, by = 0.5)
+y0     <- 1 + sin(idx)
+params <- c(2, 0.3)
+
+# the detected pattern as a logical matrix
+as_logical <- function(x) {
+  m <- matrix(FALSE, x$Dim[1], x$Dim[2])
+  m[cbind(x$i + 1, rep(seq_len(x$Dim[2]), diff(x$p)))] <- TRUE
+  m
+}
+
+test_that("the pattern of a right-hand side is found and used", {
+
+  found <- detect_sparsity(y0, NET_R, params)
+  expect_is(found, "sundialr_sparsity")
+  expect_equal(as_logical(found), pattern)
+  expect_equal(found$nnz, 2 * n)
+  expect_equal(found$storage, "sparse")
+
+  dense <- cvode(tv, y0, NET_R, params, 1e-8, 1e-10)
+  expect_equal(cvode(tv, y0, NET_R, params, 1e-8, 1e-10, sparsity = found),
+               dense, tolerance = 1e-6)
+  expect_equal(cvsolve(tv, y0, NET_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10, sparsity = found),
+               cvsolve(tv, y0, NET_R, params, reltolerance = 1e-8,
+                       abstolerance = 1e-10),
+               tolerance = 1e-6)
+
+  # a state that starts at zero still shows its dependencies
+  zero <- y0
+  zero[c(3, 17)] <- 0
+  expect_equal(as_logical(detect_sparsity(zero, NET_R, params)), pattern)
+})
+
+test_that("a banded pattern recommends band storage", {
+
+  m <- 30
+  chain <- function(t, y, p) {
+    ydot <- -p[1] * y
+    ydot[-1] <- ydot[-1] + p[1] * y[-m]
+    ydot
+  }
+  ic <- c(1, rep(0, m - 1))
+  found <- detect_sparsity(ic, chain, c(0.5))
+  expect_equal(found$storage, "band")
+  expect_equal(c(found$mupper, found$mlower), c(0, 1))
+
+  dense <- cvode(tv, ic, chain, c(0.5), 1e-8, 1e-10)
+  expect_equal(cvode(tv, ic, chain, c(0.5), 1e-8, 1e-10, sparsity = found),
+               dense, tolerance = 1e-6)
+  found$storage <- "sparse"
+  expect_equal(cvode(tv, ic, chain, c(0.5), 1e-8, 1e-10, sparsity = found),
+               dense, tolerance = 1e-6)
+
+  expect_error(cvode(tv, ic, chain, c(0.5), sparsity = found, mupper = 1, mlower = 1),
+               "sparsity cannot be combined with mupper and mlower")
+  found$storage <- "diagonal"
+  expect_error(cvode(tv, ic, chain, c(0.5), sparsity = found),
+               "must be \"sparse\" or \"band\"")
+})
+
+test_that("a model's pattern comes from its symbolic Jacobian", {
+
+  model <- ode_model(
+    list(y1 = quote(-k1 * y1 + k2 * y2 * y3),
+         y2 = quote( k1 * y1 - k2 * y2 * y3 - k3 * y2^2),
+         y3 = quote( k3 * y2^2)),
+    parameters = c("k1", "k2", "k3"))
+  expected <- matrix(c(TRUE, TRUE, FALSE, TRUE, TRUE, TRUE, TRUE, TRUE, TRUE), 3, 3)
+  expect_equal(as_logical(detect_sparsity(c(1, 0, 0), model, c(0.04, 1e4, 3e7))),
+               expected)
+
+  # and a compiled right-hand side is probed like an R one
+  native <- sundialr:::.native_test_xptr
+  expect_equal(as_logical(detect_sparsity(c(1, 0, 0), native("robertson_rhs"),
+                                          c(0.04, 1e4, 3e7))),
+               expected)
+})
+
+test_that("the pattern of a DAE residual covers y and ydot", {
+
+  NET_DAE <- function(t, y, ydot, p) NET_R(t, y, p) - ydot
+  yp0 <- NET_R(0, y0, params)
+  found <- detect_sparsity(y0, NET_DAE, params, IRes = yp0)
+  expect_equal(as_logical(found), pattern)
+  expect_equal(ida(tv, y0, yp0, NET_DAE, params, 1e-8, 1e-10, sparsity = found),
+               ida(tv, y0, yp0, NET_DAE, params, 1e-8, 1e-10),
+               tolerance = 1e-6)
+
+  # an algebraic equation coupling the first two states through ydot only
+  ALG <- function(t, y, ydot, p) c(-y[1] - ydot[1], y[1] - ydot[2], ydot[1] + y[3])
+  expect_equal(as_logical(detect_sparsity(c(1, 0, -1), ALG, numeric(0),
+                                          IRes = c(-1, 1, 0))),
+               matrix(c(TRUE, TRUE, TRUE, FALSE, TRUE, FALSE, FALSE, FALSE, TRUE), 3, 3))
+})
+
+test_that("invalid arguments to detect_sparsity are rejected", {
+
+  expect_error(detect_sparsity(y0, NET_R, params, samples = 0), "samples must be at least 1")
+  expect_error(detect_sparsity(y0, NET_R, params, IRes = 1:3 + 0), "IRes must have one value per state")
+  expect_error(detect_sparsity(c(1, NA), NET_R, params), "IC must be finite")
+  expect_error(detect_sparsity(y0, function(t, y, p) y[-1], params),
+               "must return a vector")
+  model <- ode_model(list(quote(-y[1])))
+  expect_error(detect_sparsity(1, model, numeric(0), IRes = 0),
+               "not a residual")
+})
@@ -0,0 +1,92 @@
+context("Solver statistics")
+
+## The Robertson problem of test-cvode.r
+ODE_R <- function(t, y, p){
+  r = rep(NA, length(y))
+  r[1] <- -p[1]*y[1] + p[2]*y[2]*y[3]
+  r[3] <- p[3]*y[2]*y[2]
+  r[2] <- -r[1] - r[3]
+  return(r)
+}
+time_vec <- c(0.0, 0.4, 4.0, 40.0, 4E2, 4E3)
+IC       <- c(1, 0, 0)
+params   <- c(0.04, 10000, 30000000)
+abstol   <- c(1e-8, 1e-14, 1e-6)
+
+counters <- c("steps", "rhs_evals", "rhs_evals_lin", "jac_evals", "lin_setups",
+              "nonlin_iters", "nonlin_conv_fails", "err_test_fails", "order_last",
+              "order_cur", "step_initial", "step_last", "step_cur",
+              "workspace_real", "workspace_int", "time_total", "time_callbacks",
+              "time_solver")
+
+test_that("stats are attached only when asked for, leaving the solution as it was", {
+
+  plain <- cvode(time_vec, IC, ODE_R, params, 1e-04, abstol)
+  expect_null(attr(plain, "stats"))
+
+  df <- cvode(time_vec, IC, ODE_R, params, 1e-04, abstol, stats = TRUE)
+  st <- attr(df, "stats")
+  expect_equal(names(st), counters)
+  attr(df, "stats") <- NULL
+  expect_equal(df, plain)
+
+  expect_gt(st$steps, 0)
+  expect_gte(st$rhs_evals, st$steps)
+  expect_gt(st$jac_evals, 0)           # by finite differences
+  expect_gt(st$rhs_evals_lin, 0)       # ... which cost evaluations
+  expect_true(st$order_last >= 1 && st$order_last <= 5)
+  expect_gt(st$workspace_real, 0)
+  expect_gte(st$time_callbacks, 0)
+  expect_equal(st$time_callbacks + st$time_solver, st$time_total)
+})
+
+test_that("an analytic Jacobian removes the finite-difference evaluations", {
+
+  JAC_R <- function(t, y, p) {
+    matrix(c(-p[1], p[1], 0,
+             p[2]*y[3], -p[2]*y[3] - 2*p[3]*y[2], 2*p[3]*y[2],
+             p[2]*y[2], -p[2]*y[2], 0), 3, 3)
+  }
+  st <- attr(cvode(time_vec, IC, ODE_R, params, 1e-04, abstol, jacobian = JAC_R,
+                   stats = TRUE), "stats")
+  expect_equal(st$rhs_evals_lin, 0)
+  expect_gt(st$jac_evals, 0)
+
+  # compiled functions take no measurable share of the time in R
+  native <- sundialr:::.native_test_xptr
+  st <- attr(cvode(time_vec, IC, native("robertson_rhs"), params, 1e-04, abstol,
+                   jacobian = native("robertson_jac"), stats = TRUE), "stats")
+  expect_equal(st$rhs_evals_lin, 0)
+  expect_lte(st$time_callbacks, st$time_total)
+})
+
+test_that("cvsolve() adds up the stretches between events", {
+
+  decay <- function(t, y, p) -p[1] * y
+  tv <- seq(0, 20, by = 2)
+  ev <- data.frame(ID = 1, TIME = c(5, 10), VAL = 1)
+  st0 <- attr(cvsolve(tv, 1, decay, 0.1, stats = TRUE), "stats")
+  st2 <- attr(cvsolve(tv, 1, decay, 0.1, ev, stats = TRUE), "stats")
+  expect_equal(names(st2), counters)
+  # each restart begins again with small steps
+  expect_gt(st2$steps, st0$steps)
+  expect_gt(st2$rhs_evals, st0$rhs_evals)
+})
+
+test_that("cvodes() and ida() report their own counters", {
+
+  st <- attr(cvodes(time_vec, IC, ODE_R, params, 1e-04, abstol, "STG", FALSE,
+                    stats = TRUE), "stats")
+  expect_equal(names(st), c(counters, "sens_rhs_evals"))
+  expect_gt(st$sens_rhs_evals, 0)
+
+  DAE_R <- function(t, y, ydot, p) {
+    c(-p[1] * y[1] - ydot[1], p[1] * y[1] - p[2] * y[2] - ydot[2], y[3] - y[1] - y[2])
+  }
+  df <- ida(seq(0, 20, by = 2), c(1, 0, 1), c(-0.5, 0.5, 0), DAE_R, c(0.5, 0.2),
+            1e-8, 1e-10, stats = TRUE)
+  st <- attr(df, "stats")
+  expect_equal(names(st), counters)
+  expect_gt(st$steps, 0)
+  expect_gte(st$rhs_evals, st$steps)
+})
@@ -0,0 +1,121 @@
+context("Solution at the solvers' internal steps")
+
+## y1' = -k*y1, y2' = k*y1, so y1 = exp(-k*t) and y1 + y2 = 1 at every step
+ODE_R <- function(t, y, p) c(-p[1] * y[1], p[1] * y[1])
+
+DAE_R <- function(t, y, ydot, p) {
+  c(-p[1] * y[1] - ydot[1],
+    y[2] - 1 + y[1])
+}
+
+time_vec <- c(0, 10)
+IC       <- c(1, 0)
+params   <- c(0.5)
+reltol   <- 1e-8
+abstol   <- 1e-10
+
+test_that("cvode() returns a row for every internal step", {
+
+  steps <- cvode(time_vec, IC, ODE_R, params, reltol, abstol,
+                 output = "steps", stats = TRUE)
+
+  expect_equal(ncol(steps), length(IC) + 1)
+  expect_equal(nrow(steps), attr(steps, "stats")$steps + 1)
+  expect_identical(steps[1, ], c(0, IC))
+  expect_identical(steps[nrow(steps), 1], 10)
+  expect_true(all(diff(steps[, 1]) > 0))
+  expect_lt(max(abs(steps[, 2] - exp(-params[1] * steps[, 1]))), 1e-6)
+  expect_lt(max(abs(steps[, 2] + steps[, 3] - 1)), 1e-8)
+
+  # only the first and last times set the interval
+  expect_identical(c(cvode(c(0, 3, 7, 10), IC, ODE_R, params, reltol, abstol,
+                           output = "steps")), c(steps))
+})
+
+test_that("max_rows thins the steps evenly and keeps both ends", {
+
+  all_steps <- cvode(time_vec, IC, ODE_R, params, reltol, abstol, output = "steps")
+  n <- nrow(all_steps)
+
+  for (m in c(2, 5, n - 1, n, n + 10)) {
+    thin <- cvode(time_vec, IC, ODE_R, params, reltol, abstol,
+                  output = "steps", max_rows = m)
+    expect_equal(nrow(thin), min(m, n))
+    expect_identical(thin[1, ], all_steps[1, ])
+    expect_identical(thin[nrow(thin), ], all_steps[n, ])
+    # every row is one of the steps
+    expect_true(all(thin[, 1] %in% all_steps[, 1]))
+  }
+
+  expect_error(cvode(time_vec, IC, ODE_R, params, output = "steps", max_rows = 1),
+               "max_rows must be a whole number of 2 or more")
+  expect_error(cvode(time_vec, IC, ODE_R, params, output = "step"),
+               "output must be \"times\" or \"steps\"")
+})
+
+test_that("the steps are limited as a solve to each output time is", {
+
+  ## y'' = -10^4 y over 1600 periods: more than 500 steps to the one output time
+  OSC_R <- function(t, y, p) c(y[2], -1e4 * y[1])
+  expect_error(cvode(c(0, 100), c(1, 0), OSC_R, 0, 1e-6, 1e-8, output = "steps"),
+               "mxstep steps taken before reaching tout")
+
+  # the limit counts the steps between the times of time_vector, as CVODE does
+  fine <- seq(0, 2, by = 0.1)
+  steps <- cvode(fine, c(1, 0), OSC_R, 0, 1e-6, 1e-8, output = "steps")
+  expect_gt(nrow(steps), 500)
+  expect_identical(steps[nrow(steps), 1], 2)
+})
+
+test_that("the steps can keep the dense output too", {
+
+  steps <- cvode(time_vec, IC, ODE_R, params, reltol, abstol,
+                 output = "steps", dense_output = TRUE)
+  rec <- attr(steps, "dense_output")
+  expect_identical(rec$time, steps[, 1])
+  expect_equal(dense_eval(steps, c(2.5, 7.5))[, 2], exp(-params[1] * c(2.5, 7.5)),
+               tolerance = 1e-6)
+
+  # the rows are the states at the steps, as without the dense output
+  attr(steps, "dense_output") <- NULL
+  expect_equal(steps, cvode(time_vec, IC, ODE_R, params, reltol, abstol,
+                            output = "steps"))
+  expect_lt(max(abs(steps[, 2] - exp(-params[1] * steps[, 1]))), 1e-6)
+})
+
+test_that("cvsolve() stops at each event and returns the state after it", {
+
+  events <- data.frame(state = 1, time = c(4, 6.5), value = c(1, 2))
+  steps <- cvsolve(c(0, 2, 10), IC, ODE_R, params, events, reltol, abstol,
+                   output = "steps")
+
+  expect_identical(steps[nrow(steps), 1], 10)
+  expect_true(all(diff(steps[, 1]) > 0))
+  expect_true(all(c(4, 6.5) %in% steps[, 1]))
+
+  # against the solution at the event times, which is after each event
+  times <- cvsolve(c(0, 2, 10), IC, ODE_R, params, events, reltol, abstol)
+  expect_equal(steps[steps[, 1] %in% c(4, 6.5, 10), ], times[3:5, ], tolerance = 1e-6)
+
+  thin <- cvsolve(c(0, 10), IC, ODE_R, params, events, reltol, abstol,
+                  output = "steps", max_rows = 4)
+  expect_equal(nrow(thin), 4)
+  expect_identical(thin[4, ], steps[nrow(steps), ])
+})
+
+test_that("ida() returns a row for every internal step", {
+
+  steps <- ida(time_vec, IC, c(-0.5, 0.5), DAE_R, params, reltol, abstol,
+               output = "steps", stats = TRUE)
+
+  expect_equal(nrow(steps), attr(steps, "stats")$steps + 1)
+  expect_identical(steps[nrow(steps), 1], 10)
+  expect_true(all(diff(steps[, 1]) > 0))
+  expect_lt(max(abs(steps[, 2] - exp(-params[1] * steps[, 1]))), 1e-6)
+  expect_lt(max(abs(steps[, 2] + steps[, 3] - 1)), 1e-8)
+
+  thin <- ida(time_vec, IC, c(-0.5, 0.5), DAE_R, params, reltol, abstol,
+              output = "steps", max_rows = 3)
+  expect_equal(nrow(thin), 3)
+  expect_identical(thin[3, ], steps[nrow(steps), ])
+})